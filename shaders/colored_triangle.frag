@@ -1,16 +1,30 @@
 //glsl version 4.5
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec3 inColor;
 layout (location = 1) in vec2 tex; 
+layout (location = 2) flat in uint inMaterial;
 
 //output write
 layout (location = 0) out vec4 outFragColor;
 
-layout(set = 0, binding = 1) uniform sampler2D texSampler;
+// GPUMaterialData in vk_engine.h, one per material
+struct MaterialData {
+	uint textureIndex;
+	uint padding[3];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer MaterialBuffer {
+	MaterialData materials[];
+} materialBuffer;
+
+// TextureTable in vk_descriptors.h, only the slots some material points at are written
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 void main()
 {
-	//return red
-	outFragColor = texture(texSampler, tex); 
+	// the instances of one draw can have different materials, the index isn't uniform
+	uint textureIndex = materialBuffer.materials[inMaterial].textureIndex;
+	outFragColor = texture(textures[nonuniformEXT(textureIndex)], tex); 
 }
@@ -1,23 +1,56 @@
 #version 450
 
+// packed vertex, see PackedVertex in vk_mesh.h. Position is [0, 1] inside the mesh bounds,
+// the dequantization is folded into the object's model matrix
 layout (location = 0) in vec3 vPosition;
-layout (location = 1) in vec3 vNormal;
-layout (location = 2) in vec3 vColor;
+layout (location = 1) in vec2 vNormal;
 layout (location = 3) in vec2 vTex; 
 
 layout (location = 0) out vec3 outColor;
 layout (location = 1) out vec2 outTex; 
+layout (location = 2) flat out uint outMaterial;
 
 layout(set = 0, binding = 0) uniform UniformBufferObject {
-	mat4 modelViewProjection; 
+	mat4 viewProjection; 
 	float time; 
 } ubo; 
 
+// GPUObjectData in vk_engine.h, one per renderable
+struct ObjectData {
+	mat4 model;
+	uint materialIndex;
+	uint batchIndex;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer ObjectBuffer {
+	ObjectData objects[];
+} objectBuffer;
+
+// with gpu culling the instances of a draw are the visible object ids cull.comp wrote,
+// otherwise the instance index is the object index
+layout (constant_id = 0) const bool GPU_CULLING = false;
+
+layout(std430, set = 0, binding = 3) readonly buffer InstanceBuffer {
+	uint ids[];
+} instanceBuffer;
+
+vec3 oct_decode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 void main()
 {
 	// vec3 pos = vPosition; 
 	// pos.x = pos.x + sin(ubo.time * 0.01f + pos.y) * 0.4; 
-	gl_Position = ubo.modelViewProjection * vec4(vPosition, 1.0f);
-	outColor = vColor;
+	uint objectId = GPU_CULLING ? instanceBuffer.ids[gl_InstanceIndex] : gl_InstanceIndex;
+	mat4 model = objectBuffer.objects[objectId].model;
+	gl_Position = ubo.viewProjection * model * vec4(vPosition, 1.0f);
+	outColor = oct_decode(vNormal);
 	outTex = vTex; 
+	outMaterial = objectBuffer.objects[objectId].materialIndex;
 }	
@@ -0,0 +1,113 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_culling.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+namespace {
+
+	// objects scattered in a box in front of the camera, about 60% end up inside the frustum
+	void make_scene(uint32_t objectCount, CullingData& data)
+	{
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> position(-100.f, 100.f);
+		std::uniform_real_distribution<float> radius(0.1f, 2.f);
+
+		data.resize(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			glm::mat4 transform = glm::translate(glm::mat4(1.f), glm::vec3(position(rng), position(rng), position(rng)));
+			data.set(i, transform, glm::vec3(0.f), radius(rng));
+		}
+	}
+
+	// best of a few runs, the list is tiny next to the caches for small counts so repeat those more
+	double time_cull(const Frustum& frustum, const CullingData& data, std::vector<uint32_t>& visible, CullingPath path, uint32_t& visibleCount)
+	{
+		uint32_t repeats = std::max(5u, 10'000'000u / std::max(data.count, 1u));
+		double best = 1e30;
+		for (uint32_t r = 0; r < repeats; r++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			visibleCount = cull_spheres(frustum, data, visible.data(), path);
+			best = std::min(best, vkbench::elapsed_ms(start));
+		}
+		return best;
+	}
+}
+
+// culling [--objects N]
+int bench_culling(int argc, char* argv[])
+{
+	std::vector<uint32_t> counts = { 1'000, 100'000, 1'000'000 };
+	if (const char* objects = bench_arg(argc, argv, "--objects", nullptr))
+	{
+		counts = { static_cast<uint32_t>(atoi(objects)) };
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(70.f), 16.f / 9.f, 0.1f, 200.f);
+	projection[1][1] *= -1;
+	glm::mat4 view = glm::lookAt(glm::vec3(0.f, 0.f, 100.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+	Frustum frustum = frustum_from_matrix(projection * view);
+
+	std::vector<CullingPath> paths = { CullingPath::Scalar };
+	if (best_culling_path() != CullingPath::Scalar)
+	{
+		paths.push_back(CullingPath::SSE);
+	}
+	if (best_culling_path() == CullingPath::AVX)
+	{
+		paths.push_back(CullingPath::AVX);
+	}
+
+	std::cout << "sphere frustum culling, best path on this cpu: " << culling_path_name(best_culling_path()) << std::endl;
+
+	int result = 0;
+	for (uint32_t count : counts)
+	{
+		CullingData data;
+		make_scene(count, data);
+
+		std::vector<uint32_t> reference(data.padded_count());
+		std::vector<uint32_t> visible(data.padded_count());
+		uint32_t referenceCount = 0;
+		double scalarMs = 0.0;
+
+		std::cout << count << " objects" << std::endl;
+		for (CullingPath path : paths)
+		{
+			uint32_t visibleCount = 0;
+			double ms = time_cull(frustum, data, path == CullingPath::Scalar ? reference : visible, path, visibleCount);
+
+			bool matches = true;
+			if (path == CullingPath::Scalar)
+			{
+				referenceCount = visibleCount;
+				scalarMs = ms;
+			}
+			else
+			{
+				matches = visibleCount == referenceCount && std::equal(visible.begin(), visible.begin() + visibleCount, reference.begin());
+			}
+
+			std::cout << std::fixed << std::setprecision(4)
+				<< "  " << std::left << std::setw(7) << culling_path_name(path) << std::right
+				<< ms << " ms, " << std::setprecision(0) << count / ms << " objects/ms, "
+				<< std::setprecision(2) << scalarMs / ms << "x scalar, "
+				<< visibleCount << " visible" << (matches ? "" : " MISMATCH") << std::endl;
+
+			if (!matches)
+			{
+				result = 1;
+			}
+		}
+	}
+	return result;
+}
@@ -0,0 +1,138 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_jobs.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+	// spawn count empty jobs from the owner thread and wait for all of them
+	double spawn_ns(JobSystem& jobs, uint32_t count)
+	{
+		auto start = std::chrono::steady_clock::now();
+		JobCounter counter;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			jobs.run([]() {}, &counter);
+		}
+		jobs.wait(counter);
+		return vkbench::elapsed_ms(start) * 1e6 / count;
+	}
+
+	// time from queueing a job on the owner's deque until another worker starts it. The owner only
+	// spins, so every sample is a steal
+	vkbench::SampleStats steal_latency_us(JobSystem& jobs, uint32_t samples)
+	{
+		std::vector<double> latencies;
+		latencies.reserve(samples);
+		for (uint32_t i = 0; i < samples; i++)
+		{
+			std::atomic<bool> started{ false };
+			std::chrono::steady_clock::time_point startedAt;
+			auto queuedAt = std::chrono::steady_clock::now();
+			jobs.run([&]() {
+				startedAt = std::chrono::steady_clock::now();
+				started.store(true, std::memory_order_release);
+			});
+			while (!started.load(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+			}
+			latencies.push_back(std::chrono::duration<double, std::micro>(startedAt - queuedAt).count());
+		}
+		return vkbench::compute_stats(latencies);
+	}
+
+	// cpu bound loop with no shared writes, each range sums into its own slot
+	double parallel_for_ms(JobSystem& jobs, uint32_t count, uint32_t grain)
+	{
+		std::vector<double> partial(count / grain + 1, 0.0);
+		auto start = std::chrono::steady_clock::now();
+		jobs.parallel_for(count, grain, [&](uint32_t first, uint32_t last, uint32_t) {
+			double sum = 0.0;
+			for (uint32_t i = first; i < last; i++)
+			{
+				sum += std::sqrt(static_cast<double>(i)) * std::sin(static_cast<double>(i));
+			}
+			partial[first / grain] += sum;
+		});
+		double ms = vkbench::elapsed_ms(start);
+
+		// keep the work observable
+		volatile double total = 0.0;
+		for (double p : partial)
+		{
+			total = total + p;
+		}
+		return ms;
+	}
+}
+
+// jobs [--threads N] [--spawn N] [--items N]
+int bench_jobs(int argc, char* argv[])
+{
+	uint32_t maxThreads = static_cast<uint32_t>(atoi(bench_arg(argc, argv, "--threads", "0")));
+	uint32_t spawnCount = static_cast<uint32_t>(atoi(bench_arg(argc, argv, "--spawn", "100000")));
+	uint32_t items = static_cast<uint32_t>(atoi(bench_arg(argc, argv, "--items", "4000000")));
+	if (maxThreads == 0)
+	{
+		maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	{
+		JobSystem jobs(maxThreads);
+		std::cout << jobs.thread_count() << " workers" << std::endl;
+
+		double best = 1e30;
+		for (int run = 0; run < 5; run++)
+		{
+			best = std::min(best, spawn_ns(jobs, spawnCount));
+		}
+		std::cout << std::fixed << std::setprecision(1)
+			<< "  spawn + run empty job   " << best << " ns/job (" << spawnCount << " jobs)" << std::endl;
+
+		if (jobs.thread_count() > 1)
+		{
+			vkbench::SampleStats latency = steal_latency_us(jobs, 2000);
+			std::cout << std::setprecision(2)
+				<< "  steal latency           p50 " << latency.p50 << " us, p90 " << latency.p90 << " us, p99 " << latency.p99 << " us" << std::endl;
+		}
+		else
+		{
+			std::cout << "  steal latency           needs at least 2 workers" << std::endl;
+		}
+	}
+
+	// parallel-for scaling, 1, 2, 4 ... workers plus the maximum
+	std::vector<uint32_t> threadCounts;
+	for (uint32_t t = 1; t < maxThreads; t *= 2)
+	{
+		threadCounts.push_back(t);
+	}
+	threadCounts.push_back(maxThreads);
+
+	std::cout << "  parallel_for over " << items << " items" << std::endl;
+	double singleMs = 0.0;
+	for (uint32_t threads : threadCounts)
+	{
+		JobSystem jobs(threads);
+		double best = 1e30;
+		for (int run = 0; run < 5; run++)
+		{
+			best = std::min(best, parallel_for_ms(jobs, items, 16384));
+		}
+		if (threads == 1)
+		{
+			singleMs = best;
+		}
+		std::cout << std::setprecision(3)
+			<< "    " << std::setw(3) << threads << " workers  " << best << " ms, speedup "
+			<< std::setprecision(2) << singleMs / best << "x, efficiency " << std::setprecision(0)
+			<< 100.0 * singleMs / best / threads << "%" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,27 @@
+#include <bench_suites.h>
+
+#include <cstring>
+#include <iostream>
+
+// cpu-only benchmarks, no vulkan device needed
+//   vulkan_guide_bench <suite> [suite options]
+int main(int argc, char* argv[])
+{
+	if (argc >= 2)
+	{
+		for (const BenchSuite& suite : bench_suites())
+		{
+			if (strcmp(argv[1], suite.name) == 0)
+			{
+				return suite.run(argc - 2, argv + 2);
+			}
+		}
+	}
+
+	std::cout << "usage: " << argv[0] << " <suite> [options]" << std::endl << "suites:" << std::endl;
+	for (const BenchSuite& suite : bench_suites())
+	{
+		std::cout << "  " << suite.name << " - " << suite.description << std::endl;
+	}
+	return 1;
+}
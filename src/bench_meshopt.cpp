@@ -0,0 +1,92 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_mesh.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+namespace {
+
+	void print_mesh_stats(const char* label, const MeshStats& stats, double ms)
+	{
+		std::cout << std::fixed << std::setprecision(3)
+			<< "  " << std::left << std::setw(14) << label << std::right
+			<< " acmr " << stats.acmr
+			<< "  atvr " << stats.atvr
+			<< "  overdraw " << stats.overdraw
+			<< "  overfetch " << stats.overfetch;
+		if (ms > 0.0)
+		{
+			std::cout << "  (" << std::setprecision(1) << ms << " ms)";
+		}
+		std::cout << std::endl;
+	}
+
+	// run one combination of passes on a copy of the mesh
+	void run_passes(const Mesh& source, const char* label, MeshOptimizeOptions options)
+	{
+		Mesh mesh = source;
+		auto start = std::chrono::steady_clock::now();
+		mesh.optimize(options);
+		double ms = vkbench::elapsed_ms(start);
+		print_mesh_stats(label, mesh.analyze(), ms);
+	}
+}
+
+// meshopt [--obj path] [--shuffle] [--threshold f]
+int bench_meshopt(int argc, char* argv[])
+{
+	std::string objPath = bench_arg(argc, argv, "--obj", VKGUIDE_ROOT "/assets/wahoo.obj");
+	float threshold = static_cast<float>(std::atof(bench_arg(argc, argv, "--threshold", "1.05")));
+
+	Mesh mesh;
+	mesh.load_from_obj(objPath.c_str());
+
+	// exporters usually write faces in some spatial order already, shuffling shows the worst case
+	if (bench_flag(argc, argv, "--shuffle"))
+	{
+		size_t triangleCount = mesh._indices.size() / 3;
+		std::vector<uint32_t> order(triangleCount);
+		for (size_t i = 0; i < triangleCount; i++)
+		{
+			order[i] = static_cast<uint32_t>(i);
+		}
+		std::shuffle(order.begin(), order.end(), std::mt19937(1234));
+
+		std::vector<uint32_t> shuffled;
+		shuffled.reserve(mesh._indices.size());
+		for (uint32_t t : order)
+		{
+			shuffled.insert(shuffled.end(), mesh._indices.begin() + t * 3, mesh._indices.begin() + t * 3 + 3);
+		}
+		mesh._indices.swap(shuffled);
+	}
+
+	std::cout << objPath << ": " << mesh._vertices.size() << " vertices, " << mesh._indices.size() / 3 << " triangles" << std::endl;
+
+	print_mesh_stats("input", mesh.analyze(), 0.0);
+
+	MeshOptimizeOptions options;
+	options.overdrawThreshold = threshold;
+
+	MeshOptimizeOptions cacheOnly = options;
+	cacheOnly.overdraw = false;
+	cacheOnly.vertexFetch = false;
+	run_passes(mesh, "vertex cache", cacheOnly);
+
+	MeshOptimizeOptions fetchOnly = options;
+	fetchOnly.vertexCache = false;
+	fetchOnly.overdraw = false;
+	run_passes(mesh, "vertex fetch", fetchOnly);
+
+	MeshOptimizeOptions noOverdraw = options;
+	noOverdraw.overdraw = false;
+	run_passes(mesh, "cache + fetch", noOverdraw);
+
+	run_passes(mesh, "all passes", options);
+
+	return 0;
+}
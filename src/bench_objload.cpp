@@ -0,0 +1,174 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_hash.h>
+#include <vk_mesh.h>
+#include <vk_obj_loader.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+	// writes a width x height grid of quads (2 triangles each) with positions, uvs and normals,
+	// every attribute is shared between neighbouring faces like a real scanned/sculpted mesh
+	bool write_grid_obj(const std::string& path, uint64_t triangles)
+	{
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(triangles / 2.0)));
+		uint32_t verts = side + 1;
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		// big buffered writes, the default stream buffer makes this take longer than the parse
+		std::vector<char> buffer(1 << 20);
+		file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+
+		char line[128];
+		for (uint32_t y = 0; y < verts; y++)
+		{
+			for (uint32_t x = 0; x < verts; x++)
+			{
+				float u = x / float(side);
+				float v = y / float(side);
+				float h = 0.1f * std::sin(u * 20.f) * std::cos(v * 20.f);
+				int n = snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.4f %.4f %.4f\n",
+					u, h, v, u, v, -h, 1.f, h);
+				file.write(line, n);
+			}
+		}
+
+		for (uint32_t y = 0; y < side; y++)
+		{
+			for (uint32_t x = 0; x < side; x++)
+			{
+				uint32_t a = y * verts + x + 1;
+				uint32_t b = a + 1;
+				uint32_t c = a + verts;
+				uint32_t d = c + 1;
+				int n = snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n",
+					a, a, a, c, c, c, d, d, d, b, b, b);
+				file.write(line, n);
+			}
+		}
+		return file.good();
+	}
+
+	struct LoadRun {
+		bool ok = false;
+		double ms = 0.0;
+		size_t peakBytes = 0;
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	template<typename F>
+	LoadRun measure(F&& load)
+	{
+		LoadRun run;
+		vkbench::reset_peak_rss();
+		auto start = std::chrono::steady_clock::now();
+		run.ok = load(run);
+		run.ms = vkbench::elapsed_ms(start);
+		run.peakBytes = vkbench::peak_rss_bytes();
+		return run;
+	}
+
+	void print_run(const char* label, const LoadRun& run, size_t fileBytes)
+	{
+		double mb = fileBytes / (1024.0 * 1024.0);
+		std::cout << std::fixed << std::setprecision(1)
+			<< "  " << std::left << std::setw(10) << label << std::right
+			<< std::setw(10) << run.ms << " ms"
+			<< std::setw(10) << mb / (run.ms / 1000.0) << " MB/s"
+			<< "  peak rss " << run.peakBytes / (1024.0 * 1024.0) << " MB"
+			<< "  vertices " << run.vertices.size()
+			<< "  indices " << run.indices.size() << std::endl;
+	}
+
+	bool bench_file(const std::string& path, uint32_t threads, bool skipReference)
+	{
+		std::error_code ec;
+		size_t fileBytes = static_cast<size_t>(std::filesystem::file_size(path, ec));
+		if (ec)
+		{
+			std::cout << "can't read " << path << std::endl;
+			return false;
+		}
+
+		std::cout << path << " (" << std::setprecision(1) << std::fixed << fileBytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+
+		vkobj::ObjLoadStats stats;
+		LoadRun parallel = measure([&](LoadRun& run) {
+			return vkobj::load_obj(path.c_str(), run.vertices, run.indices, threads, &stats);
+		});
+		if (!parallel.ok)
+		{
+			std::cout << "  parallel loader failed" << std::endl;
+			return false;
+		}
+		print_run("parallel", parallel, fileBytes);
+		std::cout << "  " << stats.threads << " threads, parse " << stats.parseMs << " ms, dedup " << stats.dedupMs << " ms" << std::endl;
+
+		if (skipReference)
+		{
+			return true;
+		}
+
+		// drop the parallel output before measuring so it doesn't count towards the reference peak
+		size_t vertexCount = parallel.vertices.size();
+		uint64_t vertexHash = vkutil::fnv1a(parallel.vertices.data(), parallel.vertices.size() * sizeof(Vertex));
+		uint64_t indexHash = vkutil::fnv1a(parallel.indices.data(), parallel.indices.size() * sizeof(uint32_t));
+		parallel = LoadRun{};
+
+		LoadRun reference = measure([&](LoadRun& run) {
+			Mesh mesh;
+			bool ok = mesh.load_from_obj_reference(path.c_str());
+			run.vertices = std::move(mesh._vertices);
+			run.indices = std::move(mesh._indices);
+			return ok;
+		});
+		print_run("tinyobj", reference, fileBytes);
+
+		bool match = reference.vertices.size() == vertexCount
+			&& vkutil::fnv1a(reference.vertices.data(), reference.vertices.size() * sizeof(Vertex)) == vertexHash
+			&& vkutil::fnv1a(reference.indices.data(), reference.indices.size() * sizeof(uint32_t)) == indexHash;
+		std::cout << "  output " << (match ? "matches" : "DIFFERS FROM") << " the reference loader" << std::endl;
+		return match;
+	}
+}
+
+// objload [--obj path] [--synthetic-triangles n] [--threads n] [--skip-reference]
+int bench_objload(int argc, char* argv[])
+{
+	std::string objPath = bench_arg(argc, argv, "--obj", VKGUIDE_ROOT "/assets/wahoo.obj");
+	uint64_t triangles = std::strtoull(bench_arg(argc, argv, "--synthetic-triangles", "10000000"), nullptr, 10);
+	uint32_t threads = static_cast<uint32_t>(std::atoi(bench_arg(argc, argv, "--threads", "0")));
+	bool skipReference = bench_flag(argc, argv, "--skip-reference");
+
+	bool ok = bench_file(objPath, threads, skipReference);
+
+	if (triangles > 0)
+	{
+		std::string gridPath = (std::filesystem::temp_directory_path() / ("vkguide_grid_" + std::to_string(triangles) + ".obj")).string();
+		if (!std::filesystem::exists(gridPath))
+		{
+			std::cout << "writing synthetic obj " << gridPath << std::endl;
+			if (!write_grid_obj(gridPath, triangles))
+			{
+				std::cout << "failed to write " << gridPath << std::endl;
+				return 1;
+			}
+		}
+		ok = bench_file(gridPath, threads, skipReference) && ok;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_profiler.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	// a little work per zone, so the compiler can't fold the loop away
+	inline uint64_t work(uint64_t value)
+	{
+		return value * 6364136223846793005ull + 1442695040888963407ull;
+	}
+
+	double zone_ns(uint32_t zones)
+	{
+		uint64_t value = 1;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < zones; i++)
+		{
+			VKPROF_ZONE("bench zone");
+			value = work(value);
+		}
+		double ns = vkbench::elapsed_ms(start) * 1e6 / zones;
+		volatile uint64_t sink = value;
+		(void)sink;
+		return ns;
+	}
+
+	double baseline_ns(uint32_t zones)
+	{
+		uint64_t value = 1;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < zones; i++)
+		{
+			value = work(value);
+		}
+		double ns = vkbench::elapsed_ms(start) * 1e6 / zones;
+		volatile uint64_t sink = value;
+		(void)sink;
+		return ns;
+	}
+
+	// every thread records into its own ring, the slowest thread's average is what a frame would feel
+	double threaded_zone_ns(uint32_t threads, uint32_t zones)
+	{
+		std::vector<double> perThread(threads, 0.0);
+		std::vector<std::thread> workers;
+		for (uint32_t t = 0; t < threads; t++)
+		{
+			workers.emplace_back([&, t]() { perThread[t] = zone_ns(zones); });
+		}
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+		return *std::max_element(perThread.begin(), perThread.end());
+	}
+}
+
+// profiler [--zones N] [--threads N] [--trace file]
+int bench_profiler(int argc, char* argv[])
+{
+	uint32_t zones = static_cast<uint32_t>(std::max(1, atoi(bench_arg(argc, argv, "--zones", "2000000"))));
+	uint32_t threads = static_cast<uint32_t>(atoi(bench_arg(argc, argv, "--threads", "0")));
+	if (threads == 0)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	std::string tracePath = bench_arg(argc, argv, "--trace", "");
+	bool keepTrace = !tracePath.empty();
+	if (!keepTrace)
+	{
+		tracePath = (std::filesystem::temp_directory_path() / "vkguide_bench.trace.json").string();
+	}
+
+	vkprof::set_thread_name("bench main");
+
+	// warm up the thread's ring so its allocation isn't timed
+	zone_ns(1000);
+
+	double baseline = baseline_ns(zones);
+	vkprof::set_enabled(false);
+	double disabled = zone_ns(zones);
+	vkprof::set_enabled(true);
+	double enabled = zone_ns(zones);
+	double threaded = threaded_zone_ns(threads, zones);
+
+	std::cout << std::fixed << std::setprecision(1)
+		<< zones << " zones per thread, " << vkprof::RING_EVENTS << " kept per ring" << std::endl
+		<< "  no zone          " << std::setw(7) << baseline << " ns per iteration" << std::endl
+		<< "  zone, disabled   " << std::setw(7) << disabled - baseline << " ns per zone" << std::endl
+		<< "  zone, enabled    " << std::setw(7) << enabled - baseline << " ns per zone" << std::endl
+		<< "  zone, " << std::setw(2) << threads << " threads " << std::setw(7) << threaded - baseline << " ns per zone (slowest thread)" << std::endl;
+
+	size_t recorded = vkprof::recorded_zones();
+	auto start = std::chrono::steady_clock::now();
+	bool written = vkprof::write_chrome_trace(tracePath);
+	double exportMs = vkbench::elapsed_ms(start);
+	if (!written)
+	{
+		std::cout << "failed to write " << tracePath << std::endl;
+		return 1;
+	}
+
+	std::error_code ec;
+	uintmax_t bytes = std::filesystem::file_size(tracePath, ec);
+	std::cout << "  export           " << std::setw(7) << exportMs << " ms for " << recorded << " zones, "
+		<< (ec ? 0 : bytes) << " bytes of trace json" << std::endl;
+	if (keepTrace)
+	{
+		std::cout << "  wrote " << tracePath << std::endl;
+	}
+	else
+	{
+		std::filesystem::remove(tracePath, ec);
+	}
+	return 0;
+}
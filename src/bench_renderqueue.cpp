@@ -0,0 +1,123 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_render_queue.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+namespace {
+
+	struct DrawState {
+		uint32_t pipeline;
+		uint32_t descriptorSet;
+		uint32_t mesh;
+		float distance;
+	};
+
+	struct BindCounts {
+		uint32_t pipeline = 0;
+		uint32_t descriptorSet = 0;
+		uint32_t mesh = 0;
+	};
+
+	// same elision draw_objects does: only bind what changed since the previous draw
+	BindCounts count_binds(const std::vector<DrawState>& draws, const std::vector<uint32_t>& order)
+	{
+		BindCounts counts;
+		const DrawState* last = nullptr;
+		for (uint32_t index : order)
+		{
+			const DrawState& draw = draws[index];
+			counts.pipeline += !last || last->pipeline != draw.pipeline;
+			counts.descriptorSet += !last || last->pipeline != draw.pipeline || last->descriptorSet != draw.descriptorSet;
+			counts.mesh += !last || last->mesh != draw.mesh;
+			last = &draw;
+		}
+		return counts;
+	}
+}
+
+// renderqueue [--draws N] [--pipelines N] [--materials N] [--meshes N]
+int bench_renderqueue(int argc, char* argv[])
+{
+	uint32_t drawCount = static_cast<uint32_t>(atoi(bench_arg(argc, argv, "--draws", "100000")));
+	uint32_t pipelines = static_cast<uint32_t>(atoi(bench_arg(argc, argv, "--pipelines", "8")));
+	uint32_t materials = static_cast<uint32_t>(atoi(bench_arg(argc, argv, "--materials", "64")));
+	uint32_t meshes = static_cast<uint32_t>(atoi(bench_arg(argc, argv, "--meshes", "256")));
+	const float farPlane = 200.f;
+
+	// draws in scene insertion order, state picked at random
+	std::mt19937 rng(1234);
+	std::vector<DrawState> draws(drawCount);
+	for (DrawState& draw : draws)
+	{
+		draw.pipeline = rng() % pipelines;
+		draw.descriptorSet = rng() % materials;
+		draw.mesh = rng() % meshes;
+		draw.distance = std::uniform_real_distribution<float>(0.f, farPlane)(rng);
+	}
+
+	std::vector<uint32_t> unsorted(drawCount);
+	std::iota(unsorted.begin(), unsorted.end(), 0);
+
+	RenderQueue queue;
+	auto build_queue = [&]() {
+		queue.clear();
+		for (uint32_t i = 0; i < drawCount; i++)
+		{
+			const DrawState& draw = draws[i];
+			queue.push(sortkey::make(draw.pipeline, draw.descriptorSet, draw.mesh, sortkey::quantize_depth(draw.distance, farPlane)), i);
+		}
+	};
+
+	const int runs = 20;
+	double radixMs = 1e30;
+	double buildMs = 1e30;
+	for (int r = 0; r < runs; r++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		build_queue();
+		buildMs = std::min(buildMs, vkbench::elapsed_ms(start));
+
+		start = std::chrono::steady_clock::now();
+		queue.sort();
+		radixMs = std::min(radixMs, vkbench::elapsed_ms(start));
+	}
+	std::vector<uint32_t> radixOrder = queue.objects;
+
+	// comparison sort over the same keys as a baseline
+	double stdMs = 1e30;
+	std::vector<std::pair<uint64_t, uint32_t>> pairs(drawCount);
+	for (int r = 0; r < runs; r++)
+	{
+		build_queue();
+		for (uint32_t i = 0; i < drawCount; i++)
+		{
+			pairs[i] = { queue.keys[i], queue.objects[i] };
+		}
+		auto start = std::chrono::steady_clock::now();
+		std::stable_sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		stdMs = std::min(stdMs, vkbench::elapsed_ms(start));
+	}
+	bool matches = std::equal(pairs.begin(), pairs.end(), radixOrder.begin(), [](const auto& pair, uint32_t object) { return pair.second == object; });
+
+	BindCounts before = count_binds(draws, unsorted);
+	BindCounts after = count_binds(draws, radixOrder);
+
+	std::cout << drawCount << " draws, " << pipelines << " pipelines, " << materials << " descriptor sets, " << meshes << " meshes" << std::endl
+		<< std::fixed << std::setprecision(3)
+		<< "  build keys       " << buildMs << " ms" << std::endl
+		<< "  radix sort       " << radixMs << " ms (" << std::setprecision(0) << drawCount / radixMs << " draws/ms)" << std::endl
+		<< std::setprecision(3)
+		<< "  std::stable_sort " << stdMs << " ms (" << std::setprecision(0) << drawCount / stdMs << " draws/ms), "
+		<< (matches ? "same order" : "ORDER MISMATCH") << std::endl
+		<< "  pipeline binds       " << before.pipeline << " -> " << after.pipeline << std::endl
+		<< "  descriptor set binds " << before.descriptorSet << " -> " << after.descriptorSet << std::endl
+		<< "  vertex/index binds   " << before.mesh << " -> " << after.mesh << std::endl;
+
+	return matches ? 0 : 1;
+}
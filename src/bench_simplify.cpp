@@ -0,0 +1,205 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_mesh.h>
+#include <vk_simplify.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+	// every index is a vertex of the mesh and no triangle has two corners on one position
+	bool valid_indices(const std::vector<uint32_t>& indices, size_t first, size_t count, const std::vector<Vertex>& vertices)
+	{
+		if (count % 3 != 0 || first + count > indices.size())
+		{
+			return false;
+		}
+		for (size_t i = first; i < first + count; i += 3)
+		{
+			uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+			if (a >= vertices.size() || b >= vertices.size() || c >= vertices.size())
+			{
+				return false;
+			}
+			const glm::vec3& pa = vertices[a].position;
+			const glm::vec3& pb = vertices[b].position;
+			const glm::vec3& pc = vertices[c].position;
+			if (pa == pb || pb == pc || pc == pa)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// the engine's stress grid, see VulkanEngine::init_scene(), with every cell holding the mesh
+	struct StressScene {
+		std::vector<glm::vec3> centers; // bounding sphere centers
+		float radius = 0.f;
+		float scale = 1.f;              // model to world
+	};
+
+	StressScene make_scene(const Mesh& mesh, uint32_t objects)
+	{
+		StressScene scene;
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(objects))));
+		float spacing = 6.f / side;
+		float center = (side - 1) * 0.5f;
+		float diagonal = glm::length(mesh._bounds.max - mesh._bounds.min);
+		scene.scale = diagonal > 0.f ? spacing * 0.9f / diagonal : 1.f;
+		scene.radius = mesh._bounds.radius * scene.scale;
+		for (uint32_t i = 0; i < objects; i++)
+		{
+			glm::vec3 cell{ float(i % side), float((i / side) % side), float(i / (side * side)) };
+			scene.centers.push_back((cell - center) * spacing + mesh._bounds.center * scene.scale);
+		}
+		return scene;
+	}
+
+	struct SceneFrame {
+		uint64_t triangles = 0;
+		uint64_t fullTriangles = 0;
+		uint32_t switches = 0; // objects drawn at another level than the frame before
+	};
+
+	// select every object's level the way prepare_draws() does, for a camera on the -z axis
+	SceneFrame select_scene(const Mesh& mesh, const StressScene& scene, std::vector<uint8_t>& lods, float cameraDistance,
+		float pixelsPerWorldUnit, float errorPixels, float hysteresis)
+	{
+		SceneFrame frame;
+		glm::vec3 camera{ 0.f, 0.f, -cameraDistance };
+		uint32_t lodCount = static_cast<uint32_t>(mesh._lods.size());
+		for (size_t i = 0; i < scene.centers.size(); i++)
+		{
+			float distance = std::max(glm::length(scene.centers[i] - camera) - scene.radius, 0.1f);
+			uint32_t lod = select_lod(mesh._lods.data(), lodCount, pixelsPerWorldUnit * scene.scale / distance,
+				errorPixels, hysteresis, lods[i]);
+			frame.switches += lod != lods[i] ? 1 : 0;
+			lods[i] = static_cast<uint8_t>(lod);
+			frame.triangles += mesh._lods[lod].indexCount / 3;
+			frame.fullTriangles += mesh._lods[0].indexCount / 3;
+		}
+		return frame;
+	}
+}
+
+// simplify [--obj path] [--iterations N] [--levels N] [--objects N] [--height H] [--error PIXELS] [--hysteresis F]
+int bench_simplify(int argc, char* argv[])
+{
+	std::string objPath = bench_arg(argc, argv, "--obj", VKGUIDE_ROOT "/assets/wahoo.obj");
+	int iterations = std::max(1, std::atoi(bench_arg(argc, argv, "--iterations", "3")));
+	uint32_t levels = static_cast<uint32_t>(std::atoi(bench_arg(argc, argv, "--levels", "4")));
+	uint32_t objects = static_cast<uint32_t>(std::max(1, std::atoi(bench_arg(argc, argv, "--objects", "1000"))));
+	float height = static_cast<float>(std::atof(bench_arg(argc, argv, "--height", "720")));
+	float errorPixels = static_cast<float>(std::atof(bench_arg(argc, argv, "--error", "1")));
+	float hysteresis = static_cast<float>(std::atof(bench_arg(argc, argv, "--hysteresis", "0.25")));
+
+	Mesh mesh;
+	if (!mesh.load_from_obj(objPath.c_str()))
+	{
+		std::cerr << "failed to load " << objPath << std::endl;
+		return 1;
+	}
+	mesh.optimize();
+	size_t triangles = mesh._indices.size() / 3;
+	std::cout << objPath << ": " << mesh._vertices.size() << " vertices, " << triangles << " triangles" << std::endl;
+	bool valid = true;
+
+	// throughput at a few targets, every run starts over from the full mesh. No error limit, so the target
+	// or the locked vertices are what stops it
+	std::cout << "simplify_mesh, input triangles per second:" << std::endl;
+	SimplifyOptions options;
+	options.maxError = 1.f;
+	for (float ratio : { 0.5f, 0.25f, 0.1f, 0.02f })
+	{
+		size_t target = static_cast<size_t>(float(triangles) * ratio) * 3;
+		std::vector<uint32_t> result;
+		float error = 0.f;
+		std::vector<double> samples;
+		for (int i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			result = simplify_mesh(mesh._indices, mesh._vertices, target, options, &error);
+			samples.push_back(vkbench::elapsed_ms(start));
+		}
+
+		vkbench::SampleStats stats = vkbench::compute_stats(samples);
+		bool ok = valid_indices(result, 0, result.size(), mesh._vertices) && result.size() <= mesh._indices.size();
+		valid = valid && ok;
+		std::cout << std::fixed << std::setprecision(1)
+			<< "  target " << std::setw(4) << ratio * 100.f << "%: " << std::setw(8) << result.size() / 3 << " triangles, error "
+			<< std::setprecision(4) << error << ", " << std::setprecision(2) << stats.min << " ms, "
+			<< double(triangles) / (stats.min * 1e3) << " Mtri/s" << (ok ? "" : "  INVALID") << std::endl;
+	}
+
+	// the chain load_mesh_data() bakes
+	MeshLodOptions lodOptions;
+	lodOptions.levels = levels;
+	auto lodStart = std::chrono::steady_clock::now();
+	mesh.build_lods(lodOptions);
+	double lodMs = vkbench::elapsed_ms(lodStart);
+	std::cout << "build_lods: " << mesh._lods.size() << " of " << levels << " levels in " << std::setprecision(2) << lodMs << " ms" << std::endl;
+	float scale = simplify_scale(mesh._vertices);
+	for (size_t l = 0; l < mesh._lods.size(); l++)
+	{
+		const MeshLod& lod = mesh._lods[l];
+		bool ok = valid_indices(mesh._indices, lod.firstIndex, lod.indexCount, mesh._vertices)
+			&& (l == 0 || (lod.error >= mesh._lods[l - 1].error && lod.indexCount < mesh._lods[l - 1].indexCount));
+		valid = valid && ok;
+		std::cout << "  lod " << l << ": " << std::setw(8) << lod.indexCount / 3 << " triangles, error " << std::setprecision(5)
+			<< lod.error << " (" << std::setprecision(3) << (scale > 0.f ? 100.f * lod.error / scale : 0.f) << "% of the extent)"
+			<< (ok ? "" : "  INVALID") << std::endl;
+	}
+
+	// stress scene at a few fixed camera distances, the engine's camera sits at 7
+	StressScene scene = make_scene(mesh, objects);
+	float pixelsPerWorldUnit = height / (2.f * std::tan(glm::radians(70.f) * 0.5f));
+	std::cout << "stress scene: " << objects << " objects, " << std::setprecision(0) << height << " pixels high, "
+		<< std::setprecision(1) << errorPixels
+		<< " pixel error threshold" << std::endl;
+	for (float distance : { 7.f, 15.f, 30.f, 60.f })
+	{
+		std::vector<uint8_t> lods(objects, 0);
+		SceneFrame frame = select_scene(mesh, scene, lods, distance, pixelsPerWorldUnit, errorPixels, 0.f);
+		std::cout << "  camera at " << std::setprecision(0) << std::setw(2) << distance << ": " << std::setw(10) << frame.triangles
+			<< " triangles with lod, " << std::setw(10) << frame.fullTriangles << " without (" << std::setprecision(1)
+			<< 100.0 * double(frame.triangles) / double(std::max<uint64_t>(frame.fullTriangles, 1)) << "%)" << std::endl;
+	}
+
+	// dolly out and back in with a little shake on top, the shake is what makes objects near a switch point pop
+	const uint32_t frames = 600;
+	std::vector<uint8_t> lods(objects, 0);
+	std::vector<uint8_t> lodsNoHysteresis(objects, 0);
+	SceneFrame total, totalNoHysteresis;
+	for (uint32_t f = 0; f < frames; f++)
+	{
+		float t = float(f) / float(frames - 1);
+		float distance = 7.f + 26.5f * (1.f - std::cos(t * glm::two_pi<float>()));
+		distance *= 1.f + 0.03f * std::sin(float(f) * 1.7f);
+		SceneFrame frame = select_scene(mesh, scene, lods, distance, pixelsPerWorldUnit, errorPixels, hysteresis);
+		SceneFrame noHysteresis = select_scene(mesh, scene, lodsNoHysteresis, distance, pixelsPerWorldUnit, errorPixels, 0.f);
+		total.triangles += frame.triangles;
+		total.fullTriangles += frame.fullTriangles;
+		totalNoHysteresis.triangles += noHysteresis.triangles;
+		if (f > 0)
+		{
+			total.switches += frame.switches;
+			totalNoHysteresis.switches += noHysteresis.switches;
+		}
+	}
+	std::cout << "  camera path 7 -> 60 -> 7 over " << frames << " frames, per frame: " << std::setprecision(0)
+		<< double(total.triangles) / frames << " triangles with lod, " << double(total.fullTriangles) / frames << " without" << std::endl;
+	std::cout << "  level switches: " << total.switches << " with " << std::setprecision(2) << hysteresis << " hysteresis ("
+		<< std::setprecision(0) << double(total.triangles) / frames << " triangles), " << totalNoHysteresis.switches
+		<< " without (" << double(totalNoHysteresis.triangles) / frames << " triangles)" << std::endl;
+
+	return valid ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_profiler.h>
+#include <vk_snapshot.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	// shaped like the engine's FrameSnapshot, without pulling in the engine
+	struct Snapshot {
+		uint64_t publishedNs = 0;
+		uint64_t sequence = 0;
+		uint64_t sceneVersion = 0;
+		std::vector<glm::mat4> transforms;
+	};
+
+	struct HandoffResult {
+		double publishNs = 0.0;      // average cost of a write + publish on the producer
+		double acquireNs = 0.0;      // average cost of an acquire that got something
+		uint64_t published = 0;
+		uint64_t taken = 0;
+		uint64_t repeated = 0;       // consumer rounds without a new snapshot
+		std::vector<double> ageUs;   // publish to acquire
+	};
+
+	// the producer publishes as fast as it can, the consumer takes the newest snapshot every frameUs,
+	// like a render thread paced by vsync. sceneEvery publishes share one version of the transforms
+	HandoffResult handoff(uint32_t objects, uint32_t frames, uint32_t frameUs, uint32_t sceneEvery)
+	{
+		TripleBuffer<Snapshot> buffer;
+		std::vector<glm::mat4> scene(objects, glm::mat4(1.f));
+		std::atomic<bool> stop{ false };
+		HandoffResult result;
+		result.ageUs.reserve(frames);
+
+		std::thread producer([&]() {
+			uint64_t sequence = 0;
+			uint64_t version = 1;
+			uint64_t totalNs = 0;
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				if (sceneEvery > 0 && sequence % sceneEvery == 0)
+				{
+					version++;
+					scene[sequence % objects][3].x += 1.f;
+				}
+
+				uint64_t start = vkprof::now_ns();
+				Snapshot& slot = buffer.back();
+				if (slot.sceneVersion != version)
+				{
+					slot.transforms = scene;
+					slot.sceneVersion = version;
+				}
+				slot.sequence = ++sequence;
+				slot.publishedNs = vkprof::now_ns();
+				buffer.publish();
+				totalNs += vkprof::now_ns() - start;
+
+				// a simulation tick, not a spin on the atomic
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+			result.published = sequence;
+			result.publishNs = sequence > 0 ? static_cast<double>(totalNs) / sequence : 0.0;
+		});
+
+		uint64_t acquireNs = 0;
+		uint64_t lastSequence = 0;
+		for (uint32_t f = 0; f < frames; f++)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(frameUs));
+
+			uint64_t start = vkprof::now_ns();
+			bool fresh = buffer.acquire();
+			uint64_t end = vkprof::now_ns();
+			if (!fresh)
+			{
+				result.repeated++;
+				continue;
+			}
+			acquireNs += end - start;
+			result.taken++;
+
+			const Snapshot& snapshot = buffer.front();
+			if (snapshot.sequence <= lastSequence)
+			{
+				std::cout << "snapshot went backwards: " << snapshot.sequence << " after " << lastSequence << std::endl;
+			}
+			lastSequence = snapshot.sequence;
+			result.ageUs.push_back(static_cast<double>(end - snapshot.publishedNs) * 1e-3);
+		}
+
+		stop.store(true, std::memory_order_relaxed);
+		producer.join();
+		result.acquireNs = result.taken > 0 ? static_cast<double>(acquireNs) / result.taken : 0.0;
+		return result;
+	}
+}
+
+// snapshot [--objects N] [--frames N] [--frame-us N]
+int bench_snapshot(int argc, char* argv[])
+{
+	uint32_t objects = static_cast<uint32_t>(std::max(1, atoi(bench_arg(argc, argv, "--objects", "8000"))));
+	uint32_t frames = static_cast<uint32_t>(std::max(1, atoi(bench_arg(argc, argv, "--frames", "600"))));
+	uint32_t frameUs = static_cast<uint32_t>(std::max(0, atoi(bench_arg(argc, argv, "--frame-us", "4000"))));
+
+	std::cout << objects << " transforms, consumer takes one every " << frameUs << " us for " << frames << " frames" << std::endl;
+
+	struct Case {
+		const char* name;
+		uint32_t sceneEvery;
+	};
+	const Case cases[] = {
+		{ "static scene", 0 },
+		{ "scene moves every 16th tick", 16 },
+		{ "scene moves every tick", 1 },
+	};
+
+	for (const Case& c : cases)
+	{
+		HandoffResult result = handoff(objects, frames, frameUs, c.sceneEvery);
+		vkbench::SampleStats age = vkbench::compute_stats(result.ageUs);
+
+		std::cout << std::fixed << std::setprecision(1) << c.name << std::endl
+			<< "  publish " << std::setw(9) << result.publishNs << " ns, acquire " << std::setw(6) << result.acquireNs << " ns" << std::endl
+			<< "  " << result.published << " published, " << result.taken << " taken, " << result.repeated << " frames without a new one" << std::endl
+			<< "  age at acquire p50 " << age.p50 << " us, p99 " << age.p99 << " us, max " << age.max << " us" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include <bench_suites.h>
+
+#include <cstring>
+
+const std::vector<BenchSuite>& bench_suites()
+{
+	static const std::vector<BenchSuite> suites = {
+		{ "objload", "obj parse + vertex dedup throughput and peak memory", bench_objload },
+		{ "meshopt", "vertex cache / overdraw / vertex fetch reordering, ACMR ATVR overdraw before and after", bench_meshopt },
+		{ "vertexpack", "packed vertex layout and 16 bit indices, bytes and quantization error", bench_vertexpack },
+		{ "culling", "scalar / SSE / AVX bounding sphere frustum culling, objects culled per ms", bench_culling },
+		{ "renderqueue", "64 bit sort key radix sort against std::stable_sort, bind calls before and after sorting", bench_renderqueue },
+		{ "jobs", "job system spawn overhead, steal latency and parallel_for scaling", bench_jobs },
+		{ "texture", "mip chain generation and BC1/BC3/BC7 encode throughput, PSNR and bytes against uncompressed", bench_texture },
+		{ "texload", "startup texture load, stbi_load decode + copy against the memory mapped baked container", bench_texload },
+		{ "profiler", "cost of a profiler zone enabled, disabled and on every thread, chrome trace export time", bench_profiler },
+		{ "snapshot", "triple buffered frame snapshot handoff, publish and acquire cost and snapshot age", bench_snapshot },
+		{ "simplify", "quadric error simplification throughput, lod chain and triangles drawn with and without lod in the stress scene", bench_simplify },
+	};
+	return suites;
+}
+
+const char* bench_arg(int argc, char* argv[], const char* flag, const char* fallback)
+{
+	for (int i = 0; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], flag) == 0)
+		{
+			return argv[i + 1];
+		}
+	}
+	return fallback;
+}
+
+bool bench_flag(int argc, char* argv[], const char* flag)
+{
+	for (int i = 0; i < argc; i++)
+	{
+		if (strcmp(argv[i], flag) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
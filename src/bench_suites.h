@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// build targets point this at their own checkout, see src/CMakeLists.txt
+#ifndef VKGUIDE_ROOT
+#define VKGUIDE_ROOT "."
+#endif
+
+struct BenchSuite {
+	const char* name;
+	const char* description;
+	int (*run)(int argc, char* argv[]);
+};
+
+const std::vector<BenchSuite>& bench_suites();
+
+// helpers shared by the suites for simple "--flag value" parsing
+const char* bench_arg(int argc, char* argv[], const char* flag, const char* fallback);
+bool bench_flag(int argc, char* argv[], const char* flag);
+
+int bench_objload(int argc, char* argv[]);
+int bench_meshopt(int argc, char* argv[]);
+int bench_vertexpack(int argc, char* argv[]);
+int bench_culling(int argc, char* argv[]);
+int bench_renderqueue(int argc, char* argv[]);
+int bench_jobs(int argc, char* argv[]);
+int bench_texture(int argc, char* argv[]);
+int bench_texload(int argc, char* argv[]);
+int bench_profiler(int argc, char* argv[]);
+int bench_snapshot(int argc, char* argv[]);
+int bench_simplify(int argc, char* argv[]);
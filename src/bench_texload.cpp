@@ -0,0 +1,170 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_texture.h>
+#include <vk_texture_cache.h>
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	// drop a file from the page cache so the next read comes from disk, best effort
+	void evict(const std::string& path)
+	{
+#ifndef _WIN32
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd >= 0)
+		{
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			::close(fd);
+		}
+#else
+		(void)path;
+#endif
+	}
+
+	bool bake(const std::string& imagePath, const std::string& cachePath, TextureCodec codec)
+	{
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load(imagePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			return false;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		Texture mips;
+		Texture encoded;
+		generate_mips(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), mips);
+		stbi_image_free(pixels);
+		encode_texture(mips, codec, encoded);
+		std::cout << "  baked " << cachePath << " in " << vkbench::elapsed_ms(start) << " ms" << std::endl;
+
+		return write_texture_cache(cachePath.c_str(), imagePath.c_str(), encoded);
+	}
+
+	void bench_image(const std::string& imagePath, TextureCodec codec, uint32_t runs, bool cold)
+	{
+		std::string cachePath = texture_cache_path(imagePath, codec);
+		{
+			TextureCache cache;
+			if (!cache.open(cachePath.c_str(), imagePath.c_str(), codec) && !bake(imagePath, cachePath, codec))
+			{
+				std::cout << "failed to load or bake " << imagePath << std::endl;
+				return;
+			}
+		}
+
+		int width = 0, height = 0, channels = 0;
+		stbi_info(imagePath.c_str(), &width, &height, &channels);
+		size_t decodedBytes = size_t(width) * height * 4;
+
+		// stands in for the staging ring: allocated and faulted in once, outside the timings
+		std::vector<uint8_t> staging;
+
+		// before: decode into a heap buffer, copy it into staging memory, free it
+		std::vector<double> decodeMs;
+		for (uint32_t run = 0; run < runs; run++)
+		{
+			if (cold)
+			{
+				evict(imagePath);
+			}
+			staging.resize(std::max(staging.size(), decodedBytes), 0);
+
+			auto start = std::chrono::steady_clock::now();
+			int w, h, c;
+			stbi_uc* pixels = stbi_load(imagePath.c_str(), &w, &h, &c, STBI_rgb_alpha);
+			memcpy(staging.data(), pixels, decodedBytes);
+			stbi_image_free(pixels);
+			decodeMs.push_back(vkbench::elapsed_ms(start));
+		}
+
+		// after: map the baked container and copy every level into staging memory in one go
+		std::vector<double> mappedMs;
+		size_t mappedBytes = 0;
+		uint32_t levels = 0;
+		for (uint32_t run = 0; run < runs; run++)
+		{
+			if (cold)
+			{
+				evict(cachePath);
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			TextureCache cache;
+			cache.open(cachePath.c_str(), imagePath.c_str(), codec);
+			mappedBytes = cache.data_bytes();
+			levels = cache.level_count();
+			staging.resize(std::max(staging.size(), mappedBytes), 0);
+			memcpy(staging.data(), cache.data(), mappedBytes);
+			mappedMs.push_back(vkbench::elapsed_ms(start));
+		}
+
+		vkbench::SampleStats decode = vkbench::compute_stats(decodeMs);
+		vkbench::SampleStats mapped = vkbench::compute_stats(mappedMs);
+
+		std::cout << imagePath << ": " << width << "x" << height << (cold ? ", page cache dropped before every run" : "") << std::endl;
+		std::cout << std::fixed << std::setprecision(2)
+			<< "  stbi_load + memcpy      p50 " << std::setw(9) << decode.p50 << " ms, 1 mip, "
+			<< decodedBytes << " bytes copied, " << decodedBytes << " bytes heap" << std::endl
+			<< "  mmap " << std::left << std::setw(5) << texture_codec_name(codec) << std::right << " + memcpy     p50 "
+			<< std::setw(9) << mapped.p50 << " ms, " << levels << " mips, "
+			<< mappedBytes << " bytes copied, 0 bytes heap" << std::endl
+			<< "  speedup " << decode.p50 / std::max(mapped.p50, 1e-6) << "x" << std::endl << std::endl;
+	}
+}
+
+// texload [--image path] [--codec rgba8|bc1|bc3|bc7] [--runs N] [--cold]
+int bench_texload(int argc, char* argv[])
+{
+	const char* codecName = bench_arg(argc, argv, "--codec", "bc7");
+	uint32_t runs = static_cast<uint32_t>(std::max(1, atoi(bench_arg(argc, argv, "--runs", "9"))));
+	bool cold = bench_flag(argc, argv, "--cold");
+
+	TextureCodec codec = TextureCodec::BC7;
+	bool known = false;
+	for (TextureCodec candidate : { TextureCodec::RGBA8, TextureCodec::BC1, TextureCodec::BC3, TextureCodec::BC7 })
+	{
+		if (strcmp(codecName, texture_codec_name(candidate)) == 0)
+		{
+			codec = candidate;
+			known = true;
+		}
+	}
+	if (!known)
+	{
+		std::cout << "unknown texture codec " << codecName << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> images;
+	const char* image = bench_arg(argc, argv, "--image", nullptr);
+	if (image)
+	{
+		images.push_back(image);
+	}
+	else
+	{
+		images.push_back(VKGUIDE_ROOT "/assets/lost_empire-RGBA.png");
+		images.push_back(VKGUIDE_ROOT "/assets/wahoo.bmp");
+	}
+
+	for (const std::string& path : images)
+	{
+		bench_image(path, codec, runs, cold);
+	}
+	return 0;
+}
@@ -0,0 +1,119 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_texture.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// the engine compiles stb_image into vk_engine.cpp, which the bench doesn't link
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+namespace {
+
+	// PSNR of channels [first, first + count) of level 0 against the source image, 99 dB when lossless
+	double psnr(const uint8_t* reference, const std::vector<uint8_t>& decoded, int first, int count)
+	{
+		double squared = 0.0;
+		for (size_t i = 0; i < decoded.size(); i += 4)
+		{
+			for (int c = first; c < first + count; c++)
+			{
+				double d = double(decoded[i + c]) - double(reference[i + c]);
+				squared += d * d;
+			}
+		}
+		double mse = squared / (decoded.size() / 4 * count);
+		return mse == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+	}
+
+	void bench_image(const std::string& path)
+	{
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			std::cout << "failed to load " << path << std::endl;
+			return;
+		}
+
+		Texture mips;
+		double mipMs = 1e30;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			generate_mips(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), mips);
+			mipMs = std::min(mipMs, vkbench::elapsed_ms(start));
+		}
+
+		size_t texels = 0;
+		for (const TextureLevel& level : mips.levels)
+		{
+			texels += size_t(level.width) * level.height;
+		}
+
+		// what the engine uploaded before: one uncompressed level
+		size_t baselineBytes = size_t(width) * height * 4;
+
+		std::cout << path << ": " << width << "x" << height << ", " << mips.levels.size() << " mips" << std::endl;
+		std::cout << std::fixed << std::setprecision(2)
+			<< "  mip chain          " << mipMs << " ms, " << texels / mipMs / 1000.0 << " MPix/s" << std::endl;
+
+		std::cout << "  codec      encode ms     MPix/s    rgb dB  alpha dB       bytes  vs rgba8 1 mip" << std::endl;
+		for (TextureCodec codec : { TextureCodec::RGBA8, TextureCodec::BC1, TextureCodec::BC3, TextureCodec::BC7 })
+		{
+			Texture encoded;
+			auto start = std::chrono::steady_clock::now();
+			encode_texture(mips, codec, encoded);
+			double ms = vkbench::elapsed_ms(start);
+
+			std::vector<uint8_t> decoded;
+			decode_texture_level(encoded, 0, decoded);
+
+			std::cout << "  " << std::left << std::setw(8) << texture_codec_name(codec) << std::right
+				<< std::setw(12) << ms
+				<< std::setw(11) << texels / std::max(ms, 1e-3) / 1000.0
+				<< std::setw(10) << psnr(pixels, decoded, 0, 3);
+			if (codec == TextureCodec::BC1)
+			{
+				std::cout << std::setw(10) << "-";
+			}
+			else
+			{
+				std::cout << std::setw(10) << psnr(pixels, decoded, 3, 1);
+			}
+			std::cout << std::setw(12) << encoded.data.size()
+				<< std::setw(15) << std::setprecision(1) << 100.0 * encoded.data.size() / baselineBytes << "%"
+				<< std::setprecision(2) << std::endl;
+		}
+		std::cout << std::endl;
+
+		stbi_image_free(pixels);
+	}
+}
+
+// texture [--image path]
+int bench_texture(int argc, char* argv[])
+{
+	std::vector<std::string> images;
+	const char* image = bench_arg(argc, argv, "--image", nullptr);
+	if (image)
+	{
+		images.push_back(image);
+	}
+	else
+	{
+		images.push_back(VKGUIDE_ROOT "/assets/lost_empire-RGBA.png");
+		images.push_back(VKGUIDE_ROOT "/assets/wahoo.bmp");
+	}
+
+	for (const std::string& path : images)
+	{
+		bench_image(path);
+	}
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include <bench_suites.h>
+#include <vk_benchmark.h>
+#include <vk_mesh.h>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+	// cpu mirror of oct_decode in tri_mesh.vert
+	glm::vec3 oct_decode(glm::vec2 e)
+	{
+		glm::vec3 n{ e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y) };
+		float t = std::max(-n.z, 0.f);
+		n.x += n.x >= 0.f ? -t : t;
+		n.y += n.y >= 0.f ? -t : t;
+		return glm::normalize(n);
+	}
+
+	// largest error the packed layout introduces, in model space units / degrees / uv units
+	void measure_error(const Mesh& mesh, float& position, float& normalDegrees, float& texCoord)
+	{
+		position = normalDegrees = texCoord = 0.f;
+
+		uint32_t stride = Vertex::packed_stride(mesh._vertexAttributes);
+		glm::vec3 extent = mesh._bounds.max - mesh._bounds.min;
+
+		for (size_t i = 0; i < mesh._vertices.size(); i++)
+		{
+			const Vertex& vertex = mesh._vertices[i];
+			PackedVertex packed;
+			memcpy(&packed, &mesh._packedVertices[i * stride], sizeof(packed));
+
+			glm::vec3 p = mesh._bounds.min + glm::vec3(packed.position[0], packed.position[1], packed.position[2]) / 65535.f * extent;
+			position = std::max(position, glm::length(p - vertex.position));
+
+			if (glm::length(vertex.normal) > 0.f)
+			{
+				glm::vec3 n = oct_decode(glm::max(glm::vec2(packed.normal[0], packed.normal[1]) / 32767.f, -1.f));
+				float cosine = glm::clamp(glm::dot(n, glm::normalize(vertex.normal)), -1.f, 1.f);
+				normalDegrees = std::max(normalDegrees, glm::degrees(std::acos(cosine)));
+			}
+
+			glm::vec2 uv{ glm::unpackHalf1x16(packed.texCoord[0]), glm::unpackHalf1x16(packed.texCoord[1]) };
+			texCoord = std::max(texCoord, glm::length(uv - vertex.texCoord));
+		}
+	}
+}
+
+// vertexpack [--obj path] [--color]
+int bench_vertexpack(int argc, char* argv[])
+{
+	std::string objPath = bench_arg(argc, argv, "--obj", VKGUIDE_ROOT "/assets/wahoo.obj");
+	uint32_t attributes = bench_flag(argc, argv, "--color") ? VERTEX_ATTRIBUTE_COLOR : 0;
+
+	Mesh mesh;
+	mesh.load_from_obj(objPath.c_str());
+
+	auto start = std::chrono::steady_clock::now();
+	mesh.pack(attributes);
+	double ms = vkbench::elapsed_ms(start);
+
+	size_t vertexBefore = mesh._vertices.size() * sizeof(Vertex);
+	size_t indexBefore = mesh._indices.size() * sizeof(uint32_t);
+	size_t vertexAfter = mesh._packedVertices.size();
+	size_t indexAfter = mesh._packedIndices.size();
+
+	std::cout << objPath << ": " << mesh._vertices.size() << " vertices, " << mesh._indices.size() << " indices" << std::endl
+		<< std::fixed << std::setprecision(1)
+		<< "  vertex bytes " << vertexBefore << " -> " << vertexAfter
+		<< " (" << sizeof(Vertex) << " -> " << Vertex::packed_stride(attributes) << " per vertex, "
+		<< 100.0 * vertexAfter / vertexBefore << "%)" << std::endl
+		<< "  index bytes  " << indexBefore << " -> " << indexAfter
+		<< " (" << (mesh._indexType == VK_INDEX_TYPE_UINT16 ? "uint16" : "uint32") << ", "
+		<< 100.0 * indexAfter / indexBefore << "%)" << std::endl
+		<< "  total        " << vertexBefore + indexBefore << " -> " << vertexAfter + indexAfter << std::endl
+		<< "  pack time    " << std::setprecision(2) << ms << " ms" << std::endl;
+
+	float position, normalDegrees, texCoord;
+	measure_error(mesh, position, normalDegrees, texCoord);
+	glm::vec3 extent = mesh._bounds.max - mesh._bounds.min;
+	std::cout << std::setprecision(6)
+		<< "  max error    position " << position << " (" << 100.0 * position / glm::length(extent) << "% of the diagonal)"
+		<< ", normal " << normalDegrees << " deg, uv " << texCoord << std::endl;
+
+	return 0;
+}
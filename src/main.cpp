@@ -1,9 +1,31 @@
 #include <vk_engine.h>
 
+#include <cstdlib>
+#include <cstring>
+
+//   vulkan_guide [--frames-in-flight N] [--present-mode fifo|mailbox|immediate]
 int main(int argc, char* argv[])
 {
 	VulkanEngine engine;
 
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--frames-in-flight") == 0)
+		{
+			engine._max_frames_in_flight = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--present-mode") == 0)
+		{
+			for (VkPresentModeKHR mode : { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR })
+			{
+				if (strcmp(argv[i + 1], present_mode_name(mode)) == 0)
+				{
+					engine._presentMode = mode;
+				}
+			}
+		}
+	}
+
 	engine.init();	
 	engine.run();	
 	engine.cleanup();	
@@ -0,0 +1,157 @@
+#include <vk_engine.h>
+#include <vk_benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// headless frame-time benchmark: renders the scene offscreen along a scripted trackball path. With --present-mode
+// it renders into a window instead, to compare present modes and frames in flight by their input latency
+//   vulkan_guide_headless [--frames N] [--warmup N] [--width W] [--height H] [--objects N] [--textures N] [--gpu-culling] [--no-cpu-culling] [--no-sort] [--lod-levels N] [--lod-error PIXELS] [--jobs N] [--record-threads N] [--descriptor-sets N] [--texture-codec rgba8|bc1|bc3|bc7] [--no-pipeline-cache] [--frames-in-flight N] [--present-mode fifo|mailbox|immediate] [--checksum] [--csv file] [--trace file]
+int main(int argc, char* argv[])
+{
+	VulkanEngine engine;
+	engine._headless = true;
+
+	vkbench::BenchmarkConfig config;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(argv[i], "--frames") == 0 && hasValue)
+		{
+			config.frames = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+		{
+			config.warmupFrames = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--width") == 0 && hasValue)
+		{
+			engine._windowExtent.width = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--height") == 0 && hasValue)
+		{
+			engine._windowExtent.height = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--objects") == 0 && hasValue)
+		{
+			engine._sceneObjects = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--textures") == 0 && hasValue)
+		{
+			engine._sceneTextures = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--gpu-culling") == 0)
+		{
+			engine._gpuCulling = true;
+		}
+		else if (strcmp(argv[i], "--no-cpu-culling") == 0)
+		{
+			engine._cpuCulling = false;
+		}
+		else if (strcmp(argv[i], "--no-sort") == 0)
+		{
+			engine._sortDraws = false;
+		}
+		else if (strcmp(argv[i], "--lod-levels") == 0 && hasValue)
+		{
+			engine._lodLevels = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--lod-error") == 0 && hasValue)
+		{
+			engine._lodErrorPixels = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--jobs") == 0 && hasValue)
+		{
+			engine._jobThreads = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--record-threads") == 0 && hasValue)
+		{
+			engine._recordThreads = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--descriptor-sets") == 0 && hasValue)
+		{
+			engine._descriptorStressSets = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--texture-codec") == 0 && hasValue)
+		{
+			const char* name = argv[++i];
+			bool known = false;
+			for (TextureCodec codec : { TextureCodec::RGBA8, TextureCodec::BC1, TextureCodec::BC3, TextureCodec::BC7 })
+			{
+				if (strcmp(name, texture_codec_name(codec)) == 0)
+				{
+					engine._textureCodec = codec;
+					known = true;
+				}
+			}
+			if (!known)
+			{
+				std::cout << "unknown texture codec " << name << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--no-pipeline-cache") == 0)
+		{
+			engine._usePipelineCache = false;
+		}
+		else if (strcmp(argv[i], "--frames-in-flight") == 0 && hasValue)
+		{
+			engine._max_frames_in_flight = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--present-mode") == 0 && hasValue)
+		{
+			// presenting needs a swapchain, the same path is rendered into a window instead
+			const char* name = argv[++i];
+			bool known = false;
+			for (VkPresentModeKHR mode : { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR })
+			{
+				if (strcmp(name, present_mode_name(mode)) == 0)
+				{
+					engine._presentMode = mode;
+					known = true;
+				}
+			}
+			if (!known)
+			{
+				std::cout << "unknown present mode " << name << std::endl;
+				return 1;
+			}
+			engine._headless = false;
+		}
+		else if (strcmp(argv[i], "--checksum") == 0)
+		{
+			config.checksum = true;
+		}
+		else if (strcmp(argv[i], "--csv") == 0 && hasValue)
+		{
+			config.csvPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+		{
+			engine._tracePath = argv[++i];
+		}
+		else
+		{
+			std::cout << "usage: " << argv[0] << " [--frames N] [--warmup N] [--width W] [--height H] [--objects N] [--textures N] [--gpu-culling] [--no-cpu-culling] [--no-sort] [--lod-levels N] [--lod-error PIXELS] [--jobs N] [--record-threads N] [--descriptor-sets N] [--texture-codec rgba8|bc1|bc3|bc7] [--no-pipeline-cache] [--frames-in-flight N] [--present-mode fifo|mailbox|immediate] [--checksum] [--csv file] [--trace file]" << std::endl;
+			return 1;
+		}
+	}
+
+	engine.init();
+
+	vkbench::BenchmarkResults results;
+	engine.run_benchmark(config, results);
+
+	vkbench::print_results(std::cout, results);
+	if (!config.csvPath.empty() && !vkbench::write_csv(config.csvPath, results))
+	{
+		std::cout << "failed to write " << config.csvPath << std::endl;
+	}
+
+	engine.cleanup();
+
+	return 0;
+}
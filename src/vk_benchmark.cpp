@@ -0,0 +1,194 @@
+#include <vk_benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+vkbench::SampleStats vkbench::compute_stats(std::vector<double> samples)
+{
+	SampleStats stats;
+	if (samples.empty())
+	{
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	// nearest-rank percentile, p in [0, 1]
+	auto percentile = [&](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+		return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+	};
+
+	stats.min = samples.front();
+	stats.max = samples.back();
+	stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+	stats.p50 = percentile(0.50);
+	stats.p90 = percentile(0.90);
+	stats.p99 = percentile(0.99);
+	return stats;
+}
+
+size_t vkbench::peak_rss_bytes()
+{
+#if defined(__linux__)
+	// VmHWM honours resets through clear_refs, ru_maxrss doesn't
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line))
+	{
+		if (line.compare(0, 6, "VmHWM:") == 0)
+		{
+			return static_cast<size_t>(std::stoull(line.substr(6))) * 1024;
+		}
+	}
+	return 0;
+#elif defined(__APPLE__)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return static_cast<size_t>(usage.ru_maxrss); // bytes on macOS
+#else
+	return 0;
+#endif
+}
+
+bool vkbench::reset_peak_rss()
+{
+#if defined(__linux__)
+	std::ofstream clearRefs("/proc/self/clear_refs");
+	clearRefs << "5";
+	return clearRefs.good();
+#else
+	return false;
+#endif
+}
+
+double vkbench::elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void vkbench::print_stats(std::ostream& out, const char* label, const SampleStats& stats)
+{
+	out << std::fixed << std::setprecision(3)
+		<< label
+		<< " min " << stats.min
+		<< " mean " << stats.mean
+		<< " p50 " << stats.p50
+		<< " p90 " << stats.p90
+		<< " p99 " << stats.p99
+		<< " max " << stats.max << " (ms)" << std::endl;
+}
+
+void vkbench::print_results(std::ostream& out, const BenchmarkResults& results)
+{
+	SampleStats cpu = compute_stats(results.cpuFrameMs);
+
+	out << "frames: " << results.cpuFrameMs.size() << std::endl;
+	if (!results.presentMode.empty())
+	{
+		out << "present mode: " << results.presentMode << ", frames in flight: " << results.framesInFlight << std::endl;
+	}
+	if (results.objects > 0)
+	{
+		out << "objects: " << results.objects << ", visible: " << results.visibleObjects << ", draw calls: " << results.drawCalls << std::endl;
+		out << "binds: pipeline " << results.pipelineBinds << ", descriptor set " << results.descriptorBinds << ", index buffer " << results.meshBinds << std::endl;
+		out << "textures: " << results.textures << " for " << results.materials << " materials in one bindless set" << std::endl;
+		double share = results.fullTriangles > 0 ? 100.0 * double(results.triangles) / double(results.fullTriangles) : 100.0;
+		out << "triangles: " << results.triangles << " drawn, " << results.fullTriangles << " at full detail (" << share << "%)" << std::endl;
+	}
+	print_stats(out, "cpu frame:", cpu);
+	if (!results.recordMs.empty())
+	{
+		print_stats(out, "cpu record:", compute_stats(results.recordMs));
+	}
+	if (!results.cullMs.empty())
+	{
+		print_stats(out, "cpu cull:", compute_stats(results.cullMs));
+	}
+	if (!results.blockedMs.empty())
+	{
+		print_stats(out, "cpu blocked:", compute_stats(results.blockedMs));
+	}
+	if (!results.descriptorMs.empty())
+	{
+		SampleStats descriptors = compute_stats(results.descriptorMs);
+		out << "descriptor sets: " << results.descriptorSets << " per frame from " << results.descriptorPools << " pools";
+		if (descriptors.mean > 0.0)
+		{
+			out << ", " << std::setprecision(0) << results.descriptorSets / descriptors.mean << " sets per ms";
+		}
+		out << std::endl;
+		print_stats(out, "cpu descriptors:", descriptors);
+	}
+
+	if (!results.gpuFrameMs.empty())
+	{
+		print_stats(out, "gpu frame:", compute_stats(results.gpuFrameMs));
+		print_stats(out, "input latency:", compute_stats(results.inputLatencyMs));
+	}
+	else
+	{
+		out << "gpu frame: timestamps not supported on this queue" << std::endl;
+	}
+
+	if (cpu.mean > 0.0)
+	{
+		out << "average fps: " << std::setprecision(1) << 1000.0 / cpu.mean << std::endl;
+	}
+
+	if (results.hasChecksum)
+	{
+		out << "image checksum: " << std::hex << std::setw(16) << std::setfill('0') << results.checksum
+			<< std::dec << std::setfill(' ') << std::endl;
+	}
+}
+
+bool vkbench::write_csv(const std::string& path, const BenchmarkResults& results)
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << "frame,cpu_ms,gpu_ms,record_ms,cull_ms,blocked_ms,input_latency_ms\n";
+	for (size_t i = 0; i < results.cpuFrameMs.size(); i++)
+	{
+		file << i << "," << results.cpuFrameMs[i] << ",";
+		if (i < results.gpuFrameMs.size())
+		{
+			file << results.gpuFrameMs[i];
+		}
+		file << ",";
+		if (i < results.recordMs.size())
+		{
+			file << results.recordMs[i];
+		}
+		file << ",";
+		if (i < results.cullMs.size())
+		{
+			file << results.cullMs[i];
+		}
+		file << ",";
+		if (i < results.blockedMs.size())
+		{
+			file << results.blockedMs[i];
+		}
+		file << ",";
+		if (i < results.inputLatencyMs.size())
+		{
+			file << results.inputLatencyMs[i];
+		}
+		file << "\n";
+	}
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace vkbench
+{
+	struct BenchmarkConfig {
+		uint32_t frames = 500;       // measured frames
+		uint32_t warmupFrames = 30;  // frames rendered before measuring starts
+		bool checksum = false;       // hash the final offscreen image
+		std::string csvPath;         // optional per-frame csv output
+	};
+
+	struct SampleStats {
+		double min = 0.0;
+		double max = 0.0;
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p90 = 0.0;
+		double p99 = 0.0;
+	};
+
+	struct BenchmarkResults {
+		std::vector<double> cpuFrameMs; // wall time of each draw() call
+		std::vector<double> gpuFrameMs; // timestamp delta around each frame's command buffer, empty if unsupported
+		std::vector<double> recordMs;   // object data upload + draw recording inside each frame
+		std::vector<double> cullMs;     // cpu frustum culling, part of recordMs
+		std::vector<double> blockedMs;  // frame fence wait, swapchain acquire and present inside each draw()
+		std::vector<double> descriptorMs; // allocating and writing the frame's descriptor sets
+		std::vector<double> inputLatencyMs; // input sampled to the frame finished on the gpu, needs gpuFrameMs
+		std::string presentMode;        // "offscreen" when headless
+		uint32_t framesInFlight = 0;
+		uint32_t objects = 0;           // renderables, visible ones and draw calls of the last frame
+		uint32_t visibleObjects = 0;
+		uint32_t drawCalls = 0;
+		uint32_t pipelineBinds = 0;
+		uint32_t descriptorBinds = 0;
+		uint32_t meshBinds = 0;
+		uint32_t descriptorSets = 0;    // per frame, and the pools all frame allocators hold together
+		uint32_t descriptorPools = 0;
+		uint32_t textures = 0;          // in the bindless texture table, and the materials indexing it
+		uint32_t materials = 0;
+		uint64_t triangles = 0;         // drawn at the selected levels of detail, and what full detail would have drawn
+		uint64_t fullTriangles = 0;
+		uint64_t checksum = 0;
+		bool hasChecksum = false;
+	};
+
+	/// @brief Compute min/max/mean and nearest-rank percentiles of a sample set.
+	SampleStats compute_stats(std::vector<double> samples);
+
+	/// @brief Peak resident set size of the process in bytes, 0 if the platform can't tell.
+	size_t peak_rss_bytes();
+
+	/// @brief Reset the peak resident set size so the next peak_rss_bytes() covers only what follows.
+	/// @return false where the OS has no way to reset it (the peak then stays process wide).
+	bool reset_peak_rss();
+
+	/// @brief Milliseconds elapsed since start.
+	double elapsed_ms(std::chrono::steady_clock::time_point start);
+
+	void print_stats(std::ostream& out, const char* label, const SampleStats& stats);
+	void print_results(std::ostream& out, const BenchmarkResults& results);
+	bool write_csv(const std::string& path, const BenchmarkResults& results);
+}
@@ -0,0 +1,226 @@
+#include <vk_culling.h>
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULLING_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// AVX is compiled per function so the rest of the engine keeps the baseline instruction set,
+// best_culling_path() only picks it when the cpu and os support it
+#if defined(CULLING_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CULLING_TARGET_AVX __attribute__((target("avx")))
+#else
+#define CULLING_TARGET_AVX
+#endif
+
+namespace {
+
+	// padding spheres sit at the origin with a huge negative radius, so they fail every plane
+	const float NEVER_VISIBLE_RADIUS = -1e30f;
+
+	uint32_t cull_scalar(const Frustum& frustum, const CullingData& data, uint32_t first, uint32_t last, uint32_t* visible)
+	{
+		uint32_t visibleCount = 0;
+		for (uint32_t i = first; i < std::min(last, data.count); i++)
+		{
+			bool inside = true;
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				float distance = plane.x * data.centerX[i] + plane.y * data.centerY[i] + plane.z * data.centerZ[i] + plane.w;
+				inside = inside && distance >= -data.radius[i];
+			}
+			visible[visibleCount] = i;
+			visibleCount += inside ? 1 : 0;
+		}
+		return visibleCount;
+	}
+
+#ifdef CULLING_X86
+	uint32_t cull_sse(const Frustum& frustum, const CullingData& data, uint32_t first, uint32_t last, uint32_t* visible)
+	{
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		uint32_t visibleCount = 0;
+		for (uint32_t i = first; i < last; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&data.centerX[i]);
+			__m128 y = _mm_loadu_ps(&data.centerY[i]);
+			__m128 z = _mm_loadu_ps(&data.centerZ[i]);
+			__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&data.radius[i]));
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+					_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+			}
+
+			// branchless compaction: every lane writes its index, only visible lanes advance the cursor
+			int mask = _mm_movemask_ps(inside);
+			for (uint32_t lane = 0; lane < 4; lane++)
+			{
+				visible[visibleCount] = i + lane;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+		return visibleCount;
+	}
+
+	CULLING_TARGET_AVX
+	uint32_t cull_avx(const Frustum& frustum, const CullingData& data, uint32_t first, uint32_t last, uint32_t* visible)
+	{
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+		uint32_t visibleCount = 0;
+		for (uint32_t i = first; i < last; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&data.centerX[i]);
+			__m256 y = _mm256_loadu_ps(&data.centerY[i]);
+			__m256 z = _mm256_loadu_ps(&data.centerZ[i]);
+			__m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&data.radius[i]));
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+					_mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+			}
+
+			int mask = _mm256_movemask_ps(inside);
+			for (uint32_t lane = 0; lane < 8; lane++)
+			{
+				visible[visibleCount] = i + lane;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+		return visibleCount;
+	}
+
+	bool cpu_has_avx()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		// the os has to save the ymm registers on context switches
+		return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx");
+#endif
+	}
+#endif
+}
+
+Frustum frustum_from_matrix(const glm::mat4& viewProjection)
+{
+	// Gribb/Hartmann: the clip space inequalities -w <= x <= w, -w <= y <= w and 0 <= z <= w
+	// become planes built from the rows of the matrix
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	for (glm::vec4& plane : frustum.planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+void CullingData::resize(uint32_t objectCount)
+{
+	uint32_t padded = (objectCount + CULLING_LANES - 1) / CULLING_LANES * CULLING_LANES;
+	count = objectCount;
+
+	centerX.assign(padded, 0.f);
+	centerY.assign(padded, 0.f);
+	centerZ.assign(padded, 0.f);
+	radius.assign(padded, NEVER_VISIBLE_RADIUS);
+}
+
+void CullingData::set(uint32_t index, const glm::mat4& transform, const glm::vec3& center, float sphereRadius)
+{
+	glm::vec4 worldCenter = transform * glm::vec4(center, 1.f);
+	float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	centerX[index] = worldCenter.x;
+	centerY[index] = worldCenter.y;
+	centerZ[index] = worldCenter.z;
+	radius[index] = sphereRadius * scale;
+}
+
+CullingPath best_culling_path()
+{
+#ifdef CULLING_X86
+	static const bool hasAvx = cpu_has_avx();
+	return hasAvx ? CullingPath::AVX : CullingPath::SSE;
+#else
+	return CullingPath::Scalar;
+#endif
+}
+
+const char* culling_path_name(CullingPath path)
+{
+	switch (path)
+	{
+	case CullingPath::SSE: return "sse";
+	case CullingPath::AVX: return "avx";
+	default: return "scalar";
+	}
+}
+
+uint32_t cull_spheres(const Frustum& frustum, const CullingData& data, uint32_t* visible, CullingPath path)
+{
+	return cull_spheres(frustum, data, 0, data.padded_count(), visible, path);
+}
+
+uint32_t cull_spheres(const Frustum& frustum, const CullingData& data, uint32_t first, uint32_t last, uint32_t* visible, CullingPath path)
+{
+#ifdef CULLING_X86
+	if (path == CullingPath::AVX)
+	{
+		return cull_avx(frustum, data, first, last, visible);
+	}
+	if (path == CullingPath::SSE)
+	{
+		return cull_sse(frustum, data, first, last, visible);
+	}
+#endif
+	return cull_scalar(frustum, data, first, last, visible);
+}
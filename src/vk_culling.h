@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// view frustum as 6 planes (left, right, bottom, top, near, far), xyz is the inward facing unit
+// normal and w the distance, so a point p is inside a plane when dot(xyz, p) + w >= 0
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+/// @brief Extract the world space frustum planes of a Vulkan style (0..1 depth) view projection matrix.
+Frustum frustum_from_matrix(const glm::mat4& viewProjection);
+
+// world space bounding spheres stored as one array per component, so the frustum test runs on
+// 4 (SSE) or 8 (AVX) objects at once. Padded to a multiple of CULLING_LANES with spheres that
+// are never visible, so the vector loops need no scalar tail
+const uint32_t CULLING_LANES = 8;
+
+struct CullingData {
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	uint32_t count = 0;
+
+	void resize(uint32_t objectCount);
+
+	// sphere of a mesh (in mesh space) placed with transform, non-uniform scale grows it to the largest axis
+	void set(uint32_t index, const glm::mat4& transform, const glm::vec3& center, float sphereRadius);
+
+	uint32_t padded_count() const { return static_cast<uint32_t>(centerX.size()); }
+};
+
+enum class CullingPath {
+	Scalar,
+	SSE,
+	AVX,
+};
+
+/// @brief Fastest path the cpu running this supports.
+CullingPath best_culling_path();
+
+const char* culling_path_name(CullingPath path);
+
+/// @brief Test every sphere against the frustum and write the indices of the visible ones, in order.
+/// @param visible room for data.padded_count() indices, the vector paths write past the visible count
+/// @return number of visible objects
+uint32_t cull_spheres(const Frustum& frustum, const CullingData& data, uint32_t* visible, CullingPath path = best_culling_path());
+
+/// @brief Same for the spheres [first, last) only, so ranges can be culled on different threads.
+/// first and last have to be multiples of CULLING_LANES (last may be padded_count()), the written indices are absolute.
+/// @param visible room for last - first indices
+uint32_t cull_spheres(const Frustum& frustum, const CullingData& data, uint32_t first, uint32_t last, uint32_t* visible, CullingPath path = best_culling_path());
@@ -0,0 +1,68 @@
+#include <vk_deletion_queue.h>
+
+void DeletionQueue::flush(VkDevice device, VmaAllocator allocator)
+{
+	// later objects may depend on earlier ones (views on images, framebuffers on views), so newest first
+	for (auto it = _deletions.rbegin(); it != _deletions.rend(); ++it)
+	{
+		const Deletion& d = *it;
+		switch (d.type)
+		{
+		case DeletionType::Callback:
+			d.callback(d.handle, d.argument);
+			break;
+		case DeletionType::Buffer:
+			vmaDestroyBuffer(allocator, static_cast<VkBuffer>(d.handle), d.allocation);
+			break;
+		case DeletionType::MappedBuffer:
+			vmaUnmapMemory(allocator, d.allocation);
+			vmaDestroyBuffer(allocator, static_cast<VkBuffer>(d.handle), d.allocation);
+			break;
+		case DeletionType::Image:
+			vmaDestroyImage(allocator, static_cast<VkImage>(d.handle), d.allocation);
+			break;
+		case DeletionType::ImageView:
+			vkDestroyImageView(device, static_cast<VkImageView>(d.handle), nullptr);
+			break;
+		case DeletionType::Sampler:
+			vkDestroySampler(device, static_cast<VkSampler>(d.handle), nullptr);
+			break;
+		case DeletionType::Pipeline:
+			vkDestroyPipeline(device, static_cast<VkPipeline>(d.handle), nullptr);
+			break;
+		case DeletionType::PipelineLayout:
+			vkDestroyPipelineLayout(device, static_cast<VkPipelineLayout>(d.handle), nullptr);
+			break;
+		case DeletionType::DescriptorSetLayout:
+			vkDestroyDescriptorSetLayout(device, static_cast<VkDescriptorSetLayout>(d.handle), nullptr);
+			break;
+		case DeletionType::DescriptorPool:
+			vkDestroyDescriptorPool(device, static_cast<VkDescriptorPool>(d.handle), nullptr);
+			break;
+		case DeletionType::CommandPool:
+			vkDestroyCommandPool(device, static_cast<VkCommandPool>(d.handle), nullptr);
+			break;
+		case DeletionType::RenderPass:
+			vkDestroyRenderPass(device, static_cast<VkRenderPass>(d.handle), nullptr);
+			break;
+		case DeletionType::Framebuffer:
+			vkDestroyFramebuffer(device, static_cast<VkFramebuffer>(d.handle), nullptr);
+			break;
+		case DeletionType::Fence:
+			vkDestroyFence(device, static_cast<VkFence>(d.handle), nullptr);
+			break;
+		case DeletionType::Semaphore:
+			vkDestroySemaphore(device, static_cast<VkSemaphore>(d.handle), nullptr);
+			break;
+		case DeletionType::Swapchain:
+			vkDestroySwapchainKHR(device, static_cast<VkSwapchainKHR>(d.handle), nullptr);
+			break;
+		case DeletionType::DescriptorUpdateTemplate:
+			vkDestroyDescriptorUpdateTemplate(device, static_cast<VkDescriptorUpdateTemplate>(d.handle), nullptr);
+			break;
+		}
+	}
+
+	// keeps the capacity, a queue that's flushed every frame stops allocating after the first few
+	_deletions.clear();
+}
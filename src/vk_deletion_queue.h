@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <cstdint>
+#include <vector>
+
+// the push() overloads tell handles apart by type, which only works where non-dispatchable handles are
+// distinct pointer types rather than all being uint64_t
+static_assert(sizeof(void*) == 8, "DeletionQueue needs 64 bit handles");
+
+enum class DeletionType : uint32_t {
+	Callback,
+	Buffer,
+	MappedBuffer, // unmapped before it's destroyed
+	Image,
+	ImageView,
+	Sampler,
+	Pipeline,
+	PipelineLayout,
+	DescriptorSetLayout,
+	DescriptorPool,
+	CommandPool,
+	RenderPass,
+	Framebuffer,
+	Fence,
+	Semaphore,
+	Swapchain,
+	DescriptorUpdateTemplate,
+};
+
+struct Deletion {
+	DeletionType type;
+	void* handle; // the Vulkan handle, or the callback's context
+	union {
+		VmaAllocation allocation;
+		uint64_t argument; // the callback's
+	};
+	void (*callback)(void* context, uint64_t argument);
+};
+
+// Vulkan objects waiting to be destroyed, stored as type tag + handle (+ allocation) in one flat array and
+// destroyed newest first. Pushing never allocates once the array has grown to its working size, flush()
+// keeps the capacity. Subsystems with a cleanup of their own go in as a function pointer + context
+class DeletionQueue {
+public:
+	void reserve(size_t count) { _deletions.reserve(count); }
+	size_t size() const { return _deletions.size(); }
+
+	void push(const AllocatedBuffer& buffer) { add(DeletionType::Buffer, buffer._buffer, buffer._allocation); }
+	void push_mapped(const AllocatedBuffer& buffer) { add(DeletionType::MappedBuffer, buffer._buffer, buffer._allocation); }
+	void push(const AllocatedImage& image) { add(DeletionType::Image, image._image, image._allocation); }
+	void push(VkImageView view) { add(DeletionType::ImageView, view); }
+	void push(VkSampler sampler) { add(DeletionType::Sampler, sampler); }
+	void push(VkPipeline pipeline) { add(DeletionType::Pipeline, pipeline); }
+	void push(VkPipelineLayout layout) { add(DeletionType::PipelineLayout, layout); }
+	void push(VkDescriptorSetLayout layout) { add(DeletionType::DescriptorSetLayout, layout); }
+	void push(VkDescriptorPool pool) { add(DeletionType::DescriptorPool, pool); }
+	void push(VkCommandPool pool) { add(DeletionType::CommandPool, pool); }
+	void push(VkRenderPass pass) { add(DeletionType::RenderPass, pass); }
+	void push(VkFramebuffer framebuffer) { add(DeletionType::Framebuffer, framebuffer); }
+	void push(VkFence fence) { add(DeletionType::Fence, fence); }
+	void push(VkSemaphore semaphore) { add(DeletionType::Semaphore, semaphore); }
+	void push(VkSwapchainKHR swapchain) { add(DeletionType::Swapchain, swapchain); }
+	void push(VkDescriptorUpdateTemplate updateTemplate) { add(DeletionType::DescriptorUpdateTemplate, updateTemplate); }
+
+	/// @brief Call callback(context, argument) when the queue is flushed, for objects that clean up after themselves.
+	void push(void (*callback)(void* context, uint64_t argument), void* context, uint64_t argument = 0)
+	{
+		Deletion deletion{ DeletionType::Callback, context, {}, callback };
+		deletion.argument = argument;
+		_deletions.push_back(deletion);
+	}
+
+	/// @brief Call object->Method() when the queue is flushed.
+	template <typename T, void (T::*Method)()>
+	void push_call(T* object)
+	{
+		push([](void* context, uint64_t) { (static_cast<T*>(context)->*Method)(); }, object);
+	}
+
+	/// @brief Call object->Method(argument) when the queue is flushed, e.g. to hand back a slot by index.
+	template <typename T, void (T::*Method)(uint32_t)>
+	void push_call(T* object, uint32_t argument)
+	{
+		push([](void* context, uint64_t value) { (static_cast<T*>(context)->*Method)(static_cast<uint32_t>(value)); }, object, argument);
+	}
+
+	/// @brief Move everything in other to the end of this queue, other keeps its capacity.
+	void take(DeletionQueue& other)
+	{
+		_deletions.insert(_deletions.end(), other._deletions.begin(), other._deletions.end());
+		other._deletions.clear();
+	}
+
+	/// @brief Destroy everything, newest first.
+	void flush(VkDevice device, VmaAllocator allocator);
+
+private:
+	template <typename Handle>
+	void add(DeletionType type, Handle handle, VmaAllocation allocation = VK_NULL_HANDLE)
+	{
+		_deletions.push_back(Deletion{ type, reinterpret_cast<void*>(handle), { allocation }, nullptr });
+	}
+
+	std::vector<Deletion> _deletions;
+};
@@ -0,0 +1,311 @@
+#include <vk_descriptors.h>
+#include <vk_hash.h>
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+void DescriptorAllocator::init(VkDevice device, uint32_t setsPerPool, const std::vector<DescriptorPoolRatio>& ratios,
+	VkDescriptorPoolCreateFlags poolFlags)
+{
+	_device = device;
+	_ratios = ratios;
+	_poolFlags = poolFlags;
+	_setsPerPool = std::max(1u, std::min(setsPerPool, MAX_SETS_PER_POOL));
+}
+
+void DescriptorAllocator::cleanup()
+{
+	for (VkDescriptorPool pool : _readyPools)
+	{
+		vkDestroyDescriptorPool(_device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : _fullPools)
+	{
+		vkDestroyDescriptorPool(_device, pool, nullptr);
+	}
+	if (_current != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(_device, _current, nullptr);
+	}
+	_readyPools.clear();
+	_fullPools.clear();
+	_current = VK_NULL_HANDLE;
+	_stats.pools = 0;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	if (_current == VK_NULL_HANDLE)
+	{
+		_current = next_pool();
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = _current;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	VkResult result = vkAllocateDescriptorSets(_device, &allocInfo, &set);
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		// this pool is done until the next reset, a fresh one always has room for a single set
+		_fullPools.push_back(_current);
+		_current = next_pool();
+		allocInfo.descriptorPool = _current;
+		result = vkAllocateDescriptorSets(_device, &allocInfo, &set);
+		_stats.exhausted++;
+	}
+	VK_CHECK(result);
+
+	_stats.sets++;
+	_stats.totalSets++;
+	return set;
+}
+
+void DescriptorAllocator::reset()
+{
+	if (_current != VK_NULL_HANDLE)
+	{
+		_fullPools.push_back(_current);
+		_current = VK_NULL_HANDLE;
+	}
+	for (VkDescriptorPool pool : _fullPools)
+	{
+		VK_CHECK(vkResetDescriptorPool(_device, pool, 0));
+		_readyPools.push_back(pool);
+	}
+	_fullPools.clear();
+	_stats.sets = 0;
+}
+
+VkDescriptorPool DescriptorAllocator::next_pool()
+{
+	if (!_readyPools.empty())
+	{
+		VkDescriptorPool pool = _readyPools.back();
+		_readyPools.pop_back();
+		return pool;
+	}
+
+	// every pool the chain needs past the first means the working set is bigger than guessed, so the
+	// next one gets more room and a steady frame settles on a handful of pools
+	VkDescriptorPool pool = create_pool(_setsPerPool);
+	_setsPerPool = std::min(_setsPerPool + _setsPerPool / 2, MAX_SETS_PER_POOL);
+	return pool;
+}
+
+VkDescriptorPool DescriptorAllocator::create_pool(uint32_t sets)
+{
+	std::vector<VkDescriptorPoolSize> sizes;
+	sizes.reserve(_ratios.size());
+	for (const DescriptorPoolRatio& ratio : _ratios)
+	{
+		sizes.push_back(VkDescriptorPoolSize{ ratio.type, std::max(1u, static_cast<uint32_t>(ratio.perSet * sets)) });
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = _poolFlags;
+	poolInfo.maxSets = sets;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(sizes.size());
+	poolInfo.pPoolSizes = sizes.data();
+
+	VkDescriptorPool pool;
+	VK_CHECK(vkCreateDescriptorPool(_device, &poolInfo, nullptr, &pool));
+	_stats.pools++;
+	_stats.poolsCreated++;
+	return pool;
+}
+
+void DescriptorLayoutCache::cleanup()
+{
+	for (const Layout& layout : _layouts)
+	{
+		vkDestroyDescriptorSetLayout(_device, layout.layout, nullptr);
+	}
+	_layouts.clear();
+	_lookup.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::create_layout(const VkDescriptorSetLayoutCreateInfo& info)
+{
+	// binding flags are the only pNext the key looks at, they're given in the order of pBindings
+	const VkDescriptorBindingFlags* bindingFlags = nullptr;
+	for (auto next = static_cast<const VkBaseInStructure*>(info.pNext); next != nullptr; next = next->pNext)
+	{
+		if (next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO)
+		{
+			bindingFlags = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo*>(next)->pBindingFlags;
+		}
+	}
+
+	std::vector<uint32_t> order(info.bindingCount);
+	std::iota(order.begin(), order.end(), 0u);
+	std::sort(order.begin(), order.end(),
+		[&](uint32_t a, uint32_t b) { return info.pBindings[a].binding < info.pBindings[b].binding; });
+
+	Layout key;
+	key.flags = info.flags;
+	key.bindings.reserve(order.size());
+	key.bindingFlags.reserve(order.size());
+	for (uint32_t i : order)
+	{
+		key.bindings.push_back(info.pBindings[i]);
+		key.bindingFlags.push_back(bindingFlags != nullptr ? bindingFlags[i] : 0);
+	}
+
+	// hashed field by field, the struct has padding
+	std::vector<uint64_t> words;
+	words.reserve(key.bindings.size() * 6 + 1);
+	words.push_back(key.flags);
+	for (size_t i = 0; i < key.bindings.size(); i++)
+	{
+		const VkDescriptorSetLayoutBinding& binding = key.bindings[i];
+		words.push_back(binding.binding);
+		words.push_back(binding.descriptorType);
+		words.push_back(binding.descriptorCount);
+		words.push_back(binding.stageFlags);
+		words.push_back(reinterpret_cast<uintptr_t>(binding.pImmutableSamplers));
+		words.push_back(key.bindingFlags[i]);
+	}
+	uint64_t hash = vkutil::fnv1a(words.data(), words.size() * sizeof(uint64_t));
+
+	auto same = [&](const Layout& layout) {
+		if (layout.flags != key.flags || layout.bindings.size() != key.bindings.size() || layout.bindingFlags != key.bindingFlags)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < key.bindings.size(); i++)
+		{
+			const VkDescriptorSetLayoutBinding& a = layout.bindings[i];
+			const VkDescriptorSetLayoutBinding& b = key.bindings[i];
+			if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount
+				|| a.stageFlags != b.stageFlags || a.pImmutableSamplers != b.pImmutableSamplers)
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	auto range = _lookup.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (same(_layouts[it->second]))
+		{
+			return _layouts[it->second].layout;
+		}
+	}
+
+	VK_CHECK(vkCreateDescriptorSetLayout(_device, &info, nullptr, &key.layout));
+	_lookup.emplace(hash, static_cast<uint32_t>(_layouts.size()));
+	_layouts.push_back(std::move(key));
+	return _layouts.back().layout;
+}
+
+void TextureTable::init(VkDevice device, DescriptorLayoutCache& layoutCache)
+{
+	_device = device;
+
+	// partially bound: slots nothing indexes may stay unwritten or hold views that were destroyed since.
+	// Unused while pending on top of update after bind lets add() write a slot while earlier frames run
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = MAX_TEXTURES;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+		| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+	flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flagsInfo.bindingCount = 1;
+	flagsInfo.pBindingFlags = &flags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &flagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+	_layout = layoutCache.create_layout(layoutInfo);
+
+	// the one set this table ever has
+	_allocator.init(device, 1, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<float>(MAX_TEXTURES) } },
+		VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+	_set = _allocator.allocate(_layout);
+}
+
+void TextureTable::cleanup()
+{
+	_allocator.cleanup();
+	_set = VK_NULL_HANDLE;
+	_next = 0;
+	_free.clear();
+}
+
+uint32_t TextureTable::add(VkImageView view, VkSampler sampler)
+{
+	uint32_t slot;
+	if (!_free.empty())
+	{
+		slot = _free.back();
+		_free.pop_back();
+	}
+	else if (_next < MAX_TEXTURES)
+	{
+		slot = _next++;
+	}
+	else
+	{
+		std::cout << "texture table full, " << MAX_TEXTURES << " textures" << std::endl;
+		return 0;
+	}
+
+	VkDescriptorImageInfo imageInfo{ sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = _set;
+	write.dstBinding = 0;
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+	return slot;
+}
+
+void TextureTable::release(uint32_t slot)
+{
+	_free.push_back(slot);
+}
+
+VkDescriptorUpdateTemplateEntry descriptor_template_entry(uint32_t binding, VkDescriptorType type, size_t offset)
+{
+	VkDescriptorUpdateTemplateEntry entry{};
+	entry.dstBinding = binding;
+	entry.dstArrayElement = 0;
+	entry.descriptorCount = 1;
+	entry.descriptorType = type;
+	entry.offset = offset;
+	entry.stride = 0; // one descriptor, the stride is never used
+	return entry;
+}
+
+VkDescriptorUpdateTemplate create_descriptor_template(VkDevice device, VkDescriptorSetLayout layout,
+	const std::vector<VkDescriptorUpdateTemplateEntry>& entries)
+{
+	VkDescriptorUpdateTemplateCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	info.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+	info.pDescriptorUpdateEntries = entries.data();
+	info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	info.descriptorSetLayout = layout;
+
+	VkDescriptorUpdateTemplate updateTemplate;
+	VK_CHECK(vkCreateDescriptorUpdateTemplate(device, &info, nullptr, &updateTemplate));
+	return updateTemplate;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// descriptors of a type a pool gets per set it's sized for
+struct DescriptorPoolRatio {
+	VkDescriptorType type;
+	float perSet;
+};
+
+struct DescriptorAllocatorStats {
+	uint32_t pools = 0;        // alive right now
+	uint32_t poolsCreated = 0; // over the allocator's lifetime
+	uint64_t sets = 0;         // allocated since the last reset
+	uint64_t totalSets = 0;
+	uint32_t exhausted = 0;    // allocations that ran a pool out and moved on to the next one
+};
+
+// Descriptor sets out of a chain of pools. Allocation goes to the current pool and moves on to the next
+// one when that runs out, creating it if needed, each new pool bigger than the last. Sets are never freed
+// one by one: reset() recycles every pool at once, which suits sets that live for one frame. Not thread safe,
+// each thread (or frame slot) owns its own allocator
+class DescriptorAllocator {
+public:
+	/// @param setsPerPool size of the first pool, later ones grow by half up to MAX_SETS_PER_POOL
+	/// @param poolFlags create flags of every pool, e.g. for sets of update after bind layouts
+	void init(VkDevice device, uint32_t setsPerPool, const std::vector<DescriptorPoolRatio>& ratios,
+		VkDescriptorPoolCreateFlags poolFlags = 0);
+	void cleanup();
+
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+	/// @brief Reset every pool, all sets allocated from them become invalid. Pools are kept for reuse.
+	void reset();
+
+	const DescriptorAllocatorStats& stats() const { return _stats; }
+
+	static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+private:
+	VkDescriptorPool next_pool();
+	VkDescriptorPool create_pool(uint32_t sets);
+
+	VkDevice _device = VK_NULL_HANDLE;
+	std::vector<DescriptorPoolRatio> _ratios;
+	VkDescriptorPoolCreateFlags _poolFlags = 0;
+	uint32_t _setsPerPool = 0; // size of the next pool created
+	std::vector<VkDescriptorPool> _readyPools; // empty, or with room left
+	std::vector<VkDescriptorPool> _fullPools;
+	VkDescriptorPool _current = VK_NULL_HANDLE;
+	DescriptorAllocatorStats _stats;
+};
+
+// Set layouts by their bindings: asking twice for the same bindings returns the same layout, so pipeline
+// layouts built from it stay compatible. Binding order doesn't matter. Binding flags chained in with a
+// VkDescriptorSetLayoutBindingFlagsCreateInfo are part of the key, anything else in pNext isn't. The cache
+// owns the layouts
+class DescriptorLayoutCache {
+public:
+	void init(VkDevice device) { _device = device; }
+	void cleanup();
+
+	VkDescriptorSetLayout create_layout(const VkDescriptorSetLayoutCreateInfo& info);
+
+	uint32_t layout_count() const { return static_cast<uint32_t>(_layouts.size()); }
+
+private:
+	struct Layout {
+		VkDescriptorSetLayoutCreateFlags flags;
+		std::vector<VkDescriptorSetLayoutBinding> bindings; // sorted by binding
+		std::vector<VkDescriptorBindingFlags> bindingFlags; // of bindings, 0 without binding flags
+		VkDescriptorSetLayout layout;
+	};
+
+	VkDevice _device = VK_NULL_HANDLE;
+	std::vector<Layout> _layouts;
+	std::unordered_multimap<uint64_t, uint32_t> _lookup; // binding hash -> _layouts
+};
+
+// Every texture the shaders sample, in one partially bound array of combined image samplers. The set is
+// allocated once, bound once per frame and indexed through the material table, so adding a texture never
+// adds a set or a bind. Slots are written when a texture becomes resident; the binding is update after bind,
+// so that works while frames in flight have the set bound, as long as they don't sample the slot written.
+// A replaced texture's slot is still read by those frames, release() it through a frame deletion queue
+class TextureTable {
+public:
+	void init(VkDevice device, DescriptorLayoutCache& layoutCache);
+	void cleanup();
+
+	/// @brief Write view + sampler into a free slot.
+	/// @return the slot the shaders index, 0 (the first texture added) once every slot is taken
+	uint32_t add(VkImageView view, VkSampler sampler);
+
+	/// @brief Hand a slot back, its descriptor is left as is until add() reuses it.
+	void release(uint32_t slot);
+
+	VkDescriptorSetLayout layout() const { return _layout; }
+	VkDescriptorSet set() const { return _set; }
+	uint32_t count() const { return _next - static_cast<uint32_t>(_free.size()); }
+
+	// the array size in the layout and shaders, unwritten slots cost nothing but descriptor memory
+	static constexpr uint32_t MAX_TEXTURES = 4096;
+
+private:
+	VkDevice _device = VK_NULL_HANDLE;
+	DescriptorAllocator _allocator;
+	VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+	VkDescriptorSet _set = VK_NULL_HANDLE;
+	uint32_t _next = 0; // slots below it were handed out at least once
+	std::vector<uint32_t> _free;
+};
+
+/// @brief Update template entry for one descriptor at offset in the caller's struct.
+/// Image descriptors read a VkDescriptorImageInfo there, buffers a VkDescriptorBufferInfo.
+VkDescriptorUpdateTemplateEntry descriptor_template_entry(uint32_t binding, VkDescriptorType type, size_t offset);
+
+/// @brief Template writing a whole set of layout in one vkUpdateDescriptorSetWithTemplate from one struct.
+VkDescriptorUpdateTemplate create_descriptor_template(VkDevice device, VkDescriptorSetLayout layout,
+	const std::vector<VkDescriptorUpdateTemplateEntry>& entries);
@@ -9,6 +9,9 @@
 
 #include <vk_types.h>
 #include <vk_initializers.h>
+#include <vk_mesh_cache.h>
+#include <vk_texture_cache.h>
+#include <vk_hash.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -22,53 +25,100 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
 
-// we want to immediately abort when there is an error. In normal engines this would give an error message to the user, or perform a dump of state.
-#define VK_CHECK(x)                                                     \
-	do                                                                  \
-	{                                                                   \
-		VkResult err = x;                                               \
-		if (err != VK_SUCCESS)                                          \
-		{                                                               \
-			std::cout << "Detected Vulkan error: " << err << std::endl; \
-			abort();                                                    \
-		}                                                               \
-	} while (0)
-
-#define ASSETS_PREFIX(x) (std::string("/Users/michaelmason/Desktop/vulkan-guide/assets/") + x).c_str()
-#define SHADER_PREFIX(x) (std::string("/Users/michaelmason/Desktop/vulkan-guide/shaders/") + x).c_str()
+// build targets can point the engine at their own checkout, otherwise fall back to the original location
+#ifndef VKGUIDE_ROOT
+#define VKGUIDE_ROOT "/Users/michaelmason/Desktop/vulkan-guide"
+#endif
+
+#define ASSETS_PREFIX(x) (std::string(VKGUIDE_ROOT "/assets/") + x).c_str()
+#define SHADER_PREFIX(x) (std::string(VKGUIDE_ROOT "/shaders/") + x).c_str()
+
+// tri_mesh.vert doesn't read vertex colors, so meshes are packed without them
+const uint32_t MESH_VERTEX_ATTRIBUTES = 0;
+
+// fewer draw batches than this per thread aren't worth a secondary command buffer
+const uint32_t MIN_BATCHES_PER_RECORD_THREAD = 64;
+const uint32_t MAX_RECORD_THREADS = 8;
+
+// smallest range of objects a job gets in the per frame culling and object data loops
+const uint32_t PARALLEL_OBJECT_GRAIN = 4096;
+
+// persistently mapped staging memory every streamed upload goes through
+const VkDeviceSize STAGING_RING_BYTES = 32 * 1024 * 1024;
+
+// device local geometry buffer every mesh is sub-allocated from
+const VkDeviceSize GEOMETRY_VERTEX_BYTES = 64 * 1024 * 1024;
+const VkDeviceSize GEOMETRY_INDEX_BYTES = 32 * 1024 * 1024;
+
+// what the mesh set's update template reads, one member per binding
+struct MeshSetWrites {
+	VkDescriptorBufferInfo scene;
+	VkDescriptorBufferInfo materials;
+	VkDescriptorBufferInfo objects;
+	VkDescriptorBufferInfo instances;
+};
+
+// driver pipeline cache, validated against the device on load and rewritten on cleanup
+#define PIPELINE_CACHE_PATH (VKGUIDE_ROOT "/pipeline.vkcache")
 
 void VulkanEngine::init()
 {
-	// We initialize SDL and create a window with it.
-	SDL_Init(SDL_INIT_VIDEO);
+	_jobs = std::make_unique<JobSystem>(_jobThreads);
+	_max_frames_in_flight = std::clamp(_max_frames_in_flight, 1, MAX_FRAMES_IN_FLIGHT);
+	_trackballExtent = _windowExtent;
+	_offscreenExtent = _windowExtent;
+	_drawableExtent = _windowExtent;
+
+	// We initialize SDL and create a window with it. Headless mode has no window at all
+	if (!_headless)
+	{
+		SDL_Init(SDL_INIT_VIDEO);
 
-	SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+		SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
 
-	_window = SDL_CreateWindow(
-		"Vulkan Engine",
-		SDL_WINDOWPOS_UNDEFINED,
-		SDL_WINDOWPOS_UNDEFINED,
-		_windowExtent.width,
-		_windowExtent.height,
-		window_flags);
+		_window = SDL_CreateWindow(
+			"Vulkan Engine",
+			SDL_WINDOWPOS_UNDEFINED,
+			SDL_WINDOWPOS_UNDEFINED,
+			_windowExtent.width,
+			_windowExtent.height,
+			window_flags);
+	}
 
 	init_vulkan();	  // create instance and device
-	init_swapchain(); // create the swapchain
+	init_swapchain(); // create the swapchain (or the offscreen target when headless)
 	init_commands();  // create command pool and buffer
+	init_streaming(); // background asset loading on the transfer queue
 	init_default_renderpass();
 	init_framebuffers();
 	init_sync_structures();
+	init_profiler();
+	init_pipeline_cache();
+	init_descriptors();
 	init_pipelines();
-	init_texture_image();
-	init_texture_image_view(); 
+	init_cull_pipeline();
+	std::cout << "pipelines created in " << _pipelineCreateMs << " ms, "
+		<< (_pipelineCache.warm() ? "warm cache (" + std::to_string(_pipelineCache.loaded_bytes()) + " bytes)" : std::string("cold")) << std::endl;
 	init_texture_sampler(); 
+	init_texture_image();
 	init_uniform_buffers();
-	init_descriptor_pool();
-	init_descriptor_set();
+	init_descriptor_templates();
 	load_meshes();
+	init_scene_textures();
 	init_scene();
 
+	// the simulation's own copy, the renderer gets it through the frame snapshots
+	_sceneTransforms.reserve(_renderables.size());
+	for (const RenderObject &object : _renderables)
+	{
+		_sceneTransforms.push_back(object.transformMatrix);
+	}
+
 	// everything went fine
 	_isInitialized = true;
 }
@@ -78,16 +128,49 @@ void VulkanEngine::cleanup()
 	if (_isInitialized)
 	{
 		vkWaitForFences(_device, _max_frames_in_flight, _renderFences.data(), VK_TRUE, 1000000000);
-		_mainDeletionQueue.flush();
+
+		// the last frames' gpu zones only become readable now
+		for (uint32_t i = 0; i < static_cast<uint32_t>(_max_frames_in_flight); i++)
+		{
+			resolve_gpu_timestamps((_currentFrame + i) % _max_frames_in_flight);
+		}
+		if (!_tracePath.empty())
+		{
+			if (vkprof::write_chrome_trace(_tracePath))
+			{
+				std::cout << "wrote trace " << _tracePath << std::endl;
+			}
+			else
+			{
+				std::cout << "failed to write trace " << _tracePath << std::endl;
+			}
+		}
+
+		for (DeletionQueue &queue : _frameDeletionQueues)
+		{
+			queue.flush(_device, _allocator);
+		}
+		_pendingDeletions.flush(_device, _allocator);
+
+		// the swapchain sized objects are whatever the last recreation left, they go before the render pass
+		release_swapchain(_mainDeletionQueue);
+		_mainDeletionQueue.flush(_device, _allocator);
 
 		// destroy all objects from init_vulkan
 		vmaDestroyAllocator(_allocator);
 		vkDestroyDevice(_device, nullptr);
-		vkDestroySurfaceKHR(_instance, _surface, nullptr);
+		if (!_headless)
+		{
+			vkDestroySurfaceKHR(_instance, _surface, nullptr);
+		}
 		vkb::destroy_debug_utils_messenger(_instance, _debug_messenger);
 		vkDestroyInstance(_instance, nullptr);
-		SDL_DestroyWindow(_window);
+		if (!_headless)
+		{
+			SDL_DestroyWindow(_window);
+		}
 	}
+	_jobs.reset();
 }
 
 void VulkanEngine::init_scene()
@@ -96,7 +179,57 @@ void VulkanEngine::init_scene()
 	monkey.mesh = get_mesh("monkey");
 	monkey.material = get_material("defaultmesh");
 	monkey.transformMatrix = glm::mat4{1.0f};
-	_renderables.push_back(monkey);
+
+	uint32_t objectCount = std::min(_sceneObjects, _max_objects);
+	_cullDataDirty = true;
+	if (objectCount <= 1)
+	{
+		_renderables.push_back(monkey);
+		return;
+	}
+
+	// stress scene: a cube of alternating wahoos and suzannes around the origin, scaled to fit the grid cells.
+	// Interleaving them means insertion order alone would rebind the vertex buffers for every object.
+	// suzanne is still streaming at this point, so both are sized by the wahoo
+	Mesh *meshes[2] = {monkey.mesh, get_mesh("suzanne")};
+
+	// with generated textures every one gets a share of the objects, drawn through its own material
+	std::vector<Material *> materials = {monkey.material};
+	if (_sceneTextures > 1)
+	{
+		materials.clear();
+		for (uint32_t t = 0; t < _sceneTextures; t++)
+		{
+			materials.push_back(get_material("textured_" + std::to_string(t)));
+		}
+	}
+
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(objectCount))));
+	float spacing = 6.f / side;
+	float center = (side - 1) * 0.5f;
+	float diagonal = glm::length(monkey.mesh->_bounds.max - monkey.mesh->_bounds.min);
+	float scale = diagonal > 0.f ? spacing * 0.9f / diagonal : 1.f;
+
+	_renderables.reserve(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++)
+	{
+		monkey.mesh = meshes[i % 2];
+		monkey.material = materials[(i / 2) % materials.size()];
+		glm::vec3 cell{ float(i % side), float((i / side) % side), float(i / (side * side)) };
+		monkey.transformMatrix = glm::translate((cell - center) * spacing) * glm::scale(glm::vec3(scale));
+		_renderables.push_back(monkey);
+	}
+}
+
+void VulkanEngine::init_pipeline_cache()
+{
+	_pipelineCache.init(_device, _chosenGPU, _usePipelineCache ? PIPELINE_CACHE_PATH : "", _jobs->slot_count());
+
+	// runs after every pipeline is destroyed, the cache outlives them
+	_mainDeletionQueue.push_call<PipelineCache, &PipelineCache::cleanup>(&_pipelineCache);
+
+	_pipelines.init(_device, &_pipelineCache, _jobs.get());
+	_mainDeletionQueue.push_call<PipelineLibrary, &PipelineLibrary::cleanup>(&_pipelines);
 }
 
 void VulkanEngine::init_pipelines()
@@ -114,21 +247,13 @@ void VulkanEngine::init_pipelines()
 	pipelineBuilder._inputAssembly = vkinit::input_assembly_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 
 	pipelineBuilder._vertexInputInfo = vkinit::vertex_input_state_create_info();
-	VertexInputDescription vertexDescription = Vertex::getVertexDescription();
+	VertexInputDescription vertexDescription = Vertex::getVertexDescription(MESH_VERTEX_ATTRIBUTES);
 	pipelineBuilder._vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.attributes.data();
 	pipelineBuilder._vertexInputInfo.vertexAttributeDescriptionCount = vertexDescription.attributes.size();
 	pipelineBuilder._vertexInputInfo.pVertexBindingDescriptions = vertexDescription.bindings.data();
 	pipelineBuilder._vertexInputInfo.vertexBindingDescriptionCount = vertexDescription.bindings.size();
 
-	// build viewport and scissor from the swapchain extents
-	pipelineBuilder._viewport.x = 0.0f;
-	pipelineBuilder._viewport.y = 0.0f;
-	pipelineBuilder._viewport.width = (float)_windowExtent.width;
-	pipelineBuilder._viewport.height = (float)_windowExtent.height;
-	pipelineBuilder._viewport.minDepth = 0.0f;
-	pipelineBuilder._viewport.maxDepth = 1.0f;
-	pipelineBuilder._scissor.offset = {0, 0};
-	pipelineBuilder._scissor.extent = _windowExtent;
+	// viewport and scissor are dynamic state, set from the swapchain extent in record_batches()
 	pipelineBuilder._rasterizer = vkinit::rasterization_state_create_info(VK_POLYGON_MODE_FILL);
 
 	// we don't use multisampling, so just run the default one
@@ -150,29 +275,43 @@ void VulkanEngine::init_pipelines()
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;   // vertex shader input
 	uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
 
-	// create a layout binding for sampler
-	VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-	samplerLayoutBinding.binding = 1;
-	samplerLayoutBinding.descriptorCount = 1;
-	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerLayoutBinding.pImmutableSamplers = nullptr;
-	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;   // fragment shader input
-
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+	// per-material data, indexed by the object's material index in the fragment shader
+	VkDescriptorSetLayoutBinding materialLayoutBinding{};
+	materialLayoutBinding.binding = 1;
+	materialLayoutBinding.descriptorCount = 1;
+	materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialLayoutBinding.pImmutableSamplers = nullptr;
+	materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;   // fragment shader input
+
+	// per-object data, indexed by gl_InstanceIndex in the vertex shader
+	VkDescriptorSetLayoutBinding objectLayoutBinding{};
+	objectLayoutBinding.binding = 2;
+	objectLayoutBinding.descriptorCount = 1;
+	objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	objectLayoutBinding.pImmutableSamplers = nullptr;
+	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// object ids written by the gpu culling, only read when GPU_CULLING is specialized on
+	VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+	instanceLayoutBinding.binding = 3;
+	instanceLayoutBinding.descriptorCount = 1;
+	instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceLayoutBinding.pImmutableSamplers = nullptr;
+	instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	std::array<VkDescriptorSetLayoutBinding, 4> bindings = {uboLayoutBinding, materialLayoutBinding, objectLayoutBinding, instanceLayoutBinding};
 	// create a descriptor set, and attach our UBO to it
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 	layoutInfo.pBindings = bindings.data();
 
-	VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_descriptorSetLayout));
+	_descriptorSetLayout = _layoutCache.create_layout(layoutInfo);
 
-	_mainDeletionQueue.push_function([=]()
-									 { vkDestroyDescriptorSetLayout(_device, _descriptorSetLayout, nullptr); });
-
-	// add our descriptor set to the pipeline
-	mesh_pipeline_layout_info.setLayoutCount = 1;
-	mesh_pipeline_layout_info.pSetLayouts = &_descriptorSetLayout;
+	// the frame's set, then the texture table every material samples from
+	VkDescriptorSetLayout setLayouts[2] = {_descriptorSetLayout, _textures.layout()};
+	mesh_pipeline_layout_info.setLayoutCount = 2;
+	mesh_pipeline_layout_info.pSetLayouts = setLayouts;
 
 	VK_CHECK(vkCreatePipelineLayout(_device, &mesh_pipeline_layout_info, nullptr, &_meshPipelineLayout));
 
@@ -185,62 +324,198 @@ void VulkanEngine::init_pipelines()
 	// clear the shader stages for the builder
 	pipelineBuilder._shaderStages.clear();
 
-	VkShaderModule meshVertexShader;
-	if (!load_shader_module(SHADER_PREFIX("tri_mesh.vert.spv"), &meshVertexShader))
-	{
-		std::cout << "Error when building the triangle vertex shader module" << std::endl;
-	}
-	else
+	// modules are owned by the pipeline library, they live until every compile is done
+	VkShaderModule meshVertexShader = _pipelines.load_shader(SHADER_PREFIX("tri_mesh.vert.spv"));
+	VkShaderModule meshFragmentShader = _pipelines.load_shader(SHADER_PREFIX("colored_triangle.frag.spv"));
+	if (meshVertexShader == VK_NULL_HANDLE || meshFragmentShader == VK_NULL_HANDLE)
 	{
-		std::cout << "vertex shader successfully loaded" << std::endl;
+		std::cout << "Error when building the mesh shader modules" << std::endl;
 	}
 
-	VkShaderModule meshFragmentShader;
-	if (!load_shader_module(SHADER_PREFIX("colored_triangle.frag.spv"), &meshFragmentShader))
-	{
-		std::cout << "Error when building the triangle vertex shader module" << std::endl;
-	}
-	else
-	{
-		std::cout << "fragment shader successfully loaded" << std::endl;
-	}
+	// the vertex shader looks its object up through the culled instance ids when gpu culling is on
+	VkBool32 gpuCulling = _gpuCulling ? VK_TRUE : VK_FALSE;
+	VkSpecializationMapEntry gpuCullingEntry{};
+	gpuCullingEntry.constantID = 0;
+	gpuCullingEntry.offset = 0;
+	gpuCullingEntry.size = sizeof(VkBool32);
+
+	VkSpecializationInfo vertexSpecialization{};
+	vertexSpecialization.mapEntryCount = 1;
+	vertexSpecialization.pMapEntries = &gpuCullingEntry;
+	vertexSpecialization.dataSize = sizeof(VkBool32);
+	vertexSpecialization.pData = &gpuCulling;
 
 	// add the other shaders
 	pipelineBuilder._shaderStages.push_back(
 		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT, meshVertexShader));
+	pipelineBuilder._shaderStages.back().pSpecializationInfo = &vertexSpecialization;
 
 	// make sure that triangleFragShader is holding the compiled colored_triangle.frag
 	pipelineBuilder._shaderStages.push_back(
 		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, meshFragmentShader));
 
-	// build the mesh triangle pipeline
-	_meshPipeline = pipelineBuilder.build_pipeline(_device, _renderPass);
+	// the default mesh pipeline is the fallback of every other material, nothing draws before it exists
+	auto createStart = std::chrono::high_resolution_clock::now();
+	_meshPipelineHandle = _pipelines.request(pipelineBuilder, _renderPass);
+	_meshPipeline = _pipelines.wait(_meshPipelineHandle);
+	_pipelineCreateMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - createStart).count();
 
-	create_material(_meshPipeline, _meshPipelineLayout, "defaultmesh");
+	create_material(_meshPipelineHandle, _meshPipelineLayout, "defaultmesh");
+
+	// ==== PERMUTATIONS ====
+
+	// cull mode x blend mode variants of the mesh material, compiled in the background.
+	// mesh_none_opaque is the default state again and only costs a lookup
+	const std::pair<const char*, VkCullModeFlags> cullModes[] = {
+		{ "none", VK_CULL_MODE_NONE }, { "back", VK_CULL_MODE_BACK_BIT }, { "front", VK_CULL_MODE_FRONT_BIT } };
+	const char* blendModes[] = { "opaque", "alpha", "additive" };
+	for (const auto& cull : cullModes)
+	{
+		for (uint32_t blend = 0; blend < 3; blend++)
+		{
+			PipelineBuilder variant = pipelineBuilder;
+			variant._rasterizer.cullMode = cull.second;
+			if (blend > 0)
+			{
+				// blended surfaces test against depth but don't write it
+				variant._depthStencil = vkinit::depth_stencil_create_info(true, false, VK_COMPARE_OP_LESS_OR_EQUAL);
+				variant._colorBlendAttachment.blendEnable = VK_TRUE;
+				variant._colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+				variant._colorBlendAttachment.dstColorBlendFactor = blend == 1 ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+				variant._colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+				variant._colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+				variant._colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+				variant._colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+			}
+			std::string name = std::string("mesh_") + cull.first + "_" + blendModes[blend];
+			create_material(_pipelines.request(variant, _renderPass), _meshPipelineLayout, name);
+		}
+	}
 
 	// ==== DELETION ====
 
-	// deleting all of the vulkan shaders
-	vkDestroyShaderModule(_device, meshVertexShader, nullptr);
-	vkDestroyShaderModule(_device, meshFragmentShader, nullptr);
+	// the pipelines and shader modules go with the library
+	_mainDeletionQueue.push(_meshPipelineLayout);
+}
+
+void VulkanEngine::init_cull_pipeline()
+{
+	if (!_gpuCulling)
+	{
+		return;
+	}
+
+	// objects, draw commands, instance ids, visible counter, lod table, object levels
+	std::array<VkDescriptorSetLayoutBinding, 6> bindings{};
+	for (uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	_cullSetLayout = _layoutCache.create_layout(layoutInfo);
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(CullConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkinit::pipeline_layout_create_info();
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &_cullSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
 
-	// adding the pipelines to the deletion queue
-	_mainDeletionQueue.push_function([=]()
-									 {
-		vkDestroyPipeline(_device, _meshPipeline, nullptr);
-		vkDestroyPipelineLayout(_device, _meshPipelineLayout, nullptr); });
+	VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_cullPipelineLayout));
+
+	VkShaderModule cullShader;
+	if (!load_shader_module(SHADER_PREFIX("cull.comp.spv"), &cullShader))
+	{
+		std::cout << "Error when building the cull compute shader module" << std::endl;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, cullShader);
+	pipelineInfo.layout = _cullPipelineLayout;
+
+	auto createStart = std::chrono::high_resolution_clock::now();
+	VK_CHECK(vkCreateComputePipelines(_device, _pipelineCache.cache(), 1, &pipelineInfo, nullptr, &_cullPipeline));
+	_pipelineCreateMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - createStart).count();
+
+	vkDestroyShaderModule(_device, cullShader, nullptr);
+
+	_mainDeletionQueue.push(_cullPipelineLayout);
+	_mainDeletionQueue.push(_cullPipeline);
 }
 
 void VulkanEngine::draw()
 {
-	// wait until the GPU has finished rendering the last frame. Timeout of 1 second
-	VK_CHECK(vkWaitForFences(_device, 1, &_renderFences[_currentFrame], true, 1000000000));
+	VKPROF_ZONE("draw");
+	_frameBlockedNs = 0;
+	uint64_t blockedStart = vkprof::now_ns();
+
+	// wait until the GPU has finished rendering the last frame. Timeout of 1 second. The fence is only reset
+	// once a swapchain image was acquired, a frame that bails out before that leaves it signaled
+	{
+		VKPROF_ZONE("wait for frame fence");
+		VK_CHECK(vkWaitForFences(_device, 1, &_renderFences[_currentFrame], true, 1000000000));
+	}
+	_frameBlockedNs += vkprof::now_ns() - blockedStart;
+
+	// nothing still in flight can reference what was released before this slot's last submit
+	_frameDeletionQueues[_currentFrame].flush(_device, _allocator);
+
+	// the timestamps written the last time this frame slot was used are now available
+	resolve_gpu_timestamps(_currentFrame);
+
+	// a minimized window has nothing to present to, the frame is skipped until it comes back
+	if (_swapchainDirty && !recreate_swapchain())
+	{
+		return;
+	}
+
+	// submit the uploads the loader recorded and swap in whatever became resident, never blocks
+	{
+		VKPROF_ZONE("streaming update");
+		_streamer.update();
+	}
+
+	// request image from the swapchain, one second timeout. Headless mode always renders into the single offscreen target
+	uint32_t swapchainImageIndex = 0;
+	if (!_headless)
+	{
+		VKPROF_ZONE("acquire swapchain image");
+		blockedStart = vkprof::now_ns();
+		VkResult result = vkAcquireNextImageKHR(_device, _swapchain, 1000000000, _presentSemaphores[_currentFrame], nullptr, &swapchainImageIndex);
+		_frameBlockedNs += vkprof::now_ns() - blockedStart;
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			// nothing was acquired and the semaphore stays unsignaled, try again with a new swapchain
+			_swapchainDirty = true;
+			return;
+		}
+		if (result == VK_SUBOPTIMAL_KHR)
+		{
+			// still presentable, this frame goes out and the next one rebuilds
+			_swapchainDirty = true;
+		}
+		else
+		{
+			VK_CHECK(result);
+		}
+	}
 	VK_CHECK(vkResetFences(_device, 1, &_renderFences[_currentFrame]));
 
-	// request image from the swapchain, one second timeout
-	uint32_t swapchainImageIndex;
-	VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1000000000, _presentSemaphores[_currentFrame], nullptr, &swapchainImageIndex));
-	VK_CHECK(vkResetCommandBuffer(_commandBuffers[_currentFrame], 0));
+	// everything recorded for this frame slot last time is done, drop it all at once
+	VK_CHECK(vkResetCommandPool(_device, _frameCommandPools[_currentFrame], 0));
 
 	// begin the command buffer recording. We will use this command buffer exactly once, so we want to let Vulkan know that
 	VkCommandBufferBeginInfo cmdBeginInfo = {};
@@ -253,6 +528,20 @@ void VulkanEngine::draw()
 	// begin recording
 	VK_CHECK(vkBeginCommandBuffer(_commandBuffers[_currentFrame], &cmdBeginInfo));
 
+	_gpuProfiler.begin_frame(_commandBuffers[_currentFrame], _currentFrame);
+
+	// object data and draw batches for this frame, culled on the gpu before the render pass when enabled
+	// materials whose pipeline finished compiling since the last frame stop drawing with the fallback
+	resolve_material_pipelines();
+	prepare_draws(_renderables.data(), static_cast<int>(_renderables.size()));
+	write_frame_descriptors();
+	if (_gpuCulling)
+	{
+		uint32_t cullZone = _gpuProfiler.begin_zone(_commandBuffers[_currentFrame], _currentFrame, "gpu culling");
+		cull_objects(_commandBuffers[_currentFrame]);
+		_gpuProfiler.end_zone(_commandBuffers[_currentFrame], _currentFrame, cullZone);
+	}
+
 	// create framebuffer clear values for color and depth attachment
 
 	VkClearValue clearValue;
@@ -275,11 +564,19 @@ void VulkanEngine::draw()
 	VkClearValue clearValues[] = {clearValue, depthClear};
 	rpInfo.pClearValues = clearValues;
 
-	vkCmdBeginRenderPass(_commandBuffers[_currentFrame], &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// the draws either go straight into the primary buffer or come from secondary buffers, never both
+	VkSubpassContents contents = record_thread_count() > 1 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+	uint32_t passZone = _gpuProfiler.begin_zone(_commandBuffers[_currentFrame], _currentFrame, "main render pass");
+	vkCmdBeginRenderPass(_commandBuffers[_currentFrame], &rpInfo, contents);
 
-	draw_objects(_commandBuffers[_currentFrame], _renderables.data(), _renderables.size());
+	draw_objects(_commandBuffers[_currentFrame], _framebuffers[swapchainImageIndex]);
 
 	vkCmdEndRenderPass(_commandBuffers[_currentFrame]);
+	_gpuProfiler.end_zone(_commandBuffers[_currentFrame], _currentFrame, passZone);
+
+	_gpuProfiler.end_frame(_commandBuffers[_currentFrame], _currentFrame);
+	_timestampMeasured[_currentFrame] = _measureGpuTimes;
+
 	VK_CHECK(vkEndCommandBuffer(_commandBuffers[_currentFrame]));
 
 	// ==== SUBMIT TO QUEUE ====
@@ -296,17 +593,35 @@ void VulkanEngine::draw()
 	submit.pWaitDstStageMask = &waitStage;
 
 	// wait on present semaphore before executing the command, we're waiting for the next image in swapchain
-	submit.waitSemaphoreCount = 1;
-	submit.pWaitSemaphores = &_presentSemaphores[_currentFrame];
 	// signal render semaphore once GPU has finished executing the command
-	submit.signalSemaphoreCount = 1;
-	submit.pSignalSemaphores = &_renderSemaphores[_currentFrame];
+	// nothing is acquired or presented in headless mode, so the fence is the only synchronisation
+	if (!_headless)
+	{
+		submit.waitSemaphoreCount = 1;
+		submit.pWaitSemaphores = &_presentSemaphores[_currentFrame];
+		submit.signalSemaphoreCount = 1;
+		submit.pSignalSemaphores = &_renderSemaphores[_currentFrame];
+	}
 	submit.commandBufferCount = 1;
 	submit.pCommandBuffers = &_commandBuffers[_currentFrame];
 
+	// this submit is the last use of whatever was released since the previous one, it goes once the fence says so
+	_frameDeletionQueues[_currentFrame].take(_pendingDeletions);
+	_frameInputNs[_currentFrame] = _inputSampledNs;
+
 	// submit command buffer to the queue and execute it.
 	//  _renderFence will now block CPU until the graphic commands finish execution
-	VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &submit, _renderFences[_currentFrame]));
+	{
+		VKPROF_ZONE("queue submit");
+		VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &submit, _renderFences[_currentFrame]));
+	}
+
+	if (_headless)
+	{
+		_frameNumber++;
+		_currentFrame = (_currentFrame + 1) % _max_frames_in_flight;
+		return;
+	}
 
 	// this will put the image we just rendered into the visible window.
 	// we want to wait on the _renderSemaphore for that,
@@ -320,7 +635,20 @@ void VulkanEngine::draw()
 	presentInfo.waitSemaphoreCount = 1;
 	presentInfo.pImageIndices = &swapchainImageIndex;
 
-	VK_CHECK(vkQueuePresentKHR(_graphicsQueue, &presentInfo));
+	{
+		VKPROF_ZONE("present");
+		blockedStart = vkprof::now_ns();
+		VkResult result = vkQueuePresentKHR(_graphicsQueue, &presentInfo);
+		_frameBlockedNs += vkprof::now_ns() - blockedStart;
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		{
+			_swapchainDirty = true;
+		}
+		else
+		{
+			VK_CHECK(result);
+		}
+	}
 
 	// increase the number of frames drawn
 	_frameNumber++;
@@ -330,8 +658,8 @@ void VulkanEngine::draw()
 glm::vec3 VulkanEngine::trackballProject(int pos_x, int pos_y)
 {
 	// cast everything to a float
-	float width = static_cast<float>(_windowExtent.width);
-	float height = static_cast<float>(_windowExtent.height);
+	float width = static_cast<float>(_trackballExtent.width);
+	float height = static_cast<float>(_trackballExtent.height);
 	float x = static_cast<float>(pos_x);
 	float y = static_cast<float>(pos_y);
 
@@ -350,16 +678,123 @@ glm::vec3 VulkanEngine::trackballProject(int pos_x, int pos_y)
 	return glm::normalize(glm::vec3(sx, sy, sz));
 }
 
+void VulkanEngine::write_snapshot(FrameSnapshot &snapshot)
+{
+	snapshot.camera = _currTrackballQ * _lastTrackballQ;
+	snapshot.inputSampledNs = vkprof::now_ns();
+	// main thread, so the size comes from SDL: _windowExtent is the render thread's and changes with the swapchain
+	snapshot.drawableExtent = _offscreenExtent;
+	snapshot.minimized = false;
+	if (!_headless)
+	{
+		int width = 0, height = 0;
+		SDL_Vulkan_GetDrawableSize(_window, &width, &height);
+		snapshot.drawableExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+		snapshot.minimized = (SDL_GetWindowFlags(_window) & SDL_WINDOW_MINIMIZED) != 0 || width == 0 || height == 0;
+	}
+
+	// slots are reused, a slot that already holds this version skips the copy
+	if (snapshot.sceneVersion != _sceneVersion)
+	{
+		snapshot.transforms = _sceneTransforms;
+		snapshot.sceneVersion = _sceneVersion;
+	}
+}
+
+void VulkanEngine::read_snapshot(const FrameSnapshot &snapshot)
+{
+	_cameraRotation = snapshot.camera;
+	_inputSampledNs = snapshot.inputSampledNs;
+	_windowMinimized = snapshot.minimized;
+
+	if (!_headless && (snapshot.drawableExtent.width != _drawableExtent.width || snapshot.drawableExtent.height != _drawableExtent.height))
+	{
+		_drawableExtent = snapshot.drawableExtent;
+		_swapchainDirty = true;
+	}
+
+	if (snapshot.sceneVersion != _drawnSceneVersion)
+	{
+		size_t count = std::min(_renderables.size(), snapshot.transforms.size());
+		for (size_t i = 0; i < count; i++)
+		{
+			_renderables[i].transformMatrix = snapshot.transforms[i];
+		}
+		_drawnSceneVersion = snapshot.sceneVersion;
+		_cullDataDirty = true;
+	}
+}
+
+void VulkanEngine::render_loop()
+{
+	vkprof::set_thread_name("render");
+
+	while (!_renderQuit.load(std::memory_order_acquire))
+	{
+		uint64_t start = vkprof::now_ns();
+
+		// without a new snapshot the last one is drawn again, the fence and vsync pace this loop
+		bool fresh = _snapshots.acquire();
+		if (fresh)
+		{
+			read_snapshot(_snapshots.front());
+		}
+		if (_windowMinimized)
+		{
+			// nothing to present to, no point spinning on the skipped frames
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			continue;
+		}
+
+		draw();
+
+		uint64_t elapsed = vkprof::now_ns() - start;
+		_loopStats.renderBlockedNs.fetch_add(_frameBlockedNs, std::memory_order_relaxed);
+		_loopStats.renderBusyNs.fetch_add(elapsed - std::min(elapsed, _frameBlockedNs), std::memory_order_relaxed);
+		_loopStats.frames.fetch_add(1, std::memory_order_relaxed);
+		if (!fresh)
+		{
+			_loopStats.repeatedFrames.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+void VulkanEngine::print_loop_stats(uint64_t elapsedNs)
+{
+	auto percent = [elapsedNs](std::atomic<uint64_t> &ns) { return static_cast<int>(ns.exchange(0, std::memory_order_relaxed) * 100 / elapsedNs); };
+
+	std::cout << "main thread: " << percent(_loopStats.mainBlockedNs) << "% waiting for input, "
+		<< percent(_loopStats.mainBusyNs) << "% busy, " << _loopStats.snapshots.exchange(0, std::memory_order_relaxed) << " snapshots | "
+		<< "render thread: " << percent(_loopStats.renderBlockedNs) << "% blocked on fence/acquire/present, "
+		<< percent(_loopStats.renderBusyNs) << "% busy, " << _loopStats.frames.exchange(0, std::memory_order_relaxed) << " frames, "
+		<< _loopStats.repeatedFrames.exchange(0, std::memory_order_relaxed) << " without a new snapshot" << std::endl;
+}
+
 void VulkanEngine::run()
 {
 	SDL_Event e;
 	bool bQuit = false;
 
+	// this thread keeps handling input while the render thread sits in the fence wait, acquire or present.
+	// The render thread becomes the only user of the job system and the Vulkan objects until it's joined
+	write_snapshot(_snapshots.back());
+	_snapshots.publish();
+	_renderQuit.store(false, std::memory_order_relaxed);
+	_renderThread = std::thread(&VulkanEngine::render_loop, this);
+
+	uint64_t reportStart = vkprof::now_ns();
+
 	// main loop
 	while (!bQuit)
 	{
+		// sleep until there's input, at most a millisecond so the simulation keeps ticking
+		uint64_t waitStart = vkprof::now_ns();
+		bool hasEvent = SDL_WaitEventTimeout(&e, 1) != 0;
+		uint64_t busyStart = vkprof::now_ns();
+		_loopStats.mainBlockedNs.fetch_add(busyStart - waitStart, std::memory_order_relaxed);
+
 		// Handle events on queue
-		while (SDL_PollEvent(&e) != 0)
+		for (; hasEvent; hasEvent = SDL_PollEvent(&e) != 0)
 		{
 			int pos_x, pos_y;
 
@@ -379,106 +814,282 @@ void VulkanEngine::run()
 				_lastTrackballQ = _currTrackballQ * _lastTrackballQ;
 				_currTrackballQ = glm::quat(1.f, 0.f, 0.f, 0.f);
 			}
+			if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+			{
+				_trackballExtent = {static_cast<uint32_t>(e.window.data1), static_cast<uint32_t>(e.window.data2)};
+			}
 			if (e.type == SDL_QUIT)
 				bQuit = true;
 		}
-		draw();
+
+		write_snapshot(_snapshots.back());
+		_snapshots.publish();
+
+		uint64_t end = vkprof::now_ns();
+		_loopStats.mainBusyNs.fetch_add(end - busyStart, std::memory_order_relaxed);
+		_loopStats.snapshots.fetch_add(1, std::memory_order_relaxed);
+		if (end - reportStart >= 2000000000ull)
+		{
+			print_loop_stats(end - reportStart);
+			reportStart = end;
+		}
 	}
+
+	_renderQuit.store(true, std::memory_order_release);
+	_renderThread.join();
 }
 
-void VulkanEngine::init_texture_image()
+void VulkanEngine::run_benchmark(const vkbench::BenchmarkConfig &config, vkbench::BenchmarkResults &results)
 {
-	int texWidth, texHeight, texChannels;
-	stbi_uc *pixels = stbi_load(ASSETS_PREFIX("wahoo.bmp"), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	// scripted trackball path: every drag starts at the window centre and the cursor then circles around it,
+	// feeding the same trackball math as the mouse handling in run()
+	const uint32_t dragFrames = 120;
+	const float centerX = _trackballExtent.width * 0.5f;
+	const float centerY = _trackballExtent.height * 0.5f;
+	const float radius = glm::min(_trackballExtent.width, _trackballExtent.height) * 0.25f;
+
+	const uint32_t totalFrames = config.warmupFrames + config.frames;
+
+	results.cpuFrameMs.clear();
+	results.cpuFrameMs.reserve(config.frames);
+	results.recordMs.clear();
+	results.recordMs.reserve(config.frames);
+	results.cullMs.clear();
+	results.cullMs.reserve(config.frames);
+	results.blockedMs.clear();
+	results.blockedMs.reserve(config.frames);
+	results.descriptorMs.clear();
+	results.descriptorMs.reserve(config.frames);
+	_gpuFrameTimes.clear();
+	_gpuFrameTimes.reserve(config.frames);
+	_inputLatencies.clear();
+	_inputLatencies.reserve(config.frames);
+
+	// timings and the checksum shouldn't depend on how far streaming got, so the scene is made resident first
+	_streamer.wait_idle();
+
+	// same handoff as run(), on one thread so every frame draws exactly the input scripted for it
+	FrameSnapshot snapshot;
+
+	for (uint32_t i = 0; i < totalFrames; i++)
+	{
+		uint32_t dragFrame = i % dragFrames;
+		if (dragFrame == 0)
+		{
+			// release the previous drag and press the button again at the centre
+			_lastTrackballQ = _currTrackballQ * _lastTrackballQ;
+			_currTrackballQ = glm::quat(1.f, 0.f, 0.f, 0.f);
+			_startTrackballV = trackballProject(static_cast<int>(centerX), static_cast<int>(centerY));
+		}
+		else
+		{
+			float angle = glm::two_pi<float>() * dragFrame / dragFrames;
+			float t = static_cast<float>(dragFrame) / dragFrames;
+			int pos_x = static_cast<int>(centerX + radius * t * glm::cos(angle));
+			int pos_y = static_cast<int>(centerY + radius * t * glm::sin(angle));
+			_currTrackballQ = glm::rotation(_startTrackballV, trackballProject(pos_x, pos_y));
+		}
+
+		if (!_headless)
+		{
+			// a window that's never pumped is reported as hung
+			SDL_PumpEvents();
+			SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+		}
+		write_snapshot(snapshot);
+		read_snapshot(snapshot);
 
-	// 4 bytes per pixel
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
+		bool measured = i >= config.warmupFrames;
+		_measureGpuTimes = measured;
 
-	if (!pixels)
+		auto start = std::chrono::steady_clock::now();
+		draw();
+		auto end = std::chrono::steady_clock::now();
+
+		if (measured)
+		{
+			results.cpuFrameMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+			results.recordMs.push_back(_renderStats.recordMs);
+			results.cullMs.push_back(_renderStats.cullMs);
+			results.blockedMs.push_back(static_cast<double>(_frameBlockedNs) * 1e-6);
+			results.descriptorMs.push_back(_renderStats.descriptorMs);
+		}
+	}
+
+	// collect the timestamps of the frames still in flight
+	VK_CHECK(vkDeviceWaitIdle(_device));
+	for (uint32_t i = 0; i < _max_frames_in_flight; i++)
 	{
-		throw std::runtime_error("failed to load texture image!");
+		resolve_gpu_timestamps((_currentFrame + i) % _max_frames_in_flight);
+	}
+	_measureGpuTimes = false;
+	results.gpuFrameMs = _gpuFrameTimes;
+	results.inputLatencyMs = _inputLatencies;
+	results.presentMode = _headless ? "offscreen" : present_mode_name(_activePresentMode);
+	results.framesInFlight = static_cast<uint32_t>(_max_frames_in_flight);
+	results.objects = _renderStats.objects;
+	results.visibleObjects = _renderStats.visibleObjects;
+	results.drawCalls = _renderStats.drawCalls;
+	results.pipelineBinds = _renderStats.pipelineBinds;
+	results.descriptorBinds = _renderStats.descriptorBinds;
+	results.meshBinds = _renderStats.meshBinds;
+	results.descriptorSets = _renderStats.descriptorSets;
+	results.triangles = _renderStats.triangles;
+	results.fullTriangles = _renderStats.fullTriangles;
+	results.textures = _textures.count();
+	results.materials = static_cast<uint32_t>(_materials.size());
+	results.descriptorPools = 0;
+	for (const DescriptorAllocator &allocator : _frameDescriptors)
+	{
+		results.descriptorPools += allocator.stats().pools;
 	}
 
-	AllocatedBuffer stagingBuffer;
-	vkinit::create_buffer(
-		_allocator,
-		imageSize,
-		VMA_MEMORY_USAGE_UNKNOWN,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer._buffer, stagingBuffer._allocation
-	);
+	results.hasChecksum = config.checksum && _headless;
+	if (results.hasChecksum)
+	{
+		results.checksum = checksum_offscreen_image();
+	}
+}
 
-	// copy image data into staging buffer
-	void *data;
-	vmaMapMemory(_allocator, stagingBuffer._allocation, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vmaUnmapMemory(_allocator, stagingBuffer._allocation);
+void VulkanEngine::init_texture_image()
+{
+	// whatever texture is current at shutdown, the ones replaced before went through the frame deletion queues
+	_mainDeletionQueue.push_call<VulkanEngine, &VulkanEngine::destroy_textures>(this);
 
-	stbi_image_free(pixels);
+	// white placeholder, the stream below replaces it once wahoo.bmp is on the gpu. Nothing can be drawn
+	// without a texture, so this one is waited for
+	StreamHandle placeholder = _streamer.request(
+		[](StreamPayload &payload)
+		{
+			StreamPayload::Image image;
+			image.width = 2;
+			image.height = 2;
+			image.pixels.assign(image.width * image.height * 4, 0xff);
+			payload.images.push_back(std::move(image));
+			return true;
+		},
+		[this](StreamPayload &payload)
+		{
+			_textureImage = payload.images[0].image;
+			_textureImageView = create_texture_view(_textureImage._image, payload.images[0].format, 1);
+			// the first slot, where every material created so far already points
+			_textureIndex = _textures.add(_textureImageView, _textureSampler);
+		});
+	_streamer.wait(placeholder);
+
+	_streamer.request(
+		[this, codec = _textureCodec](StreamPayload &payload)
+		{
+			StreamPayload::Image image;
+			if (!load_texture_data(image, ASSETS_PREFIX("wahoo.bmp"), codec))
+			{
+				return false;
+			}
+			payload.images.push_back(std::move(image));
+			return true;
+		},
+		[this](StreamPayload &payload)
+		{
+			// the new view goes into a slot of its own and frames from the next one on index it through the
+			// material table, only frames in flight still sample the placeholder's slot
+			_pendingDeletions.push(_textureImage);
+			_pendingDeletions.push(_textureImageView);
+			_pendingDeletions.push_call<TextureTable, &TextureTable::release>(&_textures, _textureIndex);
+			uint32_t placeholderIndex = _textureIndex;
+			_textureImage = payload.images[0].image;
+			_textureImageView = create_texture_view(_textureImage._image, payload.images[0].format, payload.images[0].mip_levels());
+			_textureIndex = _textures.add(_textureImageView, _textureSampler);
+			for (auto &it : _materials)
+			{
+				if (it.second.textureIndex == placeholderIndex)
+				{
+					it.second.textureIndex = _textureIndex;
+				}
+			}
+		});
+}
 
-	// create image and allocate the memory
-	VK_CHECK(vkinit::create_image(
-		_allocator,
-		texWidth, texHeight,
-		VK_FORMAT_R8G8B8A8_SRGB,
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		_textureImage._image,
-		_textureImage._allocation));
-
-	// transition our texture layout to optimal transfer destination, then copy from staging buffer
-	vkinit::transition_image_layout(_device, _commandPool, _graphicsQueue,
-									_textureImage._image,
-									VK_FORMAT_R8G8B8A8_SRGB,
-									VK_IMAGE_LAYOUT_UNDEFINED,			 // old layout
-									VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL // new layout
-	);
-
-	// make the copy from staging buffer to image on device memory
-	vkinit::copy_buffer_to_image(_device, _commandPool, _graphicsQueue,
-								 stagingBuffer._buffer,
-								 _textureImage._image,
-								 static_cast<uint32_t>(texWidth),
-								 static_cast<uint32_t>(texHeight));
-
-	// finally, transition image so it's optimal for shader access
-	// transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	vkinit::transition_image_layout(
-		_device, _commandPool, _graphicsQueue,
-		_textureImage._image,
-		VK_FORMAT_R8G8B8A8_SRGB,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,	 // old layout
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL // new layout
-	);
-
-	// free the staging buffer
-	vmaDestroyBuffer(_allocator, stagingBuffer._buffer, stagingBuffer._allocation); 
-
-	_mainDeletionQueue.push_function([=]() {
-		vmaDestroyImage(_allocator, _textureImage._image, _textureImage._allocation); 
-	}); 
+void VulkanEngine::init_scene_textures()
+{
+	_sceneTextures = std::min({_sceneTextures, TextureTable::MAX_TEXTURES - 2, _max_materials / 2});
+	if (_sceneTextures <= 1)
+	{
+		return;
+	}
+
+	// small checkerboards in colors spread around the hue circle, one material each. Until its texture is
+	// resident a material samples whatever the default one does
+	_generatedTextures.resize(_sceneTextures);
+	for (uint32_t t = 0; t < _sceneTextures; t++)
+	{
+		std::string name = "textured_" + std::to_string(t);
+		create_material(_meshPipelineHandle, _meshPipelineLayout, name);
+
+		_streamer.request(
+			[t, count = _sceneTextures](StreamPayload &payload)
+			{
+				StreamPayload::Image image;
+				image.width = 64;
+				image.height = 64;
+				image.pixels.resize(image.width * image.height * 4);
+
+				float hue = 6.f * t / count;
+				glm::vec3 color = glm::clamp(glm::abs(glm::mod(hue + glm::vec3(0.f, 4.f, 2.f), 6.f) - 3.f) - 1.f, 0.f, 1.f);
+				for (uint32_t y = 0; y < image.height; y++)
+				{
+					for (uint32_t x = 0; x < image.width; x++)
+					{
+						glm::vec3 texel = ((x / 8 + y / 8) % 2 == 0) ? color : color * 0.5f;
+						uint8_t *pixel = &image.pixels[(y * image.width + x) * 4];
+						pixel[0] = static_cast<uint8_t>(texel.r * 255.f);
+						pixel[1] = static_cast<uint8_t>(texel.g * 255.f);
+						pixel[2] = static_cast<uint8_t>(texel.b * 255.f);
+						pixel[3] = 0xff;
+					}
+				}
+				payload.images.push_back(std::move(image));
+				return true;
+			},
+			[this, t, name](StreamPayload &payload)
+			{
+				GeneratedTexture &texture = _generatedTextures[t];
+				texture.image = payload.images[0].image;
+				texture.view = create_texture_view(texture.image._image, payload.images[0].format, 1);
+				_materials[name].textureIndex = _textures.add(texture.view, _textureSampler);
+			});
+	}
 }
 
-void VulkanEngine::init_texture_image_view()
+VkImageView VulkanEngine::create_texture_view(VkImage image, VkFormat format, uint32_t mipLevels)
 {
 	VkImageViewCreateInfo viewInfo{};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	viewInfo.image = _textureImage._image;
+	viewInfo.image = image;
 	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
-	VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &_textureImageView)); 
+	VkImageView view;
+	VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &view)); 
+	return view;
+}
 
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroyImageView(_device, _textureImageView, nullptr); 
-	}); 
+void VulkanEngine::destroy_textures()
+{
+	vkDestroyImageView(_device, _textureImageView, nullptr);
+	vmaDestroyImage(_allocator, _textureImage._image, _textureImage._allocation);
+	for (const GeneratedTexture &texture : _generatedTextures)
+	{
+		if (texture.view != VK_NULL_HANDLE)
+		{
+			vkDestroyImageView(_device, texture.view, nullptr);
+			vmaDestroyImage(_allocator, texture.image._image, texture.image._allocation);
+		}
+	}
 }
 
 void VulkanEngine::init_texture_sampler()
@@ -507,107 +1118,278 @@ void VulkanEngine::init_texture_sampler()
 	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
 	samplerInfo.unnormalizedCoordinates = VK_FALSE;
 
-	// no mip maps yet
+	// trilinear over whatever mip chain the bound view has
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 	VK_CHECK(vkCreateSampler(_device, &samplerInfo, nullptr, &_textureSampler)); 
 
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroySampler(_device, _textureSampler, nullptr); 
-	}); 
+	_mainDeletionQueue.push(_textureSampler);
 }
 
 void VulkanEngine::load_meshes()
 {
-	Mesh monkeyMesh;
-	monkeyMesh.load_from_obj(ASSETS_PREFIX("wahoo.obj"));
-	upload_mesh(monkeyMesh);
-	_meshes["monkey"] = monkeyMesh;
+	// unit cube drawn in place of every mesh that is still streaming, waited for like the placeholder texture
+	StreamHandle placeholder = stream_mesh("placeholder", [](Mesh &mesh)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (float side : {-1.f, 1.f})
+				{
+					glm::vec3 normal{0.f}, u{0.f}, v{0.f};
+					normal[axis] = side;
+					u[(axis + 1) % 3] = 1.f;
+					v[(axis + 2) % 3] = 1.f;
+
+					uint32_t base = static_cast<uint32_t>(mesh._vertices.size());
+					const glm::vec2 corners[4] = {{-1.f, -1.f}, {1.f, -1.f}, {1.f, 1.f}, {-1.f, 1.f}};
+					for (const glm::vec2 &corner : corners)
+					{
+						Vertex vertex;
+						vertex.position = normal + corner.x * u + corner.y * v;
+						vertex.normal = normal;
+						vertex.color = glm::vec3(1.f);
+						vertex.texCoord = corner * 0.5f + 0.5f;
+						mesh._vertices.push_back(vertex);
+					}
+
+					// counter clockwise seen from outside, u x v points along +axis
+					const uint32_t front[6] = {0, 1, 2, 0, 2, 3};
+					const uint32_t back[6] = {0, 2, 1, 0, 3, 2};
+					for (uint32_t index : side > 0.f ? front : back)
+					{
+						mesh._indices.push_back(base + index);
+					}
+				}
+			}
+			mesh.update_counts_and_bounds();
+			mesh.pack(MESH_VERTEX_ATTRIBUTES);
+			return true; });
+	_streamer.wait(placeholder);
+	_placeholderMesh = get_mesh("placeholder");
+
+	// init_scene sizes the stress grid from its bounds, so the main mesh is waited for too
+	std::string monkeyPath = ASSETS_PREFIX("wahoo.obj");
+	StreamHandle monkey = stream_mesh("monkey", [this, monkeyPath](Mesh &mesh)
+									  { return load_mesh_data(mesh, monkeyPath); });
+	_streamer.wait(monkey);
+
+	// second mesh for the stress scene, so draw order matters for the vertex buffer binds. It streams in while
+	// the first frames draw the placeholder cube in its place
+	if (_sceneObjects > 1)
+	{
+		std::string suzannePath = ASSETS_PREFIX("monkey_smooth.obj");
+		stream_mesh("suzanne", [this, suzannePath](Mesh &mesh)
+					{ return load_mesh_data(mesh, suzannePath); });
+	}
 }
 
-void VulkanEngine::upload_mesh(Mesh &mesh)
+StreamHandle VulkanEngine::stream_mesh(const std::string &name, std::function<bool(Mesh &)> build)
 {
-	// ==== TRANSFER VERTEX BUFFER ====
-	VkDeviceSize size = mesh._vertices.size() * sizeof(Vertex);
-	AllocatedBuffer stagingBuffer;
-
-	// create staging buffer
-	VkResult result = vkinit::create_buffer(
-		_allocator,
-		size,
-		VMA_MEMORY_USAGE_UNKNOWN,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer._buffer,
-		stagingBuffer._allocation);
+	// the map entry exists from now on so renderables can point at it, drawable_mesh() stands in the placeholder
+	auto inserted = _meshes.try_emplace(name);
+	Mesh *mesh = &inserted.first->second;
+	if (inserted.second)
+	{
+		mesh->_id = static_cast<uint32_t>(_meshes.size() - 1);
+	}
 
-	VK_CHECK(result);
+	// built on the loader thread, only the packed data and the counts make it into the engine's mesh.
+	// The packed data is copied into a range of the geometry buffer reserved right after the build
+	auto staged = std::make_shared<Mesh>();
+	return _streamer.request(
+		[this, staged, build](StreamPayload &payload)
+		{
+			VkDeviceSize vertexOffset, indexOffset;
+			if (!build(*staged) || !_geometry.allocate(*staged, vertexOffset, indexOffset))
+			{
+				return false;
+			}
 
-	// copy vertex data to staging buffer
-	void *data;
-	vmaMapMemory(_allocator, stagingBuffer._allocation, &data);
-	memcpy(data, mesh._vertices.data(), mesh._vertices.size() * sizeof(Vertex));
-	vmaUnmapMemory(_allocator, stagingBuffer._allocation);
+			// a cache hit hands over its mapping instead of copies, the streamer reads it straight into staging memory
+			size_t indexSize = staged->_indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+			StreamPayload::Buffer vertices;
+			if (staged->_packedVertexSource)
+			{
+				vertices.source = staged->_packedVertexSource;
+				vertices.sourceSize = size_t(staged->_vertexCount) * Vertex::packed_stride(staged->_vertexAttributes);
+				vertices.sourceOwner = staged->_packedSourceOwner;
+			}
+			else
+			{
+				vertices.data = std::move(staged->_packedVertices);
+			}
+			vertices.target = _geometry.vertex_buffer();
+			vertices.targetOffset = vertexOffset;
+			payload.buffers.push_back(std::move(vertices));
 
-	// create device local buffer
-	result = vkinit::create_buffer(
-		_allocator,
-		size,
-		VMA_MEMORY_USAGE_UNKNOWN,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		mesh._vertexBuffer._buffer,
-		mesh._vertexBuffer._allocation);
+			StreamPayload::Buffer indices;
+			if (staged->_packedIndexSource)
+			{
+				indices.source = staged->_packedIndexSource;
+				indices.sourceSize = size_t(staged->_indexCount) * indexSize;
+				indices.sourceOwner = staged->_packedSourceOwner;
+			}
+			else
+			{
+				indices.data = std::move(staged->_packedIndices);
+			}
+			indices.target = _geometry.index_buffer();
+			indices.targetOffset = indexOffset;
+			payload.buffers.push_back(std::move(indices));
+
+			// the payload holds the mapping from here on, it goes away once the copies are staged
+			staged->_packedVertexSource = nullptr;
+			staged->_packedIndexSource = nullptr;
+			staged->_packedSourceOwner.reset();
+			return true;
+		},
+		[this, mesh, staged](StreamPayload &)
+		{
+			mesh->_firstIndex = staged->_firstIndex;
+			mesh->_vertexOffset = staged->_vertexOffset;
+			mesh->_vertexCount = staged->_vertexCount;
+			mesh->_indexCount = staged->_indexCount;
+			mesh->_lods = staged->_lods;
+			mesh->_lodLevels = staged->_lodLevels;
+			mesh->_bounds = staged->_bounds;
+			mesh->_vertexAttributes = staged->_vertexAttributes;
+			mesh->_indexType = staged->_indexType;
+			mesh->_optimized = staged->_optimized;
+			mesh->_resident = true;
+
+			// bounds change from the placeholder's to the mesh's own
+			_cullDataDirty = true;
+		});
+}
 
-	VK_CHECK(result);
+bool VulkanEngine::load_mesh_data(Mesh &mesh, const std::string &objPath, bool optimize)
+{
+	std::string cachePath = objPath + MESH_CACHE_EXTENSION;
+	uint32_t lodLevels = std::clamp(_lodLevels, 1u, MAX_MESH_LODS);
 
-	vkinit::copy_buffer(_device, _commandPool, _graphicsQueue, stagingBuffer._buffer, mesh._vertexBuffer._buffer, size);
+	// fast path: a matching baked mesh is already on disk. Nothing is copied here, the streamer reads the blobs out
+	// of the mapping into staging memory and the mapping goes away with the payload's reference. Only compressed
+	// indices are decoded first. Scoped so a mismatching cache is unmapped before it gets rebaked below
+	{
+		auto cache = std::make_shared<MeshCache>();
+		if (cache->open(cachePath.c_str(), objPath.c_str()) && cache->optimized() == optimize
+			&& cache->vertex_attributes() == MESH_VERTEX_ATTRIBUTES && cache->lod_levels() == lodLevels)
+		{
+			mesh._packedVertexSource = cache->vertex_data();
+			mesh._packedIndexSource = cache->index_data();
+			if (cache->compressed_indices())
+			{
+				mesh._packedIndices.resize(cache->index_bytes());
+				cache->copy_indices(mesh._packedIndices.data());
+			}
 
-	// no longer need the staging buffer
-	vmaDestroyBuffer(_allocator, stagingBuffer._buffer, stagingBuffer._allocation);
+			mesh._vertexCount = cache->header().vertexCount;
+			mesh._indexCount = cache->header().indexCount;
+			mesh._lods = cache->lods();
+			mesh._lodLevels = cache->lod_levels();
+			mesh._bounds = cache->bounds();
+			mesh._vertexAttributes = cache->vertex_attributes();
+			mesh._indexType = cache->index_type();
+			mesh._optimized = cache->optimized();
+			mesh._packedSourceOwner = std::move(cache);
+			return true;
+		}
+	}
 
-	// ==== TRANSFER INDEX BUFFER ====
-	size = sizeof(mesh._indices[0]) * mesh._indices.size();
+	// cache miss, parse the obj and bake it for the next launch
+	if (!mesh.load_from_obj(objPath.c_str()))
+	{
+		std::cout << "failed to load mesh " << objPath << std::endl;
+		return false;
+	}
 
-	// create staging buffer
-	result = vkinit::create_buffer(
-		_allocator,
-		size,
-		VMA_MEMORY_USAGE_UNKNOWN,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer._buffer,
-		stagingBuffer._allocation);
-	VK_CHECK(result);
+	if (optimize)
+	{
+		MeshStats before = mesh.analyze();
+		mesh.optimize();
+		MeshStats after = mesh.analyze();
+		std::cout << objPath << ": acmr " << before.acmr << " -> " << after.acmr
+			<< ", atvr " << before.atvr << " -> " << after.atvr
+			<< ", overdraw " << before.overdraw << " -> " << after.overdraw << std::endl;
+	}
 
-	// copy indice data into host memory
-	vmaMapMemory(_allocator, stagingBuffer._allocation, &data);
-	memcpy(data, mesh._indices.data(), mesh._indices.size() * sizeof(mesh._indices[0]));
-	vmaUnmapMemory(_allocator, stagingBuffer._allocation);
+	// baked with the rest, the levels cost a simplification pass each and that's too slow for every launch
+	MeshLodOptions lodOptions;
+	lodOptions.levels = lodLevels;
+	mesh.build_lods(lodOptions);
+	std::cout << objPath << ": lod triangles";
+	for (const MeshLod &lod : mesh._lods)
+	{
+		std::cout << " " << lod.indexCount / 3;
+	}
+	std::cout << std::endl;
 
-	// create device local buffer
-	result = vkinit::create_buffer(
-		_allocator,
-		size,
-		VMA_MEMORY_USAGE_UNKNOWN,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		mesh._indexBuffer._buffer,
-		mesh._indexBuffer._allocation);
+	mesh.pack(MESH_VERTEX_ATTRIBUTES);
+	std::cout << objPath << ": vertex bytes " << mesh._vertices.size() * sizeof(Vertex) << " -> " << mesh._packedVertices.size()
+		<< ", index bytes " << mesh._indices.size() * sizeof(uint32_t) << " -> " << mesh._packedIndices.size() << std::endl;
+
+	if (!write_mesh_cache(cachePath.c_str(), objPath.c_str(), mesh))
+	{
+		std::cout << "failed to write mesh cache " << cachePath << std::endl;
+	}
+	return true;
+}
 
-	VK_CHECK(result);
+bool VulkanEngine::load_texture_data(StreamPayload::Image &image, const std::string &imagePath, TextureCodec codec)
+{
+	std::string cachePath = texture_cache_path(imagePath, codec);
+
+	// fast path: the mip chain was already baked with this codec. Nothing is decoded, the streamer copies the
+	// levels out of the mapping into staging memory and the mapping goes away with the payload's reference
+	auto cache = std::make_shared<TextureCache>();
+	if (cache->open(cachePath.c_str(), imagePath.c_str(), codec))
+	{
+		image.width = cache->header().width;
+		image.height = cache->header().height;
+		image.format = cache->format();
+		image.regions.assign(cache->regions(), cache->regions() + cache->level_count());
+		image.source = cache->data();
+		image.sourceSize = cache->data_bytes();
+		image.sourceOwner = std::move(cache);
+		return true;
+	}
+
+	// cache miss, decode the image and bake it for the next launch
+	int texWidth, texHeight, texChannels;
+	stbi_uc *pixels = stbi_load(imagePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	if (!pixels)
+	{
+		std::cout << "failed to load texture image " << imagePath << std::endl;
+		return false;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	Texture mips;
+	Texture texture;
+	generate_mips(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), mips);
+	stbi_image_free(pixels);
+	encode_texture(mips, codec, texture);
 
-	vkinit::copy_buffer(_device, _commandPool, _graphicsQueue, stagingBuffer._buffer, mesh._indexBuffer._buffer, size);
-	vmaDestroyBuffer(_allocator, stagingBuffer._buffer, stagingBuffer._allocation);
+	auto end = std::chrono::high_resolution_clock::now();
+	std::cout << imagePath << ": " << texture.levels.size() << " mips as " << texture_codec_name(codec)
+		<< ", bytes " << size_t(texWidth) * texHeight * 4 << " -> " << texture.data.size()
+		<< " in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
 
-	// add the destruction of triangle mesh buffer to the deletion queue
-	_mainDeletionQueue.push_function([=]()
-									 {  
-		vmaDestroyBuffer(_allocator, mesh._vertexBuffer._buffer, mesh._vertexBuffer._allocation); 
-		vmaDestroyBuffer(_allocator, mesh._indexBuffer._buffer, mesh._indexBuffer._allocation); });
+	if (!write_texture_cache(cachePath.c_str(), imagePath.c_str(), texture))
+	{
+		std::cout << "failed to write texture cache " << cachePath << std::endl;
+	}
+
+	image.width = texture.width;
+	image.height = texture.height;
+	image.format = texture_codec_format(codec);
+	texture_copy_regions(texture, image.regions);
+	image.pixels = std::move(texture.data);
+	return true;
 }
 
 // private functions
@@ -662,10 +1444,12 @@ void VulkanEngine::init_vulkan()
 	vkb::InstanceBuilder builder;
 
 	// make the Vulkan instance, with basic debug features
+	// headless skips the surface extensions so it runs without a display (e.g. lavapipe on a build box)
 	auto inst_ret = builder.set_app_name("Example Vulkan Application")
 						.request_validation_layers(true)
-						.require_api_version(1, 1, 0)
+						.require_api_version(1, 2, 0)
 						.use_default_debug_messenger()
+						.set_headless(_headless)
 						.build();
 
 	vkb::Instance vkb_inst = inst_ret.value();
@@ -678,20 +1462,63 @@ void VulkanEngine::init_vulkan()
 	// ======== PHYSICAL DEVICE & DEVICE =========
 
 	// get the surface of the window we opened with SDL
-	SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
+	if (!_headless)
+	{
+		SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
+	}
 
 	VkPhysicalDeviceFeatures features{}; 
 	features.samplerAnisotropy = VK_TRUE; 
+	// indirect draws start each batch at its own instance range
+	features.drawIndirectFirstInstance = _gpuCulling ? VK_TRUE : VK_FALSE;
+	// and every run of batches sharing a pipeline goes out as one multi draw
+	features.multiDrawIndirect = _gpuCulling ? VK_TRUE : VK_FALSE;
+
+	// descriptor indexing for the texture table: a runtime sized array indexed per material, written while
+	// frames in flight have it bound and only partially filled
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.descriptorIndexing = VK_TRUE;
+	features12.runtimeDescriptorArray = VK_TRUE;
+	features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	features12.descriptorBindingPartiallyBound = VK_TRUE;
+	features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 
 	// use vkbootstrap to select a GPU.
-	// We want a GPU that can write to the SDL surface and supports Vulkan 1.1
+	// We want a GPU that can write to the SDL surface and supports Vulkan 1.2
 	vkb::PhysicalDeviceSelector selector{vkb_inst};
-	vkb::PhysicalDevice physicalDevice = selector
-											 .set_minimum_version(1, 1)
-											 .set_surface(_surface)
-											 .set_required_features(features)
-											 .select()
-											 .value();
+	selector.set_minimum_version(1, 2)
+		.set_required_features(features)
+		.set_required_features_12(features12);
+
+	if (_headless)
+	{
+		selector.require_present(false);
+	}
+	else
+	{
+		selector.set_surface(_surface);
+	}
+
+	vkb::PhysicalDevice physicalDevice = selector.select().value();
+
+	// block compressed textures are optional, anything without them samples uncompressed RGBA8
+	if (_textureCodec != TextureCodec::RGBA8)
+	{
+		VkPhysicalDeviceFeatures compression{};
+		compression.textureCompressionBC = VK_TRUE;
+
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice.physical_device, texture_codec_format(_textureCodec), &formatProperties);
+		VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+		if (!physicalDevice.enable_features_if_present(compression) || (formatProperties.optimalTilingFeatures & needed) != needed)
+		{
+			std::cout << texture_codec_name(_textureCodec) << " textures not supported, falling back to rgba8" << std::endl;
+			_textureCodec = TextureCodec::RGBA8;
+		}
+	}
 
 	// finally create the logical device
 	vkb::DeviceBuilder deviceBuilder{physicalDevice};
@@ -706,6 +1533,19 @@ void VulkanEngine::init_vulkan()
 	_graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 	_graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+	// a separate transfer family runs the asset uploads on the copy engine next to rendering
+	auto transferQueue = vkbDevice.get_queue(vkb::QueueType::transfer);
+	if (transferQueue.has_value())
+	{
+		_transferQueue = transferQueue.value();
+		_transferQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::transfer).value();
+	}
+	else
+	{
+		_transferQueue = _graphicsQueue;
+		_transferQueueFamily = _graphicsQueueFamily;
+	}
+
 	// initialize the memory allocator
 	VmaAllocatorCreateInfo allocatorInfo = {};
 	allocatorInfo.physicalDevice = _chosenGPU;
@@ -714,14 +1554,49 @@ void VulkanEngine::init_vulkan()
 	vmaCreateAllocator(&allocatorInfo, &_allocator);
 }
 
+const char* present_mode_name(VkPresentModeKHR mode)
+{
+	switch (mode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "mailbox";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "fifo_relaxed";
+	default:
+		return "fifo";
+	}
+}
+
 void VulkanEngine::init_swapchain()
+{
+	// the swapchain, its views, the depth image and the framebuffers are recreated on resize, so none of
+	// them go into the main deletion queue. cleanup() releases whatever is current at the time
+	if (_headless)
+	{
+		init_offscreen_target();
+	}
+	else
+	{
+		create_swapchain(VK_NULL_HANDLE);
+		std::cout << "present mode " << present_mode_name(_activePresentMode) << " (" << present_mode_name(_presentMode) << " requested), "
+			<< _swapchainImages.size() << " images, " << _max_frames_in_flight << " frames in flight" << std::endl;
+	}
+
+	create_depth_image();
+}
+
+void VulkanEngine::create_swapchain(VkSwapchainKHR oldSwapchain)
 {
 	vkb::SwapchainBuilder swapchainBuilder{_chosenGPU, _device, _surface};
 	vkb::Swapchain vkbSwapchain = swapchainBuilder
 									  .use_default_format_selection()
-									  // use vsync present mode
-									  .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+									  .set_desired_present_mode(_presentMode)
+									  .add_fallback_present_mode(VK_PRESENT_MODE_FIFO_KHR)
 									  .set_desired_extent(_windowExtent.width, _windowExtent.height)
+									  // lets the driver hand over resources of the old one, which stays valid until released
+									  .set_old_swapchain(oldSwapchain)
 									  .build()
 									  .value();
 
@@ -730,10 +1605,61 @@ void VulkanEngine::init_swapchain()
 	_swapchainImages = vkbSwapchain.get_images().value();
 	_swapchainImageViews = vkbSwapchain.get_image_views().value();
 	_swapchainImageFormat = vkbSwapchain.image_format;
+	_activePresentMode = vkbSwapchain.present_mode;
+
+	// the surface has the final say on the extent, everything sized to the window follows the swapchain
+	_windowExtent = vkbSwapchain.extent;
+}
+
+bool VulkanEngine::recreate_swapchain()
+{
+	VKPROF_ZONE("recreate swapchain");
+
+	// the size comes from the snapshot, SDL belongs to the thread running run()
+	if (_drawableExtent.width == 0 || _drawableExtent.height == 0)
+	{
+		return false;
+	}
 
-	_mainDeletionQueue.push_function([=]()
-									 { vkDestroySwapchainKHR(_device, _swapchain, nullptr); });
+	// frames in flight may still render into or present the old images. Instead of waiting for the device
+	// to go idle they're released with the next submit, and destroyed once its fence has signaled
+	VkSwapchainKHR oldSwapchain = _swapchain;
+	release_swapchain(_pendingDeletions);
 
+	_windowExtent = _drawableExtent;
+	create_swapchain(oldSwapchain);
+	create_depth_image();
+	init_framebuffers();
+
+	_swapchainDirty = false;
+	return true;
+}
+
+void VulkanEngine::release_swapchain(DeletionQueue &queue)
+{
+	// in creation order, the queue destroys the framebuffers first
+	if (_swapchain != VK_NULL_HANDLE)
+	{
+		queue.push(_swapchain);
+	}
+	for (VkImageView view : _swapchainImageViews)
+	{
+		queue.push(view);
+	}
+	queue.push(_depthImage);
+	queue.push(_depthImageView);
+	for (VkFramebuffer framebuffer : _framebuffers)
+	{
+		queue.push(framebuffer);
+	}
+
+	_swapchain = VK_NULL_HANDLE;
+	_swapchainImageViews.clear();
+	_framebuffers.clear();
+}
+
+void VulkanEngine::create_depth_image()
+{
 	// ==== allocate depth buffer image to memory ====
 
 	// depth image size will match the window
@@ -761,34 +1687,181 @@ void VulkanEngine::init_swapchain()
 	VkImageViewCreateInfo dview_info = vkinit::imageview_create_info(_depthFormat, _depthImage._image, VK_IMAGE_ASPECT_DEPTH_BIT);
 
 	VK_CHECK(vkCreateImageView(_device, &dview_info, nullptr, &_depthImageView));
+}
 
-	// add to deletion queues
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroyImageView(_device, _depthImageView, nullptr);
-		vmaDestroyImage(_allocator, _depthImage._image, _depthImage._allocation); 
-	});
+void VulkanEngine::init_offscreen_target()
+{
+	// a single color image stands in for the swapchain images. It is used as a transfer source
+	// so the last frame can be read back for a checksum
+	_swapchainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+	VkExtent3D imageExtent = {
+		_windowExtent.width,
+		_windowExtent.height,
+		1
+	};
+
+	VkImageCreateInfo img_info = vkinit::image_create_info(
+		_swapchainImageFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		imageExtent);
+
+	VmaAllocationCreateInfo img_allocinfo = {};
+	img_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	img_allocinfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	VK_CHECK(vmaCreateImage(_allocator, &img_info, &img_allocinfo, &_offscreenImage._image, &_offscreenImage._allocation, nullptr));
+
+	VkImageViewCreateInfo view_info = vkinit::imageview_create_info(_swapchainImageFormat, _offscreenImage._image, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	VkImageView view;
+	VK_CHECK(vkCreateImageView(_device, &view_info, nullptr, &view));
+
+	// the view is destroyed together with its framebuffer, like the swapchain image views
+	_swapchainImages = {_offscreenImage._image};
+	_swapchainImageViews = {view};
+
+	_mainDeletionQueue.push(_offscreenImage);
 }
 
-void VulkanEngine::init_commands()
+void VulkanEngine::init_profiler()
 {
-	// resize to number of frames in flight
-	_commandBuffers.resize(_max_frames_in_flight);
+	vkprof::set_thread_name("main");
+
+	_gpuProfiler.init(_device, _chosenGPU, _graphicsQueueFamily, static_cast<uint32_t>(_max_frames_in_flight));
+	_timestampMeasured.assign(_max_frames_in_flight, false);
+	_frameInputNs.assign(_max_frames_in_flight, 0);
+
+	_mainDeletionQueue.push_call<GpuProfiler, &GpuProfiler::cleanup>(&_gpuProfiler);
+}
+
+void VulkanEngine::resolve_gpu_timestamps(uint32_t frame)
+{
+	// only called once the frame's fence has signaled, so this never waits
+	if (_gpuProfiler.resolve(frame) && _timestampMeasured[frame])
+	{
+		_gpuFrameTimes.push_back(_gpuProfiler.frame_ms());
+		int64_t latencyNs = static_cast<int64_t>(_gpuProfiler.frame_end_ns() - _frameInputNs[frame]);
+		_inputLatencies.push_back(static_cast<double>(latencyNs) * 1e-6);
+	}
+}
+
+uint64_t VulkanEngine::checksum_offscreen_image()
+{
+	VkDeviceSize imageSize = static_cast<VkDeviceSize>(_windowExtent.width) * _windowExtent.height * 4;
+
+	AllocatedBuffer readbackBuffer;
+	VK_CHECK(vkinit::create_buffer(
+		_allocator,
+		imageSize,
+		VMA_MEMORY_USAGE_UNKNOWN,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		readbackBuffer._buffer, readbackBuffer._allocation));
+
+	VkCommandBuffer cmd = vkinit::begin_single_time_commands(_device, _commandPool);
+
+	// the render pass leaves the image in TRANSFER_SRC_OPTIMAL, make the color writes visible to the copy
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = _offscreenImage._image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region{};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = {_windowExtent.width, _windowExtent.height, 1};
+
+	vkCmdCopyImageToBuffer(cmd, _offscreenImage._image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer._buffer, 1, &region);
+
+	vkinit::end_single_time_commands(_device, _commandPool, _graphicsQueue, cmd);
 
-	// create command pool for graphics queue
+	void *data;
+	vmaMapMemory(_allocator, readbackBuffer._allocation, &data);
+	uint64_t checksum = vkutil::fnv1a(data, static_cast<size_t>(imageSize));
+	vmaUnmapMemory(_allocator, readbackBuffer._allocation);
+
+	vmaDestroyBuffer(_allocator, readbackBuffer._buffer, readbackBuffer._allocation);
+	return checksum;
+}
+
+void VulkanEngine::init_commands()
+{
+	// create command pool for graphics queue, used by the one-off upload commands
 	VkCommandPoolCreateInfo commandPoolInfo = vkinit::command_pool_create_info(
 		_graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
 	VK_CHECK(vkCreateCommandPool(_device, &commandPoolInfo, nullptr, &_commandPool));
 
-	// create command buffer
-	VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::command_buffer_allocate_info(
-		_commandPool,
-		static_cast<uint32_t>(_commandBuffers.size()));
+	_mainDeletionQueue.push(_commandPool);
+
+	// per frame pools are reset as a whole, so their buffers don't need the individual reset flag
+	VkCommandPoolCreateInfo framePoolInfo = vkinit::command_pool_create_info(_graphicsQueueFamily, 0);
+
+	_recordThreads = _recordThreads == 0 ? _jobs->thread_count() : _recordThreads;
+	_recordThreads = std::clamp(_recordThreads, 1u, MAX_RECORD_THREADS);
+
+	_frameCommandPools.resize(_max_frames_in_flight);
+	_commandBuffers.resize(_max_frames_in_flight);
+	_recordCommandPools.resize(_max_frames_in_flight * _recordThreads);
+	_recordCommandBuffers.resize(_max_frames_in_flight * _recordThreads);
+
+	for (int i = 0; i < _max_frames_in_flight; i++)
+	{
+		VK_CHECK(vkCreateCommandPool(_device, &framePoolInfo, nullptr, &_frameCommandPools[i]));
+
+		VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::command_buffer_allocate_info(_frameCommandPools[i], 1);
+		VK_CHECK(vkAllocateCommandBuffers(_device, &cmdAllocInfo, &_commandBuffers[i]));
 
-	VK_CHECK(vkAllocateCommandBuffers(_device, &cmdAllocInfo, _commandBuffers.data()));
+		for (uint32_t t = 0; t < _recordThreads; t++)
+		{
+			uint32_t slot = i * _recordThreads + t;
+			VK_CHECK(vkCreateCommandPool(_device, &framePoolInfo, nullptr, &_recordCommandPools[slot]));
+
+			VkCommandBufferAllocateInfo secondaryAllocInfo = vkinit::command_buffer_allocate_info(
+				_recordCommandPools[slot], 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			VK_CHECK(vkAllocateCommandBuffers(_device, &secondaryAllocInfo, &_recordCommandBuffers[slot]));
+		}
+	}
 
-	_mainDeletionQueue.push_function([=]()
-									 { vkDestroyCommandPool(_device, _commandPool, nullptr); });
+	for (VkCommandPool pool : _frameCommandPools)
+	{
+		_mainDeletionQueue.push(pool);
+	}
+	for (VkCommandPool pool : _recordCommandPools)
+	{
+		_mainDeletionQueue.push(pool);
+	}
+}
+
+void VulkanEngine::init_streaming()
+{
+	// the transfer queue writes new meshes into it while frames draw the ones already there
+	std::vector<uint32_t> families = {_graphicsQueueFamily};
+	if (_transferQueueFamily != _graphicsQueueFamily)
+	{
+		families.push_back(_transferQueueFamily);
+	}
+	_geometry.init(_allocator, GEOMETRY_VERTEX_BYTES, GEOMETRY_INDEX_BYTES, Vertex::packed_stride(MESH_VERTEX_ATTRIBUTES),
+		static_cast<uint32_t>(families.size()), families.data());
+	_mainDeletionQueue.push_call<GeometryBuffer, &GeometryBuffer::cleanup>(&_geometry);
+
+	_streamer.init(_device, _allocator, _transferQueue, _transferQueueFamily, _graphicsQueueFamily, STAGING_RING_BYTES);
+
+	// flushed late: in flight uploads finish and the loader thread stops before the allocator goes away
+	_mainDeletionQueue.push_call<AssetStreamer, &AssetStreamer::cleanup>(&_streamer);
 }
 
 void VulkanEngine::init_default_renderpass()
@@ -808,7 +1881,8 @@ void VulkanEngine::init_default_renderpass()
 	// we don't know or care about the starting layout of the attachment
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	// after the renderpass ends, the image has to be on a layout ready for display
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// (or ready to be read back when rendering offscreen)
+	colorAttachment.finalLayout = _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	// create our subpass
 	VkAttachmentReference colorAttachmentReference{};
@@ -875,8 +1949,7 @@ void VulkanEngine::init_default_renderpass()
 
 	VK_CHECK(vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass));
 
-	_mainDeletionQueue.push_function([=]()
-									 { vkDestroyRenderPass(_device, _renderPass, nullptr); });
+	_mainDeletionQueue.push(_renderPass);
 }
 
 void VulkanEngine::init_framebuffers()
@@ -904,16 +1977,17 @@ void VulkanEngine::init_framebuffers()
 		frameBufferInfo.attachmentCount = 2;
 
 		VK_CHECK(vkCreateFramebuffer(_device, &frameBufferInfo, nullptr, &_framebuffers[i]));
-
-		_mainDeletionQueue.push_function([=]()
-										 {
-			vkDestroyFramebuffer(_device, _framebuffers[i], nullptr); 
-			vkDestroyImageView(_device, _swapchainImageViews[i], nullptr); });
 	}
 }
 
 void VulkanEngine::init_sync_structures()
 {
+	_frameDeletionQueues.resize(_max_frames_in_flight);
+	for (DeletionQueue &queue : _frameDeletionQueues)
+	{
+		queue.reserve(64);
+	}
+
 	_renderFences.resize(_max_frames_in_flight);
 	_presentSemaphores.resize(_max_frames_in_flight);
 	_renderSemaphores.resize(_max_frames_in_flight);
@@ -930,13 +2004,12 @@ void VulkanEngine::init_sync_structures()
 		VK_CHECK(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &_renderSemaphores[i]));
 	}
 
-	_mainDeletionQueue.push_function([=]()
-									 {
-		for (size_t i = 0; i < _max_frames_in_flight; i++) {
-			vkDestroyFence(_device, _renderFences[i], nullptr); 
-			vkDestroySemaphore(_device, _presentSemaphores[i], nullptr); 
-			vkDestroySemaphore(_device, _renderSemaphores[i], nullptr);
-		} });
+	for (size_t i = 0; i < _max_frames_in_flight; i++)
+	{
+		_mainDeletionQueue.push(_renderFences[i]);
+		_mainDeletionQueue.push(_presentSemaphores[i]);
+		_mainDeletionQueue.push(_renderSemaphores[i]);
+	}
 }
 
 void VulkanEngine::init_uniform_buffers()
@@ -959,163 +2032,283 @@ void VulkanEngine::init_uniform_buffers()
 			VK_CHECK(result);
 			VK_CHECK(vmaMapMemory(_allocator, _uniformBuffers[i]._allocation, &_uniformBufferMappings[i]));
 
-			_mainDeletionQueue.push_function([=]()
-											 {
-				vmaUnmapMemory(_allocator, _uniformBuffers[i]._allocation); 
-				vmaDestroyBuffer(_allocator, _uniformBuffers[i]._buffer, _uniformBuffers[i]._allocation); });
+			_mainDeletionQueue.push_mapped(_uniformBuffers[i]);
 		}
 	}
+
+	// material table, rewritten every frame by prepare_draws
+	{
+		VkDeviceSize bufferSize = sizeof(GPUMaterialData) * _max_materials;
+		_materialBuffers.resize(_max_frames_in_flight);
+		_materialBufferMappings.resize(_max_frames_in_flight);
+
+		for (size_t i = 0; i < _max_frames_in_flight; i++)
+		{
+			VkResult result = vkinit::create_buffer(
+				_allocator,
+				bufferSize,
+				VMA_MEMORY_USAGE_UNKNOWN,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				_materialBuffers[i]._buffer,
+				_materialBuffers[i]._allocation);
+			VK_CHECK(result);
+			VK_CHECK(vmaMapMemory(_allocator, _materialBuffers[i]._allocation, &_materialBufferMappings[i]));
+			memset(_materialBufferMappings[i], 0, bufferSize);
+
+			_mainDeletionQueue.push_mapped(_materialBuffers[i]);
+		}
+	}
+
+	// object data, written once per frame by draw_objects and read by every instanced draw
+	{
+		VkDeviceSize bufferSize = sizeof(GPUObjectData) * _max_objects;
+		_objectBuffers.resize(_max_frames_in_flight);
+		_objectBufferMappings.resize(_max_frames_in_flight);
+
+		for (size_t i = 0; i < _max_frames_in_flight; i++)
+		{
+			VkResult result = vkinit::create_buffer(
+				_allocator,
+				bufferSize,
+				VMA_MEMORY_USAGE_UNKNOWN,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				_objectBuffers[i]._buffer,
+				_objectBuffers[i]._allocation);
+			VK_CHECK(result);
+			VK_CHECK(vmaMapMemory(_allocator, _objectBuffers[i]._allocation, &_objectBufferMappings[i]));
+
+			_mainDeletionQueue.push_mapped(_objectBuffers[i]);
+		}
+	}
+
+	// culled object ids, only ever touched by the gpu. Always created since the mesh descriptor set binds it
+	{
+		_instanceBuffers.resize(_max_frames_in_flight);
+		for (size_t i = 0; i < _max_frames_in_flight; i++)
+		{
+			VkResult result = vkinit::create_buffer(
+				_allocator,
+				sizeof(uint32_t) * instance_capacity(),
+				VMA_MEMORY_USAGE_UNKNOWN,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				_instanceBuffers[i]._buffer,
+				_instanceBuffers[i]._allocation);
+			VK_CHECK(result);
+
+			_mainDeletionQueue.push(_instanceBuffers[i]);
+		}
+	}
+
+	// indirect draw commands, the visible counter and the lod table. The cpu writes the commands with zero instances,
+	// cull.comp counts the visible objects into them
+	if (_gpuCulling)
+	{
+		_indirectBuffers.resize(_max_frames_in_flight);
+		_indirectBufferMappings.resize(_max_frames_in_flight);
+		_cullCounterBuffers.resize(_max_frames_in_flight);
+		_cullCounterMappings.resize(_max_frames_in_flight);
+		_lodBuffers.resize(_max_frames_in_flight);
+		_lodBufferMappings.resize(_max_frames_in_flight);
+		_objectDataVersions.assign(_max_frames_in_flight, 0);
+
+		for (size_t i = 0; i < _max_frames_in_flight; i++)
+		{
+			VkResult result = vkinit::create_buffer(
+				_allocator,
+				sizeof(VkDrawIndexedIndirectCommand) * _max_draw_batches,
+				VMA_MEMORY_USAGE_UNKNOWN,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				_indirectBuffers[i]._buffer,
+				_indirectBuffers[i]._allocation);
+			VK_CHECK(result);
+			VK_CHECK(vmaMapMemory(_allocator, _indirectBuffers[i]._allocation, &_indirectBufferMappings[i]));
+
+			result = vkinit::create_buffer(
+				_allocator,
+				sizeof(uint32_t),
+				VMA_MEMORY_USAGE_UNKNOWN,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				_cullCounterBuffers[i]._buffer,
+				_cullCounterBuffers[i]._allocation);
+			VK_CHECK(result);
+			VK_CHECK(vmaMapMemory(_allocator, _cullCounterBuffers[i]._allocation, &_cullCounterMappings[i]));
+			memset(_cullCounterMappings[i], 0, sizeof(uint32_t));
+
+			result = vkinit::create_buffer(
+				_allocator,
+				sizeof(GPULodData) * _max_lod_groups,
+				VMA_MEMORY_USAGE_UNKNOWN,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				_lodBuffers[i]._buffer,
+				_lodBuffers[i]._allocation);
+			VK_CHECK(result);
+			VK_CHECK(vmaMapMemory(_allocator, _lodBuffers[i]._allocation, &_lodBufferMappings[i]));
+
+			_mainDeletionQueue.push_mapped(_cullCounterBuffers[i]);
+			_mainDeletionQueue.push_mapped(_indirectBuffers[i]);
+			_mainDeletionQueue.push_mapped(_lodBuffers[i]);
+		}
+
+		// only cull.comp reads and writes it, a level out of a group's range is clamped there
+		VkResult result = vkinit::create_buffer(
+			_allocator,
+			sizeof(uint32_t) * _max_objects,
+			VMA_MEMORY_USAGE_UNKNOWN,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			_objectLodBuffer._buffer,
+			_objectLodBuffer._allocation);
+		VK_CHECK(result);
+
+		_mainDeletionQueue.push(_objectLodBuffer);
+	}
 }
 
-void VulkanEngine::init_descriptor_pool()
+void VulkanEngine::init_descriptors()
 {
-	// create a descriptor pool. This describes the total number of descriptor sets
-	// we would like, per type. We use the descriptor pool to allocate descriptor sets
-	VkDescriptorPoolSize poolSizeUniform{};
-	poolSizeUniform.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizeUniform.descriptorCount = static_cast<uint32_t>(_max_frames_in_flight);
-
-	VkDescriptorPoolSize poolSizeSampler{}; 
-	poolSizeSampler.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; 
-	poolSizeSampler.descriptorCount = static_cast<uint32_t>(_max_frames_in_flight); 
-
-	std::array<VkDescriptorPoolSize, 2> poolSizeArray = {poolSizeUniform, poolSizeSampler}; 
-
-	VkDescriptorPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = poolSizeArray.size();
-	poolInfo.pPoolSizes = poolSizeArray.data();
-	poolInfo.maxSets = static_cast<uint32_t>(_max_frames_in_flight);
-	VK_CHECK(vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool));
-
-	_mainDeletionQueue.push_function([=]() { 
-		vkDestroyDescriptorPool(_device, _descriptorPool, nullptr); 
-	});
+	_layoutCache.init(_device);
+	_mainDeletionQueue.push_call<DescriptorLayoutCache, &DescriptorLayoutCache::cleanup>(&_layoutCache);
+
+	// every set lives for one frame: a mesh set with a UBO and three storage buffers, plus six storage
+	// buffers for the cull set. The pools grow from here when a frame needs more
+	const std::vector<DescriptorPoolRatio> ratios = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5.f },
+	};
+	_frameDescriptors.resize(_max_frames_in_flight);
+	for (DescriptorAllocator &allocator : _frameDescriptors)
+	{
+		allocator.init(_device, 16, ratios);
+		_mainDeletionQueue.push_call<DescriptorAllocator, &DescriptorAllocator::cleanup>(&allocator);
+	}
+
+	// the one set that outlives frames, filled in as textures become resident
+	_textures.init(_device, _layoutCache);
+	_mainDeletionQueue.push_call<TextureTable, &TextureTable::cleanup>(&_textures);
 }
 
-void VulkanEngine::init_descriptor_set()
+void VulkanEngine::init_descriptor_templates()
 {
-	// lets allocated our uniform descriptor set, we create an exact copy for each frame in flight
-	std::vector<VkDescriptorSetLayout> layouts(_max_frames_in_flight, _descriptorSetLayout);
-	VkDescriptorSetAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = _descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(_max_frames_in_flight);
-	allocInfo.pSetLayouts = layouts.data();
-
-	_descriptorSets.resize(_max_frames_in_flight);
-	VK_CHECK(vkAllocateDescriptorSets(_device, &allocInfo, _descriptorSets.data()));
-
-	// for each of the descriptor sets we created, we need to specify
-	// which binding we want our uniform buffer to write into
-	// so we actually attach our buffer here
-	for (size_t i = 0; i < _max_frames_in_flight; i++)
+	// one template per layout, a whole set is written from one struct in a single call
+	_meshSetTemplate = create_descriptor_template(_device, _descriptorSetLayout, {
+		descriptor_template_entry(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(MeshSetWrites, scene)),
+		descriptor_template_entry(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshSetWrites, materials)),
+		descriptor_template_entry(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshSetWrites, objects)),
+		descriptor_template_entry(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshSetWrites, instances)),
+	});
+	_mainDeletionQueue.push(_meshSetTemplate);
+
+	if (!_gpuCulling)
 	{
-		// specify the buffer we created
-		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = _uniformBuffers[i]._buffer;
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UBO);
-
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = _textureImageView;
-		imageInfo.sampler = _textureSampler;
-
-		// specify the set and binding we want to write into, as well
-		// as the buffer we'll use.
-		VkWriteDescriptorSet descriptorWrite{};
-		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.dstSet = _descriptorSets[i];
-		descriptorWrite.dstBinding = 0;
-		descriptorWrite.dstArrayElement = 0;
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrite.descriptorCount = 1;
-		descriptorWrite.pBufferInfo = &bufferInfo;
-
-		VkWriteDescriptorSet descriptorImageWrite{}; 
-		descriptorImageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorImageWrite.dstSet = _descriptorSets[i];
-		descriptorImageWrite.dstBinding = 1;
-		descriptorImageWrite.dstArrayElement = 0;
-		descriptorImageWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorImageWrite.descriptorCount = 1;
-		descriptorImageWrite.pImageInfo = &imageInfo;
-
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites = {descriptorWrite, descriptorImageWrite};
-
-		vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		return;
 	}
+
+	std::vector<VkDescriptorUpdateTemplateEntry> cullEntries;
+	for (uint32_t binding = 0; binding < 6; binding++)
+	{
+		cullEntries.push_back(descriptor_template_entry(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, sizeof(VkDescriptorBufferInfo) * binding));
+	}
+	_cullSetTemplate = create_descriptor_template(_device, _cullSetLayout, cullEntries);
+	_mainDeletionQueue.push(_cullSetTemplate);
 }
 
-VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass)
+void VulkanEngine::write_frame_descriptors()
 {
-	// make viewport state from our stored viewport and scissor.
-	// at the moment we won't support multiple viewports or scissors
-	VkPipelineViewportStateCreateInfo viewportState = {};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.pNext = nullptr;
-
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &_viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &_scissor;
-
-	// setup dummy color blending. We aren't using transparent objects yet
-	// the blending is just "no blend", but we do write to the color attachment
-	VkPipelineColorBlendStateCreateInfo colorBlending = {};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.pNext = nullptr;
-
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &_colorBlendAttachment;
-
-	// build graphics pipeline from stored states
-
-	VkGraphicsPipelineCreateInfo pipelineInfo = {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.pNext = nullptr;
-
-	// our "programmable" stages. (vertex and fragment shaders)
-	pipelineInfo.stageCount = _shaderStages.size();
-	pipelineInfo.pStages = _shaderStages.data();
-	pipelineInfo.pVertexInputState = &_vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &_inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pDepthStencilState = &_depthStencil;
-	pipelineInfo.pRasterizationState = &_rasterizer;
-	pipelineInfo.pMultisampleState = &_multisampling;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.layout = _pipelineLayout; // (?)
-	pipelineInfo.renderPass = pass;
-	pipelineInfo.subpass = 0;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-	// it's easy to error out on create graphics pipeline, so we handle it a bit better than the common VK_CHECK case
-	VkPipeline newPipeline;
-	if (vkCreateGraphicsPipelines(
-			device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS)
-	{
-		std::cout << "failed to create pipeline\n";
-		return VK_NULL_HANDLE; // failed to create graphics pipeline
+	VKPROF_ZONE("write descriptors");
+	auto start = std::chrono::steady_clock::now();
+
+	// the sets of the last time this slot was used went with its fence, so the whole frame allocator
+	// starts over. Every frame writes its sets from scratch, textures live in the table's own set
+	DescriptorAllocator &allocator = _frameDescriptors[_currentFrame];
+	allocator.reset();
+
+	MeshSetWrites mesh{};
+	mesh.scene = {_uniformBuffers[_currentFrame]._buffer, 0, sizeof(UBO)};
+	mesh.materials = {_materialBuffers[_currentFrame]._buffer, 0, sizeof(GPUMaterialData) * _max_materials};
+	mesh.objects = {_objectBuffers[_currentFrame]._buffer, 0, sizeof(GPUObjectData) * _max_objects};
+	mesh.instances = {_instanceBuffers[_currentFrame]._buffer, 0, sizeof(uint32_t) * instance_capacity()};
+
+	_meshSet = allocator.allocate(_descriptorSetLayout);
+	vkUpdateDescriptorSetWithTemplate(_device, _meshSet, _meshSetTemplate, &mesh);
+
+	// load for the allocator, written like the real one but never bound
+	for (uint32_t i = 0; i < _descriptorStressSets; i++)
+	{
+		VkDescriptorSet set = allocator.allocate(_descriptorSetLayout);
+		vkUpdateDescriptorSetWithTemplate(_device, set, _meshSetTemplate, &mesh);
 	}
-	else
+
+	if (_gpuCulling)
 	{
-		return newPipeline;
+		// objects, draw commands, instance ids, counter, lod table, object levels
+		VkDescriptorBufferInfo cull[6] = {
+			{_objectBuffers[_currentFrame]._buffer, 0, sizeof(GPUObjectData) * _max_objects},
+			{_indirectBuffers[_currentFrame]._buffer, 0, sizeof(VkDrawIndexedIndirectCommand) * _max_draw_batches},
+			{_instanceBuffers[_currentFrame]._buffer, 0, sizeof(uint32_t) * instance_capacity()},
+			{_cullCounterBuffers[_currentFrame]._buffer, 0, sizeof(uint32_t)},
+			{_lodBuffers[_currentFrame]._buffer, 0, sizeof(GPULodData) * _max_lod_groups},
+			{_objectLodBuffer._buffer, 0, sizeof(uint32_t) * _max_objects},
+		};
+		_cullSet = allocator.allocate(_cullSetLayout);
+		vkUpdateDescriptorSetWithTemplate(_device, _cullSet, _cullSetTemplate, cull);
 	}
+
+	_renderStats.descriptorSets = static_cast<uint32_t>(allocator.stats().sets);
+	_renderStats.descriptorMs = vkbench::elapsed_ms(start);
 }
 
-Material *VulkanEngine::create_material(VkPipeline pipeline, VkPipelineLayout layout, const std::string &name)
+Material *VulkanEngine::create_material(PipelineHandle pipeline, VkPipelineLayout layout, const std::string &name)
 {
 	Material mat;
-	mat.pipeline = pipeline;
+	mat.pipeline = VK_NULL_HANDLE;
 	mat.pipelineLayout = layout;
+	auto existing = _materials.find(name);
+	mat.index = existing != _materials.end() ? existing->second.index : static_cast<uint32_t>(_materials.size());
+	mat.textureIndex = existing != _materials.end() ? existing->second.textureIndex : _textureIndex;
+	mat.pipelineId = 0;
+	mat.pipelineHandle = pipeline;
 	_materials[name] = mat;
+
+	// picks the fallback if it's still compiling
+	_resolvedPipelines = UINT32_MAX;
+	resolve_material_pipelines();
 	return &_materials[name];
 }
 
+void VulkanEngine::resolve_material_pipelines()
+{
+	uint32_t finished = _pipelines.finished_count();
+	if (finished != _resolvedPipelines)
+	{
+		_resolvedPipelines = finished;
+		for (auto &it : _materials)
+		{
+			Material &mat = it.second;
+			VkPipeline pipeline = _pipelines.get(mat.pipelineHandle);
+			bool ready = pipeline != VK_NULL_HANDLE;
+			mat.pipeline = ready ? pipeline : _meshPipeline;
+			mat.pipelineId = ready ? mat.pipelineHandle : _meshPipelineHandle;
+		}
+		_drawGroupsDirty = true;
+	}
+
+	// once, after init() requested the whole material set
+	if (_isInitialized && !_pipelinesReported && finished == _pipelines.pipeline_count())
+	{
+		_pipelinesReported = true;
+		PipelineLibraryStats stats = _pipelines.stats();
+		std::cout << "material pipelines: " << stats.requested << " requested, " << stats.deduplicated << " deduplicated, "
+			<< stats.compiled << " compiled, " << stats.failed << " failed in " << stats.wallMs << " ms ("
+			<< stats.compileMs << " ms compiling on " << _jobs->thread_count() << " workers, slowest " << stats.maxCompileMs << " ms)" << std::endl;
+	}
+}
+
 Material *VulkanEngine::get_material(const std::string &name)
 {
 	// search for the object, and return nullptr if not found
@@ -1143,49 +2336,516 @@ Mesh *VulkanEngine::get_mesh(const std::string &name)
 	}
 }
 
-void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject *first, int count)
+Mesh *VulkanEngine::drawable_mesh(Mesh *mesh) const
+{
+	return mesh->_resident ? mesh : _placeholderMesh;
+}
+
+void VulkanEngine::prepare_draws(RenderObject *first, int count)
 {
-	// make a model view matrix for rendering the object
+	VKPROF_ZONE("prepare draws");
+	auto start = std::chrono::steady_clock::now();
+
+	// make a view projection matrix, the trackball rotates the whole scene
 	// camera view
 	glm::vec3 camPos = {0.f, 0.f, -7.f};
-	glm::mat4 view = glm::translate(glm::mat4(1.f), camPos);
-	glm::mat4 projection = glm::perspective(glm::radians(70.f), (float)_windowExtent.width / (float)_windowExtent.height, 0.1f, 200.0f);
+	glm::mat4 rot = glm::toMat4(_cameraRotation);
+	glm::mat4 view = glm::translate(glm::mat4(1.f), camPos) * rot;
+	const float fov = glm::radians(70.f);
+	const float nearPlane = 0.1f;
+	const float farPlane = 200.f;
+	glm::mat4 projection = glm::perspective(fov, (float)_windowExtent.width / (float)_windowExtent.height, nearPlane, farPlane);
 	projection[1][1] *= -1;
+	_viewProjection = projection * view;
+
+	UBO ubo{
+		.viewProjection = _viewProjection,
+		.time = static_cast<float>(_frameNumber)};
+
+	memcpy(_uniformBufferMappings[_currentFrame], &ubo, sizeof(UBO));
+
+	count = std::min(count, static_cast<int>(_max_objects));
+	_renderStats = RenderStats{};
+	_renderStats.objects = static_cast<uint32_t>(count);
+
+	// the material table is a few bytes per material, rewritten whole so a texture that became resident
+	// shows up without tracking which slot last saw which index
+	GPUMaterialData *materialData = static_cast<GPUMaterialData *>(_materialBufferMappings[_currentFrame]);
+	for (const auto &it : _materials)
+	{
+		if (it.second.index < _max_materials)
+		{
+			materialData[it.second.index].textureIndex = it.second.textureIndex;
+		}
+	}
+
+	// levels of detail are picked by how many pixels their error covers. The near side of the bounding sphere is
+	// as close as the mesh gets, a world unit at distance d spans pixelsPerWorldUnit / d pixels there
+	const float pixelsPerWorldUnit = static_cast<float>(_windowExtent.height) / (2.f * std::tan(fov * 0.5f));
+
+	if (_gpuCulling)
+	{
+		// cull.comp culls and picks the levels from the camera's world position
+		Frustum frustum = frustum_from_matrix(_viewProjection);
+		for (int i = 0; i < 6; i++)
+		{
+			_cullConstants.planes[i] = frustum.planes[i];
+		}
+		_cullConstants.camera = glm::vec4(glm::vec3(glm::inverse(view)[3]), pixelsPerWorldUnit);
+		_cullConstants.objectCount = static_cast<uint32_t>(count);
+		_cullConstants.lodErrorPixels = _lodErrorPixels;
+		_cullConstants.lodHysteresis = _lodHysteresis;
+		_cullConstants.nearPlane = nearPlane;
+
+		prepare_gpu_draws(first, static_cast<uint32_t>(count));
+		_renderStats.recordMs = vkbench::elapsed_ms(start);
+		return;
+	}
+
+	// cpu culling shrinks the object list to what the camera sees, every later step only walks the visible ones
+	auto cullStart = std::chrono::steady_clock::now();
+	if (_cullDataDirty || _cullData.count != static_cast<uint32_t>(count))
+	{
+		_cullData.resize(static_cast<uint32_t>(count));
+		_jobs->parallel_for(static_cast<uint32_t>(count), PARALLEL_OBJECT_GRAIN, [&](uint32_t firstObject, uint32_t lastObject, uint32_t)
+							{
+			VKPROF_ZONE("update cull data");
+			for (uint32_t i = firstObject; i < lastObject; i++)
+			{
+				const MeshBounds &bounds = drawable_mesh(first[i].mesh)->_bounds;
+				_cullData.set(i, first[i].transformMatrix, bounds.center, bounds.radius);
+			} });
+		_cullDataDirty = false;
+	}
+
+	_visibleObjects.resize(_cullData.padded_count());
+	uint32_t visibleCount = static_cast<uint32_t>(count);
+	if (_cpuCulling)
+	{
+		// every job culls a lane aligned slice into the same slice of _visibleObjects, the slices are packed together after
+		Frustum frustum = frustum_from_matrix(_viewProjection);
+		uint32_t chunks = _cullData.padded_count() / CULLING_LANES;
+		std::vector<uint32_t> sliceCounts(chunks, 0);
+		_jobs->parallel_for(chunks, PARALLEL_OBJECT_GRAIN / CULLING_LANES, [&](uint32_t firstChunk, uint32_t lastChunk, uint32_t)
+							{
+			VKPROF_ZONE("cull objects");
+			uint32_t firstSphere = firstChunk * CULLING_LANES;
+			sliceCounts[firstChunk] = cull_spheres(frustum, _cullData, firstSphere, lastChunk * CULLING_LANES, &_visibleObjects[firstSphere]); });
+
+		visibleCount = 0;
+		for (uint32_t c = 0; c < chunks; c++)
+		{
+			if (sliceCounts[c] > 0)
+			{
+				memmove(&_visibleObjects[visibleCount], &_visibleObjects[c * CULLING_LANES], sliceCounts[c] * sizeof(uint32_t));
+				visibleCount += sliceCounts[c];
+			}
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < visibleCount; i++)
+		{
+			_visibleObjects[i] = i;
+		}
+	}
+	_renderStats.cullMs = vkbench::elapsed_ms(cullStart);
+	_renderStats.visibleObjects = visibleCount;
+
+	_objectLods.resize(static_cast<size_t>(count), 0);
+
+	// sort the visible objects by state, then front to back. The depth is the view distance of the bounding sphere
+	// center, the camera looks down -z
+	_renderQueue.clear();
+	for (uint32_t v = 0; v < visibleCount; v++)
+	{
+		uint32_t i = _visibleObjects[v];
+		const Mesh *mesh = drawable_mesh(first[i].mesh);
+		glm::vec4 viewCenter = view * glm::vec4(_cullData.centerX[i], _cullData.centerY[i], _cullData.centerZ[i], 1.f);
 
-	Mesh *lastMesh = nullptr;
-	Material *lastMaterial = nullptr;
+		uint32_t lod = 0;
+		uint32_t lodCount = static_cast<uint32_t>(mesh->_lods.size());
+		if (_lodErrorPixels > 0.f && lodCount > 1)
+		{
+			// level errors are in model units, the sphere radius against the mesh's tells how far the transform scales them
+			float distance = std::max(glm::length(glm::vec3(viewCenter)) - _cullData.radius[i], nearPlane);
+			float scale = mesh->_bounds.radius > 0.f ? _cullData.radius[i] / mesh->_bounds.radius : 1.f;
+			lod = select_lod(mesh->_lods.data(), lodCount, pixelsPerWorldUnit * scale / distance, _lodErrorPixels,
+				_lodHysteresis, _objectLods[i]);
+		}
+		_objectLods[i] = static_cast<uint8_t>(lod);
 
-	for (int i = 0; i < count; i++)
+		uint64_t key = v;
+		if (_sortDraws)
+		{
+			uint32_t depth = sortkey::quantize_depth(-viewCenter.z, farPlane);
+			// every material shares the frame's sets, so the descriptor bits stay clear and meshes of
+			// different materials still end up next to each other. Levels of a mesh sort like meshes of their own
+			key = sortkey::make(first[i].material->pipelineId, 0, mesh->_id * MAX_MESH_LODS + lod, depth);
+		}
+		_renderQueue.push(key, i);
+	}
+	if (_sortDraws)
 	{
-		RenderObject &object = first[i];
-		if (object.material != lastMaterial)
+		_renderQueue.sort();
+	}
+	const std::vector<uint32_t> &drawOrder = _renderQueue.objects;
+
+	// consecutive queued objects sharing mesh, level and pipeline collapse into one instanced draw
+	_drawBatches.clear();
+	for (uint32_t q = 0; q < visibleCount; q++)
+	{
+		const RenderObject &object = first[drawOrder[q]];
+		Mesh *mesh = drawable_mesh(object.mesh);
+		uint32_t lod = _objectLods[drawOrder[q]];
+		if (_drawBatches.empty() || _drawBatches.back().mesh != mesh || _drawBatches.back().lod != lod
+			|| _drawBatches.back().material->pipeline != object.material->pipeline)
 		{
-			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, object.material->pipeline);
-			lastMaterial = object.material;
+			_drawBatches.push_back(DrawBatch{mesh, object.material, q, 0, lod});
 		}
+		_drawBatches.back().objectCount++;
+	}
+
+	for (const DrawBatch &batch : _drawBatches)
+	{
+		_renderStats.triangles += uint64_t(batch.objectCount) * (batch.mesh->_lods[batch.lod].indexCount / 3);
+		_renderStats.fullTriangles += uint64_t(batch.objectCount) * (batch.mesh->_lods[0].indexCount / 3);
+	}
 
-		glm::mat4 rot = glm::toMat4(_currTrackballQ * _lastTrackballQ);
-		glm::mat4 model = rot * object.transformMatrix;
-		glm::mat4 mesh_matrix = projection * view * model;
+	// write every visible object once into this frame's storage buffer, the shader picks its entry with gl_InstanceIndex.
+	// Jobs take ranges of the draw order and look up the batch their range starts in
+	GPUObjectData *objectData = static_cast<GPUObjectData *>(_objectBufferMappings[_currentFrame]);
+	_jobs->parallel_for(visibleCount, PARALLEL_OBJECT_GRAIN, [&](uint32_t firstDraw, uint32_t lastDraw, uint32_t)
+						{
+		VKPROF_ZONE("write object data");
+		auto batchAfter = std::upper_bound(_drawBatches.begin(), _drawBatches.end(), firstDraw,
+			[](uint32_t draw, const DrawBatch &batch) { return draw < batch.firstObject; });
+		uint32_t b = static_cast<uint32_t>(batchAfter - _drawBatches.begin()) - 1;
+
+		while (firstDraw < lastDraw)
+		{
+			const DrawBatch &batch = _drawBatches[b];
+			glm::mat4 dequantize = batch.mesh->dequantize_matrix();
+			uint32_t batchEnd = std::min(lastDraw, batch.firstObject + batch.objectCount);
+			for (uint32_t v = firstDraw; v < batchEnd; v++)
+			{
+				GPUObjectData data{};
+				data.model = first[drawOrder[v]].transformMatrix * dequantize;
+				data.materialIndex = first[drawOrder[v]].material->index;
+				data.batchIndex = b;
+				objectData[v] = data;
+			}
+			firstDraw = batchEnd;
+			b++;
+		} });
+
+	_renderStats.recordMs = vkbench::elapsed_ms(start);
+}
+
+void VulkanEngine::prepare_gpu_draws(RenderObject *first, uint32_t count)
+{
+	// the counter and draw commands still hold what the cull pass found the last time this frame slot ran. The
+	// commands only line up with _drawBatches if the groups weren't rebuilt since
+	uint32_t *visibleCounter = static_cast<uint32_t *>(_cullCounterMappings[_currentFrame]);
+	_renderStats.visibleObjects = *visibleCounter;
+	*visibleCounter = 0;
+
+	VkDrawIndexedIndirectCommand *commands = static_cast<VkDrawIndexedIndirectCommand *>(_indirectBufferMappings[_currentFrame]);
+	if (_objectDataVersions[_currentFrame] == _drawGroupsVersion)
+	{
+		for (uint32_t b = 0; b < _drawBatches.size(); b++)
+		{
+			_renderStats.triangles += uint64_t(commands[b].instanceCount) * (commands[b].indexCount / 3);
+			_renderStats.fullTriangles += uint64_t(commands[b].instanceCount) * (_drawBatches[b].mesh->_lods[0].indexCount / 3);
+		}
+	}
+
+	// nothing below is per object unless the scene changed since this slot last ran
+	if (_cullDataDirty || _drawGroupsDirty || _objectGroups.size() != count)
+	{
+		build_draw_groups(first, count);
+		_cullDataDirty = false;
+		_drawGroupsDirty = false;
+	}
+
+	if (_objectDataVersions[_currentFrame] != _drawGroupsVersion)
+	{
+		// in _renderables order, cull.comp writes the instance ids the draws find them with
+		GPUObjectData *objectData = static_cast<GPUObjectData *>(_objectBufferMappings[_currentFrame]);
+		uint32_t lodGroups = static_cast<uint32_t>(_lodGroups.size());
+		_jobs->parallel_for(count, PARALLEL_OBJECT_GRAIN, [&](uint32_t firstObject, uint32_t lastObject, uint32_t)
+							{
+			VKPROF_ZONE("write object data");
+			for (uint32_t i = firstObject; i < lastObject; i++)
+			{
+				uint32_t group = _objectGroups[i];
+				GPUObjectData data{};
+				data.model = first[i].transformMatrix * drawable_mesh(first[i].mesh)->dequantize_matrix();
+				data.materialIndex = first[i].material->index;
+				data.batchIndex = _groupFirstBatch[group];
+				data.lodGroup = group < lodGroups ? group : NO_LOD_GROUP;
+				objectData[i] = data;
+			} });
+		memcpy(_lodBufferMappings[_currentFrame], _lodGroups.data(), sizeof(GPULodData) * _lodGroups.size());
+		_objectDataVersions[_currentFrame] = _drawGroupsVersion;
+	}
+
+	// each batch owns an instance id range its whole group fits in, cull.comp fills in instanceCount
+	for (uint32_t b = 0; b < _drawBatches.size(); b++)
+	{
+		const MeshLod &lod = _drawBatches[b].mesh->_lods[_drawBatches[b].lod];
+		VkDrawIndexedIndirectCommand command{};
+		command.indexCount = lod.indexCount;
+		command.instanceCount = 0;
+		command.firstIndex = _drawBatches[b].mesh->_firstIndex + lod.firstIndex;
+		command.vertexOffset = _drawBatches[b].mesh->_vertexOffset;
+		command.firstInstance = _drawBatches[b].firstObject;
+		commands[b] = command;
+	}
+}
+
+void VulkanEngine::build_draw_groups(RenderObject *first, uint32_t count)
+{
+	VKPROF_ZONE("build draw groups");
+
+	// objects of one pipeline and mesh share a group, keyed like the cpu path sorts them
+	struct DrawGroup {
+		uint64_t key;
+		Mesh *mesh;
+		Material *material;
+		uint32_t objectCount;
+	};
+	std::vector<DrawGroup> groups;
+	std::unordered_map<uint64_t, uint32_t> groupOfKey;
+	_objectGroups.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Mesh *mesh = drawable_mesh(first[i].mesh);
+		uint64_t key = sortkey::make(first[i].material->pipelineId, 0, mesh->_id * MAX_MESH_LODS, 0);
+		auto inserted = groupOfKey.emplace(key, static_cast<uint32_t>(groups.size()));
+		if (inserted.second)
+		{
+			groups.push_back(DrawGroup{key, mesh, first[i].material, 0});
+		}
+		groups[inserted.first->second].objectCount++;
+		_objectGroups[i] = inserted.first->second;
+	}
 
-		UBO ubo{
-			.time = static_cast<float>(_frameNumber),
-			.mvp = mesh_matrix};
+	// groups in key order keep a pipeline's batches next to each other, record_batches draws them with one call
+	std::vector<uint32_t> order(groups.size());
+	std::iota(order.begin(), order.end(), 0u);
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return groups[a].key < groups[b].key; });
+
+	std::vector<uint32_t> rank(groups.size());
+	_drawBatches.clear();
+	_groupFirstBatch.clear();
+	_lodGroups.clear();
+	uint32_t firstInstance = 0;
+	for (uint32_t r = 0; r < order.size(); r++)
+	{
+		const DrawGroup &group = groups[order[r]];
+		rank[order[r]] = r;
+		_groupFirstBatch.push_back(static_cast<uint32_t>(_drawBatches.size()));
 
-		memcpy(_uniformBufferMappings[_currentFrame], &ubo, sizeof(UBO));
+		// a batch per level, each with room for the whole group since cull.comp may put every object in any of them
+		uint32_t levels = r < _max_lod_groups ? static_cast<uint32_t>(group.mesh->_lods.size()) : 1;
+		for (uint32_t l = 0; l < levels; l++)
+		{
+			_drawBatches.push_back(DrawBatch{group.mesh, group.material, firstInstance, group.objectCount, l});
+			firstInstance += group.objectCount;
+		}
 
-		// only bind the mesh if it's a different one from last bind
-		if (object.mesh != lastMesh)
+		if (r < _max_lod_groups)
 		{
-			VkDeviceSize offset = 0;
-			vkCmdBindVertexBuffers(cmd, 0, 1, &object.mesh->_vertexBuffer._buffer, &offset);
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, object.material->pipelineLayout, 0, 1, &_descriptorSets[_currentFrame], 0, nullptr);
-			vkCmdBindIndexBuffer(cmd, object.mesh->_indexBuffer._buffer, 0, VK_INDEX_TYPE_UINT32);
-			lastMesh = object.mesh;
+			const MeshBounds &bounds = group.mesh->_bounds;
+			GPULodData lod{};
+			lod.extent = glm::vec4(bounds.max - bounds.min, bounds.radius);
+			for (uint32_t l = 0; l < levels; l++)
+			{
+				lod.errors[l] = group.mesh->_lods[l].error;
+			}
+			lod.lodCount = levels;
+			_lodGroups.push_back(lod);
 		}
+	}
+
+	for (uint32_t &group : _objectGroups)
+	{
+		group = rank[group];
+	}
+	_drawGroupsVersion++;
+}
+
+void VulkanEngine::cull_objects(VkCommandBuffer cmd)
+{
+	VKPROF_ZONE("record gpu culling");
+	auto start = std::chrono::steady_clock::now();
+
+	// the object levels are shared by the frame slots, the previous frame's pass has to be done with them
+	VkMemoryBarrier lodBarrier{};
+	lodBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	lodBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	lodBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &lodBarrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 0, 1, &_cullSet, 0, nullptr);
+	vkCmdPushConstants(cmd, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &_cullConstants);
+	vkCmdDispatch(cmd, (_cullConstants.objectCount + 63) / 64, 1, 1);
+
+	// draw commands and instance ids have to land before the indirect draws read them. The counter and the
+	// instance counts are read back by prepare_gpu_draws() once the frame fence signaled, the host half makes
+	// them visible there. Both buffers are host coherent, so nothing needs invalidating on the cpu side
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	_renderStats.recordMs += vkbench::elapsed_ms(start);
+}
+
+uint32_t VulkanEngine::record_thread_count() const
+{
+	uint32_t batches = static_cast<uint32_t>(_drawBatches.size());
+	return std::clamp(batches / MIN_BATCHES_PER_RECORD_THREAD, 1u, _recordThreads);
+}
 
-		vkCmdDrawIndexed(cmd, static_cast<uint32_t>(object.mesh->_indices.size()), 1, 0, 0, 0);
+void VulkanEngine::draw_objects(VkCommandBuffer cmd, VkFramebuffer framebuffer)
+{
+	VKPROF_ZONE("record draws");
+	auto start = std::chrono::steady_clock::now();
+
+	uint32_t threads = record_thread_count();
+	uint32_t batchCount = static_cast<uint32_t>(_drawBatches.size());
+	if (threads <= 1)
+	{
+		record_batches(cmd, 0, batchCount, _renderStats);
+		_renderStats.recordMs += vkbench::elapsed_ms(start);
+		_frameNumber++;
+		return;
 	}
 
+	// every job records a contiguous slice of the sorted batches into the slice's own secondary buffer,
+	// so the primary executes them in draw order
+	std::vector<RenderStats> threadStats(threads);
+	auto record_slice = [&](uint32_t t) {
+		VKPROF_ZONE("record draw slice");
+		uint32_t slot = _currentFrame * _recordThreads + t;
+		VK_CHECK(vkResetCommandPool(_device, _recordCommandPools[slot], 0));
+
+		VkCommandBufferInheritanceInfo inheritanceInfo = {};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = _renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = framebuffer;
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VkCommandBuffer secondary = _recordCommandBuffers[slot];
+		VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+		record_batches(secondary, batchCount * t / threads, batchCount * (t + 1) / threads, threadStats[t]);
+		VK_CHECK(vkEndCommandBuffer(secondary));
+	};
+
+	_jobs->parallel_for(threads, 1, [&](uint32_t firstSlice, uint32_t lastSlice, uint32_t)
+						{
+		for (uint32_t t = firstSlice; t < lastSlice; t++)
+		{
+			record_slice(t);
+		} });
+
+	vkCmdExecuteCommands(cmd, threads, &_recordCommandBuffers[_currentFrame * _recordThreads]);
+
+	for (const RenderStats &stats : threadStats)
+	{
+		_renderStats.drawCalls += stats.drawCalls;
+		_renderStats.pipelineBinds += stats.pipelineBinds;
+		_renderStats.descriptorBinds += stats.descriptorBinds;
+		_renderStats.meshBinds += stats.meshBinds;
+	}
+
+	_renderStats.recordMs += vkbench::elapsed_ms(start);
+
 	_frameNumber++;
 }
+
+void VulkanEngine::record_batches(VkCommandBuffer cmd, uint32_t firstBatch, uint32_t lastBatch, RenderStats &stats)
+{
+	// a fresh command buffer has no state bound, so each slice starts from nothing
+	VkPipeline lastPipeline = VK_NULL_HANDLE;
+	VkIndexType lastIndexType = VK_INDEX_TYPE_MAX_ENUM;
+
+	// dynamic state isn't inherited by secondary command buffers, every slice sets it
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(_windowExtent.width);
+	viewport.height = static_cast<float>(_windowExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.extent = _windowExtent;
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	// every mesh lives in the geometry buffer, one vertex buffer bind covers the whole slice
+	VkBuffer vertexBuffer = _geometry.vertex_buffer();
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, &offset);
+
+	// the frame's buffers and every texture, bound once for the slice. All mesh pipelines share the layout,
+	// so binding a pipeline leaves them in place
+	VkDescriptorSet sets[2] = {_meshSet, _textures.set()};
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _meshPipelineLayout, 0, 2, sets, 0, nullptr);
+	stats.descriptorBinds++;
+
+	for (uint32_t b = firstBatch; b < lastBatch; b++)
+	{
+		const DrawBatch &batch = _drawBatches[b];
+
+		if (batch.material->pipeline != lastPipeline)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, batch.material->pipeline);
+			lastPipeline = batch.material->pipeline;
+			stats.pipelineBinds++;
+		}
+
+		// 16 and 32 bit meshes share the index buffer, it's only rebound when the index type changes
+		if (batch.mesh->_indexType != lastIndexType)
+		{
+			vkCmdBindIndexBuffer(cmd, _geometry.index_buffer(), 0, batch.mesh->_indexType);
+			lastIndexType = batch.mesh->_indexType;
+			stats.meshBinds++;
+		}
+
+		if (_gpuCulling)
+		{
+			// the following batches of the same pipeline and index type go out with this one, levels and meshes
+			// nothing picked are draws of zero instances
+			uint32_t runEnd = b + 1;
+			while (runEnd < lastBatch && _drawBatches[runEnd].material->pipeline == lastPipeline
+				&& _drawBatches[runEnd].mesh->_indexType == lastIndexType)
+			{
+				runEnd++;
+			}
+			vkCmdDrawIndexedIndirect(cmd, _indirectBuffers[_currentFrame]._buffer, b * sizeof(VkDrawIndexedIndirectCommand),
+				runEnd - b, sizeof(VkDrawIndexedIndirectCommand));
+			b = runEnd - 1;
+		}
+		else
+		{
+			// firstInstance keeps gl_InstanceIndex pointing at the right object data
+			const MeshLod &lod = batch.mesh->_lods[batch.lod];
+			vkCmdDrawIndexed(cmd, lod.indexCount, batch.objectCount, batch.mesh->_firstIndex + lod.firstIndex, batch.mesh->_vertexOffset, batch.firstObject);
+		}
+		stats.drawCalls++;
+	}
+}
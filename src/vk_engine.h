@@ -9,15 +9,35 @@
 #include <deque> 
 #include <vk_mem_alloc.h>
 #include <vk_mesh.h>
+#include <vk_benchmark.h>
+#include <vk_culling.h>
+#include <vk_render_queue.h>
+#include <vk_jobs.h>
+#include <vk_streaming.h>
+#include <vk_geometry.h>
+#include <vk_texture.h>
+#include <vk_pipeline_cache.h>
+#include <vk_pipelines.h>
+#include <vk_profiler.h>
+#include <vk_gpu_profiler.h>
+#include <vk_deletion_queue.h>
+#include <vk_descriptors.h>
+#include <vk_snapshot.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <atomic>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
 struct Material {
-	VkPipeline pipeline;
+	VkPipeline pipeline; // the fallback pipeline until pipelineHandle has compiled
 	VkPipelineLayout pipelineLayout;
+	uint32_t index; // written into GPUObjectData for the shaders, entry of the material table
+	uint32_t textureIndex; // slot in the texture table, changes when a streamed texture replaces its placeholder
+	uint32_t pipelineId; // handle of the pipeline bound for it, goes into the draw sort key
+	PipelineHandle pipelineHandle;
 };
 
 struct RenderObject {
@@ -26,57 +46,124 @@ struct RenderObject {
 	glm::mat4 transformMatrix;
 };
 
-struct MeshPushConstants {
-	glm::vec4 data;
-	glm::mat4 render_matrix;
+// one entry per renderable in the per-frame object storage buffer, indexed by gl_InstanceIndex.
+// std430 layout, padded to a multiple of 16 bytes
+struct GPUObjectData {
+	glm::mat4 model; // includes the mesh dequantization
+	uint32_t materialIndex;
+	uint32_t batchIndex; // draw batch the gpu culling appends the object to, with gpu lod the group's first level
+	uint32_t lodGroup;   // into the lod table cull.comp picks the level with, NO_LOD_GROUP draws level 0
+	uint32_t padding;
 };
 
-struct DeletionQueue
-{
-	std::deque<std::function<void()>> deletors;
+const uint32_t NO_LOD_GROUP = ~0u;
+
+// levels of detail of one gpu culling draw group, the batches of its levels follow each other. std430 layout
+struct GPULodData {
+	glm::vec4 extent; // xyz model units per quantized unit, takes the scale back out of the object's model matrix. w bounding radius in model units
+	float errors[MAX_MESH_LODS];
+	uint32_t lodCount;
+	uint32_t padding[3];
+};
 
-	void push_function(std::function<void()>&& function) {
-		deletors.push_back(function);
-	}
 
-	void flush() {
-		// reverse iterate the deletion queue to execute all the functions
-		for (auto it = deletors.rbegin(); it != deletors.rend(); it++) {
-			(*it)(); //call the function
-		}
+// one entry per material in the per-frame material storage buffer, indexed by GPUObjectData::materialIndex.
+// std430 layout, padded to 16 bytes
+struct GPUMaterialData {
+	uint32_t textureIndex; // into the bindless texture array
+	uint32_t padding[3];
+};
 
-		deletors.clear();
-	}
+// run of consecutive renderables sharing mesh, level of detail and pipeline, drawn with one instanced draw.
+// Materials only differ in what the shaders read from the material table, so they don't split batches.
+// With gpu culling it's one level of a draw group instead, the instance id range cull.comp fills
+struct DrawBatch {
+	Mesh* mesh;
+	Material* material;
+	uint32_t firstObject; // into the draw order, or the instance ids with gpu culling
+	uint32_t objectCount; // the group's object count with gpu culling, an upper bound of what gets drawn
+	uint32_t lod; // into mesh->_lods
 };
 
-struct PipelineBuilder {
-	std::vector<VkPipelineShaderStageCreateInfo> _shaderStages;
-	VkPipelineVertexInputStateCreateInfo _vertexInputInfo;
-	VkPipelineInputAssemblyStateCreateInfo _inputAssembly;
-	VkViewport _viewport;
-	VkRect2D _scissor;
-	VkPipelineRasterizationStateCreateInfo _rasterizer;
-	VkPipelineColorBlendAttachmentState _colorBlendAttachment;
-	VkPipelineMultisampleStateCreateInfo _multisampling;
-	VkPipelineLayout _pipelineLayout;
-	VkPipelineDepthStencilStateCreateInfo _depthStencil;
-
-	VkPipeline build_pipeline(VkDevice device, VkRenderPass pass);
+// push constants of cull.comp
+struct CullConstants {
+	glm::vec4 planes[6];
+	glm::vec4 camera; // world space position, w pixels per world unit at distance 1
+	uint32_t objectCount;
+	float lodErrorPixels; // 0 draws level 0 only
+	float lodHysteresis;
+	float nearPlane;
 };
 
+// counters filled by prepare_draws/draw_objects every frame
+struct RenderStats {
+	uint32_t objects = 0;
+	uint32_t visibleObjects = 0; // gpu culling reads this back, so it lags _max_frames_in_flight frames behind
+	double cullMs = 0.0;         // cpu frustum culling, part of recordMs
+	uint32_t drawCalls = 0;
+	uint32_t pipelineBinds = 0;
+	uint32_t descriptorBinds = 0;
+	uint32_t meshBinds = 0;      // index buffer binds, once per slice and index type change
+	uint32_t descriptorSets = 0; // allocated and written this frame
+	double descriptorMs = 0.0;
+	double recordMs = 0.0; // object data upload + draw recording
+	uint64_t triangles = 0;     // drawn at the selected levels of detail, lags like visibleObjects with gpu culling
+	uint64_t fullTriangles = 0; // the same objects all at full detail
+};
+
+// per-frame scene data, per-object data lives in the object storage buffer
 struct UBO {
-	glm::mat4 mvp;
+	glm::mat4 viewProjection;
 	float time;
 }; 
 
+// everything the render thread takes from the simulation for a frame, handed over through a TripleBuffer
+struct FrameSnapshot {
+	glm::quat camera{ 1.f, 0.f, 0.f, 0.f }; // trackball rotation of the scene
+	VkExtent2D drawableExtent{ 0, 0 };      // the swapchain is rebuilt when this changes
+	bool minimized{ false };
+	uint64_t inputSampledNs{ 0 };           // vkprof::now_ns() right after the input went in
+	uint64_t sceneVersion{ 0 };             // version of transforms, copied only when the slot is behind
+	std::vector<glm::mat4> transforms;      // of _renderables
+};
+
+// where the threads of run() spend their time, written by the thread a field belongs to and
+// taken by the periodic report
+struct FrameLoopStats {
+	std::atomic<uint64_t> mainBlockedNs{ 0 };   // waiting for input
+	std::atomic<uint64_t> mainBusyNs{ 0 };      // event handling and snapshot writes
+	std::atomic<uint32_t> snapshots{ 0 };
+	std::atomic<uint64_t> renderBlockedNs{ 0 }; // frame fence, swapchain acquire and present
+	std::atomic<uint64_t> renderBusyNs{ 0 };
+	std::atomic<uint32_t> frames{ 0 };
+	std::atomic<uint32_t> repeatedFrames{ 0 };  // drawn from a snapshot an earlier frame already drew
+};
+
+const char* present_mode_name(VkPresentModeKHR mode);
+
 class VulkanEngine {
 public:
 	VmaAllocator _allocator; //vma lib allocator
 
-	const int _max_frames_in_flight = 2;
+	static const int MAX_FRAMES_IN_FLIGHT = 4; // upper bound of _max_frames_in_flight
+	const uint32_t _max_objects = 128 * 1024;
+	const uint32_t _max_materials = 4096;
+	const uint32_t _max_lod_groups = 4096; // gpu culling draw groups beyond it only draw level 0
+	const uint32_t _max_draw_batches = _max_objects + _max_lod_groups * (MAX_MESH_LODS - 1);
 	uint32_t _currentFrame = 0;
 
-	DeletionQueue _mainDeletionQueue;
+	DeletionQueue _mainDeletionQueue; // flushed once on cleanup
+
+	// objects released while frames in flight may still use them, flushed when the slot's fence has signaled
+	std::vector<DeletionQueue> _frameDeletionQueues;
+
+	// released since the last submit, handed to the frame slot that submits next. A frame that bails out
+	// before its submit (out of date swapchain, minimized window) leaves its fence signaled for frames
+	// that were submitted before the release, so the slot's own queue would be flushed too early
+	DeletionQueue _pendingDeletions;
+
+	// runs culling, object data updates and command recording, created first in init()
+	std::unique_ptr<JobSystem> _jobs;
 	
 	VkInstance _instance; // Vulkan library handle
 	VkDebugUtilsMessengerEXT _debug_messenger; // Vulkan debug output handle
@@ -87,16 +174,104 @@ public:
 	glm::quat _lastTrackballQ = glm::quat(1.f, 0.f, 0.f, 0.f);
 	glm::quat _currTrackballQ = glm::quat(1.f ,0.f, 0.f, 0.f); 
 	glm::vec3 _startTrackballV = glm::vec3(0.f); 
-
-	VkDescriptorPool _descriptorPool; 
+	VkExtent2D _trackballExtent; // window size the mouse coordinates are in
+	VkExtent2D _offscreenExtent; // headless render target size, fixed by init(). _windowExtent belongs to the render thread
+
+	// simulation state, owned by the thread running run(). The render thread only sees it through _snapshots
+	std::vector<glm::mat4> _sceneTransforms; // of _renderables
+	uint64_t _sceneVersion{ 1 };             // bumped whenever _sceneTransforms change
+
+	// run() publishes a snapshot after every round of input, the render thread draws the newest one
+	TripleBuffer<FrameSnapshot> _snapshots;
+	std::thread _renderThread;
+	std::atomic<bool> _renderQuit{ false };
+	FrameLoopStats _loopStats;
+
+	// render side of the snapshot last read
+	glm::quat _cameraRotation{ 1.f, 0.f, 0.f, 0.f };
+	VkExtent2D _drawableExtent;
+	bool _windowMinimized{ false };
+	uint64_t _drawnSceneVersion{ 0 };
+	uint64_t _frameBlockedNs{ 0 }; // fence wait, acquire and present of the last draw()
+
+	// set layouts come from the cache, sets from the frame slot's allocator and are written every frame
+	DescriptorLayoutCache _layoutCache;
+	std::vector<DescriptorAllocator> _frameDescriptors; // reset once the slot's fence has signaled
 	VkDescriptorSetLayout _descriptorSetLayout; 
-	std::vector<VkDescriptorSet> _descriptorSets; 
+	VkDescriptorUpdateTemplate _meshSetTemplate;
+	VkDescriptorSet _meshSet; // the current frame's
 	std::vector<AllocatedBuffer> _uniformBuffers; 
+	std::vector<AllocatedBuffer> _materialBuffers; // GPUMaterialData[_max_materials], persistently mapped
+	std::vector<void*> _materialBufferMappings;
 	std::vector<void*> _uniformBufferMappings; 
+	std::vector<AllocatedBuffer> _objectBuffers; // GPUObjectData[_max_objects], persistently mapped
+	std::vector<void*> _objectBufferMappings;
+	std::vector<AllocatedBuffer> _instanceBuffers; // visible object ids per draw batch, written by cull.comp
+	uint32_t instance_capacity() const { return _gpuCulling ? _max_objects * MAX_MESH_LODS : _max_objects; }
+
+	// gpu driven culling, only created with _gpuCulling
+	VkDescriptorSetLayout _cullSetLayout{ VK_NULL_HANDLE };
+	VkPipelineLayout _cullPipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline _cullPipeline{ VK_NULL_HANDLE };
+	VkDescriptorUpdateTemplate _cullSetTemplate{ VK_NULL_HANDLE };
+	VkDescriptorSet _cullSet; // the current frame's
+	std::vector<AllocatedBuffer> _indirectBuffers; // VkDrawIndexedIndirectCommand per draw batch, persistently mapped
+	std::vector<void*> _indirectBufferMappings;
+	std::vector<AllocatedBuffer> _cullCounterBuffers; // visible object count, persistently mapped
+	std::vector<void*> _cullCounterMappings;
+	std::vector<AllocatedBuffer> _lodBuffers; // GPULodData[_max_lod_groups], persistently mapped
+	std::vector<void*> _lodBufferMappings;
+	AllocatedBuffer _objectLodBuffer; // level every object drew with last frame, shared by the frame slots for the hysteresis
+
+	// draw groups are runs of objects sharing pipeline and mesh, in _renderables order otherwise. Rebuilt when the
+	// scene or a material's pipeline changes, a frame slot's object and lod data only when it's behind the version
+	bool _drawGroupsDirty{ true };
+	uint64_t _drawGroupsVersion{ 0 };
+	std::vector<uint64_t> _objectDataVersions;
+	std::vector<uint32_t> _objectGroups;     // draw group of each of _renderables
+	std::vector<uint32_t> _groupFirstBatch;  // of each draw group
+	std::vector<GPULodData> _lodGroups;      // the first _max_lod_groups draw groups
+	CullConstants _cullConstants{};          // filled by prepare_draws, pushed by cull_objects
 	AllocatedImage _textureImage; 
-	VkImageView _textureImageView; 
+	VkImageView _textureImageView; // the placeholder until the streamed texture is resident
+	uint32_t _textureIndex{ 0 }; // of _textureImageView in _textures
 	VkSampler _textureSampler; 
 
+	// every texture sampled by the mesh shaders, set 1 of the mesh pipeline layout and bound once per frame
+	TextureTable _textures;
+
+	// generated for the _sceneTextures stress scene, one material each
+	struct GeneratedTexture {
+		AllocatedImage image;
+		VkImageView view{ VK_NULL_HANDLE };
+	};
+	std::vector<GeneratedTexture> _generatedTextures;
+
+	// headless mode renders into an offscreen color target instead of the swapchain,
+	// no window or surface is created
+	AllocatedImage _offscreenImage;
+
+	// gpu zones of every frame in flight, the frame zone doubles as the benchmark's gpu frame time
+	GpuProfiler _gpuProfiler;
+	std::vector<bool> _timestampMeasured;
+	std::vector<double> _gpuFrameTimes;
+	bool _measureGpuTimes{ false };
+
+	// input latency: cpu time the input a frame was built from got sampled, to the end of that frame on
+	// the gpu. Needs the timestamps, collected along with _gpuFrameTimes
+	uint64_t _inputSampledNs{ 0 };
+	std::vector<uint64_t> _frameInputNs;
+	std::vector<double> _inputLatencies;
+
+	// every pipeline is created through it, persisted across launches
+	PipelineCache _pipelineCache;
+	double _pipelineCreateMs{ 0.0 }; // time spent in vkCreate*Pipelines during init
+
+	// material pipeline permutations, compiled by the job system while the first frames draw with the fallback
+	PipelineLibrary _pipelines;
+	uint32_t _resolvedPipelines{ 0 }; // _pipelines.finished_count() the materials were last updated at
+	bool _pipelinesReported{ false };
+
 	// depth buffer
 	VkImageView _depthImageView; 
 	AllocatedImage _depthImage; 
@@ -105,15 +280,34 @@ public:
 	//array of images from the swapchain
 	std::vector<VkImage> _swapchainImages;
 	std::vector<VkImageView> _swapchainImageViews;
-	VkSwapchainKHR _swapchain; // from other articles
+	VkSwapchainKHR _swapchain{ VK_NULL_HANDLE }; // from other articles
 	VkFormat _swapchainImageFormat;
+	VkPresentModeKHR _activePresentMode{ VK_PRESENT_MODE_FIFO_KHR }; // what the surface gave us for _presentMode
+	bool _swapchainDirty{ false }; // resized or out of date, rebuilt at the start of the next frame
 
 	VkQueue _graphicsQueue; // queue we will submit to
 	uint32_t _graphicsQueueFamily; // family of that queue
 
-	VkCommandPool _commandPool; //the command pool for our commands
+	// uploads go through their own family when the device has one, otherwise they share the graphics queue
+	VkQueue _transferQueue;
+	uint32_t _transferQueueFamily;
+
+	// vertices and indices of every mesh, sub-allocated per mesh
+	GeometryBuffer _geometry;
+
+	// loads meshes and textures in the background, drawn as the placeholders until they are resident
+	AssetStreamer _streamer;
+	Mesh* _placeholderMesh{ nullptr };
+
+	VkCommandPool _commandPool; //the command pool for one-off upload commands
+	std::vector<VkCommandPool> _frameCommandPools; // one per frame in flight, reset whole at the start of the frame
 	std::vector<VkCommandBuffer> _commandBuffers; 
 
+	// secondary command buffers recorded in parallel inside the render pass, [frame * _recordThreads + thread].
+	// Every thread owns its pool, so recording needs no locks
+	std::vector<VkCommandPool> _recordCommandPools;
+	std::vector<VkCommandBuffer> _recordCommandBuffers;
+
 	VkRenderPass _renderPass;
 	std::vector<VkFramebuffer> _framebuffers;
 
@@ -122,22 +316,103 @@ public:
 	std::vector<VkFence> _renderFences; // wait for GPU to finish draw command before continuing loop(?)
 
 	VkPipelineLayout _meshPipelineLayout; 
-	VkPipeline _meshPipeline;
+	VkPipeline _meshPipeline; // default mesh pipeline, compiled up front. Drawn with until a material's own is ready
+	PipelineHandle _meshPipelineHandle{ INVALID_PIPELINE };
 
 	// scene description
 	std::vector<RenderObject> _renderables;
 	std::unordered_map<std::string, Material> _materials;
 	std::unordered_map<std::string, Mesh> _meshes;
 
-	Material* create_material(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name);
+	std::vector<DrawBatch> _drawBatches;
+
+	// world space bounding spheres of _renderables in SoA layout, rebuilt when the scene changes
+	CullingData _cullData;
+	bool _cullDataDirty{ true };
+	std::vector<uint32_t> _visibleObjects;
+
+	// level of detail each of _renderables drew with last frame, the hysteresis band is around it
+	std::vector<uint8_t> _objectLods;
+
+	// visible objects ordered by state and depth, draw batches are runs of equal mesh, level and pipeline in it
+	RenderQueue _renderQueue;
+	glm::mat4 _viewProjection{ 1.f };
+	RenderStats _renderStats;
+
+	Material* create_material(PipelineHandle pipeline, VkPipelineLayout layout, const std::string& name);
+	void resolve_material_pipelines();
 	Material* get_material(const std::string& name);
 	Mesh* get_mesh(const std::string& name);
-	void draw_objects(VkCommandBuffer cmd,RenderObject* first, int count);
+	Mesh* drawable_mesh(Mesh* mesh) const;
+	void prepare_draws(RenderObject* first, int count);
+	void prepare_gpu_draws(RenderObject* first, uint32_t count);
+	void build_draw_groups(RenderObject* first, uint32_t count);
+	void cull_objects(VkCommandBuffer cmd);
+	uint32_t record_thread_count() const;
+	void draw_objects(VkCommandBuffer cmd, VkFramebuffer framebuffer);
+	void record_batches(VkCommandBuffer cmd, uint32_t firstBatch, uint32_t lastBatch, RenderStats& stats);
 
 public:
 	bool _isInitialized{ false };
 	int _frameNumber {0};
 
+	// set before init() to render offscreen without SDL window or swapchain
+	bool _headless{ false };
+
+	// set before init(), monkeys beyond the first are laid out in a grid to stress the renderer
+	uint32_t _sceneObjects{ 1 };
+
+	// set before init(), distinct textures the stress scene spreads over its objects, each with a material
+	// of its own. All of them go through the one bindless set, 1 draws everything with wahoo
+	uint32_t _sceneTextures{ 1 };
+
+	// set before init() to frustum cull on the gpu and draw through indirect commands
+	bool _gpuCulling{ false };
+
+	// frustum cull on the cpu before building draw batches, ignored with _gpuCulling
+	bool _cpuCulling{ true };
+
+	// order draws by pipeline, mesh and depth instead of _renderables order
+	bool _sortDraws{ true };
+
+	// set before init(), levels of detail built per mesh when it's baked, the full mesh included. 1 builds none
+	uint32_t _lodLevels{ 4 };
+
+	// screen space error in pixels a level of detail may show before a finer one is drawn, 0 always draws full detail
+	float _lodErrorPixels{ 1.f };
+
+	// fraction of _lodErrorPixels the projected error has to move past a switch point before the level changes
+	float _lodHysteresis{ 0.25f };
+
+	// set before init(), job system workers including the main thread. 0 picks the hardware concurrency
+	uint32_t _jobThreads{ 0 };
+
+	// set before init(), slices the draw batches are split into, each recorded by a job into its own secondary
+	// command buffer. 0 matches the job workers, capped at 8. Small frames are still recorded inline
+	uint32_t _recordThreads{ 0 };
+
+	// set before init(), block compression textures are baked to. Falls back to RGBA8 when the device can't
+	// sample the format
+	TextureCodec _textureCodec{ TextureCodec::BC7 };
+
+	// set before init(), extra descriptor sets allocated and written every frame on top of the real ones,
+	// never bound. Loads the descriptor allocator the way a scene with that many materials would
+	uint32_t _descriptorStressSets{ 0 };
+
+	// set before init(), load and save the pipeline cache file. Off means every launch compiles cold
+	bool _usePipelineCache{ true };
+
+	// set before init(), frames the cpu records ahead of the gpu, 1 to MAX_FRAMES_IN_FLIGHT. More hides cpu
+	// and gpu stalls behind each other, fewer shortens the time from input to the frame showing it
+	int _max_frames_in_flight{ 2 };
+
+	// set before init(), FIFO waits for vblank, MAILBOX replaces the queued image with a newer one and
+	// IMMEDIATE tears. Falls back to FIFO, which every surface supports
+	VkPresentModeKHR _presentMode{ VK_PRESENT_MODE_FIFO_KHR };
+
+	// cpu and gpu profiler zones still in the rings are written here as a Chrome trace on cleanup(), empty skips it
+	std::string _tracePath;
+
 	VkExtent2D _windowExtent{ 1000 , 529 };
 
 	struct SDL_Window* _window{ nullptr };
@@ -156,25 +431,48 @@ public:
     //run main loop
 	void run();
 
+	//render a scripted trackball path and collect frame timings instead of running the SDL loop
+	void run_benchmark(const vkbench::BenchmarkConfig& config, vkbench::BenchmarkResults& results);
+
 private:
+	void write_snapshot(FrameSnapshot& snapshot);
+	void read_snapshot(const FrameSnapshot& snapshot);
+	void render_loop();
+	void print_loop_stats(uint64_t elapsedNs);
+
 	void init_texture_image(); 
-	void init_texture_image_view(); 
+	VkImageView create_texture_view(VkImage image, VkFormat format, uint32_t mipLevels);
+	void destroy_textures();
 	void init_texture_sampler(); 
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size); 
+	void init_scene_textures();
 	void load_meshes();
-	void upload_mesh(Mesh& mesh);
+	StreamHandle stream_mesh(const std::string& name, std::function<bool(Mesh&)> build);
+	bool load_mesh_data(Mesh& mesh, const std::string& objPath, bool optimize = true);
+	bool load_texture_data(StreamPayload::Image& image, const std::string& imagePath, TextureCodec codec);
 
 	bool load_shader_module(const char* filePath, VkShaderModule* outShaderModule);
 
 	void init_vulkan();
 	void init_swapchain();
+	void create_swapchain(VkSwapchainKHR oldSwapchain);
+	void create_depth_image();
+	bool recreate_swapchain();
+	void release_swapchain(DeletionQueue& queue);
+	void init_offscreen_target();
+	void init_profiler();
+	void resolve_gpu_timestamps(uint32_t frame);
+	uint64_t checksum_offscreen_image();
 	void init_commands(); 
+	void init_streaming();
 	void init_default_renderpass();
 	void init_framebuffers();
 	void init_sync_structures();
     void init_uniform_buffers();
-    void init_descriptor_pool(); 
-	void init_descriptor_set(); 
+	void init_descriptors();
+	void init_descriptor_templates();
+	void write_frame_descriptors();
+	void init_pipeline_cache();
 	void init_pipelines();
+	void init_cull_pipeline();
 	void init_scene();
 };
@@ -0,0 +1,176 @@
+#include <vk_geometry.h>
+#include <vk_initializers.h>
+
+#include <iostream>
+#include <iterator>
+
+void RangeAllocator::reset(uint64_t capacity)
+{
+	_capacity = capacity;
+	_freeSpace = 0;
+	_byOffset.clear();
+	_bySize.clear();
+	if (capacity > 0)
+	{
+		insert(0, capacity);
+	}
+}
+
+uint64_t RangeAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+	if (size == 0)
+	{
+		return INVALID;
+	}
+
+	// smallest free range first, larger ones only when alignment padding pushes the end out of the smaller ones
+	for (auto candidate = _bySize.lower_bound(size); candidate != _bySize.end(); candidate++)
+	{
+		uint64_t rangeOffset = candidate->second;
+		uint64_t rangeSize = candidate->first;
+		uint64_t offset = (rangeOffset + alignment - 1) / alignment * alignment;
+		if (offset + size > rangeOffset + rangeSize)
+		{
+			continue;
+		}
+
+		erase(_byOffset.find(rangeOffset));
+
+		// the padding in front and whatever is left behind stay free
+		if (offset > rangeOffset)
+		{
+			insert(rangeOffset, offset - rangeOffset);
+		}
+		if (offset + size < rangeOffset + rangeSize)
+		{
+			insert(offset + size, rangeOffset + rangeSize - offset - size);
+		}
+		return offset;
+	}
+	return INVALID;
+}
+
+void RangeAllocator::release(uint64_t offset, uint64_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	// merge with the free ranges right after and right before
+	auto next = _byOffset.lower_bound(offset);
+	if (next != _byOffset.end() && offset + size == next->first)
+	{
+		size += next->second;
+		auto merged = next++;
+		erase(merged);
+	}
+	if (next != _byOffset.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			size += previous->second;
+			erase(previous);
+		}
+	}
+	insert(offset, size);
+}
+
+uint64_t RangeAllocator::largest_free() const
+{
+	return _bySize.empty() ? 0 : _bySize.rbegin()->first;
+}
+
+void RangeAllocator::insert(uint64_t offset, uint64_t size)
+{
+	_byOffset.emplace(offset, size);
+	_bySize.emplace(size, offset);
+	_freeSpace += size;
+}
+
+void RangeAllocator::erase(std::map<uint64_t, uint64_t>::iterator range)
+{
+	auto sized = _bySize.equal_range(range->second);
+	for (auto it = sized.first; it != sized.second; it++)
+	{
+		if (it->second == range->first)
+		{
+			_bySize.erase(it);
+			break;
+		}
+	}
+	_freeSpace -= range->second;
+	_byOffset.erase(range);
+}
+
+void GeometryBuffer::init(VmaAllocator allocator, VkDeviceSize vertexBytes, VkDeviceSize indexBytes, uint32_t vertexStride,
+	uint32_t queueFamilyCount, const uint32_t* queueFamilies)
+{
+	_allocator = allocator;
+	_vertexStride = vertexStride;
+
+	VK_CHECK(vkinit::create_buffer(_allocator, vertexBytes, VMA_MEMORY_USAGE_UNKNOWN,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		_vertexBuffer._buffer, _vertexBuffer._allocation, queueFamilyCount, queueFamilies));
+
+	VK_CHECK(vkinit::create_buffer(_allocator, indexBytes, VMA_MEMORY_USAGE_UNKNOWN,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		_indexBuffer._buffer, _indexBuffer._allocation, queueFamilyCount, queueFamilies));
+
+	_vertices.reset(vertexBytes / vertexStride);
+	_indices.reset(indexBytes);
+}
+
+void GeometryBuffer::cleanup()
+{
+	vmaDestroyBuffer(_allocator, _vertexBuffer._buffer, _vertexBuffer._allocation);
+	vmaDestroyBuffer(_allocator, _indexBuffer._buffer, _indexBuffer._allocation);
+}
+
+bool GeometryBuffer::allocate(Mesh& mesh, VkDeviceSize& vertexByteOffset, VkDeviceSize& indexByteOffset)
+{
+	if (Vertex::packed_stride(mesh._vertexAttributes) != _vertexStride)
+	{
+		std::cout << "mesh vertex stride doesn't match the geometry buffer" << std::endl;
+		return false;
+	}
+
+	uint64_t indexSize = mesh._indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	uint64_t indexBytes = mesh._indexCount * indexSize;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	uint64_t firstVertex = _vertices.allocate(mesh._vertexCount);
+	uint64_t indexOffset = _indices.allocate(indexBytes, sizeof(uint32_t));
+	if (firstVertex == RangeAllocator::INVALID || indexOffset == RangeAllocator::INVALID)
+	{
+		if (firstVertex != RangeAllocator::INVALID)
+		{
+			_vertices.release(firstVertex, mesh._vertexCount);
+		}
+		if (indexOffset != RangeAllocator::INVALID)
+		{
+			_indices.release(indexOffset, indexBytes);
+		}
+		std::cout << "geometry buffer full, " << _vertices.free_space() << " vertices and "
+			<< _indices.free_space() << " index bytes left" << std::endl;
+		return false;
+	}
+
+	mesh._vertexOffset = static_cast<int32_t>(firstVertex);
+	mesh._firstIndex = static_cast<uint32_t>(indexOffset / indexSize);
+
+	vertexByteOffset = firstVertex * _vertexStride;
+	indexByteOffset = indexOffset;
+	return true;
+}
+
+void GeometryBuffer::release(const Mesh& mesh)
+{
+	uint64_t indexSize = mesh._indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_vertices.release(static_cast<uint64_t>(mesh._vertexOffset), mesh._vertexCount);
+	_indices.release(mesh._firstIndex * indexSize, mesh._indexCount * indexSize);
+}
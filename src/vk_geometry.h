@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_mesh.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+/// @brief Good fit sub-allocator over [0, capacity) in caller defined units.
+/// Free ranges are indexed by offset and by size: allocate takes the smallest range that fits, release merges
+/// with the free neighbours, both O(log n) in the number of free ranges. Not thread safe.
+class RangeAllocator {
+public:
+	static constexpr uint64_t INVALID = ~0ull;
+
+	void reset(uint64_t capacity);
+
+	/// @return offset of the range or INVALID when no free range fits
+	uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+
+	/// @brief Give back a range returned by allocate(), size as passed to it.
+	void release(uint64_t offset, uint64_t size);
+
+	uint64_t capacity() const { return _capacity; }
+	uint64_t free_space() const { return _freeSpace; }
+	uint64_t largest_free() const;
+	size_t free_ranges() const { return _byOffset.size(); }
+
+private:
+	void insert(uint64_t offset, uint64_t size);
+	void erase(std::map<uint64_t, uint64_t>::iterator range);
+
+	uint64_t _capacity = 0;
+	uint64_t _freeSpace = 0;
+	std::map<uint64_t, uint64_t> _byOffset;    // offset -> size
+	std::multimap<uint64_t, uint64_t> _bySize; // size -> offset
+};
+
+// all static mesh geometry in one device local vertex buffer and one index buffer, so the whole scene draws
+// with a single vertex buffer bind. Meshes own a {firstIndex, vertexOffset, indexCount} range of it.
+// Vertices are allocated in units of one packed vertex, indices in bytes so 16 and 32 bit meshes share the
+// buffer; the index buffer is only rebound when the index type changes
+class GeometryBuffer {
+public:
+	/// @param queueFamilies families the buffers are shared between, more than one makes them CONCURRENT
+	void init(VmaAllocator allocator, VkDeviceSize vertexBytes, VkDeviceSize indexBytes, uint32_t vertexStride,
+		uint32_t queueFamilyCount, const uint32_t* queueFamilies);
+	void cleanup();
+
+	/// @brief Reserve room for mesh's packed data and set its _firstIndex/_vertexOffset. Thread safe.
+	/// @param vertexByteOffset, indexByteOffset where to copy _packedVertices and _packedIndices
+	/// @return false when either buffer is too full or the mesh doesn't use the buffer's vertex stride
+	bool allocate(Mesh& mesh, VkDeviceSize& vertexByteOffset, VkDeviceSize& indexByteOffset);
+
+	/// @brief Give the mesh's ranges back once no frame in flight draws it anymore. Thread safe.
+	void release(const Mesh& mesh);
+
+	VkBuffer vertex_buffer() const { return _vertexBuffer._buffer; }
+	VkBuffer index_buffer() const { return _indexBuffer._buffer; }
+	uint32_t vertex_stride() const { return _vertexStride; }
+
+private:
+	VmaAllocator _allocator = VK_NULL_HANDLE;
+	AllocatedBuffer _vertexBuffer{};
+	AllocatedBuffer _indexBuffer{};
+	uint32_t _vertexStride = 0;
+
+	std::mutex _mutex;
+	RangeAllocator _vertices; // units of one vertex
+	RangeAllocator _indices;  // bytes, 4 byte aligned so any range can hold 32 bit indices
+};
@@ -0,0 +1,137 @@
+#include <vk_gpu_profiler.h>
+#include <vk_profiler.h>
+
+#include <algorithm>
+#include <iostream>
+
+bool GpuProfiler::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t framesInFlight)
+{
+	_device = device;
+
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+	uint32_t validBits = queueFamily < familyCount ? families[queueFamily].timestampValidBits : 0;
+
+	// not every implementation can write timestamps on the graphics queue
+	if (!properties.limits.timestampComputeAndGraphics || validBits == 0)
+	{
+		std::cout << "timestamp queries not supported, gpu zones disabled" << std::endl;
+		return false;
+	}
+	_period = properties.limits.timestampPeriod;
+	_validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = framesInFlight * MAX_ZONES * 2;
+	VK_CHECK(vkCreateQueryPool(_device, &queryPoolInfo, nullptr, &_pool));
+
+	_frames.assign(framesInFlight, Frame{});
+	_results.resize(MAX_ZONES * 2);
+	_track = vkprof::create_track("gpu");
+	return true;
+}
+
+void GpuProfiler::cleanup()
+{
+	if (_pool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(_device, _pool, nullptr);
+		_pool = VK_NULL_HANDLE;
+	}
+	_frames.clear();
+}
+
+void GpuProfiler::begin_frame(VkCommandBuffer cmd, uint32_t frame)
+{
+	if (_pool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	Frame& f = _frames[frame];
+	f.zoneCount = 0;
+	f.pending = false;
+	vkCmdResetQueryPool(cmd, _pool, query(frame, 0, false), MAX_ZONES * 2);
+	begin_zone(cmd, frame, "gpu frame");
+}
+
+void GpuProfiler::end_frame(VkCommandBuffer cmd, uint32_t frame)
+{
+	if (_pool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	end_zone(cmd, frame, 0);
+	_frames[frame].submitNs = vkprof::now_ns();
+	_frames[frame].pending = true;
+}
+
+uint32_t GpuProfiler::begin_zone(VkCommandBuffer cmd, uint32_t frame, const char* name)
+{
+	if (_pool == VK_NULL_HANDLE || _frames[frame].zoneCount == MAX_ZONES)
+	{
+		return UINT32_MAX;
+	}
+
+	Frame& f = _frames[frame];
+	uint32_t zone = f.zoneCount++;
+	f.names[zone] = name;
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _pool, query(frame, zone, false));
+	return zone;
+}
+
+void GpuProfiler::end_zone(VkCommandBuffer cmd, uint32_t frame, uint32_t zone)
+{
+	if (_pool == VK_NULL_HANDLE || zone >= _frames[frame].zoneCount)
+	{
+		return;
+	}
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _pool, query(frame, zone, true));
+}
+
+bool GpuProfiler::resolve(uint32_t frame)
+{
+	if (_pool == VK_NULL_HANDLE || !_frames[frame].pending)
+	{
+		return false;
+	}
+
+	Frame& f = _frames[frame];
+	f.pending = false;
+
+	// no WAIT bit, a zone that isn't written yet makes this return VK_NOT_READY instead of stalling
+	VkResult result = vkGetQueryPoolResults(_device, _pool, query(frame, 0, false), f.zoneCount * 2,
+		f.zoneCount * 2 * sizeof(uint64_t), _results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	auto to_ns = [&](uint64_t ticks) { return static_cast<int64_t>(static_cast<double>(ticks & _validMask) * _period); };
+
+	// without calibrated timestamps the clocks are aligned by the submit: the gpu can't start a frame before
+	// the cpu submitted it, so the offset is the smallest one that keeps every frame after its submit
+	int64_t frameStart = to_ns(_results[0]);
+	_offsetNs = std::max(_offsetNs, static_cast<int64_t>(f.submitNs) - frameStart);
+	_frameMs = static_cast<double>(to_ns(_results[1]) - frameStart) * 1e-6;
+	_frameEndNs = static_cast<uint64_t>(to_ns(_results[1]) + _offsetNs);
+
+	if (vkprof::enabled())
+	{
+		for (uint32_t zone = 0; zone < f.zoneCount; zone++)
+		{
+			int64_t start = to_ns(_results[zone * 2]) + _offsetNs;
+			int64_t end = std::max(to_ns(_results[zone * 2 + 1]) + _offsetNs, start);
+			vkprof::record_track(_track, f.names[zone], static_cast<uint64_t>(start), static_cast<uint64_t>(end));
+		}
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <cstdint>
+#include <vector>
+
+// Timestamp queries around command ranges. A frame slot's queries are read back once its fence has
+// signaled, so results arrive frames in flight late and reading them never waits on the gpu. Resolved
+// zones go into the vkprof "gpu" track, shifted onto the cpu clock so they line up with the cpu zones.
+// Zones are recorded into primary command buffers outside of render passes with secondary contents,
+// from the thread that owns the frame
+class GpuProfiler {
+public:
+	static const uint32_t MAX_ZONES = 32; // per frame, the frame zone included
+
+	/// @param queueFamily family of the queue the frames are submitted to
+	/// @return false when that queue can't write timestamps, every other call is a no-op then
+	bool init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t framesInFlight);
+	void cleanup();
+
+	/// @brief Reset frame's queries and open its frame zone, first thing in the command buffer.
+	/// The previous contents of the slot must have been resolved by then.
+	void begin_frame(VkCommandBuffer cmd, uint32_t frame);
+
+	/// @brief Close the frame zone, last thing before the command buffer ends and is submitted.
+	void end_frame(VkCommandBuffer cmd, uint32_t frame);
+
+	/// @brief Every zone begun has to be ended in the same frame, or the frame never resolves.
+	/// @return the zone to pass to end_zone(), UINT32_MAX once the frame ran out of zones
+	uint32_t begin_zone(VkCommandBuffer cmd, uint32_t frame, const char* name);
+	void end_zone(VkCommandBuffer cmd, uint32_t frame, uint32_t zone);
+
+	/// @brief Read frame's timestamps back, only after its fence has signaled.
+	/// @return false if nothing was pending or the results weren't there yet
+	bool resolve(uint32_t frame);
+
+	/// @brief Gpu time of the frame zone resolve() last read.
+	double frame_ms() const { return _frameMs; }
+
+	/// @brief When that frame zone ended, on the vkprof::now_ns() clock.
+	uint64_t frame_end_ns() const { return _frameEndNs; }
+
+	bool enabled() const { return _pool != VK_NULL_HANDLE; }
+
+private:
+	struct Frame {
+		const char* names[MAX_ZONES];
+		uint32_t zoneCount = 0;
+		uint64_t submitNs = 0; // cpu time right before submit, the gpu can't have started earlier
+		bool pending = false;
+	};
+
+	uint32_t query(uint32_t frame, uint32_t zone, bool end) const { return (frame * MAX_ZONES + zone) * 2 + (end ? 1 : 0); }
+
+	VkDevice _device = VK_NULL_HANDLE;
+	VkQueryPool _pool = VK_NULL_HANDLE;
+	double _period = 0.0; // nanoseconds per tick
+	uint64_t _validMask = ~0ull;
+	std::vector<Frame> _frames;
+	std::vector<uint64_t> _results;
+	uint32_t _track = 0;
+	int64_t _offsetNs = INT64_MIN; // cpu ns = gpu ns + offset
+	double _frameMs = 0.0;
+	uint64_t _frameEndNs = 0;
+};
@@ -133,13 +133,15 @@ void vkinit::copy_buffer_to_image(VkDevice device, VkCommandPool commandPool, Vk
     end_single_time_commands(device, commandPool, graphicsQueue, commandBuffer);
 }
 
-VkResult vkinit::create_buffer(VmaAllocator allocator, VkDeviceSize size, VmaMemoryUsage memoryUsage, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VmaAllocation &allocation)
+VkResult vkinit::create_buffer(VmaAllocator allocator, VkDeviceSize size, VmaMemoryUsage memoryUsage, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VmaAllocation &allocation, uint32_t queueFamilyCount, const uint32_t *queueFamilies)
 {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
 	bufferInfo.usage = bufferUsage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferInfo.sharingMode = queueFamilyCount > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	bufferInfo.queueFamilyIndexCount = queueFamilyCount > 1 ? queueFamilyCount : 0;
+	bufferInfo.pQueueFamilyIndices = queueFamilyCount > 1 ? queueFamilies : nullptr;
 
 	VmaAllocationCreateInfo allocationInfo{};
 	allocationInfo.usage = memoryUsage;
@@ -159,7 +161,9 @@ VkResult vkinit::create_image(
 	uint32_t width, uint32_t height,
 	VkFormat format, VkImageTiling tiling,
 	VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-	VkImage &image, VmaAllocation &imageAllocation)
+	VkImage &image, VmaAllocation &imageAllocation,
+	uint32_t queueFamilyCount, const uint32_t *queueFamilies,
+	uint32_t mipLevels)
 {
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -167,14 +171,16 @@ VkResult vkinit::create_image(
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageInfo.usage = usage;
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.sharingMode = queueFamilyCount > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.queueFamilyIndexCount = queueFamilyCount > 1 ? queueFamilyCount : 0;
+	imageInfo.pQueueFamilyIndices = queueFamilyCount > 1 ? queueFamilies : nullptr;
 
 	VmaAllocationCreateInfo allocInfo{};
 	allocInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
@@ -19,8 +19,10 @@ namespace vkinit
 
     void copy_buffer_to_image(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 
-    VkResult create_buffer(VmaAllocator allocator, VkDeviceSize size, VmaMemoryUsage memoryUsage, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VmaAllocation &allocation);
-    VkResult create_image(VmaAllocator allocator, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VmaAllocation &imageAllocation);
+    // more than one queue family makes the resource VK_SHARING_MODE_CONCURRENT between them, so a transfer
+    // queue can fill it without ownership transfers
+    VkResult create_buffer(VmaAllocator allocator, VkDeviceSize size, VmaMemoryUsage memoryUsage, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VmaAllocation &allocation, uint32_t queueFamilyCount = 0, const uint32_t *queueFamilies = nullptr);
+    VkResult create_image(VmaAllocator allocator, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VmaAllocation &imageAllocation, uint32_t queueFamilyCount = 0, const uint32_t *queueFamilies = nullptr, uint32_t mipLevels = 1);
 
     /// @brief Create a VkCommandPoolInfo with sensible defaults.
 	/// @param queueFamilyIndex pick queue family index.
@@ -0,0 +1,256 @@
+#include <vk_jobs.h>
+#include <vk_profiler.h>
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+	// workers spin this many times over the deques before going to sleep
+	const uint32_t IDLE_SPINS = 64;
+
+	thread_local const JobSystem* t_system = nullptr;
+	thread_local uint32_t t_worker = 0;
+}
+
+JobSystem::JobSystem(uint32_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// a single thread system gets a background only thread, otherwise nothing would ever take the background
+	// queue. It's the last slot, its deque only holds what its own jobs queue and the others steal from it
+	_threadCount = threadCount;
+	uint32_t slots = threadCount == 1 ? 2 : threadCount;
+	_workers.reserve(slots);
+	for (uint32_t i = 0; i < slots; i++)
+	{
+		_workers.push_back(std::make_unique<Worker>());
+	}
+
+	_threads.reserve(slots - 1);
+	for (uint32_t i = 1; i < slots; i++)
+	{
+		_threads.emplace_back(&JobSystem::worker_main, this, i, i >= threadCount);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+
+	for (std::thread& thread : _threads)
+	{
+		thread.join();
+	}
+}
+
+uint32_t JobSystem::worker_index() const
+{
+	return t_system == this ? t_worker : 0;
+}
+
+void JobSystem::run(Job job, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->pending.fetch_add(1);
+	}
+
+	// counted before it is visible, so a thief can never take _queued below zero.
+	// Pairs with the _sleeping increment in worker_main: either the sleeper sees the job or we see the sleeper
+	_queued.fetch_add(1);
+
+	Worker& worker = *_workers[worker_index()];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.jobs.push_back(QueuedJob{ std::move(job), counter });
+	}
+
+	if (_sleeping.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_wake.notify_one();
+	}
+}
+
+void JobSystem::run_background(Job job, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->pending.fetch_add(1);
+	}
+
+	// same ordering against the sleepers as run()
+	_backgroundQueued.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(_backgroundMutex);
+		_background.push_back(QueuedJob{ std::move(job), counter });
+	}
+
+	if (_sleeping.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_wake.notify_all();
+	}
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	uint32_t worker = worker_index();
+	while (counter.pending.load(std::memory_order_acquire) > 0)
+	{
+		if (!run_one(worker))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::wait_background(JobCounter& counter)
+{
+	uint32_t worker = worker_index();
+	while (counter.pending.load(std::memory_order_acquire) > 0)
+	{
+		if (!run_one(worker) && !run_one_background())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::parallel_for(uint32_t count, uint32_t grain, const RangeJob& fn)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// a few ranges per worker so stealing can even out uneven ranges
+	grain = std::max(grain, 1u);
+	uint32_t ranges = std::min((count + grain - 1) / grain, thread_count() * 4);
+	if (ranges <= 1)
+	{
+		fn(0, count, worker_index());
+		return;
+	}
+
+	JobCounter counter;
+	for (uint32_t r = 1; r < ranges; r++)
+	{
+		uint32_t first = static_cast<uint32_t>(uint64_t(count) * r / ranges);
+		uint32_t last = static_cast<uint32_t>(uint64_t(count) * (r + 1) / ranges);
+		run([this, &fn, first, last]() { fn(first, last, worker_index()); }, &counter);
+	}
+
+	// the first range runs right here, the rest gets picked up by whoever is free
+	fn(0, static_cast<uint32_t>(uint64_t(count) / ranges), worker_index());
+	wait(counter);
+}
+
+bool JobSystem::pop(uint32_t worker, QueuedJob& job)
+{
+	Worker& own = *_workers[worker];
+	std::lock_guard<std::mutex> lock(own.mutex);
+	if (own.jobs.empty())
+	{
+		return false;
+	}
+	job = std::move(own.jobs.back());
+	own.jobs.pop_back();
+	return true;
+}
+
+bool JobSystem::steal(uint32_t thief, QueuedJob& job)
+{
+	uint32_t count = slot_count();
+	for (uint32_t i = 1; i < count; i++)
+	{
+		Worker& victim = *_workers[(thief + i) % count];
+		std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+		if (!lock.owns_lock() || victim.jobs.empty())
+		{
+			continue;
+		}
+		job = std::move(victim.jobs.front());
+		victim.jobs.pop_front();
+		return true;
+	}
+	return false;
+}
+
+bool JobSystem::run_one(uint32_t worker)
+{
+	QueuedJob job;
+	if (!pop(worker, job) && !steal(worker, job))
+	{
+		return false;
+	}
+	_queued.fetch_sub(1);
+
+	job.job();
+	if (job.counter)
+	{
+		job.counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+	return true;
+}
+
+bool JobSystem::run_one_background()
+{
+	QueuedJob job;
+	{
+		std::lock_guard<std::mutex> lock(_backgroundMutex);
+		if (_background.empty())
+		{
+			return false;
+		}
+		job = std::move(_background.front());
+		_background.pop_front();
+	}
+	_backgroundQueued.fetch_sub(1);
+
+	job.job();
+	if (job.counter)
+	{
+		job.counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+	return true;
+}
+
+void JobSystem::worker_main(uint32_t worker, bool backgroundOnly)
+{
+	t_system = this;
+	t_worker = worker;
+	vkprof::set_thread_name(backgroundOnly ? "job background" : ("job worker " + std::to_string(worker)).c_str());
+
+	uint32_t idle = 0;
+	while (!_stop.load())
+	{
+		// background jobs only once the deques are empty, one at a time so new jobs are picked up in between
+		if ((!backgroundOnly && run_one(worker)) || run_one_background())
+		{
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < IDLE_SPINS)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		_sleeping.fetch_add(1);
+		_wake.wait(lock, [this, backgroundOnly]() {
+			return (!backgroundOnly && _queued.load() > 0) || _backgroundQueued.load() > 0 || _stop.load(); });
+		_sleeping.fetch_sub(1);
+		idle = 0;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// number of unfinished jobs, JobSystem::wait() returns once it drops to zero
+struct JobCounter {
+	std::atomic<uint32_t> pending{ 0 };
+};
+
+// work-stealing job system. Every worker owns a deque, it pushes and pops its own jobs at the back
+// (newest first, their data is still in cache) while idle workers steal the oldest ones from the front.
+// The thread that creates the system is worker 0, it has no thread of its own and runs jobs while it waits.
+// Background jobs go into a shared queue of their own that only the worker threads take from once the deques
+// are empty, so long running work never ends up inside a wait() or parallel_for() of a frame
+class JobSystem {
+public:
+	using Job = std::function<void()>;
+	using RangeJob = std::function<void(uint32_t first, uint32_t last, uint32_t worker)>;
+
+	/// @param threadCount workers including the calling thread, 0 picks the hardware concurrency
+	explicit JobSystem(uint32_t threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	uint32_t thread_count() const { return _threadCount; }
+
+	/// @brief Indices worker_index() can return: the workers, plus the background only thread when there is one.
+	uint32_t slot_count() const { return static_cast<uint32_t>(_workers.size()); }
+
+	/// @brief Index of the calling thread, 0 for the owner and for threads that don't belong to this system.
+	uint32_t worker_index() const;
+
+	/// @brief Queue a job on the calling worker's deque.
+	/// @param counter incremented now and decremented once the job has run, may be null
+	void run(Job job, JobCounter* counter = nullptr);
+
+	/// @brief Queue a low priority job, oldest first. Only worker threads run it, never wait() or parallel_for().
+	/// A system without worker threads gets one that serves nothing but this queue, with a worker index of its own
+	/// @param counter incremented now and decremented once the job has run, may be null
+	void run_background(Job job, JobCounter* counter = nullptr);
+
+	/// @brief Run queued jobs until counter reaches zero, so jobs can wait on other jobs without blocking a worker.
+	void wait(JobCounter& counter);
+
+	/// @brief wait() that runs background jobs too, for a caller blocked on one of them anyway.
+	void wait_background(JobCounter& counter);
+
+	/// @brief Split [0, count) into ranges of at least grain items, run fn on them in parallel and wait for all of them.
+	void parallel_for(uint32_t count, uint32_t grain, const RangeJob& fn);
+
+private:
+	struct QueuedJob {
+		Job job;
+		JobCounter* counter;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<QueuedJob> jobs;
+	};
+
+	bool pop(uint32_t worker, QueuedJob& job);
+	bool steal(uint32_t thief, QueuedJob& job);
+	bool run_one(uint32_t worker);
+	bool run_one_background();
+	void worker_main(uint32_t worker, bool backgroundOnly);
+
+	uint32_t _threadCount = 0;
+	std::vector<std::unique_ptr<Worker>> _workers; // per slot
+	std::vector<std::thread> _threads;
+
+	std::mutex _backgroundMutex;
+	std::deque<QueuedJob> _background;
+	std::atomic<uint32_t> _backgroundQueued{ 0 };
+
+	// idle workers sleep on _wake once every queue is empty, run() only signals when someone sleeps
+	std::atomic<uint32_t> _queued{ 0 };
+	std::atomic<uint32_t> _sleeping{ 0 };
+	std::atomic<bool> _stop{ false };
+	std::mutex _sleepMutex;
+	std::condition_variable _wake;
+};
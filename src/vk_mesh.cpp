@@ -1,57 +1,574 @@
 #include <vk_mesh.h>
+#include <vk_obj_loader.h>
+#include <vk_simplify.h>
 #include <tiny_obj_loader.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <unordered_map>
 
-VertexInputDescription Vertex::getVertexDescription()
+namespace {
+
+	// fifo post-transform cache used for the stats, the size of older nvidia/amd caches
+	const uint32_t STATS_CACHE_SIZE = 16;
+
+	// lru cache simulated by the reordering, larger than the fifo so the ordering generalizes
+	const uint32_t OPTIMIZE_CACHE_SIZE = 32;
+
+	const uint32_t FETCH_LINE_BYTES = 64;
+	const uint32_t FETCH_CACHE_LINES = 256; // 16KB direct mapped
+
+	const uint32_t OVERDRAW_GRID = 256;
+
+	// cluster sorts the overdraw pass tries, each with the split threshold halfway closer to 1
+	const uint32_t OVERDRAW_ATTEMPTS = 4;
+
+	// fifo cache simulation shared by the stats and the overdraw clustering, uses per vertex
+	// timestamps so there's no cache array to search
+	struct FifoCache {
+		std::vector<uint32_t> timestamps;
+		uint32_t time;
+		uint32_t size;
+
+		FifoCache(size_t vertexCount, uint32_t cacheSize) : timestamps(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+		void reset() { time += size + 1; }
+
+		// returns true on a miss
+		bool fetch(uint32_t vertex)
+		{
+			if (time - timestamps[vertex] > size)
+			{
+				timestamps[vertex] = time++;
+				return true;
+			}
+			return false;
+		}
+
+		uint32_t fetch_triangle(const uint32_t* tri)
+		{
+			return uint32_t(fetch(tri[0])) + uint32_t(fetch(tri[1])) + uint32_t(fetch(tri[2]));
+		}
+	};
+
+	uint16_t quantize_unorm16(float v)
+	{
+		return static_cast<uint16_t>(std::lround(glm::clamp(v, 0.f, 1.f) * 65535.f));
+	}
+
+	int16_t quantize_snorm16(float v)
+	{
+		return static_cast<int16_t>(std::lround(glm::clamp(v, -1.f, 1.f) * 32767.f));
+	}
+
+	// project onto the octahedron and fold the lower half over, decoded in tri_mesh.vert
+	glm::vec2 oct_encode(glm::vec3 n)
+	{
+		float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (length == 0.f)
+		{
+			return glm::vec2{ 0.f };
+		}
+		n /= length;
+
+		glm::vec2 p{ n.x, n.y };
+		if (n.z < 0.f)
+		{
+			p.x = (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+			p.y = (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+		}
+		return p;
+	}
+
+	// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation". Greedily emits the triangle with the
+	// best score, vertices score higher when they're recently used or have few triangles left
+	struct ForsythScores {
+		float cache[OPTIMIZE_CACHE_SIZE];
+		float valence[64];
+
+		ForsythScores()
+		{
+			for (uint32_t i = 0; i < OPTIMIZE_CACHE_SIZE; i++)
+			{
+				// the last triangle's vertices get a fixed score so the next one doesn't simply reuse its edge
+				cache[i] = i < 3 ? 0.75f : std::pow(1.f - float(i - 3) / float(OPTIMIZE_CACHE_SIZE - 3), 1.5f);
+			}
+			valence[0] = 0.f;
+			for (uint32_t i = 1; i < 64; i++)
+			{
+				valence[i] = 2.f / std::sqrt(float(i));
+			}
+		}
+
+		float score(int32_t cachePosition, uint32_t liveTriangles) const
+		{
+			if (liveTriangles == 0)
+			{
+				return -1.f;
+			}
+			float result = valence[std::min(liveTriangles, 63u)];
+			if (cachePosition >= 0)
+			{
+				result += cache[cachePosition];
+			}
+			return result;
+		}
+	};
+
+	void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		static const ForsythScores scores;
+
+		size_t triangleCount = indices.size() / 3;
+
+		// vertex -> triangle adjacency, live triangles are kept at the front of each list
+		std::vector<uint32_t> liveTriangles(vertexCount, 0);
+		for (uint32_t index : indices)
+		{
+			liveTriangles[index]++;
+		}
+
+		std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+		}
+
+		std::vector<uint32_t> adjacency(indices.size());
+		std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				adjacency[fill[indices[t * 3 + k]]++] = uint32_t(t);
+			}
+		}
+
+		std::vector<int32_t> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			vertexScore[v] = scores.score(-1, liveTriangles[v]);
+		}
+
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+
+		// lru cache, room for a full cache plus the 3 vertices of the triangle being added
+		uint32_t cache[OPTIMIZE_CACHE_SIZE + 3];
+		uint32_t cacheCount = 0;
+
+		size_t nextInputTriangle = 0;
+		int64_t best = triangleCount > 0 ? 0 : -1;
+
+		while (best >= 0)
+		{
+			const uint32_t* tri = &indices[size_t(best) * 3];
+			result.insert(result.end(), tri, tri + 3);
+			emitted[size_t(best)] = true;
+
+			// move the triangle's vertices to the front of the cache
+			uint32_t newCache[OPTIMIZE_CACHE_SIZE + 3];
+			uint32_t newCount = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				newCache[newCount++] = tri[k];
+			}
+			for (uint32_t i = 0; i < cacheCount; i++)
+			{
+				uint32_t v = cache[i];
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+				{
+					newCache[newCount++] = v;
+				}
+			}
+
+			// retire the triangle from its vertices' adjacency
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = tri[k];
+				uint32_t* list = &adjacency[adjacencyOffset[v]];
+				uint32_t live = liveTriangles[v];
+				for (uint32_t i = 0; i < live; i++)
+				{
+					if (list[i] == uint32_t(best))
+					{
+						list[i] = list[live - 1];
+						break;
+					}
+				}
+				liveTriangles[v] = live - 1;
+			}
+
+			// vertices past the cache size fall out, their score drops back to valence only
+			for (uint32_t i = 0; i < newCount; i++)
+			{
+				uint32_t v = newCache[i];
+				cachePosition[v] = i < OPTIMIZE_CACHE_SIZE ? int32_t(i) : -1;
+				vertexScore[v] = scores.score(cachePosition[v], liveTriangles[v]);
+			}
+
+			// rescore every live triangle touching the cache and pick the best one
+			best = -1;
+			float bestScore = 0.f;
+			for (uint32_t i = 0; i < newCount; i++)
+			{
+				uint32_t v = newCache[i];
+				const uint32_t* list = &adjacency[adjacencyOffset[v]];
+				for (uint32_t j = 0; j < liveTriangles[v]; j++)
+				{
+					uint32_t t = list[j];
+					const uint32_t* other = &indices[size_t(t) * 3];
+					float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+					if (score > bestScore)
+					{
+						bestScore = score;
+						best = t;
+					}
+				}
+			}
+
+			cacheCount = std::min(newCount, OPTIMIZE_CACHE_SIZE);
+			std::copy(newCache, newCache + cacheCount, cache);
+
+			// nothing connected to the cache, continue with the next unused triangle in input order
+			if (best < 0)
+			{
+				while (nextInputTriangle < triangleCount && emitted[nextInputTriangle])
+				{
+					nextInputTriangle++;
+				}
+				if (nextInputTriangle < triangleCount)
+				{
+					best = int64_t(nextInputTriangle);
+				}
+			}
+		}
+
+		indices.swap(result);
+	}
+
+	// Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+	// The cache optimized order is split into clusters where the cache restarts anyway, then
+	// clusters facing away from the mesh center are drawn first since they tend to occlude the rest.
+	// threshold bounds every patch's ACMR on its own, the misses of restarting the cache at each cluster
+	// come on top of that
+	std::vector<uint32_t> sort_clusters(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold)
+	{
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+		{
+			return indices;
+		}
+
+		// hard boundaries: triangles that miss on all 3 vertices start a new patch of the mesh
+		FifoCache fifo(vertices.size(), STATS_CACHE_SIZE);
+		std::vector<uint32_t> hardBoundaries;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			if (fifo.fetch_triangle(&indices[t * 3]) == 3 || t == 0)
+			{
+				hardBoundaries.push_back(uint32_t(t));
+			}
+		}
+		hardBoundaries.push_back(uint32_t(triangleCount));
+
+		// soft boundaries: split a patch further wherever restarting the cache costs little, i.e. the
+		// running ACMR since the last split is already within threshold of the patch's ACMR
+		std::vector<uint32_t> clusters;
+		for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+		{
+			uint32_t begin = hardBoundaries[h];
+			uint32_t end = hardBoundaries[h + 1];
+
+			fifo.reset();
+			uint32_t patchMisses = 0;
+			for (uint32_t t = begin; t < end; t++)
+			{
+				patchMisses += fifo.fetch_triangle(&indices[size_t(t) * 3]);
+			}
+			float patchThreshold = threshold * float(patchMisses) / float(end - begin);
+
+			clusters.push_back(begin);
+			fifo.reset();
+			uint32_t misses = 0;
+			uint32_t start = begin;
+			for (uint32_t t = begin; t < end; t++)
+			{
+				misses += fifo.fetch_triangle(&indices[size_t(t) * 3]);
+				if (t + 1 < end && float(misses) / float(t + 1 - start) <= patchThreshold)
+				{
+					clusters.push_back(t + 1);
+					fifo.reset();
+					misses = 0;
+					start = t + 1;
+				}
+			}
+		}
+		clusters.push_back(uint32_t(triangleCount));
+
+		glm::vec3 meshCenter{ 0.f };
+		for (const Vertex& v : vertices)
+		{
+			meshCenter += v.position;
+		}
+		meshCenter /= float(std::max<size_t>(vertices.size(), 1));
+
+		// area weighted centroid and normal of every cluster
+		size_t clusterCount = clusters.size() - 1;
+		std::vector<float> sortKey(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			glm::vec3 centroid{ 0.f };
+			glm::vec3 normal{ 0.f };
+			float area = 0.f;
+			for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+			{
+				const glm::vec3& p0 = vertices[indices[size_t(t) * 3 + 0]].position;
+				const glm::vec3& p1 = vertices[indices[size_t(t) * 3 + 1]].position;
+				const glm::vec3& p2 = vertices[indices[size_t(t) * 3 + 2]].position;
+				glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				float a = glm::length(n);
+				centroid += (p0 + p1 + p2) * (a / 3.f);
+				normal += n;
+				area += a;
+			}
+			centroid = area > 0.f ? centroid / area : meshCenter;
+			float normalLength = glm::length(normal);
+			sortKey[c] = normalLength > 0.f ? glm::dot(centroid - meshCenter, normal / normalLength) : 0.f;
+		}
+
+		std::vector<uint32_t> order(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			order[c] = uint32_t(c);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+		for (uint32_t c : order)
+		{
+			result.insert(result.end(), indices.begin() + size_t(clusters[c]) * 3, indices.begin() + size_t(clusters[c + 1]) * 3);
+		}
+		return result;
+	}
+
+	uint64_t count_cache_misses(const std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		FifoCache fifo(vertexCount, STATS_CACHE_SIZE);
+		uint64_t misses = 0;
+		for (uint32_t index : indices)
+		{
+			misses += fifo.fetch(index) ? 1 : 0;
+		}
+		return misses;
+	}
+
+	// the cluster sort with threshold held against the whole mesh's ACMR. A split threshold that gives up too
+	// much is tightened towards 1, and the cache order stays when even the tightest one does
+	void optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold)
+	{
+		double allowedMisses = double(count_cache_misses(indices, vertices.size())) * threshold;
+		float split = threshold;
+		for (uint32_t attempt = 0; attempt < OVERDRAW_ATTEMPTS; attempt++)
+		{
+			std::vector<uint32_t> sorted = sort_clusters(indices, vertices, split);
+			if (double(count_cache_misses(sorted, vertices.size())) <= allowedMisses)
+			{
+				indices.swap(sorted);
+				return;
+			}
+			split = 1.f + (split - 1.f) * 0.5f;
+		}
+	}
+
+	// renumber vertices in the order the index buffer first touches them
+	void optimize_vertex_fetch(std::vector<uint32_t>& indices, std::vector<Vertex>& vertices)
+	{
+		const uint32_t unused = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t> remap(vertices.size(), unused);
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+
+		for (uint32_t& index : indices)
+		{
+			if (remap[index] == unused)
+			{
+				remap[index] = uint32_t(result.size());
+				result.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+		vertices.swap(result);
+	}
+
+	// orthographic depth tested rasterization of the mesh along +-x, +-y and +-z with back face culling,
+	// counts pixels that pass the depth test against pixels covered at the end
+	void measure_overdraw(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+		const MeshBounds& bounds, uint64_t& shaded, uint64_t& covered)
+	{
+		glm::vec3 extent = bounds.max - bounds.min;
+		float scale = std::max(extent.x, std::max(extent.y, extent.z));
+		scale = scale > 0.f ? float(OVERDRAW_GRID - 1) / scale : 0.f;
+
+		std::vector<float> depth(OVERDRAW_GRID * OVERDRAW_GRID);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			int u = (axis + 1) % 3;
+			int v = (axis + 2) % 3;
+
+			for (float direction : { 1.f, -1.f })
+			{
+				std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+
+				for (size_t t = 0; t + 2 < indices.size(); t += 3)
+				{
+					glm::vec3 p[3];
+					for (int k = 0; k < 3; k++)
+					{
+						glm::vec3 local = (vertices[indices[t + k]].position - bounds.min) * scale;
+						p[k] = glm::vec3(local[u], local[v], local[axis] * direction);
+					}
+
+					// the camera looks down +axis for direction 1, so counter clockwise front faces project
+					// clockwise, looking down -axis mirrors that
+					float area = ((p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x)) * direction;
+					if (area >= 0.f)
+					{
+						continue;
+					}
+					if (direction > 0.f)
+					{
+						std::swap(p[1], p[2]);
+					}
+
+					int minX = std::max(0, int(std::floor(std::min(p[0].x, std::min(p[1].x, p[2].x)))));
+					int minY = std::max(0, int(std::floor(std::min(p[0].y, std::min(p[1].y, p[2].y)))));
+					int maxX = std::min(int(OVERDRAW_GRID) - 1, int(std::ceil(std::max(p[0].x, std::max(p[1].x, p[2].x)))));
+					int maxY = std::min(int(OVERDRAW_GRID) - 1, int(std::ceil(std::max(p[0].y, std::max(p[1].y, p[2].y)))));
+
+					for (int y = minY; y <= maxY; y++)
+					{
+						for (int x = minX; x <= maxX; x++)
+						{
+							float px = x + 0.5f;
+							float py = y + 0.5f;
+
+							// barycentrics, shared edges are owned by one triangle through the >= / > split
+							float w0 = (p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x);
+							float w1 = (p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x);
+							float w2 = (p[1].x - p[0].x) * (py - p[0].y) - (p[1].y - p[0].y) * (px - p[0].x);
+							if (w0 < 0.f || w1 < 0.f || w2 < 0.f || (w0 == 0.f && w1 == 0.f))
+							{
+								continue;
+							}
+
+							float z = (w0 * p[0].z + w1 * p[1].z + w2 * p[2].z) / (w0 + w1 + w2);
+							float& stored = depth[y * OVERDRAW_GRID + x];
+							if (z < stored)
+							{
+								stored = z;
+								shaded++;
+							}
+						}
+					}
+				}
+
+				for (float d : depth)
+				{
+					covered += d != std::numeric_limits<float>::max();
+				}
+			}
+		}
+	}
+}
+
+VertexInputDescription Vertex::getVertexDescription(uint32_t attributes)
 {
     VertexInputDescription description;
 
 	// we will main vertex buffer binding, with a per-vertex rate
 	VkVertexInputBindingDescription mainBinding{}; 
 	mainBinding.binding = 0;
-	mainBinding.stride = sizeof(Vertex);
+	mainBinding.stride = packed_stride(attributes);
 	mainBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
     
 	description.bindings.push_back(mainBinding);
 
-	// Position will be stored at Location 0
+	// Position will be stored at Location 0, unorm so the shader sees [0, 1] inside the mesh bounds
 	VkVertexInputAttributeDescription positionAttribute = {};
 	positionAttribute.binding = 0;
 	positionAttribute.location = 0;
-	positionAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
-	positionAttribute.offset = offsetof(Vertex, position);
+	positionAttribute.format = VK_FORMAT_R16G16B16A16_UNORM;
+	positionAttribute.offset = offsetof(PackedVertex, position);
 
-	// Normal will be stored at Location 1
+	// Normal will be stored at Location 1, octahedral encoded
 	VkVertexInputAttributeDescription normalAttribute = {};
 	normalAttribute.binding = 0;
 	normalAttribute.location = 1;
-	normalAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
-	normalAttribute.offset = offsetof(Vertex, normal);
-
-	// Color will be stored at Location 2
-	VkVertexInputAttributeDescription colorAttribute = {};
-	colorAttribute.binding = 0;
-	colorAttribute.location = 2;
-	colorAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
-	colorAttribute.offset = offsetof(Vertex, color);
+	normalAttribute.format = VK_FORMAT_R16G16_SNORM;
+	normalAttribute.offset = offsetof(PackedVertex, normal);
 
 	// texCoords at Location 3
 	VkVertexInputAttributeDescription texAttribute = {}; 
 	texAttribute.binding = 0;
 	texAttribute.location = 3;
-	texAttribute.format = VK_FORMAT_R32G32_SFLOAT;
-	texAttribute.offset = offsetof(Vertex, texCoord);
+	texAttribute.format = VK_FORMAT_R16G16_SFLOAT;
+	texAttribute.offset = offsetof(PackedVertex, texCoord);
 
 	description.attributes.push_back(positionAttribute);
 	description.attributes.push_back(normalAttribute);
-	description.attributes.push_back(colorAttribute);
 	description.attributes.push_back(texAttribute); 
+
+	// Color will be stored at Location 2, after the fixed part of the vertex
+	if (attributes & VERTEX_ATTRIBUTE_COLOR)
+	{
+		VkVertexInputAttributeDescription colorAttribute = {};
+		colorAttribute.binding = 0;
+		colorAttribute.location = 2;
+		colorAttribute.format = VK_FORMAT_R8G8B8A8_UNORM;
+		colorAttribute.offset = sizeof(PackedVertex);
+
+		description.attributes.push_back(colorAttribute);
+	}
 	return description;
 }
 
+uint32_t Vertex::packed_stride(uint32_t attributes)
+{
+	uint32_t stride = sizeof(PackedVertex);
+	if (attributes & VERTEX_ATTRIBUTE_COLOR)
+	{
+		stride += 4;
+	}
+	return stride;
+}
+
 bool Mesh::load_from_obj(const char *filename)
+{
+	_vertices.clear();
+	_indices.clear();
+
+	if (!vkobj::load_obj(filename, _vertices, _indices))
+	{
+		throw std::runtime_error(std::string("failed to load obj ") + filename);
+	}
+
+	update_counts_and_bounds();
+
+	return true;
+}
+
+bool Mesh::load_from_obj_reference(const char *filename)
 {
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
@@ -79,12 +596,14 @@ bool Mesh::load_from_obj(const char *filename)
 				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
 			};
 
-			vertex.color = {
+			vertex.normal = {
 				attrib.normals[3 * index.normal_index + 0],
 				attrib.normals[3 * index.normal_index + 1],
 				attrib.normals[3 * index.normal_index + 2]
 			};
 
+			vertex.color = { 1.f, 1.f, 1.f };
+
 			// push back only if the vertex doesn't already exist
 			if (uniqueVertices.count(vertex) == 0) {
 				uniqueVertices[vertex] = static_cast<uint32_t>(_vertices.size());
@@ -95,5 +614,244 @@ bool Mesh::load_from_obj(const char *filename)
 		}
 	}
 
+	update_counts_and_bounds();
+
 	return true; 
 }
+
+void Mesh::update_counts_and_bounds()
+{
+	_vertexCount = static_cast<uint32_t>(_vertices.size());
+	_indexCount = static_cast<uint32_t>(_indices.size());
+	_lods.assign(1, MeshLod{ 0, _indexCount, 0.f });
+	_lodLevels = 1;
+
+	if (_vertices.empty())
+	{
+		_bounds = MeshBounds{};
+		return;
+	}
+
+	_bounds.min = _vertices[0].position;
+	_bounds.max = _vertices[0].position;
+	for (const Vertex& v : _vertices)
+	{
+		_bounds.min = glm::min(_bounds.min, v.position);
+		_bounds.max = glm::max(_bounds.max, v.position);
+	}
+
+	// centered on the box, but only as large as the farthest vertex rather than the box corner
+	_bounds.center = (_bounds.min + _bounds.max) * 0.5f;
+	float radiusSquared = 0.f;
+	for (const Vertex& v : _vertices)
+	{
+		glm::vec3 d = v.position - _bounds.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+	}
+	_bounds.radius = std::sqrt(radiusSquared);
+}
+
+void Mesh::pack(uint32_t attributes)
+{
+	glm::vec3 extent = _bounds.max - _bounds.min;
+	glm::vec3 invExtent{
+		extent.x > 0.f ? 1.f / extent.x : 0.f,
+		extent.y > 0.f ? 1.f / extent.y : 0.f,
+		extent.z > 0.f ? 1.f / extent.z : 0.f
+	};
+
+	uint32_t stride = Vertex::packed_stride(attributes);
+	_packedVertices.assign(_vertices.size() * stride, 0);
+
+	for (size_t i = 0; i < _vertices.size(); i++)
+	{
+		const Vertex& vertex = _vertices[i];
+		uint8_t* out = &_packedVertices[i * stride];
+
+		PackedVertex packed{};
+		glm::vec3 position = (vertex.position - _bounds.min) * invExtent;
+		packed.position[0] = quantize_unorm16(position.x);
+		packed.position[1] = quantize_unorm16(position.y);
+		packed.position[2] = quantize_unorm16(position.z);
+
+		glm::vec2 normal = oct_encode(vertex.normal);
+		packed.normal[0] = quantize_snorm16(normal.x);
+		packed.normal[1] = quantize_snorm16(normal.y);
+
+		packed.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+		packed.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+		memcpy(out, &packed, sizeof(packed));
+
+		if (attributes & VERTEX_ATTRIBUTE_COLOR)
+		{
+			glm::vec3 color = glm::clamp(vertex.color, 0.f, 1.f) * 255.f;
+			uint8_t rgba[4] = { uint8_t(std::lround(color.r)), uint8_t(std::lround(color.g)), uint8_t(std::lround(color.b)), 255 };
+			memcpy(out + sizeof(PackedVertex), rgba, sizeof(rgba));
+		}
+	}
+
+	// 0xffff is left out so the buffer stays valid with primitive restart turned on
+	if (_vertices.size() < 0xffff)
+	{
+		_indexType = VK_INDEX_TYPE_UINT16;
+		_packedIndices.resize(_indices.size() * sizeof(uint16_t));
+		uint16_t* out = reinterpret_cast<uint16_t*>(_packedIndices.data());
+		for (size_t i = 0; i < _indices.size(); i++)
+		{
+			out[i] = static_cast<uint16_t>(_indices[i]);
+		}
+	}
+	else
+	{
+		_indexType = VK_INDEX_TYPE_UINT32;
+		_packedIndices.resize(_indices.size() * sizeof(uint32_t));
+		memcpy(_packedIndices.data(), _indices.data(), _packedIndices.size());
+	}
+
+	_vertexAttributes = attributes;
+}
+
+glm::mat4 Mesh::dequantize_matrix() const
+{
+	glm::mat4 translate = glm::translate(glm::mat4{ 1.f }, _bounds.min);
+	return glm::scale(translate, _bounds.max - _bounds.min);
+}
+
+void Mesh::optimize(const MeshOptimizeOptions& options)
+{
+	if (options.vertexCache)
+	{
+		optimize_vertex_cache(_indices, _vertices.size());
+
+		if (options.overdraw)
+		{
+			optimize_overdraw(_indices, _vertices, options.overdrawThreshold);
+		}
+	}
+
+	if (options.vertexFetch)
+	{
+		optimize_vertex_fetch(_indices, _vertices);
+	}
+
+	update_counts_and_bounds();
+	_optimized = true;
+}
+
+void Mesh::build_lods(const MeshLodOptions& options)
+{
+	// rebuilding drops the levels a previous call appended
+	if (_lods.empty())
+	{
+		_lods.assign(1, MeshLod{ 0, static_cast<uint32_t>(_indices.size()), 0.f });
+	}
+	_lods.resize(1);
+	_indices.resize(_lods[0].indexCount);
+
+	SimplifyOptions simplify;
+	simplify.normalWeight = options.normalWeight;
+	simplify.texCoordWeight = options.texCoordWeight;
+	float scale = simplify_scale(_vertices);
+	float error = 0.f;
+
+	// simplifying the previous level rather than the full mesh every time is a lot cheaper, the errors add up
+	// instead, which only overestimates them
+	std::vector<uint32_t> level = _indices;
+	uint32_t levels = std::min(options.levels, MAX_MESH_LODS);
+	_lodLevels = levels;
+	for (uint32_t l = 1; l < levels; l++)
+	{
+		simplify.maxError = options.maxError - error;
+		size_t target = static_cast<size_t>(float(level.size() / 3) * options.reduction) * 3;
+		float levelError = 0.f;
+		std::vector<uint32_t> next = simplify_mesh(level, _vertices, target, simplify, &levelError);
+
+		// barely simpler than the level before, whatever stopped it would stop the ones after too
+		if (next.empty() || next.size() * 10 > level.size() * 9)
+		{
+			break;
+		}
+		if (_optimized)
+		{
+			optimize_vertex_cache(next, _vertices.size());
+		}
+
+		error += levelError;
+		_lods.push_back(MeshLod{ static_cast<uint32_t>(_indices.size()), static_cast<uint32_t>(next.size()), error * scale });
+		_indices.insert(_indices.end(), next.begin(), next.end());
+		level = std::move(next);
+	}
+
+	_indexCount = static_cast<uint32_t>(_indices.size());
+}
+
+uint32_t select_lod(const MeshLod* lods, uint32_t lodCount, float pixelsPerUnit, float thresholdPixels,
+	float hysteresis, uint32_t currentLod)
+{
+	if (lodCount == 0)
+	{
+		return 0;
+	}
+
+	// errors grow with the level, so walking from the current one finds the switch point in a step or two
+	uint32_t lod = std::min(currentLod, lodCount - 1);
+	float coarsen = thresholdPixels * (1.f - hysteresis);
+	float refine = thresholdPixels * (1.f + hysteresis);
+	while (lod + 1 < lodCount && lods[lod + 1].error * pixelsPerUnit <= coarsen)
+	{
+		lod++;
+	}
+	while (lod > 0 && lods[lod].error * pixelsPerUnit > refine)
+	{
+		lod--;
+	}
+	return lod;
+}
+
+MeshStats Mesh::analyze() const
+{
+	MeshStats stats;
+	if (_indices.empty() || _vertices.empty())
+	{
+		return stats;
+	}
+
+	// vertex fetches only happen on post-transform cache misses, in the packed layout the gpu reads
+	const uint64_t stride = Vertex::packed_stride(_vertexAttributes);
+	FifoCache fifo(_vertices.size(), STATS_CACHE_SIZE);
+	std::vector<uint64_t> lines(FETCH_CACHE_LINES, std::numeric_limits<uint64_t>::max());
+	uint64_t misses = 0;
+	uint64_t fetchedBytes = 0;
+
+	for (uint32_t index : _indices)
+	{
+		if (!fifo.fetch(index))
+		{
+			continue;
+		}
+		misses++;
+
+		uint64_t first = uint64_t(index) * stride / FETCH_LINE_BYTES;
+		uint64_t last = (uint64_t(index) * stride + stride - 1) / FETCH_LINE_BYTES;
+		for (uint64_t line = first; line <= last; line++)
+		{
+			uint64_t& slot = lines[line % FETCH_CACHE_LINES];
+			if (slot != line)
+			{
+				slot = line;
+				fetchedBytes += FETCH_LINE_BYTES;
+			}
+		}
+	}
+
+	stats.acmr = float(misses) / float(_indices.size() / 3);
+	stats.atvr = float(misses) / float(_vertices.size());
+	stats.overfetch = float(fetchedBytes) / float(_vertices.size() * stride);
+
+	uint64_t shaded = 0;
+	uint64_t covered = 0;
+	measure_overdraw(_indices, _vertices, _bounds, shaded, covered);
+	stats.overdraw = covered > 0 ? float(shaded) / float(covered) : 0.f;
+
+	return stats;
+}
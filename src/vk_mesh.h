@@ -1,9 +1,13 @@
 #pragma once
 
 #include <vk_types.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <vector>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <glm/mat4x4.hpp>
 #include <vector>
 #include <glm/gtx/hash.hpp>
 
@@ -13,13 +17,33 @@ struct VertexInputDescription {
 	VkPipelineVertexInputStateCreateFlags flags = 0;
 };
 
+// optional attributes of the packed gpu vertex, position/normal/texCoord are always there
+enum VertexAttributeFlags : uint32_t {
+	VERTEX_ATTRIBUTE_COLOR = 1 << 0,
+};
+
+// packed gpu vertex, 16 bytes (20 with color) instead of 44:
+//   location 0  position  R16G16B16A16_UNORM  quantized to the mesh bounds, see Mesh::dequantize_matrix()
+//   location 1  normal    R16G16_SNORM        octahedral encoding
+//   location 2  color     R8G8B8A8_UNORM      only with VERTEX_ATTRIBUTE_COLOR, appended at the end
+//   location 3  texCoord  R16G16_SFLOAT
+struct PackedVertex {
+	uint16_t position[4];
+	int16_t normal[2];
+	uint16_t texCoord[2];
+};
+
+// cpu side vertex used while loading and optimizing, Mesh::pack() turns it into the gpu layout
 struct Vertex {
     glm::vec3 position;
 	glm::vec3 normal; 
     glm::vec3 color;
 	glm::vec2 texCoord; 
 
-    static VertexInputDescription getVertexDescription();
+	// describes the packed layout for the given VertexAttributeFlags
+    static VertexInputDescription getVertexDescription(uint32_t attributes = 0);
+
+	static uint32_t packed_stride(uint32_t attributes);
 	
 	bool operator==(const Vertex& other) const {
         return position == other.position 
@@ -29,18 +53,151 @@ struct Vertex {
     }
 };
 
+// murmur3 style hash over every field of the vertex. -0.f is folded into 0.f so that
+// vertices that compare equal always hash equal
+inline uint32_t hash_vertex(const Vertex& vertex) {
+	const float fields[11] = {
+		vertex.position.x, vertex.position.y, vertex.position.z,
+		vertex.normal.x, vertex.normal.y, vertex.normal.z,
+		vertex.color.x, vertex.color.y, vertex.color.z,
+		vertex.texCoord.x, vertex.texCoord.y
+	};
+
+	uint32_t h = 0x9747b28c;
+	for (float field : fields) {
+		float folded = field + 0.0f;
+		uint32_t k;
+		memcpy(&k, &folded, sizeof(k));
+		k *= 0xcc9e2d51;
+		k = (k << 15) | (k >> 17);
+		k *= 0x1b873593;
+		h ^= k;
+		h = (h << 13) | (h >> 19);
+		h = h * 5 + 0xe6546b64;
+	}
+
+	// final avalanche
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
 template<> struct std::hash<Vertex> {
 	size_t operator()(Vertex const& vertex) const {
-		return ((std::hash<glm::vec3>()(vertex.position) ^ (std::hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ (std::hash<glm::vec2>()(vertex.texCoord) << 1);
+		return hash_vertex(vertex);
 	}
 };
 
+struct MeshBounds {
+	glm::vec3 min{ 0.f };
+	glm::vec3 max{ 0.f };
+
+	// bounding sphere around the box center, used for frustum culling
+	glm::vec3 center{ 0.f };
+	float radius = 0.f;
+};
+
+// index buffer quality, see Mesh::analyze()
+struct MeshStats {
+	float acmr = 0.f;      // average cache miss ratio, vertex shader runs per triangle. 0.5 is ideal, 3 is the worst
+	float atvr = 0.f;      // average transform to vertex ratio, vertex shader runs per vertex. 1 is ideal
+	float overdraw = 0.f;  // shaded / covered pixels, averaged over the 6 axis aligned views. 1 is ideal
+	float overfetch = 0.f; // bytes pulled through 64 byte cache lines / vertex buffer size. 1 is ideal
+};
+
+struct MeshOptimizeOptions {
+	bool vertexCache = true;         // reorder triangles for the post-transform cache
+	bool overdraw = true;            // reorder triangle clusters front to back, needs vertexCache
+	bool vertexFetch = true;         // reorder vertices in first use order, drops unreferenced ones
+	float overdrawThreshold = 1.05f; // how much of the mesh's ACMR the overdraw pass may give up, 1.05 = 5% worse
+};
+
+// one level of detail, a range of Mesh::_indices over the same vertices
+struct MeshLod {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	float error = 0.f; // how far the level strays from the full mesh, in model units. 0 for the full mesh
+};
+
+// levels a mesh keeps at most, the full mesh included. Fixed so the mesh cache header can hold them
+const uint32_t MAX_MESH_LODS = 8;
+
+struct MeshLodOptions {
+	uint32_t levels = 4;         // full mesh included, 1 builds none
+	float reduction = 0.5f;      // triangles of a level against the one before it
+	float maxError = 0.1f;       // relative to the mesh extent, the chain stops short of levels straying further
+	float normalWeight = 0.5f;   // see SimplifyOptions
+	float texCoordWeight = 1.f;
+};
+
 struct Mesh {
 	std::vector<Vertex> _vertices;
 	std::vector<uint32_t> _indices; 
 
-	AllocatedBuffer _vertexBuffer; 
-	AllocatedBuffer _indexBuffer; 
+	// what was uploaded to the gpu. Meshes streamed from the binary cache keep no cpu side copy
+	uint32_t _vertexCount = 0;
+	uint32_t _indexCount = 0;
+	MeshBounds _bounds;
+
+	// gpu layout built by pack(), 16 bit indices whenever the vertex count allows it
+	std::vector<uint8_t> _packedVertices;
+	std::vector<uint8_t> _packedIndices;
+
+	// set instead of the vectors above when the packed data can be read straight out of memory _packedSourceOwner
+	// keeps alive, e.g. a mapped mesh cache, so the upload copies it exactly once
+	const uint8_t* _packedVertexSource = nullptr;
+	const uint8_t* _packedIndexSource = nullptr;
+	std::shared_ptr<const void> _packedSourceOwner;
+	uint32_t _vertexAttributes = 0;
+	VkIndexType _indexType = VK_INDEX_TYPE_UINT32;
+
+	// range of the engine's GeometryBuffer the packed data lives in, see GeometryBuffer::allocate()
+	uint32_t _firstIndex = 0;
+	int32_t _vertexOffset = 0;
 
 	bool load_from_obj(const char* filename);
+
+	// single threaded tinyobj + std::unordered_map loader, kept as a baseline for the loader benchmark
+	bool load_from_obj_reference(const char* filename);
+
+	// recompute counts, box and sphere bounds from _vertices/_indices
+	void update_counts_and_bounds();
+
+	// reorder _indices/_vertices for the gpu, pure cpu transform done before upload
+	void optimize(const MeshOptimizeOptions& options = {});
+
+	// quantize _vertices/_indices into _packedVertices/_packedIndices, attributes not asked for are dropped
+	void pack(uint32_t attributes);
+
+	// maps the quantized [0, 1] positions back to model space, goes in front of the model matrix
+	glm::mat4 dequantize_matrix() const;
+
+	// simulate the post-transform cache, vertex fetch and a small depth tested rasterizer over _indices
+	MeshStats analyze() const;
+
+	// append simplified levels to _indices, each one simplified from the one before it. Goes after optimize(),
+	// which would reorder them all as one. _indexCount covers every level, the gpu gets them all in one range
+	void build_lods(const MeshLodOptions& options = {});
+
+	// level 0 is the whole mesh, set by update_counts_and_bounds() and extended by build_lods()
+	std::vector<MeshLod> _lods;
+	uint32_t _lodLevels = 1; // what build_lods() was asked for, _lods ends up shorter when simplification stalls
+
+	// set by optimize(), baked into the mesh cache so a cache hit knows what it holds
+	bool _optimized = false;
+
+	// small id handed out by the engine, goes into the draw sort key
+	uint32_t _id = 0;
+
+	// set once the streamed buffers are on the gpu, until then the engine draws its placeholder instead
+	bool _resident = false;
 };
+
+/// @brief Coarsest level whose error projects to at most thresholdPixels, for a mesh covering pixelsPerUnit
+/// screen pixels per model unit. A band of hysteresis (a fraction of the threshold) around the switch points
+/// keeps the current level, so objects sitting right at one don't flip between levels every frame.
+uint32_t select_lod(const MeshLod* lods, uint32_t lodCount, float pixelsPerUnit, float thresholdPixels,
+	float hysteresis, uint32_t currentLod);
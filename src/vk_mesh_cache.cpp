@@ -0,0 +1,390 @@
+#include <vk_mesh_cache.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	const uint64_t BLOB_ALIGNMENT = 16;
+
+	uint64_t align_up(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	void encode_indices(const std::vector<uint32_t>& indices, std::vector<uint8_t>& out)
+	{
+		// neighbouring indices are close together, so zigzag deltas mostly fit in one or two bytes
+		out.reserve(indices.size() * 2);
+		uint32_t prev = 0;
+		for (uint32_t index : indices)
+		{
+			int32_t delta = static_cast<int32_t>(index - prev);
+			uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+			while (zigzag >= 0x80)
+			{
+				out.push_back(static_cast<uint8_t>(zigzag | 0x80));
+				zigzag >>= 7;
+			}
+			out.push_back(static_cast<uint8_t>(zigzag));
+			prev = index;
+		}
+	}
+
+	template<typename T>
+	void decode_indices(const uint8_t* src, size_t srcSize, uint32_t count, T* dst)
+	{
+		const uint8_t* end = src + srcSize;
+		uint32_t prev = 0;
+		uint32_t i = 0;
+		for (; i < count && src < end; i++)
+		{
+			uint32_t zigzag = 0;
+			uint32_t shift = 0;
+			while (src < end && shift < 32)
+			{
+				uint8_t byte = *src++;
+				zigzag |= static_cast<uint32_t>(byte & 0x7f) << shift;
+				shift += 7;
+				if ((byte & 0x80) == 0)
+				{
+					break;
+				}
+			}
+			int32_t delta = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+			prev += static_cast<uint32_t>(delta);
+			dst[i] = static_cast<T>(prev);
+		}
+
+		// a truncated blob is caught by validation, but never leave garbage behind
+		if (i < count)
+		{
+			memset(dst + i, 0, (count - i) * sizeof(T));
+		}
+	}
+}
+
+bool source_stamp(const char* sourcePath, uint64_t& size, int64_t& time)
+{
+	std::error_code ec;
+	size = std::filesystem::file_size(sourcePath, ec);
+	if (ec)
+	{
+		return false;
+	}
+	auto writeTime = std::filesystem::last_write_time(sourcePath, ec);
+	if (ec)
+	{
+		return false;
+	}
+	time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+	return true;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	_file = file;
+	_mapping = mapping;
+	_data = static_cast<const uint8_t*>(view);
+	_size = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_data)
+	{
+		UnmapViewOfFile(_data);
+		CloseHandle(_mapping);
+		CloseHandle(_file);
+	}
+	_data = nullptr;
+	_size = 0;
+	_file = nullptr;
+	_mapping = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// the mapping keeps its own reference to the file
+	::close(fd);
+
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+
+	// the blobs are read front to back exactly once
+	madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+	_data = static_cast<const uint8_t*>(view);
+	_size = static_cast<size_t>(st.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_data)
+	{
+		munmap(const_cast<uint8_t*>(_data), _size);
+	}
+	_data = nullptr;
+	_size = 0;
+}
+
+#endif
+
+bool MeshCache::open(const char* cachePath, const char* sourcePath)
+{
+	_header = nullptr;
+
+	if (!_file.open(cachePath) || _file.size() < sizeof(MeshCacheHeader))
+	{
+		return false;
+	}
+
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(_file.data());
+
+	bool valid = header->magic == MESH_CACHE_MAGIC
+		&& header->version == MESH_CACHE_VERSION
+		&& header->vertexStride == Vertex::packed_stride(header->vertexAttributes)
+		&& (header->indexSize == sizeof(uint16_t) || header->indexSize == sizeof(uint32_t))
+		&& header->vertexBytes == static_cast<uint64_t>(header->vertexCount) * header->vertexStride
+		&& header->vertexOffset + header->vertexBytes <= _file.size()
+		&& header->indexOffset + header->indexBytes <= _file.size();
+
+	if (valid && (header->flags & MESH_CACHE_COMPRESSED_INDICES) == 0)
+	{
+		valid = header->indexBytes == static_cast<uint64_t>(header->indexCount) * header->indexSize;
+	}
+
+	// every level has to lie inside the index blob, a draw would read past the mesh's range otherwise
+	valid = valid && header->lodCount >= 1 && header->lodCount <= MAX_MESH_LODS;
+	for (uint32_t i = 0; valid && i < header->lodCount; i++)
+	{
+		const MeshLod& lod = header->lods[i];
+		valid = static_cast<uint64_t>(lod.firstIndex) + lod.indexCount <= header->indexCount;
+	}
+
+	// caches baked from a different version of the obj are stale
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (valid && source_stamp(sourcePath, sourceSize, sourceTime))
+	{
+		valid = header->sourceSize == sourceSize && header->sourceTime == sourceTime;
+	}
+
+	if (!valid)
+	{
+		_file.close();
+		return false;
+	}
+
+	_header = header;
+	return true;
+}
+
+void MeshCache::copy_vertices(void* dst) const
+{
+	memcpy(dst, _file.data() + _header->vertexOffset, static_cast<size_t>(_header->vertexBytes));
+}
+
+void MeshCache::copy_indices(void* dst) const
+{
+	const uint8_t* src = _file.data() + _header->indexOffset;
+	if (_header->flags & MESH_CACHE_COMPRESSED_INDICES)
+	{
+		if (_header->indexSize == sizeof(uint16_t))
+		{
+			decode_indices(src, static_cast<size_t>(_header->indexBytes), _header->indexCount, static_cast<uint16_t*>(dst));
+		}
+		else
+		{
+			decode_indices(src, static_cast<size_t>(_header->indexBytes), _header->indexCount, static_cast<uint32_t*>(dst));
+		}
+	}
+	else
+	{
+		memcpy(dst, src, static_cast<size_t>(_header->indexBytes));
+	}
+}
+
+MeshBounds MeshCache::bounds() const
+{
+	MeshBounds bounds;
+	bounds.min = glm::vec3(_header->boundsMin[0], _header->boundsMin[1], _header->boundsMin[2]);
+	bounds.max = glm::vec3(_header->boundsMax[0], _header->boundsMax[1], _header->boundsMax[2]);
+	bounds.center = glm::vec3(_header->boundsSphere[0], _header->boundsSphere[1], _header->boundsSphere[2]);
+	bounds.radius = _header->boundsSphere[3];
+	return bounds;
+}
+
+bool write_mesh_cache(const char* cachePath, const char* sourcePath, const Mesh& mesh, bool compressIndices)
+{
+	MeshCacheHeader header{};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexStride = Vertex::packed_stride(mesh._vertexAttributes);
+	header.vertexCount = static_cast<uint32_t>(mesh._vertices.size());
+	header.indexCount = static_cast<uint32_t>(mesh._indices.size());
+	header.indexSize = mesh._indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	header.vertexAttributes = mesh._vertexAttributes;
+	header.lodLevels = mesh._lodLevels;
+
+	// a mesh that never had its counts updated is one level over all of its indices
+	if (mesh._lods.empty())
+	{
+		header.lodCount = 1;
+		header.lods[0].indexCount = header.indexCount;
+	}
+	else
+	{
+		header.lodCount = std::min(static_cast<uint32_t>(mesh._lods.size()), MAX_MESH_LODS);
+		std::copy(mesh._lods.begin(), mesh._lods.begin() + header.lodCount, header.lods);
+	}
+
+	// only the packed gpu layout is baked
+	if (mesh._packedVertices.size() != static_cast<size_t>(header.vertexCount) * header.vertexStride
+		|| mesh._packedIndices.size() != static_cast<size_t>(header.indexCount) * header.indexSize)
+	{
+		return false;
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		header.boundsMin[i] = mesh._bounds.min[i];
+		header.boundsMax[i] = mesh._bounds.max[i];
+		header.boundsSphere[i] = mesh._bounds.center[i];
+	}
+	header.boundsSphere[3] = mesh._bounds.radius;
+
+	if (!source_stamp(sourcePath, header.sourceSize, header.sourceTime))
+	{
+		return false;
+	}
+
+	if (mesh._optimized)
+	{
+		header.flags |= MESH_CACHE_OPTIMIZED;
+	}
+
+	std::vector<uint8_t> encodedIndices;
+	const void* indexData = mesh._packedIndices.data();
+	header.indexBytes = mesh._packedIndices.size();
+
+	if (compressIndices)
+	{
+		encode_indices(mesh._indices, encodedIndices);
+		header.flags |= MESH_CACHE_COMPRESSED_INDICES;
+		indexData = encodedIndices.data();
+		header.indexBytes = encodedIndices.size();
+	}
+
+	header.vertexOffset = align_up(sizeof(MeshCacheHeader), BLOB_ALIGNMENT);
+	header.vertexBytes = mesh._packedVertices.size();
+	header.indexOffset = align_up(header.vertexOffset + header.vertexBytes, BLOB_ALIGNMENT);
+
+	std::string tempPath = std::string(cachePath) + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		const char padding[BLOB_ALIGNMENT] = {};
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(padding, static_cast<std::streamsize>(header.vertexOffset - sizeof(header)));
+		file.write(reinterpret_cast<const char*>(mesh._packedVertices.data()), static_cast<std::streamsize>(header.vertexBytes));
+		file.write(padding, static_cast<std::streamsize>(header.indexOffset - header.vertexOffset - header.vertexBytes));
+		file.write(static_cast<const char*>(indexData), static_cast<std::streamsize>(header.indexBytes));
+
+		if (!file.good())
+		{
+			file.close();
+			std::filesystem::remove(tempPath);
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vk_mesh.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Baked binary mesh format. The file is memory mapped and the vertex/index blobs are copied
+// straight into staging memory, so no text parsing or vertex dedup happens on a cache hit.
+//
+// layout: [MeshCacheHeader][vertex blob][index blob], blobs aligned to 16 bytes
+
+const uint32_t MESH_CACHE_MAGIC = 0x4d474b56; // "VKGM"
+const uint32_t MESH_CACHE_VERSION = 4;
+
+// caches live next to their source asset, e.g. assets/wahoo.obj.vkmesh
+const char* const MESH_CACHE_EXTENSION = ".vkmesh";
+
+enum MeshCacheFlags : uint32_t {
+	// index blob is delta + zigzag + varint encoded instead of raw uint32_t
+	MESH_CACHE_COMPRESSED_INDICES = 1 << 0,
+	// baked after Mesh::optimize(), a cache with the wrong state is rebaked
+	MESH_CACHE_OPTIMIZED = 1 << 1,
+};
+
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t vertexStride;     // packed stride when baked, a layout change invalidates the cache
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize;        // bytes per decoded index, 2 or 4
+	uint32_t vertexAttributes; // VertexAttributeFlags the vertices were packed with
+	float boundsMin[3];
+	float boundsMax[3];
+	float boundsSphere[4];     // center, radius
+	uint64_t sourceSize;       // size and modification time of the source obj, used to detect stale caches
+	int64_t sourceTime;
+	uint64_t vertexOffset;
+	uint64_t vertexBytes;
+	uint64_t indexOffset;
+	uint64_t indexBytes;       // stored size, smaller than indexCount * indexSize when compressed
+	uint32_t lodLevels;        // levels Mesh::build_lods() was asked for, a different setting rebakes the cache
+	uint32_t lodCount;         // levels in lods, back to back in the index blob
+	MeshLod lods[MAX_MESH_LODS];
+};
+
+// read-only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	const uint8_t* data() const { return _data; }
+	size_t size() const { return _size; }
+
+private:
+	const uint8_t* _data = nullptr;
+	size_t _size = 0;
+#ifdef _WIN32
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#endif
+};
+
+/// @brief Size and modification time of a source asset, baked into caches so an edited source invalidates them.
+bool source_stamp(const char* sourcePath, uint64_t& size, int64_t& time);
+
+class MeshCache {
+public:
+	/// @brief Map a cache file and validate it against the obj it was baked from.
+	/// @return false when the cache is missing, corrupt or stale.
+	bool open(const char* cachePath, const char* sourcePath);
+
+	const MeshCacheHeader& header() const { return *_header; }
+
+	size_t vertex_bytes() const { return static_cast<size_t>(_header->vertexCount) * _header->vertexStride; }
+	size_t index_bytes() const { return static_cast<size_t>(_header->indexCount) * _header->indexSize; }
+
+	// copy (or decode) the blobs into already mapped destination memory, e.g. a staging buffer
+	void copy_vertices(void* dst) const;
+	void copy_indices(void* dst) const;
+
+	// the blobs inside the mapping, valid while the cache is open. Compressed indices have to go through copy_indices()
+	const uint8_t* vertex_data() const { return _file.data() + _header->vertexOffset; }
+	const uint8_t* index_data() const { return compressed_indices() ? nullptr : _file.data() + _header->indexOffset; }
+	bool compressed_indices() const { return (_header->flags & MESH_CACHE_COMPRESSED_INDICES) != 0; }
+
+	MeshBounds bounds() const;
+	std::vector<MeshLod> lods() const { return std::vector<MeshLod>(_header->lods, _header->lods + _header->lodCount); }
+	uint32_t lod_levels() const { return _header->lodLevels; }
+
+	bool optimized() const { return (_header->flags & MESH_CACHE_OPTIMIZED) != 0; }
+	uint32_t vertex_attributes() const { return _header->vertexAttributes; }
+	VkIndexType index_type() const { return _header->indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32; }
+
+private:
+	MappedFile _file;
+	const MeshCacheHeader* _header = nullptr;
+};
+
+/// @brief Bake a packed mesh (see Mesh::pack()) to disk. Written to a temporary file first and renamed so readers never see a partial cache.
+bool write_mesh_cache(const char* cachePath, const char* sourcePath, const Mesh& mesh, bool compressIndices = false);
@@ -0,0 +1,662 @@
+#include <vk_obj_loader.h>
+#include <vk_mesh_cache.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+	// don't bother splitting files into chunks smaller than this
+	const size_t MIN_CHUNK_BYTES = 64 * 1024;
+
+	// below this many corners a single dedup table is faster than partitioning
+	const uint64_t MIN_PARALLEL_CORNERS = 64 * 1024;
+
+	struct ObjCorner {
+		int32_t position;
+		int32_t texcoord; // -1 when the face has no texcoord
+		int32_t normal;   // -1 when the face has no normal
+	};
+
+	struct ObjChunk {
+		const char* begin = nullptr;
+		const char* end = nullptr;
+
+		// statement counts inside this chunk
+		uint64_t positions = 0;
+		uint64_t texcoords = 0;
+		uint64_t normals = 0;
+		uint64_t corners = 0;
+
+		// exclusive prefix sums over the previous chunks
+		uint64_t positionBase = 0;
+		uint64_t texcoordBase = 0;
+		uint64_t normalBase = 0;
+		uint64_t cornerBase = 0;
+
+		bool valid = true;
+	};
+
+	struct ObjData {
+		std::vector<float> positions;
+		std::vector<float> texcoords;
+		std::vector<float> normals;
+		std::vector<ObjCorner> corners;
+	};
+
+	// run fn(begin, end, worker) over [0, count) split into one contiguous range per worker
+	template <typename F>
+	void parallel_ranges(uint64_t count, uint32_t workers, const F& fn)
+	{
+		if (workers <= 1 || count < workers)
+		{
+			fn(0, count, 0u);
+			return;
+		}
+
+		std::vector<std::thread> threads;
+		threads.reserve(workers - 1);
+		for (uint32_t w = 1; w < workers; w++)
+		{
+			threads.emplace_back([&, w]() { fn(count * w / workers, count * (w + 1) / workers, w); });
+		}
+		fn(0, count / workers, 0u);
+
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+	}
+
+	inline bool is_space(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool is_digit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline const char* skip_space(const char* p, const char* end)
+	{
+		while (p < end && is_space(*p))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	inline const char* line_end(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n')
+		{
+			p++;
+		}
+		return p;
+	}
+
+	// obj floats are plain decimals, so this avoids strtof's locale handling and per call overhead
+	const char* parse_float(const char* p, const char* end, float& out)
+	{
+		static const double powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		p = skip_space(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+
+		for (; p < end && is_digit(*p); p++)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+			}
+			else
+			{
+				exponent++;
+			}
+		}
+
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && is_digit(*p); p++)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				p++;
+			}
+			int e = 0;
+			for (; p < end && is_digit(*p); p++)
+			{
+				e = std::min(e * 10 + (*p - '0'), 1000);
+			}
+			exponent += negativeExponent ? -e : e;
+		}
+
+		double value = static_cast<double>(mantissa);
+		if (exponent < 0)
+		{
+			value = -exponent <= 22 ? value / powers[-exponent] : value * std::pow(10.0, exponent);
+		}
+		else if (exponent > 0)
+		{
+			value = exponent <= 22 ? value * powers[exponent] : value * std::pow(10.0, exponent);
+		}
+
+		out = static_cast<float>(negative ? -value : value);
+
+		// skip anything we didn't understand (nan, inf) up to the next separator
+		while (p < end && !is_space(*p) && *p != '\n')
+		{
+			p++;
+		}
+		return p;
+	}
+
+	inline const char* parse_int(const char* p, const char* end, int64_t& out)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+		int64_t value = 0;
+		for (; p < end && is_digit(*p); p++)
+		{
+			value = value * 10 + (*p - '0');
+		}
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// obj indices are 1 based, negative values count back from the attributes seen so far
+	inline int32_t resolve_index(int64_t index, uint64_t seen, uint64_t total)
+	{
+		int64_t resolved = index > 0 ? index - 1 : static_cast<int64_t>(seen) + index;
+		return resolved >= 0 && static_cast<uint64_t>(resolved) < total ? static_cast<int32_t>(resolved) : INT32_MIN;
+	}
+
+	enum class Statement { Position, Texcoord, Normal, Face, Other };
+
+	inline Statement classify(const char*& p, const char* end)
+	{
+		if (end - p < 2)
+		{
+			return Statement::Other;
+		}
+		if (p[0] == 'v')
+		{
+			if (is_space(p[1])) { p += 2; return Statement::Position; }
+			if (end - p >= 3 && is_space(p[2]))
+			{
+				if (p[1] == 't') { p += 3; return Statement::Texcoord; }
+				if (p[1] == 'n') { p += 3; return Statement::Normal; }
+			}
+		}
+		else if (p[0] == 'f' && is_space(p[1]))
+		{
+			p += 2;
+			return Statement::Face;
+		}
+		return Statement::Other;
+	}
+
+	uint32_t count_face_vertices(const char* p, const char* end)
+	{
+		uint32_t count = 0;
+		while (true)
+		{
+			p = skip_space(p, end);
+			if (p >= end || *p == '#')
+			{
+				return count;
+			}
+			count++;
+			while (p < end && !is_space(*p))
+			{
+				p++;
+			}
+		}
+	}
+
+	void count_chunk(ObjChunk& chunk)
+	{
+		for (const char* p = chunk.begin; p < chunk.end;)
+		{
+			const char* end = line_end(p, chunk.end);
+			const char* s = skip_space(p, end);
+
+			switch (classify(s, end))
+			{
+			case Statement::Position: chunk.positions++; break;
+			case Statement::Texcoord: chunk.texcoords++; break;
+			case Statement::Normal: chunk.normals++; break;
+			case Statement::Face:
+			{
+				uint32_t count = count_face_vertices(s, end);
+				if (count >= 3)
+				{
+					chunk.corners += 3 * (count - 2);
+				}
+				break;
+			}
+			default: break;
+			}
+
+			p = end + 1;
+		}
+	}
+
+	void parse_chunk(ObjChunk& chunk, ObjData& data, uint64_t totalPositions, uint64_t totalTexcoords, uint64_t totalNormals)
+	{
+		uint64_t positions = chunk.positionBase;
+		uint64_t texcoords = chunk.texcoordBase;
+		uint64_t normals = chunk.normalBase;
+		uint64_t corners = chunk.cornerBase;
+
+		for (const char* p = chunk.begin; p < chunk.end;)
+		{
+			const char* end = line_end(p, chunk.end);
+			const char* s = skip_space(p, end);
+
+			switch (classify(s, end))
+			{
+			case Statement::Position:
+			{
+				float* out = &data.positions[positions++ * 3];
+				s = parse_float(s, end, out[0]);
+				s = parse_float(s, end, out[1]);
+				parse_float(s, end, out[2]);
+				break;
+			}
+			case Statement::Texcoord:
+			{
+				float* out = &data.texcoords[texcoords++ * 2];
+				s = parse_float(s, end, out[0]);
+				parse_float(s, end, out[1]);
+				break;
+			}
+			case Statement::Normal:
+			{
+				float* out = &data.normals[normals++ * 3];
+				s = parse_float(s, end, out[0]);
+				s = parse_float(s, end, out[1]);
+				parse_float(s, end, out[2]);
+				break;
+			}
+			case Statement::Face:
+			{
+				// triangulate as a fan around the first corner
+				ObjCorner first{}, previous{};
+				uint32_t count = 0;
+				while (true)
+				{
+					s = skip_space(s, end);
+					if (s >= end || *s == '#')
+					{
+						break;
+					}
+
+					ObjCorner corner{ INT32_MIN, -1, -1 };
+					int64_t index;
+					s = parse_int(s, end, index);
+					corner.position = resolve_index(index, positions, totalPositions);
+					if (s < end && *s == '/')
+					{
+						s++;
+						if (s < end && *s != '/' && !is_space(*s))
+						{
+							s = parse_int(s, end, index);
+							corner.texcoord = resolve_index(index, texcoords, totalTexcoords);
+						}
+						if (s < end && *s == '/')
+						{
+							s = parse_int(s + 1, end, index);
+							corner.normal = resolve_index(index, normals, totalNormals);
+						}
+					}
+					while (s < end && !is_space(*s))
+					{
+						s++;
+					}
+
+					if (corner.position == INT32_MIN || corner.texcoord == INT32_MIN || corner.normal == INT32_MIN)
+					{
+						chunk.valid = false;
+						return;
+					}
+
+					if (count == 0)
+					{
+						first = corner;
+					}
+					else if (count >= 2)
+					{
+						data.corners[corners++] = first;
+						data.corners[corners++] = previous;
+						data.corners[corners++] = corner;
+					}
+					previous = corner;
+					count++;
+				}
+				break;
+			}
+			default: break;
+			}
+
+			p = end + 1;
+		}
+	}
+
+	// matches what the tinyobj based loader builds. obj vertex colors aren't read, color is white
+	inline Vertex build_vertex(const ObjData& data, const ObjCorner& corner)
+	{
+		Vertex vertex{};
+		vertex.color = glm::vec3{ 1.f };
+		const float* position = &data.positions[static_cast<size_t>(corner.position) * 3];
+		vertex.position = glm::vec3{ position[0], position[1], position[2] };
+
+		if (corner.texcoord >= 0)
+		{
+			const float* texcoord = &data.texcoords[static_cast<size_t>(corner.texcoord) * 2];
+			vertex.texCoord = glm::vec2{ texcoord[0], 1.0f - texcoord[1] };
+		}
+
+		if (corner.normal >= 0)
+		{
+			const float* normal = &data.normals[static_cast<size_t>(corner.normal) * 3];
+			vertex.normal = glm::vec3{ normal[0], normal[1], normal[2] };
+		}
+		return vertex;
+	}
+
+	// open-addressing table (linear probing) from vertex to partition-local id.
+	// slots keep the full hash so growing never rebuilds vertices
+	struct DedupTable {
+		struct Slot {
+			uint32_t hash;
+			uint32_t id; // local id + 1, 0 marks an empty slot
+		};
+
+		std::vector<Slot> slots;
+		std::vector<uint32_t> firstCorner; // first corner that produced each local id
+		uint32_t mask = 0;
+
+		void init(size_t expected)
+		{
+			size_t capacity = 64;
+			while (capacity < expected * 2)
+			{
+				capacity *= 2;
+			}
+			slots.assign(capacity, Slot{ 0, 0 });
+			mask = static_cast<uint32_t>(capacity - 1);
+			firstCorner.reserve(expected);
+		}
+
+		void grow()
+		{
+			std::vector<Slot> old;
+			old.swap(slots);
+			slots.assign(old.size() * 2, Slot{ 0, 0 });
+			mask = static_cast<uint32_t>(slots.size() - 1);
+			for (const Slot& slot : old)
+			{
+				if (slot.id != 0)
+				{
+					uint32_t i = slot.hash & mask;
+					while (slots[i].id != 0)
+					{
+						i = (i + 1) & mask;
+					}
+					slots[i] = slot;
+				}
+			}
+		}
+
+		// returns the local id of the vertex at corner c, inserting it if it hasn't been seen
+		uint32_t insert(const ObjData& data, uint32_t hash, uint64_t c, bool& inserted)
+		{
+			const ObjCorner& corner = data.corners[c];
+			uint32_t i = hash & mask;
+			while (slots[i].id != 0)
+			{
+				if (slots[i].hash == hash)
+				{
+					const ObjCorner& other = data.corners[firstCorner[slots[i].id - 1]];
+					bool sameIndices = other.position == corner.position && other.texcoord == corner.texcoord && other.normal == corner.normal;
+					if (sameIndices || build_vertex(data, other) == build_vertex(data, corner))
+					{
+						inserted = false;
+						return slots[i].id - 1;
+					}
+				}
+				i = (i + 1) & mask;
+			}
+
+			uint32_t id = static_cast<uint32_t>(firstCorner.size());
+			firstCorner.push_back(static_cast<uint32_t>(c));
+			slots[i] = Slot{ hash, id + 1 };
+			inserted = true;
+
+			// keep the load factor under one half
+			if (firstCorner.size() * 2 > slots.size())
+			{
+				grow();
+			}
+			return id;
+		}
+	};
+
+	// partitions are picked from the high bits, the table probes with the low bits
+	inline uint32_t partition_of(uint32_t hash, uint32_t partitions)
+	{
+		return static_cast<uint32_t>((static_cast<uint64_t>(hash) * partitions) >> 32);
+	}
+}
+
+bool vkobj::load_obj(const char* filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t threadCount, ObjLoadStats* stats)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		return false;
+	}
+
+	const char* begin = reinterpret_cast<const char*>(file.data());
+	const char* end = begin + file.size();
+
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	uint32_t chunkCount = static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(threadCount, file.size() / MIN_CHUNK_BYTES)));
+
+	// ==== SPLIT INTO LINE ALIGNED CHUNKS ====
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* chunkBegin = begin;
+	for (uint32_t i = 0; i < chunkCount; i++)
+	{
+		const char* chunkEnd = i + 1 == chunkCount ? end : begin + file.size() * (i + 1) / chunkCount;
+		chunkEnd = std::max(chunkEnd, chunkBegin);
+		chunkEnd = chunkEnd < end ? line_end(chunkEnd, end) : end;
+		chunkEnd = chunkEnd < end ? chunkEnd + 1 : end;
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	// ==== COUNT, THEN PARSE INTO PREALLOCATED ARRAYS ====
+	parallel_ranges(chunkCount, chunkCount, [&](uint64_t first, uint64_t last, uint32_t) {
+		for (uint64_t i = first; i < last; i++)
+		{
+			count_chunk(chunks[i]);
+		}
+	});
+
+	uint64_t totalPositions = 0, totalTexcoords = 0, totalNormals = 0, totalCorners = 0;
+	for (ObjChunk& chunk : chunks)
+	{
+		chunk.positionBase = totalPositions;
+		chunk.texcoordBase = totalTexcoords;
+		chunk.normalBase = totalNormals;
+		chunk.cornerBase = totalCorners;
+		totalPositions += chunk.positions;
+		totalTexcoords += chunk.texcoords;
+		totalNormals += chunk.normals;
+		totalCorners += chunk.corners;
+	}
+
+	if (totalCorners > UINT32_MAX || totalPositions > INT32_MAX || totalTexcoords > INT32_MAX || totalNormals > INT32_MAX)
+	{
+		return false;
+	}
+
+	ObjData data;
+	data.positions.resize(totalPositions * 3);
+	data.texcoords.resize(totalTexcoords * 2);
+	data.normals.resize(totalNormals * 3);
+	data.corners.resize(totalCorners);
+
+	parallel_ranges(chunkCount, chunkCount, [&](uint64_t first, uint64_t last, uint32_t) {
+		for (uint64_t i = first; i < last; i++)
+		{
+			parse_chunk(chunks[i], data, totalPositions, totalTexcoords, totalNormals);
+		}
+	});
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		if (!chunk.valid)
+		{
+			return false;
+		}
+	}
+
+	auto parsed = std::chrono::steady_clock::now();
+
+	// ==== DEDUP ====
+	// every corner is hashed once, then each worker owns the slice of the hash space that maps to its
+	// partition and scans all corners in order, so local ids follow first occurrence
+	std::vector<uint32_t> hashes(totalCorners);
+	parallel_ranges(totalCorners, threadCount, [&](uint64_t first, uint64_t last, uint32_t) {
+		for (uint64_t c = first; c < last; c++)
+		{
+			hashes[c] = hash_vertex(build_vertex(data, data.corners[c]));
+		}
+	});
+
+	uint32_t partitions = totalCorners < MIN_PARALLEL_CORNERS ? 1 : threadCount;
+	std::vector<DedupTable> tables(partitions);
+	std::vector<uint8_t> isFirst(totalCorners, 0);
+
+	// indices temporarily hold partition-local ids
+	indices.resize(totalCorners);
+
+	parallel_ranges(partitions, partitions, [&](uint64_t first, uint64_t last, uint32_t) {
+		for (uint64_t p = first; p < last; p++)
+		{
+			DedupTable& table = tables[p];
+			table.init(static_cast<size_t>(std::min<uint64_t>(totalPositions, totalCorners) / partitions + 1));
+			for (uint64_t c = 0; c < totalCorners; c++)
+			{
+				if (partition_of(hashes[c], partitions) != p)
+				{
+					continue;
+				}
+				bool inserted;
+				indices[c] = table.insert(data, hashes[c], c, inserted);
+				isFirst[c] = inserted;
+			}
+		}
+	});
+
+	// global ids are handed out in first occurrence order: count the first corners per range,
+	// prefix sum, then every range writes its vertices and the local -> global mapping
+	std::vector<std::vector<uint32_t>> globalIds(partitions);
+	size_t uniqueCount = 0;
+	for (uint32_t p = 0; p < partitions; p++)
+	{
+		globalIds[p].resize(tables[p].firstCorner.size());
+		uniqueCount += tables[p].firstCorner.size();
+	}
+	vertices.resize(uniqueCount);
+
+	std::vector<uint64_t> rangeFirsts(threadCount + 1, 0);
+	parallel_ranges(totalCorners, threadCount, [&](uint64_t first, uint64_t last, uint32_t worker) {
+		uint64_t count = 0;
+		for (uint64_t c = first; c < last; c++)
+		{
+			count += isFirst[c];
+		}
+		rangeFirsts[worker + 1] = count;
+	});
+	for (uint32_t w = 0; w < threadCount; w++)
+	{
+		rangeFirsts[w + 1] += rangeFirsts[w];
+	}
+
+	parallel_ranges(totalCorners, threadCount, [&](uint64_t first, uint64_t last, uint32_t worker) {
+		uint64_t next = rangeFirsts[worker];
+		for (uint64_t c = first; c < last; c++)
+		{
+			if (isFirst[c])
+			{
+				globalIds[partition_of(hashes[c], partitions)][indices[c]] = static_cast<uint32_t>(next);
+				vertices[next] = build_vertex(data, data.corners[c]);
+				next++;
+			}
+		}
+	});
+
+	parallel_ranges(totalCorners, threadCount, [&](uint64_t first, uint64_t last, uint32_t) {
+		for (uint64_t c = first; c < last; c++)
+		{
+			indices[c] = globalIds[partition_of(hashes[c], partitions)][indices[c]];
+		}
+	});
+
+	auto finished = std::chrono::steady_clock::now();
+
+	if (stats)
+	{
+		stats->fileBytes = file.size();
+		stats->threads = threadCount;
+		stats->corners = totalCorners;
+		stats->parseMs = std::chrono::duration<double, std::milli>(parsed - start).count();
+		stats->dedupMs = std::chrono::duration<double, std::milli>(finished - parsed).count();
+	}
+	return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vk_mesh.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace vkobj
+{
+	struct ObjLoadStats {
+		size_t fileBytes = 0;
+		uint32_t threads = 0;
+		uint64_t corners = 0;      // triangle corners after fan triangulation
+		double parseMs = 0.0;      // count + parse passes
+		double dedupMs = 0.0;      // hashing, dedup and index remap
+	};
+
+	/// @brief Multi-threaded obj loader. The mapped file is split into line aligned chunks that are
+	/// counted and parsed in parallel, then vertices are deduplicated through hash-partitioned
+	/// open-addressing tables. Output is identical to a sequential first-occurrence dedup.
+	/// Supports v/vt/vn/f (with negative indices and polygon fans), other statements are ignored.
+	/// @param threadCount 0 picks the hardware concurrency.
+	/// @return false if the file can't be read or references attributes that don't exist.
+	bool load_obj(const char* filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+		uint32_t threadCount = 0, ObjLoadStats* stats = nullptr);
+}
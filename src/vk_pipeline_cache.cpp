@@ -0,0 +1,162 @@
+#include <vk_pipeline_cache.h>
+#include <vk_hash.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+void PipelineCache::init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path, uint32_t workerCount)
+{
+	_device = device;
+	_path = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &_properties);
+
+	_seed.clear();
+	_loadedBytes = 0;
+	if (!_path.empty() && read_file(_seed))
+	{
+		_loadedBytes = _seed.size();
+	}
+	else
+	{
+		_seed.clear();
+	}
+
+	VkPipelineCacheCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	info.initialDataSize = _seed.size();
+	info.pInitialData = _seed.empty() ? nullptr : _seed.data();
+	VK_CHECK(vkCreatePipelineCache(_device, &info, nullptr, &_cache));
+
+	// all up front, worker_cache() is called from every slot's thread and must not create anything
+	_workerCaches.assign(workerCount, VK_NULL_HANDLE);
+	for (VkPipelineCache& worker : _workerCaches)
+	{
+		VK_CHECK(vkCreatePipelineCache(_device, &info, nullptr, &worker));
+	}
+}
+
+void PipelineCache::cleanup()
+{
+	if (_cache == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	if (!_workerCaches.empty())
+	{
+		VK_CHECK(vkMergePipelineCaches(_device, _cache, static_cast<uint32_t>(_workerCaches.size()), _workerCaches.data()));
+	}
+
+	if (!_path.empty())
+	{
+		size_t size = 0;
+		std::vector<uint8_t> data;
+		if (vkGetPipelineCacheData(_device, _cache, &size, nullptr) == VK_SUCCESS && size > 0)
+		{
+			data.resize(size);
+			if (vkGetPipelineCacheData(_device, _cache, &size, data.data()) == VK_SUCCESS)
+			{
+				data.resize(size);
+				if (!write_file(data))
+				{
+					std::cout << "failed to write pipeline cache " << _path << std::endl;
+				}
+			}
+		}
+	}
+
+	for (VkPipelineCache worker : _workerCaches)
+	{
+		vkDestroyPipelineCache(_device, worker, nullptr);
+	}
+	vkDestroyPipelineCache(_device, _cache, nullptr);
+	_workerCaches.clear();
+	_cache = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache::worker_cache(uint32_t worker)
+{
+	return worker < _workerCaches.size() ? _workerCaches[worker] : _cache;
+}
+
+bool PipelineCache::read_file(std::vector<uint8_t>& data) const
+{
+	std::ifstream file(_path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	PipelineCacheFileHeader header{};
+	if (fileSize < sizeof(header))
+	{
+		return false;
+	}
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION
+		|| header.dataSize != fileSize - sizeof(header) || header.dataSize < 16 + VK_UUID_SIZE)
+	{
+		return false;
+	}
+
+	data.resize(static_cast<size_t>(header.dataSize));
+	file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	if (!file.good() || vkutil::fnv1a(data.data(), data.size()) != header.dataHash)
+	{
+		return false;
+	}
+
+	// VkPipelineCacheHeaderVersionOne: header size, header version, vendor, device, cache uuid.
+	// A driver update changes the uuid, the old blob would only be rejected (or worse) by the driver
+	uint32_t fields[4];
+	memcpy(fields, data.data(), sizeof(fields));
+	bool matches = fields[0] >= 16 + VK_UUID_SIZE
+		&& fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& fields[2] == _properties.vendorID
+		&& fields[3] == _properties.deviceID
+		&& memcmp(data.data() + 16, _properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	if (!matches)
+	{
+		std::cout << "pipeline cache " << _path << " is from another device or driver, starting cold" << std::endl;
+	}
+	return matches;
+}
+
+bool PipelineCache::write_file(const std::vector<uint8_t>& data) const
+{
+	PipelineCacheFileHeader header{};
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.version = PIPELINE_CACHE_VERSION;
+	header.dataSize = data.size();
+	header.dataHash = vkutil::fnv1a(data.data(), data.size());
+
+	std::string tempPath = _path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		if (!file.good())
+		{
+			file.close();
+			std::filesystem::remove(tempPath);
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, _path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
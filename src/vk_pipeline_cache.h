@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Pipeline cache file: our own header guarding the driver's blob against truncation, then the blob as
+// returned by vkGetPipelineCacheData. The blob starts with VkPipelineCacheHeaderVersionOne, which is checked
+// against the device before the driver ever sees the data; a cache from another gpu or driver is dropped.
+//
+// layout: [PipelineCacheFileHeader][driver blob]
+
+const uint32_t PIPELINE_CACHE_MAGIC = 0x43504b56; // "VKPC"
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+
+struct PipelineCacheFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t dataSize;
+	uint64_t dataHash; // fnv1a of the blob
+};
+
+// VkPipelineCache seeded from and written back to disk. Pipelines built on the main thread go through cache(),
+// every job system slot builds through a cache of its own (seeded with the same data) so concurrent compiles
+// don't contend on one cache; those are merged into the main one before it's written
+class PipelineCache {
+public:
+	/// @param path cache file, empty keeps the cache in memory only
+	/// @param workerCount job system slots (JobSystem::slot_count()), their caches are all created here
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path, uint32_t workerCount);
+
+	/// @brief Merge the worker caches and write everything to disk, to a temporary file first and renamed
+	/// so a crash never leaves a partial cache behind. Destroys all caches.
+	void cleanup();
+
+	VkPipelineCache cache() const { return _cache; }
+
+	/// @brief The cache of a job system slot. Slot 0 is shared by the job system's owner and threads outside of it,
+	/// which is fine since the driver synchronizes a cache internally, the slots only spread the contention.
+	VkPipelineCache worker_cache(uint32_t worker);
+
+	/// @brief Whether init() found a cache file matching this device.
+	bool warm() const { return _loadedBytes > 0; }
+	size_t loaded_bytes() const { return _loadedBytes; }
+
+private:
+	bool read_file(std::vector<uint8_t>& data) const;
+	bool write_file(const std::vector<uint8_t>& data) const;
+
+	VkDevice _device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties _properties{};
+	std::string _path;
+	VkPipelineCache _cache = VK_NULL_HANDLE;
+	std::vector<VkPipelineCache> _workerCaches;
+	std::vector<uint8_t> _seed; // the validated file blob, workers start from it too
+	size_t _loadedBytes = 0;
+};
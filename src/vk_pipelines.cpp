@@ -0,0 +1,427 @@
+#include <vk_pipelines.h>
+#include <vk_pipeline_cache.h>
+#include <vk_hash.h>
+#include <vk_profiler.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+	// appends plain values to a pipeline key. Only used with 32 and 64 bit fields, so no padding ends up in it
+	struct KeyWriter {
+		std::vector<uint8_t>& out;
+
+		void bytes(const void* data, size_t size)
+		{
+			const uint8_t* first = static_cast<const uint8_t*>(data);
+			out.insert(out.end(), first, first + size);
+		}
+
+		template <typename T>
+		void add(const T& value)
+		{
+			static_assert(sizeof(T) == 4 || sizeof(T) == 8, "key fields are 32 or 64 bit");
+			bytes(&value, sizeof(T));
+		}
+
+		// non-dispatchable handles are pointers or uint64_t depending on the platform
+		template <typename T>
+		void handle(T value)
+		{
+			uint64_t bits = 0;
+			memcpy(&bits, &value, sizeof(value));
+			add(bits);
+		}
+
+		void string(const char* value)
+		{
+			uint32_t length = value ? static_cast<uint32_t>(strlen(value)) : 0;
+			add(length);
+			bytes(value, length);
+		}
+	};
+}
+
+VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass, VkPipelineCache cache)
+{
+	// one viewport and scissor, both set while recording so the pipeline doesn't depend on the
+	// swapchain extent and survives resizes
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.pNext = nullptr;
+
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = nullptr;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = nullptr;
+
+	const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.pNext = nullptr;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	// setup dummy color blending. We aren't using transparent objects yet
+	// the blending is just "no blend", but we do write to the color attachment
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.pNext = nullptr;
+
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &_colorBlendAttachment;
+
+	// build graphics pipeline from stored states
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = nullptr;
+
+	// our "programmable" stages. (vertex and fragment shaders)
+	pipelineInfo.stageCount = _shaderStages.size();
+	pipelineInfo.pStages = _shaderStages.data();
+	pipelineInfo.pVertexInputState = &_vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &_inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pDepthStencilState = &_depthStencil;
+	pipelineInfo.pRasterizationState = &_rasterizer;
+	pipelineInfo.pMultisampleState = &_multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = _pipelineLayout; // (?)
+	pipelineInfo.renderPass = pass;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+	// it's easy to error out on create graphics pipeline, so we handle it a bit better than the common VK_CHECK case
+	VkPipeline newPipeline;
+	if (vkCreateGraphicsPipelines(
+			device, cache, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS)
+	{
+		std::cout << "failed to create pipeline\n";
+		return VK_NULL_HANDLE; // failed to create graphics pipeline
+	}
+	else
+	{
+		return newPipeline;
+	}
+}
+
+void PipelineLibrary::init(VkDevice device, PipelineCache* cache, JobSystem* jobs)
+{
+	_device = device;
+	_cache = cache;
+	_jobs = jobs;
+}
+
+void PipelineLibrary::cleanup()
+{
+	for (auto& entry : _entries)
+	{
+		_jobs->wait_background(entry->counter);
+		if (entry->pipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(_device, entry->pipeline, nullptr);
+		}
+	}
+	for (auto& shader : _shaders)
+	{
+		vkDestroyShaderModule(_device, shader.second.module, nullptr);
+	}
+
+	_entries.clear();
+	_lookup.clear();
+	_shaders.clear();
+	_shaderHashes.clear();
+	_finished = 0;
+	_requested = 0;
+}
+
+VkShaderModule PipelineLibrary::load_shader(const std::string& path)
+{
+	auto it = _shaders.find(path);
+	if (it != _shaders.end())
+	{
+		return it->second.module;
+	}
+
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "failed to open shader " << path << std::endl;
+		return VK_NULL_HANDLE;
+	}
+
+	// spirv is a stream of 32 bit words
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	std::vector<uint32_t> code(fileSize / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(code.data()), static_cast<std::streamsize>(code.size() * sizeof(uint32_t)));
+	if (!file.good() || code.empty())
+	{
+		std::cout << "failed to read shader " << path << std::endl;
+		return VK_NULL_HANDLE;
+	}
+
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size() * sizeof(uint32_t);
+	createInfo.pCode = code.data();
+
+	VkShaderModule module;
+	if (vkCreateShaderModule(_device, &createInfo, nullptr, &module) != VK_SUCCESS)
+	{
+		std::cout << "failed to create shader module " << path << std::endl;
+		return VK_NULL_HANDLE;
+	}
+
+	// pipelines are keyed by what the module contains, the same shader under another path still dedups
+	uint64_t hash = vkutil::fnv1a(code.data(), createInfo.codeSize);
+	_shaders[path] = Shader{ module, hash };
+	_shaderHashes[module] = hash;
+	return module;
+}
+
+PipelineHandle PipelineLibrary::request(const PipelineBuilder& builder, VkRenderPass pass)
+{
+	if (_requested++ == 0)
+	{
+		_firstRequest = std::chrono::steady_clock::now();
+	}
+
+	std::vector<uint8_t> key;
+	write_key(builder, pass, key);
+	uint64_t hash = vkutil::fnv1a(key.data(), key.size());
+
+	auto range = _lookup.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (_entries[it->second]->key == key)
+		{
+			return it->second;
+		}
+	}
+
+	PipelineHandle handle = static_cast<PipelineHandle>(_entries.size());
+	_entries.push_back(std::make_unique<Entry>());
+	Entry* entry = _entries.back().get();
+	entry->key = std::move(key);
+	entry->pass = pass;
+	freeze(*entry, builder);
+	_lookup.emplace(hash, handle);
+
+	// a background job, so a frame waiting on its own jobs never ends up compiling
+	_jobs->run_background([this, entry]() { compile(entry); }, &entry->counter);
+	return handle;
+}
+
+VkPipeline PipelineLibrary::get(PipelineHandle handle) const
+{
+	if (handle >= _entries.size())
+	{
+		return VK_NULL_HANDLE;
+	}
+	const Entry& entry = *_entries[handle];
+	return entry.state.load(std::memory_order_acquire) == READY ? entry.pipeline : VK_NULL_HANDLE;
+}
+
+VkPipeline PipelineLibrary::wait(PipelineHandle handle)
+{
+	if (handle >= _entries.size())
+	{
+		return VK_NULL_HANDLE;
+	}
+	_jobs->wait_background(_entries[handle]->counter);
+	return get(handle);
+}
+
+PipelineLibraryStats PipelineLibrary::stats() const
+{
+	PipelineLibraryStats stats;
+	stats.requested = _requested;
+	stats.deduplicated = _requested - static_cast<uint32_t>(_entries.size());
+
+	std::chrono::steady_clock::time_point lastFinished = _firstRequest;
+	for (const auto& entry : _entries)
+	{
+		uint32_t state = entry->state.load(std::memory_order_acquire);
+		if (state == PENDING)
+		{
+			stats.pending++;
+			continue;
+		}
+		(state == READY ? stats.compiled : stats.failed)++;
+		stats.compileMs += entry->compileMs;
+		stats.maxCompileMs = std::max(stats.maxCompileMs, entry->compileMs);
+		lastFinished = std::max(lastFinished, entry->finishedAt);
+	}
+	stats.wallMs = std::chrono::duration<double, std::milli>(lastFinished - _firstRequest).count();
+	return stats;
+}
+
+void PipelineLibrary::write_key(const PipelineBuilder& builder, VkRenderPass pass, std::vector<uint8_t>& key) const
+{
+	KeyWriter w{ key };
+
+	w.add(static_cast<uint32_t>(builder._shaderStages.size()));
+	for (const VkPipelineShaderStageCreateInfo& stage : builder._shaderStages)
+	{
+		w.add(stage.stage);
+		auto shader = _shaderHashes.find(stage.module);
+		if (shader != _shaderHashes.end())
+		{
+			w.add(shader->second);
+		}
+		else
+		{
+			// not loaded through us, all we know is the handle
+			w.handle(stage.module);
+		}
+		w.string(stage.pName);
+
+		const VkSpecializationInfo* spec = stage.pSpecializationInfo;
+		w.add(spec ? spec->mapEntryCount : 0u);
+		if (spec)
+		{
+			for (uint32_t i = 0; i < spec->mapEntryCount; i++)
+			{
+				w.add(spec->pMapEntries[i].constantID);
+				w.add(spec->pMapEntries[i].offset);
+				w.add(static_cast<uint64_t>(spec->pMapEntries[i].size));
+			}
+			w.add(static_cast<uint64_t>(spec->dataSize));
+			w.bytes(spec->pData, spec->dataSize);
+		}
+	}
+
+	const VkPipelineVertexInputStateCreateInfo& vertexInput = builder._vertexInputInfo;
+	w.add(vertexInput.vertexBindingDescriptionCount);
+	for (uint32_t i = 0; i < vertexInput.vertexBindingDescriptionCount; i++)
+	{
+		const VkVertexInputBindingDescription& binding = vertexInput.pVertexBindingDescriptions[i];
+		w.add(binding.binding);
+		w.add(binding.stride);
+		w.add(binding.inputRate);
+	}
+	w.add(vertexInput.vertexAttributeDescriptionCount);
+	for (uint32_t i = 0; i < vertexInput.vertexAttributeDescriptionCount; i++)
+	{
+		const VkVertexInputAttributeDescription& attribute = vertexInput.pVertexAttributeDescriptions[i];
+		w.add(attribute.location);
+		w.add(attribute.binding);
+		w.add(attribute.format);
+		w.add(attribute.offset);
+	}
+
+	w.add(builder._inputAssembly.topology);
+	w.add(builder._inputAssembly.primitiveRestartEnable);
+
+	const VkPipelineRasterizationStateCreateInfo& raster = builder._rasterizer;
+	w.add(raster.depthClampEnable);
+	w.add(raster.rasterizerDiscardEnable);
+	w.add(raster.polygonMode);
+	w.add(raster.cullMode);
+	w.add(raster.frontFace);
+	w.add(raster.depthBiasEnable);
+	w.add(raster.depthBiasConstantFactor);
+	w.add(raster.depthBiasClamp);
+	w.add(raster.depthBiasSlopeFactor);
+	w.add(raster.lineWidth);
+
+	const VkPipelineColorBlendAttachmentState& blend = builder._colorBlendAttachment;
+	w.add(blend.blendEnable);
+	w.add(blend.srcColorBlendFactor);
+	w.add(blend.dstColorBlendFactor);
+	w.add(blend.colorBlendOp);
+	w.add(blend.srcAlphaBlendFactor);
+	w.add(blend.dstAlphaBlendFactor);
+	w.add(blend.alphaBlendOp);
+	w.add(blend.colorWriteMask);
+
+	const VkPipelineMultisampleStateCreateInfo& multisample = builder._multisampling;
+	w.add(multisample.rasterizationSamples);
+	w.add(multisample.sampleShadingEnable);
+	w.add(multisample.minSampleShading);
+	w.add(multisample.alphaToCoverageEnable);
+	w.add(multisample.alphaToOneEnable);
+
+	const VkPipelineDepthStencilStateCreateInfo& depth = builder._depthStencil;
+	w.add(depth.depthTestEnable);
+	w.add(depth.depthWriteEnable);
+	w.add(depth.depthCompareOp);
+	w.add(depth.depthBoundsTestEnable);
+	w.add(depth.stencilTestEnable);
+	for (const VkStencilOpState* stencil : { &depth.front, &depth.back })
+	{
+		w.add(stencil->failOp);
+		w.add(stencil->passOp);
+		w.add(stencil->depthFailOp);
+		w.add(stencil->compareOp);
+		w.add(stencil->compareMask);
+		w.add(stencil->writeMask);
+		w.add(stencil->reference);
+	}
+	w.add(depth.minDepthBounds);
+	w.add(depth.maxDepthBounds);
+
+	w.handle(builder._pipelineLayout);
+	w.handle(pass);
+}
+
+void PipelineLibrary::freeze(Entry& entry, const PipelineBuilder& builder)
+{
+	entry.builder = builder;
+
+	VkPipelineVertexInputStateCreateInfo& vertexInput = entry.builder._vertexInputInfo;
+	entry.bindings.assign(vertexInput.pVertexBindingDescriptions, vertexInput.pVertexBindingDescriptions + vertexInput.vertexBindingDescriptionCount);
+	entry.attributes.assign(vertexInput.pVertexAttributeDescriptions, vertexInput.pVertexAttributeDescriptions + vertexInput.vertexAttributeDescriptionCount);
+	vertexInput.pVertexBindingDescriptions = entry.bindings.data();
+	vertexInput.pVertexAttributeDescriptions = entry.attributes.data();
+
+	// sized up front, the stages point into these
+	size_t stageCount = entry.builder._shaderStages.size();
+	entry.entryPoints.resize(stageCount);
+	entry.specializations.resize(stageCount);
+	entry.specializationEntries.resize(stageCount);
+	entry.specializationData.resize(stageCount);
+	for (size_t i = 0; i < stageCount; i++)
+	{
+		VkPipelineShaderStageCreateInfo& stage = entry.builder._shaderStages[i];
+		entry.entryPoints[i] = stage.pName ? stage.pName : "main";
+		stage.pName = entry.entryPoints[i].c_str();
+
+		if (stage.pSpecializationInfo)
+		{
+			const VkSpecializationInfo& spec = *stage.pSpecializationInfo;
+			const uint8_t* data = static_cast<const uint8_t*>(spec.pData);
+			entry.specializationEntries[i].assign(spec.pMapEntries, spec.pMapEntries + spec.mapEntryCount);
+			entry.specializationData[i].assign(data, data + spec.dataSize);
+
+			VkSpecializationInfo& copy = entry.specializations[i];
+			copy = spec;
+			copy.pMapEntries = entry.specializationEntries[i].data();
+			copy.pData = entry.specializationData[i].data();
+			stage.pSpecializationInfo = &copy;
+		}
+	}
+}
+
+void PipelineLibrary::compile(Entry* entry)
+{
+	VKPROF_ZONE("compile pipeline");
+	auto start = std::chrono::steady_clock::now();
+
+	// every worker compiles through its own cache, they're merged when the cache is written
+	VkPipelineCache cache = _cache ? _cache->worker_cache(_jobs->worker_index()) : VK_NULL_HANDLE;
+	entry->pipeline = entry->builder.build_pipeline(_device, entry->pass, cache);
+
+	entry->finishedAt = std::chrono::steady_clock::now();
+	entry->compileMs = std::chrono::duration<double, std::milli>(entry->finishedAt - start).count();
+	entry->state.store(entry->pipeline != VK_NULL_HANDLE ? READY : FAILED, std::memory_order_release);
+	_finished.fetch_add(1, std::memory_order_release);
+}
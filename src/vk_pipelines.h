@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_jobs.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PipelineCache;
+
+struct PipelineBuilder {
+	std::vector<VkPipelineShaderStageCreateInfo> _shaderStages;
+	VkPipelineVertexInputStateCreateInfo _vertexInputInfo;
+	VkPipelineInputAssemblyStateCreateInfo _inputAssembly;
+	VkPipelineRasterizationStateCreateInfo _rasterizer;
+	VkPipelineColorBlendAttachmentState _colorBlendAttachment;
+	VkPipelineMultisampleStateCreateInfo _multisampling;
+	VkPipelineLayout _pipelineLayout;
+	VkPipelineDepthStencilStateCreateInfo _depthStencil;
+
+	VkPipeline build_pipeline(VkDevice device, VkRenderPass pass, VkPipelineCache cache = VK_NULL_HANDLE);
+};
+
+// index of a pipeline in the PipelineLibrary, valid until its cleanup()
+using PipelineHandle = uint32_t;
+const PipelineHandle INVALID_PIPELINE = UINT32_MAX;
+
+struct PipelineLibraryStats {
+	uint32_t requested = 0;    // request() calls
+	uint32_t deduplicated = 0; // requests answered with the pipeline of an identical earlier one
+	uint32_t compiled = 0;
+	uint32_t failed = 0;
+	uint32_t pending = 0;
+	double compileMs = 0.0;    // summed over every compile, so it exceeds wallMs when workers overlap
+	double maxCompileMs = 0.0;
+	double wallMs = 0.0;       // first request until the last finished compile
+};
+
+// Graphics pipelines compiled as background jobs of the job system. A request is keyed by the whole builder
+// state plus the SPIR-V of its shaders (not the module handles), so identical requests share one pipeline and
+// only new states cost a compile. request() returns right away and get() stays null until the compile is done,
+// callers draw with a fallback pipeline meanwhile. Only the thread owning the job system calls in here
+class PipelineLibrary {
+public:
+	void init(VkDevice device, PipelineCache* cache, JobSystem* jobs);
+
+	/// @brief Wait for the compiles in flight, then destroy every pipeline and shader module.
+	void cleanup();
+
+	/// @brief Load a SPIR-V file once, later calls with the same path return the same module.
+	/// @return VK_NULL_HANDLE if the file can't be read or the module can't be created
+	VkShaderModule load_shader(const std::string& path);
+
+	/// @brief Find the pipeline of an identical earlier request or queue a compile for it.
+	/// The builder and everything it points to is copied, it can go away right after.
+	/// pNext chains and sample masks aren't part of the key, the builder sets neither
+	PipelineHandle request(const PipelineBuilder& builder, VkRenderPass pass);
+
+	/// @brief The compiled pipeline, VK_NULL_HANDLE while it's still compiling or if it failed.
+	VkPipeline get(PipelineHandle handle) const;
+
+	/// @brief Run compile jobs until handle is done, for pipelines nothing can be drawn without.
+	VkPipeline wait(PipelineHandle handle);
+
+	/// @brief Compiles finished so far, failed ones included. Cheap enough to poll every frame.
+	uint32_t finished_count() const { return _finished.load(std::memory_order_acquire); }
+	uint32_t pipeline_count() const { return static_cast<uint32_t>(_entries.size()); }
+
+	PipelineLibraryStats stats() const;
+
+private:
+	enum : uint32_t { PENDING, READY, FAILED };
+
+	// a frozen copy of the request, the builder's pointers are patched to the vectors next to it
+	struct Entry {
+		PipelineBuilder builder;
+		VkRenderPass pass;
+		std::vector<VkVertexInputBindingDescription> bindings;
+		std::vector<VkVertexInputAttributeDescription> attributes;
+		std::vector<std::string> entryPoints;
+		std::vector<VkSpecializationInfo> specializations;
+		std::vector<std::vector<VkSpecializationMapEntry>> specializationEntries;
+		std::vector<std::vector<uint8_t>> specializationData;
+
+		std::vector<uint8_t> key;
+
+		// written by the compile job before state is released
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		double compileMs = 0.0;
+		std::chrono::steady_clock::time_point finishedAt;
+		std::atomic<uint32_t> state{ PENDING };
+		JobCounter counter;
+	};
+
+	struct Shader {
+		VkShaderModule module;
+		uint64_t hash; // fnv1a of the SPIR-V
+	};
+
+	void write_key(const PipelineBuilder& builder, VkRenderPass pass, std::vector<uint8_t>& key) const;
+	static void freeze(Entry& entry, const PipelineBuilder& builder);
+	void compile(Entry* entry);
+
+	VkDevice _device = VK_NULL_HANDLE;
+	PipelineCache* _cache = nullptr;
+	JobSystem* _jobs = nullptr;
+
+	std::vector<std::unique_ptr<Entry>> _entries;
+	std::unordered_multimap<uint64_t, PipelineHandle> _lookup; // key hash -> entries, the key bytes settle collisions
+	std::unordered_map<std::string, Shader> _shaders;
+	std::unordered_map<VkShaderModule, uint64_t> _shaderHashes;
+
+	std::atomic<uint32_t> _finished{ 0 };
+	uint32_t _requested = 0;
+	std::chrono::steady_clock::time_point _firstRequest;
+};
@@ -0,0 +1,227 @@
+#include <vk_profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vkprof
+{
+	std::atomic<bool> g_enabled{ true };
+}
+
+namespace {
+
+	// slots are atomics so the exporter may read them while the owner writes, relaxed stores compile to
+	// plain moves. head counts every zone ever written, slot i & (RING_EVENTS - 1) holds zone i
+	struct Slot {
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<uint64_t> start{ 0 };
+		std::atomic<uint64_t> end{ 0 };
+	};
+
+	struct Ring {
+		std::string name;
+		uint32_t id;
+		std::atomic<uint64_t> head{ 0 };
+		Slot slots[vkprof::RING_EVENTS];
+
+		void push(const char* zone, uint64_t startNs, uint64_t endNs)
+		{
+			uint64_t index = head.load(std::memory_order_relaxed);
+			Slot& slot = slots[index & (vkprof::RING_EVENTS - 1)];
+			slot.name.store(zone, std::memory_order_relaxed);
+			slot.start.store(startNs, std::memory_order_relaxed);
+			slot.end.store(endNs, std::memory_order_relaxed);
+			head.store(index + 1, std::memory_order_release);
+		}
+	};
+
+	static_assert((vkprof::RING_EVENTS & (vkprof::RING_EVENTS - 1)) == 0, "ring size must be a power of two");
+
+	// rings are never freed, a thread's zones outlive the thread
+	struct Registry {
+		std::mutex mutex;
+		std::vector<std::unique_ptr<Ring>> rings;
+
+		Ring* add(std::string name)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			rings.push_back(std::make_unique<Ring>());
+			Ring* ring = rings.back().get();
+			ring->id = static_cast<uint32_t>(rings.size() - 1);
+			ring->name = name.empty() ? "thread " + std::to_string(ring->id) : std::move(name);
+			return ring;
+		}
+	};
+
+	Registry& registry()
+	{
+		static Registry instance;
+		return instance;
+	}
+
+	thread_local Ring* t_ring = nullptr;
+
+	Ring* thread_ring()
+	{
+		if (!t_ring)
+		{
+			t_ring = registry().add("");
+		}
+		return t_ring;
+	}
+
+	struct ExportedZone {
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// copies the ring and drops whatever the owner overwrote while we were copying
+	void snapshot(const Ring& ring, std::vector<ExportedZone>& zones)
+	{
+		zones.clear();
+		uint64_t head = ring.head.load(std::memory_order_acquire);
+		uint64_t first = head > vkprof::RING_EVENTS ? head - vkprof::RING_EVENTS : 0;
+		for (uint64_t i = first; i < head; i++)
+		{
+			const Slot& slot = ring.slots[i & (vkprof::RING_EVENTS - 1)];
+			zones.push_back({ slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed) });
+		}
+
+		// the owner may be writing zone headAfter right now, which lands on the slot of headAfter - RING_EVENTS
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t headAfter = ring.head.load(std::memory_order_relaxed);
+		uint64_t valid = headAfter + 1 > vkprof::RING_EVENTS ? headAfter + 1 - vkprof::RING_EVENTS : 0;
+		if (valid > first)
+		{
+			zones.erase(zones.begin(), zones.begin() + static_cast<ptrdiff_t>(std::min(valid - first, uint64_t(zones.size()))));
+		}
+	}
+
+	void write_json_string(std::ofstream& out, const char* text)
+	{
+		out << '"';
+		for (const char* c = text ? text : ""; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				out << '\\';
+			}
+			if (static_cast<unsigned char>(*c) >= 0x20)
+			{
+				out << *c;
+			}
+		}
+		out << '"';
+	}
+}
+
+void vkprof::set_enabled(bool enabled)
+{
+	g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t vkprof::now_ns()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void vkprof::set_thread_name(const char* name)
+{
+	Ring* ring = thread_ring();
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	ring->name = name;
+}
+
+void vkprof::record(const char* name, uint64_t startNs, uint64_t endNs)
+{
+	thread_ring()->push(name, startNs, endNs);
+}
+
+uint32_t vkprof::create_track(const char* name)
+{
+	return registry().add(name)->id;
+}
+
+void vkprof::record_track(uint32_t track, const char* name, uint64_t startNs, uint64_t endNs)
+{
+	Ring* ring;
+	{
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		if (track >= registry().rings.size())
+		{
+			return;
+		}
+		ring = registry().rings[track].get();
+	}
+	ring->push(name, startNs, endNs);
+}
+
+bool vkprof::write_chrome_trace(const std::string& path)
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out.is_open())
+	{
+		return false;
+	}
+
+	std::vector<Ring*> rings;
+	{
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		for (auto& ring : registry().rings)
+		{
+			rings.push_back(ring.get());
+		}
+	}
+
+	// chrome wants microseconds, relative to the oldest zone keeps the numbers short
+	std::vector<std::vector<ExportedZone>> zones(rings.size());
+	uint64_t origin = UINT64_MAX;
+	for (size_t i = 0; i < rings.size(); i++)
+	{
+		snapshot(*rings[i], zones[i]);
+		for (const ExportedZone& zone : zones[i])
+		{
+			origin = std::min(origin, zone.start);
+		}
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (size_t i = 0; i < rings.size(); i++)
+	{
+		{
+			std::lock_guard<std::mutex> lock(registry().mutex);
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << rings[i]->id << ",\"args\":{\"name\":";
+			write_json_string(out, rings[i]->name.c_str());
+			out << "}}";
+			first = false;
+		}
+
+		for (const ExportedZone& zone : zones[i])
+		{
+			out << ",\n{\"name\":";
+			write_json_string(out, zone.name);
+			out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << rings[i]->id
+				<< ",\"ts\":" << (zone.start - origin) / 1000 << "." << (zone.start - origin) % 1000 / 100
+				<< ",\"dur\":" << (zone.end - zone.start) / 1000 << "." << (zone.end - zone.start) % 1000 / 100 << "}";
+		}
+	}
+	out << "\n]}\n";
+	return out.good();
+}
+
+size_t vkprof::recorded_zones()
+{
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	size_t total = 0;
+	for (auto& ring : registry().rings)
+	{
+		total += static_cast<size_t>(std::min<uint64_t>(ring->head.load(std::memory_order_acquire), RING_EVENTS));
+	}
+	return total;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped cpu timers cheap enough to stay on in release builds. Every thread writes its finished zones
+// into a ring of its own: no locks, no allocation after the thread's first zone, the newest RING_EVENTS
+// per thread are kept. Zone names are stored as pointers, so they have to be string literals.
+// Tracks are rings that belong to something other than a thread, the gpu queue for example.
+// write_chrome_trace() exports whatever the rings hold as Chrome trace_event JSON (chrome://tracing, Perfetto)
+namespace vkprof
+{
+	const uint32_t RING_EVENTS = 16384; // per thread or track, power of two
+
+	extern std::atomic<bool> g_enabled;
+
+	inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+	void set_enabled(bool enabled);
+
+	/// @brief Nanoseconds on the steady clock, the time base of every zone.
+	uint64_t now_ns();
+
+	/// @brief Name the calling thread in the exported trace.
+	void set_thread_name(const char* name);
+
+	/// @brief Record a finished zone on the calling thread.
+	void record(const char* name, uint64_t startNs, uint64_t endNs);
+
+	/// @brief Create a named track. Like a thread's ring it has a single writer, keep each track to one thread.
+	uint32_t create_track(const char* name);
+	void record_track(uint32_t track, const char* name, uint64_t startNs, uint64_t endNs);
+
+	/// @brief Write every zone still held by the rings as Chrome trace_event JSON. Safe while other threads
+	/// record, zones overwritten during the export are left out.
+	bool write_chrome_trace(const std::string& path);
+
+	/// @brief Zones held by all rings right now.
+	size_t recorded_zones();
+
+	class Zone {
+	public:
+		explicit Zone(const char* name)
+			: _name(name), _active(enabled())
+		{
+			if (_active)
+			{
+				_start = now_ns();
+			}
+		}
+
+		~Zone()
+		{
+			if (_active)
+			{
+				record(_name, _start, now_ns());
+			}
+		}
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* _name;
+		uint64_t _start = 0;
+		bool _active;
+	};
+}
+
+#define VKPROF_CONCAT_INNER(a, b) a##b
+#define VKPROF_CONCAT(a, b) VKPROF_CONCAT_INNER(a, b)
+
+// times the rest of the enclosing scope
+#define VKPROF_ZONE(name) vkprof::Zone VKPROF_CONCAT(vkprofZone, __LINE__)(name)
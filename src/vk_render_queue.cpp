@@ -0,0 +1,69 @@
+#include <vk_render_queue.h>
+
+#include <cstring>
+#include <utility>
+
+void radix_sort(uint64_t* keys, uint32_t* values, uint64_t* keyScratch, uint32_t* valueScratch, size_t count)
+{
+	const int PASSES = 8;
+
+	// all 8 histograms in a single read of the keys
+	size_t histograms[PASSES][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t key = keys[i];
+		for (int pass = 0; pass < PASSES; pass++)
+		{
+			histograms[pass][(key >> (pass * 8)) & 0xff]++;
+		}
+	}
+
+	uint64_t* srcKeys = keys;
+	uint32_t* srcValues = values;
+	uint64_t* dstKeys = keyScratch;
+	uint32_t* dstValues = valueScratch;
+
+	for (int pass = 0; pass < PASSES; pass++)
+	{
+		size_t* histogram = histograms[pass];
+
+		// one bucket holding everything means this digit doesn't reorder anything
+		if (count == 0 || histogram[(srcKeys[0] >> (pass * 8)) & 0xff] == count)
+		{
+			continue;
+		}
+
+		size_t offset = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			size_t bucket = histogram[digit];
+			histogram[digit] = offset;
+			offset += bucket;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t position = histogram[(srcKeys[i] >> (pass * 8)) & 0xff]++;
+			dstKeys[position] = srcKeys[i];
+			dstValues[position] = srcValues[i];
+		}
+
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
+	}
+
+	// an odd number of passes leaves the result in the scratch buffers
+	if (srcKeys != keys)
+	{
+		memcpy(keys, srcKeys, count * sizeof(uint64_t));
+		memcpy(values, srcValues, count * sizeof(uint32_t));
+	}
+}
+
+void RenderQueue::sort()
+{
+	_keyScratch.resize(keys.size());
+	_objectScratch.resize(objects.size());
+	radix_sort(keys.data(), objects.data(), _keyScratch.data(), _objectScratch.data(), keys.size());
+}
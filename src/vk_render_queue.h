@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 64 bit draw sort key, most significant bits first:
+//   pipeline       12 bits  most expensive state change, never split
+//   descriptor set 12 bits
+//   mesh           16 bits  vertex/index buffer binds, equal meshes end up next to each other for instancing
+//   depth          24 bits  view distance quantized over [0, far], front to back for early-z on opaque draws
+namespace sortkey
+{
+	const uint32_t PIPELINE_BITS = 12;
+	const uint32_t DESCRIPTOR_BITS = 12;
+	const uint32_t MESH_BITS = 16;
+	const uint32_t DEPTH_BITS = 24;
+
+	inline uint64_t make(uint32_t pipeline, uint32_t descriptorSet, uint32_t mesh, uint32_t depth)
+	{
+		return (uint64_t(pipeline & ((1u << PIPELINE_BITS) - 1)) << (DESCRIPTOR_BITS + MESH_BITS + DEPTH_BITS))
+			| (uint64_t(descriptorSet & ((1u << DESCRIPTOR_BITS) - 1)) << (MESH_BITS + DEPTH_BITS))
+			| (uint64_t(mesh & ((1u << MESH_BITS) - 1)) << DEPTH_BITS)
+			| uint64_t(depth & ((1u << DEPTH_BITS) - 1));
+	}
+
+	// distance in [0, far] to DEPTH_BITS, anything behind the camera or past far is clamped
+	inline uint32_t quantize_depth(float distance, float far)
+	{
+		float t = distance / far;
+		t = t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+		return static_cast<uint32_t>(t * float((1u << DEPTH_BITS) - 1) + 0.5f);
+	}
+}
+
+/// @brief Stable LSD radix sort of keys with a 32 bit payload, one 8 bit digit per pass.
+/// Passes where every key has the same digit are skipped, so unused high bits cost one histogram read.
+/// @param keyScratch, valueScratch room for count entries
+void radix_sort(uint64_t* keys, uint32_t* values, uint64_t* keyScratch, uint32_t* valueScratch, size_t count);
+
+// draws of one frame, pushed in any order and read back sorted by key
+struct RenderQueue {
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> objects;
+
+	void clear() { keys.clear(); objects.clear(); }
+
+	void push(uint64_t key, uint32_t object) { keys.push_back(key); objects.push_back(object); }
+
+	size_t size() const { return keys.size(); }
+
+	void sort();
+
+private:
+	std::vector<uint64_t> _keyScratch;
+	std::vector<uint32_t> _objectScratch;
+};
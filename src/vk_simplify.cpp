@@ -0,0 +1,646 @@
+#include <vk_simplify.h>
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+	// normal xyz and texCoord uv, weighted and carried through the attribute quadrics
+	const uint32_t ATTRIBUTES = 5;
+
+	// weight of the plane through an open edge against the triangle planes, keeps borders from shrinking
+	const float BORDER_WEIGHT = 2.f;
+
+	// a collapse may turn a remaining triangle's normal by at most ~75 degrees
+	const float FLIP_COSINE = 0.25f;
+
+	const uint32_t NO_VERTEX = ~0u;
+
+	enum VertexKind : uint8_t {
+		KIND_MANIFOLD, // one wedge, no open edges
+		KIND_BORDER,   // one wedge on an open border, moves along it
+		KIND_SEAM,     // two wedges split by normals/uvs, both move along the seam together
+		KIND_LOCKED,   // anything else, never moves
+		KIND_COUNT,
+	};
+
+	// a vertex of the row's kind may collapse onto one of the column's kind
+	const bool CAN_COLLAPSE[KIND_COUNT][KIND_COUNT] = {
+		{ true, true, true, true },
+		{ false, true, false, false },
+		{ false, false, true, false },
+		{ false, false, false, false },
+	};
+
+	// p^T A p + 2 b.p + c with symmetric A, a weighted sum of squared plane distances. The weight sum is kept
+	// apart so errors come out as a weighted mean
+	struct Quadric {
+		float a00 = 0.f, a11 = 0.f, a22 = 0.f, a10 = 0.f, a20 = 0.f, a21 = 0.f;
+		float b0 = 0.f, b1 = 0.f, b2 = 0.f;
+		float c = 0.f;
+		float w = 0.f;
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a11 += q.a11; a22 += q.a22;
+			a10 += q.a10; a20 += q.a20; a21 += q.a21;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			w += q.w;
+		}
+
+		// (n.p + d)^2 * weight, n doesn't need to be unit length. Leaves w to the caller
+		void add_plane(const glm::vec3& n, float d, float weight)
+		{
+			a00 += weight * n.x * n.x;
+			a11 += weight * n.y * n.y;
+			a22 += weight * n.z * n.z;
+			a10 += weight * n.y * n.x;
+			a20 += weight * n.z * n.x;
+			a21 += weight * n.z * n.y;
+			b0 += weight * n.x * d;
+			b1 += weight * n.y * d;
+			b2 += weight * n.z * d;
+			c += weight * d * d;
+		}
+
+		float evaluate(const glm::vec3& p) const
+		{
+			float rx = a00 * p.x + a10 * p.y + a20 * p.z;
+			float ry = a10 * p.x + a11 * p.y + a21 * p.z;
+			float rz = a20 * p.x + a21 * p.y + a22 * p.z;
+			return rx * p.x + ry * p.y + rz * p.z + 2.f * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+		}
+
+		float error(const glm::vec3& p) const
+		{
+			return w > 0.f ? std::abs(evaluate(p)) / w : 0.f;
+		}
+	};
+
+	// every attribute is linear over a triangle, a = g.p + d. Moving a vertex to p with attributes s costs
+	// (g.p + d - s)^2 per attribute: the (g.p + d)^2 part is a plain quadric, the rest is linear in s
+	struct AttributeQuadric {
+		Quadric quadric;
+		glm::vec3 g[ATTRIBUTES] = {};
+		float d[ATTRIBUTES] = {};
+
+		void add(const AttributeQuadric& q)
+		{
+			quadric.add(q.quadric);
+			for (uint32_t k = 0; k < ATTRIBUTES; k++)
+			{
+				g[k] += q.g[k];
+				d[k] += q.d[k];
+			}
+		}
+
+		float error(const glm::vec3& p, const float* s) const
+		{
+			float r = quadric.evaluate(p);
+			for (uint32_t k = 0; k < ATTRIBUTES; k++)
+			{
+				r += quadric.w * s[k] * s[k] - 2.f * s[k] * (glm::dot(g[k], p) + d[k]);
+			}
+			return quadric.w > 0.f ? std::abs(r) / quadric.w : 0.f;
+		}
+	};
+
+	void add_triangle_attributes(AttributeQuadric& q, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2,
+		const float* s0, const float* s1, const float* s2, float weight)
+	{
+		// dual basis of the triangle's edges in its plane: g1.e1 = 1, g1.e2 = 0 and the other way around
+		glm::vec3 e1 = p1 - p0;
+		glm::vec3 e2 = p2 - p0;
+		float d00 = glm::dot(e1, e1);
+		float d01 = glm::dot(e1, e2);
+		float d11 = glm::dot(e2, e2);
+		float denominator = d00 * d11 - d01 * d01;
+		if (denominator <= 0.f)
+		{
+			return;
+		}
+		glm::vec3 g1 = (e1 * d11 - e2 * d01) / denominator;
+		glm::vec3 g2 = (e2 * d00 - e1 * d01) / denominator;
+
+		for (uint32_t k = 0; k < ATTRIBUTES; k++)
+		{
+			glm::vec3 g = g1 * (s1[k] - s0[k]) + g2 * (s2[k] - s0[k]);
+			float d = s0[k] - glm::dot(g, p0);
+			q.quadric.add_plane(g, d, weight);
+			q.g[k] += g * weight;
+			q.d[k] += d * weight;
+		}
+		q.quadric.w += weight;
+	}
+
+	// outgoing half-edges of every vertex, with the third vertex of the triangle they belong to
+	struct EdgeAdjacency {
+		std::vector<uint32_t> offsets; // vertexCount + 1
+		std::vector<uint32_t> next;
+		std::vector<uint32_t> third;
+
+		void build(const std::vector<uint32_t>& indices, const uint32_t* remap, size_t vertexCount)
+		{
+			offsets.assign(vertexCount + 1, 0);
+			for (uint32_t index : indices)
+			{
+				offsets[remap[index] + 1]++;
+			}
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				offsets[v + 1] += offsets[v];
+			}
+
+			next.resize(indices.size());
+			third.resize(indices.size());
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				for (uint32_t e = 0; e < 3; e++)
+				{
+					uint32_t a = remap[indices[i + e]];
+					uint32_t slot = fill[a]++;
+					next[slot] = remap[indices[i + (e + 1) % 3]];
+					third[slot] = remap[indices[i + (e + 2) % 3]];
+				}
+			}
+		}
+
+		bool has_edge(uint32_t a, uint32_t b) const
+		{
+			for (uint32_t e = offsets[a]; e < offsets[a + 1]; e++)
+			{
+				if (next[e] == b)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	// remap[v] is the first vertex with v's position, wedge[] links the vertices sharing one into a ring
+	void build_position_remap(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& remap, std::vector<uint32_t>& wedge)
+	{
+		uint32_t count = static_cast<uint32_t>(positions.size());
+		std::vector<uint32_t> order(count);
+		std::iota(order.begin(), order.end(), 0u);
+		auto less = [&](uint32_t a, uint32_t b) {
+			const glm::vec3& pa = positions[a];
+			const glm::vec3& pb = positions[b];
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			if (pa.z != pb.z) return pa.z < pb.z;
+			return a < b;
+		};
+		std::sort(order.begin(), order.end(), less);
+
+		remap.resize(count);
+		wedge.resize(count);
+		for (uint32_t first = 0; first < count;)
+		{
+			uint32_t last = first + 1;
+			while (last < count && positions[order[last]] == positions[order[first]])
+			{
+				last++;
+			}
+			for (uint32_t i = first; i < last; i++)
+			{
+				remap[order[i]] = order[first];
+				wedge[order[i]] = order[i + 1 < last ? i + 1 : first];
+			}
+			first = last;
+		}
+	}
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		float error;    // ranks the collapses, position and attribute deviation together
+		float distance; // position part alone, what maxError and the reported error go by
+	};
+
+	struct Simplifier {
+		std::vector<glm::vec3> positions; // in [0, 1] of the mesh extent
+		std::vector<float> attributes;    // ATTRIBUTES per vertex, weighted
+		std::vector<uint32_t> remap;
+		std::vector<uint32_t> wedge;
+		std::vector<uint8_t> kind;
+		std::vector<uint32_t> loop;       // open edge out of the vertex, NO_VERTEX if none
+		std::vector<uint32_t> loopback;   // open edge into it
+		std::vector<Quadric> vertexQuadrics;             // by position, remap[v]
+		std::vector<AttributeQuadric> attributeQuadrics; // by vertex
+
+		void classify(const std::vector<uint32_t>& indices)
+		{
+			uint32_t count = static_cast<uint32_t>(positions.size());
+			std::vector<uint32_t> identity(count);
+			std::iota(identity.begin(), identity.end(), 0u);
+			EdgeAdjacency adjacency;
+			adjacency.build(indices, identity.data(), count);
+
+			// open half-edges, the vertex itself stands for "more than one"
+			std::vector<uint32_t> openIn(count, NO_VERTEX);
+			std::vector<uint32_t> openOut(count, NO_VERTEX);
+			for (uint32_t v = 0; v < count; v++)
+			{
+				for (uint32_t e = adjacency.offsets[v]; e < adjacency.offsets[v + 1]; e++)
+				{
+					uint32_t target = adjacency.next[e];
+					if (!adjacency.has_edge(target, v))
+					{
+						openIn[target] = openIn[target] == NO_VERTEX ? v : target;
+						openOut[v] = openOut[v] == NO_VERTEX ? target : v;
+					}
+				}
+			}
+
+			kind.assign(count, KIND_LOCKED);
+			for (uint32_t v = 0; v < count; v++)
+			{
+				if (remap[v] != v)
+				{
+					continue;
+				}
+
+				uint32_t w = wedge[v];
+				if (w == v)
+				{
+					// counts anything without open edges as manifold, four triangles on one edge included
+					if (openIn[v] == NO_VERTEX && openOut[v] == NO_VERTEX)
+					{
+						kind[v] = KIND_MANIFOLD;
+					}
+					else if (openIn[v] != v && openOut[v] != v && openIn[v] != NO_VERTEX && openOut[v] != NO_VERTEX)
+					{
+						kind[v] = KIND_BORDER;
+					}
+				}
+				else if (wedge[w] == v)
+				{
+					// a seam has one open half-edge in and out on both sides, and they meet at the same positions
+					uint32_t inV = openIn[v], outV = openOut[v], inW = openIn[w], outW = openOut[w];
+					bool single = inV != NO_VERTEX && inV != v && outV != NO_VERTEX && outV != v
+						&& inW != NO_VERTEX && inW != w && outW != NO_VERTEX && outW != w;
+					if (single && remap[inV] == remap[outW] && remap[outV] == remap[inW])
+					{
+						kind[v] = KIND_SEAM;
+					}
+				}
+			}
+
+			for (uint32_t v = 0; v < count; v++)
+			{
+				kind[v] = kind[remap[v]];
+			}
+			loop = std::move(openOut);
+			loopback = std::move(openIn);
+		}
+
+		void fill_quadrics(const std::vector<uint32_t>& indices)
+		{
+			vertexQuadrics.assign(positions.size(), Quadric{});
+			attributeQuadrics.assign(positions.size(), AttributeQuadric{});
+
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				uint32_t v[3] = { indices[i], indices[i + 1], indices[i + 2] };
+				const glm::vec3& p0 = positions[v[0]];
+				const glm::vec3& p1 = positions[v[1]];
+				const glm::vec3& p2 = positions[v[2]];
+
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float length = glm::length(normal);
+				if (length > 0.f)
+				{
+					// weighted by area, big triangles pin their vertices harder
+					Quadric plane;
+					glm::vec3 n = normal / length;
+					plane.add_plane(n, -glm::dot(n, p0), length);
+					plane.w = length;
+					for (uint32_t corner : v)
+					{
+						vertexQuadrics[remap[corner]].add(plane);
+					}
+				}
+
+				AttributeQuadric attribute;
+				add_triangle_attributes(attribute, p0, p1, p2, &attributes[v[0] * ATTRIBUTES],
+					&attributes[v[1] * ATTRIBUTES], &attributes[v[2] * ATTRIBUTES], length);
+				for (uint32_t corner : v)
+				{
+					attributeQuadrics[corner].add(attribute);
+				}
+
+				// open edges get a plane standing on them, perpendicular to the triangle
+				for (uint32_t e = 0; e < 3; e++)
+				{
+					uint32_t i0 = v[e];
+					uint32_t i1 = v[(e + 1) % 3];
+					if (loop[i0] != i1)
+					{
+						continue;
+					}
+					glm::vec3 edge = positions[i1] - positions[i0];
+					float edgeLength = glm::length(edge);
+					if (edgeLength == 0.f)
+					{
+						continue;
+					}
+					edge /= edgeLength;
+					glm::vec3 toThird = positions[v[(e + 2) % 3]] - positions[i0];
+					glm::vec3 perpendicular = toThird - edge * glm::dot(toThird, edge);
+					float perpendicularLength = glm::length(perpendicular);
+					if (perpendicularLength == 0.f)
+					{
+						continue;
+					}
+					perpendicular /= perpendicularLength;
+
+					Quadric border;
+					float weight = edgeLength * edgeLength * BORDER_WEIGHT;
+					border.add_plane(perpendicular, -glm::dot(perpendicular, positions[i0]), weight);
+					border.w = weight;
+					vertexQuadrics[remap[i0]].add(border);
+					vertexQuadrics[remap[i1]].add(border);
+				}
+			}
+		}
+
+		// border and seam vertices only move along their open edge, a seam's other wedge has to follow along
+		// the matching edge on the other side
+		bool can_collapse(uint32_t from, uint32_t to) const
+		{
+			if (!CAN_COLLAPSE[kind[from]][kind[to]])
+			{
+				return false;
+			}
+			if (kind[from] == KIND_BORDER || kind[from] == KIND_SEAM)
+			{
+				if (loop[from] != to && loopback[from] != to)
+				{
+					return false;
+				}
+			}
+			if (kind[from] == KIND_SEAM)
+			{
+				uint32_t w0 = wedge[from];
+				uint32_t w1 = wedge[to];
+				return loop[w0] == w1 || loopback[w0] == w1;
+			}
+			return true;
+		}
+
+		Collapse rank_collapse(uint32_t from, uint32_t to) const
+		{
+			Collapse collapse{ from, to, 0.f, vertexQuadrics[remap[from]].error(positions[to]) };
+			collapse.error = collapse.distance + attributeQuadrics[from].error(positions[to], &attributes[to * ATTRIBUTES]);
+			if (kind[from] == KIND_SEAM)
+			{
+				collapse.error += attributeQuadrics[wedge[from]].error(positions[to], &attributes[wedge[to] * ATTRIBUTES]);
+			}
+			return collapse;
+		}
+
+		// an open edge whose far end collapsed points at where it went, one whose near end collapsed onto the
+		// far end skips ahead to the next edge along the border
+		void remap_loops(const std::vector<uint32_t>& collapseRemap)
+		{
+			for (std::vector<uint32_t>* edges : { &loop, &loopback })
+			{
+				std::vector<uint32_t>& l = *edges;
+				for (uint32_t v = 0; v < l.size(); v++)
+				{
+					if (l[v] == NO_VERTEX)
+					{
+						continue;
+					}
+					uint32_t target = collapseRemap[l[v]];
+					l[v] = target == v ? l[l[v]] : target;
+				}
+			}
+		}
+
+		// moving from onto to must not fold any triangle that stays over
+		bool flips(const EdgeAdjacency& adjacency, const std::vector<uint32_t>& collapseRemap, uint32_t from, uint32_t to) const
+		{
+			uint32_t r0 = remap[from];
+			uint32_t r1 = remap[to];
+			const glm::vec3& p0 = positions[from];
+			const glm::vec3& p1 = positions[to];
+			for (uint32_t e = adjacency.offsets[r0]; e < adjacency.offsets[r0 + 1]; e++)
+			{
+				uint32_t a = adjacency.next[e];
+				uint32_t b = adjacency.third[e];
+				if (a == r1 || b == r1)
+				{
+					continue;
+				}
+
+				// neighbours collapsed earlier in this pass already moved
+				const glm::vec3& pa = positions[collapseRemap[a]];
+				const glm::vec3& pb = positions[collapseRemap[b]];
+				glm::vec3 before = glm::cross(pa - p0, pb - p0);
+				glm::vec3 after = glm::cross(pa - p1, pb - p1);
+				float dot = glm::dot(before, after);
+				if (dot <= FLIP_COSINE * std::sqrt(glm::dot(before, before) * glm::dot(after, after)))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+}
+
+float simplify_scale(const std::vector<Vertex>& vertices)
+{
+	if (vertices.empty())
+	{
+		return 0.f;
+	}
+	glm::vec3 min = vertices[0].position;
+	glm::vec3 max = vertices[0].position;
+	for (const Vertex& vertex : vertices)
+	{
+		min = glm::min(min, vertex.position);
+		max = glm::max(max, vertex.position);
+	}
+	glm::vec3 extent = max - min;
+	return std::max(extent.x, std::max(extent.y, extent.z));
+}
+
+std::vector<uint32_t> simplify_mesh(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+	size_t targetIndexCount, const SimplifyOptions& options, float* resultError)
+{
+	std::vector<uint32_t> result = indices;
+	if (resultError)
+	{
+		*resultError = 0.f;
+	}
+	float scale = simplify_scale(vertices);
+	if (result.size() <= targetIndexCount || scale == 0.f)
+	{
+		return result;
+	}
+
+	// positions scaled to the unit box so errors are relative to the mesh and comparable with attributes
+	Simplifier simplifier;
+	size_t vertexCount = vertices.size();
+	glm::vec3 min = vertices[0].position;
+	for (const Vertex& vertex : vertices)
+	{
+		min = glm::min(min, vertex.position);
+	}
+	simplifier.positions.resize(vertexCount);
+	simplifier.attributes.resize(vertexCount * ATTRIBUTES);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		simplifier.positions[v] = (vertices[v].position - min) / scale;
+		float* attribute = &simplifier.attributes[v * ATTRIBUTES];
+		attribute[0] = vertices[v].normal.x * options.normalWeight;
+		attribute[1] = vertices[v].normal.y * options.normalWeight;
+		attribute[2] = vertices[v].normal.z * options.normalWeight;
+		attribute[3] = vertices[v].texCoord.x * options.texCoordWeight;
+		attribute[4] = vertices[v].texCoord.y * options.texCoordWeight;
+	}
+
+	build_position_remap(simplifier.positions, simplifier.remap, simplifier.wedge);
+	simplifier.classify(result);
+	simplifier.fill_quadrics(result);
+
+	const std::vector<uint32_t>& remap = simplifier.remap;
+	const std::vector<uint32_t>& wedge = simplifier.wedge;
+	float errorLimit = options.maxError * options.maxError;
+	float worstError = 0.f;
+
+	EdgeAdjacency adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> collapseRemap(vertexCount);
+	std::vector<uint8_t> touched(vertexCount);
+
+	// every pass ranks all edges, then collapses the cheapest ones that don't share a vertex
+	while (result.size() > targetIndexCount)
+	{
+		adjacency.build(result, remap.data(), vertexCount);
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (uint32_t e = 0; e < 3; e++)
+			{
+				uint32_t i0 = result[i + e];
+				uint32_t i1 = result[i + (e + 1) % 3];
+				uint32_t r0 = remap[i0];
+				uint32_t r1 = remap[i1];
+
+				// an inner edge is seen from both of its triangles, only one of them ranks it
+				if (r0 == r1 || (r0 > r1 && adjacency.has_edge(r1, r0)))
+				{
+					continue;
+				}
+
+				bool forward = simplifier.can_collapse(i0, i1);
+				bool backward = simplifier.can_collapse(i1, i0);
+				if (!forward && !backward)
+				{
+					continue;
+				}
+				if (forward && backward)
+				{
+					Collapse a = simplifier.rank_collapse(i0, i1);
+					Collapse b = simplifier.rank_collapse(i1, i0);
+					collapses.push_back(a.error <= b.error ? a : b);
+				}
+				else
+				{
+					collapses.push_back(forward ? simplifier.rank_collapse(i0, i1) : simplifier.rank_collapse(i1, i0));
+				}
+			}
+		}
+		if (collapses.empty())
+		{
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		std::iota(collapseRemap.begin(), collapseRemap.end(), 0u);
+		std::fill(touched.begin(), touched.end(), uint8_t(0));
+		size_t goal = (result.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		uint32_t performed = 0;
+
+		// a collapse usually removes two triangles, so about goal / 2 of them do. Collapses skipped for sharing a
+		// vertex would be made up for with ones far down the list, those wait for the next pass and fresh quadrics.
+		// Only once the pass did something though, the cheap ones may all have been over the distance limit
+		float errorGoal = 1.5f * collapses[std::min(goal / 2, collapses.size() - 1)].error;
+		for (const Collapse& collapse : collapses)
+		{
+			if (removed >= goal || (collapse.error > errorGoal && performed > 0))
+			{
+				break;
+			}
+			if (collapse.distance > errorLimit)
+			{
+				continue;
+			}
+			uint32_t r0 = remap[collapse.from];
+			uint32_t r1 = remap[collapse.to];
+			if (touched[r0] || touched[r1] || simplifier.flips(adjacency, collapseRemap, collapse.from, collapse.to))
+			{
+				continue;
+			}
+
+			uint8_t kind = simplifier.kind[collapse.from];
+			collapseRemap[collapse.from] = collapse.to;
+			simplifier.vertexQuadrics[r1].add(simplifier.vertexQuadrics[r0]);
+			simplifier.attributeQuadrics[collapse.to].add(simplifier.attributeQuadrics[collapse.from]);
+			if (kind == KIND_SEAM)
+			{
+				collapseRemap[wedge[collapse.from]] = wedge[collapse.to];
+				simplifier.attributeQuadrics[wedge[collapse.to]].add(simplifier.attributeQuadrics[wedge[collapse.from]]);
+			}
+
+			// both ends keep still for the rest of the pass, their quadrics and neighbourhood changed
+			touched[r0] = 1;
+			touched[r1] = 1;
+			removed += kind == KIND_BORDER ? 1 : 2;
+			worstError = std::max(worstError, collapse.distance);
+			performed++;
+		}
+		if (performed == 0)
+		{
+			break;
+		}
+
+		// triangles that had a collapsed edge end up with two corners on one position
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t a = collapseRemap[result[i]];
+			uint32_t b = collapseRemap[result[i + 1]];
+			uint32_t c = collapseRemap[result[i + 2]];
+			if (remap[a] != remap[b] && remap[b] != remap[c] && remap[c] != remap[a])
+			{
+				result[write] = a;
+				result[write + 1] = b;
+				result[write + 2] = c;
+				write += 3;
+			}
+		}
+		result.resize(write);
+		simplifier.remap_loops(collapseRemap);
+	}
+
+	if (resultError)
+	{
+		*resultError = std::sqrt(worstError);
+	}
+	return result;
+}
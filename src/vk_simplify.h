@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vk_mesh.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SimplifyOptions {
+	float maxError = 1.f;      // relative to the mesh extent, collapses moving the surface further are left out
+	float normalWeight = 0.5f; // attribute deviation against position deviation, 0 ignores the attribute
+	float texCoordWeight = 1.f;
+};
+
+/// @brief Quadric error edge collapse of a triangle list down to about targetIndexCount indices.
+/// A collapse moves a vertex onto a neighbour and never creates one, so the result indexes the same
+/// vertices and can share their buffer. Open borders and normal/uv seams only collapse along themselves,
+/// vertices where that can't be told apart stay where they are.
+/// Attribute deviation only ranks the collapses, the error limit and resultError are geometric.
+/// @param resultError if given, the largest distance of the result to the input surface, relative to the mesh
+/// extent
+/// @return the simplified indices, more than targetIndexCount when maxError or locked vertices stop it
+std::vector<uint32_t> simplify_mesh(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+	size_t targetIndexCount, const SimplifyOptions& options = {}, float* resultError = nullptr);
+
+/// @brief The extent simplify_mesh() errors are relative to, the largest side of the bounding box.
+float simplify_scale(const std::vector<Vertex>& vertices);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Hands the newest value from one producer thread to one consumer thread without locks. Three slots: the
+// producer fills its back slot and swaps it with the middle one, the consumer swaps the middle one with its
+// front slot when the middle holds something it hasn't seen. Neither side ever waits on the other, values
+// published faster than the consumer takes them are overwritten. Slots are reused, so members that own
+// memory keep their capacity from one round to the next
+template <typename T>
+class TripleBuffer {
+public:
+	/// @brief The producer's slot, holds whatever it published two rounds ago.
+	T& back() { return _slots[_back]; }
+
+	/// @brief Make back() the newest value and take the previous middle slot as the new back().
+	void publish()
+	{
+		// release so the slot's contents are visible before its index, acquire to get the old middle's
+		// contents back from the consumer
+		uint32_t old = _middle.exchange(_back | FRESH, std::memory_order_acq_rel);
+		_back = old & INDEX;
+	}
+
+	/// @brief Swap in the newest published value.
+	/// @return false if nothing was published since the last call, front() is unchanged then
+	bool acquire()
+	{
+		if ((_middle.load(std::memory_order_relaxed) & FRESH) == 0)
+		{
+			return false;
+		}
+		uint32_t old = _middle.exchange(_front, std::memory_order_acq_rel);
+		_front = old & INDEX;
+		return true;
+	}
+
+	/// @brief The consumer's slot, stays put until the next successful acquire().
+	T& front() { return _slots[_front]; }
+
+private:
+	static const uint32_t INDEX = 3;
+	static const uint32_t FRESH = 4; // set on publish, the middle slot hasn't been taken yet
+
+	T _slots[3];
+	uint32_t _back = 0;
+	std::atomic<uint32_t> _middle{ 1 };
+	uint32_t _front = 2;
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "TripleBuffer needs a lock free index");
+};
@@ -0,0 +1,540 @@
+#include <vk_streaming.h>
+#include <vk_initializers.h>
+#include <vk_profiler.h>
+
+#include <algorithm>
+#include <cstring>
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkBufferImageCopy image_copy_region(VkDeviceSize bufferOffset, uint32_t mipLevel, uint32_t width, uint32_t height)
+{
+	VkBufferImageCopy region{};
+	region.bufferOffset = bufferOffset;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = mipLevel;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = {width, height, 1};
+	return region;
+}
+
+void StagingRing::init(VmaAllocator allocator, VkDeviceSize capacity)
+{
+	_allocator = allocator;
+	_capacity = align_up(capacity, ALIGNMENT);
+	_head = 0;
+	_tail = 0;
+	_regions.clear();
+
+	VK_CHECK(vkinit::create_buffer(_allocator, _capacity, VMA_MEMORY_USAGE_UNKNOWN, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		_buffer._buffer, _buffer._allocation));
+
+	// mapped for the lifetime of the ring
+	void* mapped;
+	VK_CHECK(vmaMapMemory(_allocator, _buffer._allocation, &mapped));
+	_mapped = static_cast<uint8_t*>(mapped);
+}
+
+void StagingRing::cleanup()
+{
+	if (_mapped)
+	{
+		vmaUnmapMemory(_allocator, _buffer._allocation);
+		vmaDestroyBuffer(_allocator, _buffer._buffer, _buffer._allocation);
+		_mapped = nullptr;
+	}
+}
+
+bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize& offset)
+{
+	uint64_t start = align_up(_head, ALIGNMENT);
+	if (start % _capacity + size > _capacity)
+	{
+		// doesn't fit before the end, the rest of the lap is skipped
+		start = align_up(start, _capacity);
+	}
+
+	// nothing in flight, the skipped space costs nothing
+	if (_tail == _head)
+	{
+		_tail = start;
+	}
+
+	if (start + size - _tail > _capacity)
+	{
+		return false;
+	}
+
+	offset = start % _capacity;
+	_head = start + size;
+	return true;
+}
+
+void StagingRing::close(uint64_t value, uint64_t end)
+{
+	_regions.push_back(Region{value, end});
+}
+
+void StagingRing::retire(uint64_t value)
+{
+	while (!_regions.empty() && _regions.front().value <= value)
+	{
+		_tail = std::max(_tail, _regions.front().end);
+		_regions.pop_front();
+	}
+}
+
+void AssetStreamer::init(VkDevice device, VmaAllocator allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily,
+	VkDeviceSize stagingBytes)
+{
+	_device = device;
+	_allocator = allocator;
+	_transferQueue = transferQueue;
+
+	_queueFamilies = {graphicsFamily};
+	if (transferFamily != graphicsFamily)
+	{
+		_queueFamilies.push_back(transferFamily);
+	}
+
+	_ring.init(_allocator, stagingBytes);
+
+	// flush command buffers are reused once their fence signalled
+	VkCommandPoolCreateInfo poolInfo = vkinit::command_pool_create_info(transferFamily,
+		VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	VK_CHECK(vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool));
+
+	_stop = false;
+	_nextFlushValue = 1;
+	_loader = std::thread(&AssetStreamer::loader_main, this);
+}
+
+void AssetStreamer::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	_ringSpace.notify_all();
+	if (_loader.joinable())
+	{
+		_loader.join();
+	}
+
+	// whatever is still in flight finishes first, nothing that never became resident is handed out
+	for (Flush& flush : _inFlight)
+	{
+		VK_CHECK(vkWaitForFences(_device, 1, &flush.fence, VK_TRUE, UINT64_MAX));
+		for (std::unique_ptr<Request>& request : flush.requests)
+		{
+			destroy_payload(*request, true);
+		}
+		flush.requests.clear();
+		_freeFlushes.push_back(std::move(flush));
+	}
+	for (std::unique_ptr<Request>& request : _staged)
+	{
+		destroy_payload(*request, true);
+	}
+	_inFlight.clear();
+	_staged.clear();
+	_queued.clear();
+
+	for (Flush& flush : _freeFlushes)
+	{
+		vkDestroyFence(_device, flush.fence, nullptr);
+	}
+	_freeFlushes.clear();
+
+	// destroying the pool frees all of its command buffers
+	vkDestroyCommandPool(_device, _commandPool, nullptr);
+	_commandPool = VK_NULL_HANDLE;
+	_ring.cleanup();
+}
+
+StreamHandle AssetStreamer::request(DecodeFn decode, ResidentFn resident)
+{
+	std::unique_ptr<Request> request = std::make_unique<Request>();
+	request->decode = std::move(decode);
+	request->resident = std::move(resident);
+
+	StreamHandle handle;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		handle = static_cast<StreamHandle>(_states.size());
+		request->handle = handle;
+		_states.push_back(StreamState::Queued);
+		_queued.push_back(std::move(request));
+	}
+	_wake.notify_one();
+	return handle;
+}
+
+StreamState AssetStreamer::state(StreamHandle handle) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return handle < _states.size() ? _states[handle] : StreamState::Failed;
+}
+
+uint32_t AssetStreamer::pending() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	uint32_t count = 0;
+	for (StreamState state : _states)
+	{
+		count += (state == StreamState::Queued || state == StreamState::Uploading) ? 1 : 0;
+	}
+	return count;
+}
+
+void AssetStreamer::set_state(StreamHandle handle, StreamState state)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_states[handle] = state;
+}
+
+void AssetStreamer::update()
+{
+	// everything the loader staged since the last call goes out as one flush
+	Flush flush;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_staged.empty())
+		{
+			flush.requests.swap(_staged);
+			flush.value = _nextFlushValue++;
+			_ring.close(flush.value, flush.requests.back()->ringEnd);
+		}
+	}
+
+	if (!flush.requests.empty())
+	{
+		if (_freeFlushes.empty())
+		{
+			Flush created;
+			VkCommandBufferAllocateInfo allocInfo = vkinit::command_buffer_allocate_info(_commandPool);
+			VK_CHECK(vkAllocateCommandBuffers(_device, &allocInfo, &created.cmd));
+			VkFenceCreateInfo fenceInfo = vkinit::fence_create_info();
+			VK_CHECK(vkCreateFence(_device, &fenceInfo, nullptr, &created.fence));
+			_freeFlushes.push_back(std::move(created));
+		}
+		flush.cmd = _freeFlushes.back().cmd;
+		flush.fence = _freeFlushes.back().fence;
+		_freeFlushes.pop_back();
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK(vkBeginCommandBuffer(flush.cmd, &beginInfo));
+		for (const std::unique_ptr<Request>& request : flush.requests)
+		{
+			record_copies(flush.cmd, *request);
+		}
+		VK_CHECK(vkEndCommandBuffer(flush.cmd));
+
+		VkSubmitInfo submit = {};
+		submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit.commandBufferCount = 1;
+		submit.pCommandBuffers = &flush.cmd;
+		VK_CHECK(vkQueueSubmit(_transferQueue, 1, &submit, flush.fence));
+
+		_inFlight.push_back(std::move(flush));
+	}
+
+	// retire finished flushes in submission order, polling only
+	uint64_t retiredValue = 0;
+	while (!_inFlight.empty() && vkGetFenceStatus(_device, _inFlight.front().fence) == VK_SUCCESS)
+	{
+		Flush done = std::move(_inFlight.front());
+		_inFlight.pop_front();
+		retiredValue = done.value;
+
+		for (std::unique_ptr<Request>& request : done.requests)
+		{
+			destroy_payload(*request, false);
+			request->resident(request->payload);
+			set_state(request->handle, StreamState::Resident);
+		}
+		done.requests.clear();
+
+		VK_CHECK(vkResetFences(_device, 1, &done.fence));
+		_freeFlushes.push_back(std::move(done));
+	}
+
+	if (retiredValue != 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_ring.retire(retiredValue);
+		}
+		_ringSpace.notify_one();
+	}
+}
+
+void AssetStreamer::wait(StreamHandle handle)
+{
+	while (true)
+	{
+		StreamState current = state(handle);
+		if (current == StreamState::Resident || current == StreamState::Failed)
+		{
+			return;
+		}
+		wait_step();
+	}
+}
+
+void AssetStreamer::wait_idle()
+{
+	while (pending() > 0)
+	{
+		wait_step();
+	}
+}
+
+void AssetStreamer::wait_step()
+{
+	// submit whatever is staged, then block on the oldest flush or yield while the loader decodes
+	update();
+	if (!_inFlight.empty())
+	{
+		VK_CHECK(vkWaitForFences(_device, 1, &_inFlight.front().fence, VK_TRUE, UINT64_MAX));
+	}
+	else
+	{
+		std::this_thread::yield();
+	}
+	update();
+}
+
+void AssetStreamer::loader_main()
+{
+	vkprof::set_thread_name("asset loader");
+	while (true)
+	{
+		std::unique_ptr<Request> request;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this]() { return _stop || !_queued.empty(); });
+			if (_stop)
+			{
+				return;
+			}
+			request = std::move(_queued.front());
+			_queued.pop_front();
+		}
+
+		bool decoded;
+		{
+			VKPROF_ZONE("decode asset");
+			decoded = request->decode(request->payload);
+		}
+		if (!decoded)
+		{
+			set_state(request->handle, StreamState::Failed);
+			continue;
+		}
+
+		set_state(request->handle, StreamState::Uploading);
+		VKPROF_ZONE("stage asset");
+		if (!stage(*request))
+		{
+			// stopped while waiting for ring space
+			destroy_payload(*request, true);
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_staged.push_back(std::move(request));
+	}
+}
+
+bool AssetStreamer::stage(Request& request)
+{
+	uint32_t familyCount = static_cast<uint32_t>(_queueFamilies.size());
+
+	for (StreamPayload::Buffer& buffer : request.payload.buffers)
+	{
+		if (buffer.target != VK_NULL_HANDLE)
+		{
+			continue;
+		}
+		VK_CHECK(vkinit::create_buffer(_allocator, buffer.size(), VMA_MEMORY_USAGE_UNKNOWN,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | buffer.usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			buffer.buffer._buffer, buffer.buffer._allocation, familyCount, _queueFamilies.data()));
+	}
+	for (StreamPayload::Image& image : request.payload.images)
+	{
+		VK_CHECK(vkinit::create_image(_allocator, image.width, image.height, image.format, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			image.image._image, image.image._allocation, familyCount, _queueFamilies.data(), image.mip_levels()));
+	}
+
+	// every blob of the request in staging order, payload buffers first
+	struct Source {
+		const uint8_t* data;
+		size_t size;
+	};
+	std::vector<Source> sources;
+	for (const StreamPayload::Buffer& buffer : request.payload.buffers)
+	{
+		sources.push_back(buffer.source ? Source{buffer.source, buffer.sourceSize} : Source{buffer.data.data(), buffer.data.size()});
+	}
+	for (const StreamPayload::Image& image : request.payload.images)
+	{
+		sources.push_back(image.source ? Source{image.source, image.sourceSize} : Source{image.pixels.data(), image.pixels.size()});
+	}
+	VkDeviceSize total = 0;
+	for (const Source& source : sources)
+	{
+		total = align_up(total, StagingRing::ALIGNMENT) + source.size;
+	}
+
+	// the whole request is reserved at once, waiting for earlier flushes to retire while the ring is full. A request
+	// holding part of the ring while it waits for the rest could wait forever, its part only goes back once it's
+	// flushed. Requests the ring could never hold get a staging buffer of their own, destroyed when their flush retires
+	VkBuffer stagingBuffer;
+	uint8_t* staging;
+	VkDeviceSize base = 0;
+	if (total <= _ring.capacity())
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_ringSpace.wait(lock, [&]() { return _stop || _ring.allocate(total, base); });
+		if (_stop)
+		{
+			return false;
+		}
+		request.ringEnd = _ring.head();
+
+		// the reserved space is this thread's until the flush retires, no lock needed for the copies
+		stagingBuffer = _ring.buffer();
+		staging = _ring.mapped() + base;
+	}
+	else
+	{
+		AllocatedBuffer oversized;
+		VK_CHECK(vkinit::create_buffer(_allocator, total, VMA_MEMORY_USAGE_UNKNOWN, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			oversized._buffer, oversized._allocation));
+		request.oversized.push_back(oversized);
+
+		void* mapped;
+		VK_CHECK(vmaMapMemory(_allocator, oversized._allocation, &mapped));
+		stagingBuffer = oversized._buffer;
+		staging = static_cast<uint8_t*>(mapped);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		request.ringEnd = _ring.head();
+	}
+
+	VkDeviceSize offset = 0;
+	for (const Source& source : sources)
+	{
+		offset = align_up(offset, StagingRing::ALIGNMENT);
+		memcpy(staging + offset, source.data, source.size);
+		request.blobs.push_back(Blob{stagingBuffer, base + offset, source.size});
+		offset += source.size;
+	}
+	if (!request.oversized.empty())
+	{
+		vmaUnmapMemory(_allocator, request.oversized.back()._allocation);
+	}
+
+	// the host copies are in staging memory now, free them (or unmap their source) right away
+	for (StreamPayload::Buffer& buffer : request.payload.buffers)
+	{
+		std::vector<uint8_t>().swap(buffer.data);
+		buffer.source = nullptr;
+		buffer.sourceOwner.reset();
+	}
+	for (StreamPayload::Image& image : request.payload.images)
+	{
+		std::vector<uint8_t>().swap(image.pixels);
+		image.source = nullptr;
+		image.sourceOwner.reset();
+	}
+	return true;
+}
+
+void AssetStreamer::record_copies(VkCommandBuffer cmd, const Request& request)
+{
+	const Blob* blob = request.blobs.data();
+	for (const StreamPayload::Buffer& buffer : request.payload.buffers)
+	{
+		VkBufferCopy copy{};
+		copy.srcOffset = blob->offset;
+		copy.dstOffset = buffer.targetOffset;
+		copy.size = blob->size;
+		VkBuffer destination = buffer.target != VK_NULL_HANDLE ? buffer.target : buffer.buffer._buffer;
+		vkCmdCopyBuffer(cmd, blob->source, destination, 1, &copy);
+		blob++;
+	}
+
+	std::vector<VkBufferImageCopy> regions;
+	for (const StreamPayload::Image& image : request.payload.images)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image.image._image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = image.mip_levels();
+		barrier.subresourceRange.layerCount = 1;
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		// one region per mip level, all out of the same staged blob
+		regions.assign(image.regions.begin(), image.regions.end());
+		if (regions.empty())
+		{
+			regions.push_back(image_copy_region(0, 0, image.width, image.height));
+		}
+		for (VkBufferImageCopy& region : regions)
+		{
+			region.bufferOffset += blob->offset;
+		}
+		vkCmdCopyBufferToImage(cmd, blob->source, image.image._image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(regions.size()), regions.data());
+		blob++;
+
+		// a transfer only queue knows no shader stages, the fence orders the copy before the first draw reading it
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+}
+
+void AssetStreamer::destroy_payload(Request& request, bool deviceResources)
+{
+	for (AllocatedBuffer& staging : request.oversized)
+	{
+		vmaDestroyBuffer(_allocator, staging._buffer, staging._allocation);
+	}
+	request.oversized.clear();
+
+	if (!deviceResources)
+	{
+		return;
+	}
+	// ranges of a target buffer stay with whoever handed them out, buffers of its own are null there
+	for (StreamPayload::Buffer& buffer : request.payload.buffers)
+	{
+		vmaDestroyBuffer(_allocator, buffer.buffer._buffer, buffer.buffer._allocation);
+	}
+	for (StreamPayload::Image& image : request.payload.images)
+	{
+		vmaDestroyImage(_allocator, image.image._image, image.image._allocation);
+	}
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// host side copy of the device resources one asset needs, filled by a decode callback on the loader thread.
+// The streamer creates the device buffers/images, copies the data over and fills in the handles
+struct StreamPayload {
+	// either gets a device buffer of its own, or is copied into a range of an existing one when target is set.
+	// The data is either owned, or read straight out of memory sourceOwner keeps alive like an Image's
+	struct Buffer {
+		std::vector<uint8_t> data;
+		const uint8_t* source = nullptr;
+		size_t sourceSize = 0;
+		std::shared_ptr<const void> sourceOwner;
+		VkBufferUsageFlags usage = 0;
+		AllocatedBuffer buffer{};
+		VkBuffer target = VK_NULL_HANDLE;
+		VkDeviceSize targetOffset = 0;
+
+		size_t size() const { return source ? sourceSize : data.size(); }
+	};
+
+	// every mip level of one image, largest first. regions say where each level starts in the image's data,
+	// bufferOffset relative to its first byte; none means a single tightly packed width x height level.
+	// The data is either owned in pixels, or read straight out of memory sourceOwner keeps alive, e.g. a mapped
+	// texture cache, so it's copied exactly once on its way into staging memory.
+	// Ends up in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	struct Image {
+		std::vector<uint8_t> pixels;
+		const uint8_t* source = nullptr;
+		size_t sourceSize = 0;
+		std::shared_ptr<const void> sourceOwner;
+		std::vector<VkBufferImageCopy> regions;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+		AllocatedImage image{};
+
+		uint32_t mip_levels() const { return regions.empty() ? 1 : static_cast<uint32_t>(regions.size()); }
+	};
+
+	std::vector<Buffer> buffers;
+	std::vector<Image> images;
+};
+
+// persistently mapped, host visible ring every upload is staged in. Space is handed out in order and given back
+// in order once the flush that copied out of it has finished, tracked by flush value. Not thread safe,
+// AssetStreamer guards it with its mutex
+class StagingRing {
+public:
+	static constexpr VkDeviceSize ALIGNMENT = 16; // covers texel and compressed block sizes of buffer to image copies
+
+	void init(VmaAllocator allocator, VkDeviceSize capacity);
+	void cleanup();
+
+	/// @brief Reserve size bytes, never split across the end of the ring.
+	/// @return false while the ring is too full of data that hasn't been copied yet
+	bool allocate(VkDeviceSize size, VkDeviceSize& offset);
+
+	/// @brief Everything allocated up to end is read by flush value.
+	void close(uint64_t value, uint64_t end);
+
+	/// @brief Flushes up to value finished, their space can be reused.
+	void retire(uint64_t value);
+
+	/// @brief Position after the last allocation, pass to close().
+	uint64_t head() const { return _head; }
+
+	VkBuffer buffer() const { return _buffer._buffer; }
+	uint8_t* mapped() const { return _mapped; }
+	VkDeviceSize capacity() const { return _capacity; }
+
+private:
+	struct Region {
+		uint64_t value;
+		uint64_t end;
+	};
+
+	VmaAllocator _allocator = VK_NULL_HANDLE;
+	AllocatedBuffer _buffer{};
+	uint8_t* _mapped = nullptr;
+	VkDeviceSize _capacity = 0;
+
+	// monotonic byte positions, the ring offset is position % capacity
+	uint64_t _head = 0;
+	uint64_t _tail = 0;
+	std::deque<Region> _regions;
+};
+
+enum class StreamState : uint32_t {
+	Queued,    // waiting for the loader thread
+	Uploading, // decoded, copies recorded or in flight on the transfer queue
+	Resident,  // copies finished, the resident callback has run
+	Failed,    // decode returned false, nothing was created
+};
+
+using StreamHandle = uint32_t;
+
+// background asset loader. A dedicated thread decodes requests and stages their data in the ring, the main
+// thread records everything staged since the last update() into one command buffer, submits it on the transfer
+// queue and polls the fences of earlier flushes, so neither side ever waits on the gpu. Callers keep drawing
+// placeholders until their resident callback has run
+class AssetStreamer {
+public:
+	// loader thread: fill the payload, false marks the request failed
+	using DecodeFn = std::function<bool(StreamPayload& payload)>;
+	// main thread, from update(): the device resources in the payload belong to the callee from here on
+	using ResidentFn = std::function<void(StreamPayload& payload)>;
+
+	/// @param transferFamily queue family of transferQueue, resources are shared with graphicsFamily when they differ
+	/// @param stagingBytes size of the staging ring, requests larger than that get a staging buffer of their own
+	void init(VkDevice device, VmaAllocator allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily,
+		VkDeviceSize stagingBytes);
+
+	/// @brief Wait for the uploads in flight, stop the loader thread and free whatever never became resident.
+	void cleanup();
+
+	StreamHandle request(DecodeFn decode, ResidentFn resident);
+
+	StreamState state(StreamHandle handle) const;
+
+	/// @brief Submit everything staged since the last call as one flush and retire the finished ones.
+	/// Main thread, once per frame.
+	void update();
+
+	/// @brief Block until handle is resident or failed, for the few assets nothing can be drawn without.
+	void wait(StreamHandle handle);
+
+	/// @brief Block until every request is resident or failed.
+	void wait_idle();
+
+	/// @brief Requests not resident or failed yet.
+	uint32_t pending() const;
+
+private:
+	// staged copy of one payload buffer or image
+	struct Blob {
+		VkBuffer source; // the ring, or an oversized request's own staging buffer
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	struct Request {
+		StreamHandle handle;
+		DecodeFn decode;
+		ResidentFn resident;
+		StreamPayload payload;
+		std::vector<Blob> blobs; // payload buffers first, then images
+		std::vector<AllocatedBuffer> oversized; // at most one, holding every blob of the request
+		uint64_t ringEnd = 0;    // ring head after this request's allocations
+	};
+
+	// one submission of everything staged between two update() calls
+	struct Flush {
+		uint64_t value = 0;
+		VkCommandBuffer cmd = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		std::vector<std::unique_ptr<Request>> requests;
+	};
+
+	void loader_main();
+	bool stage(Request& request);
+	void record_copies(VkCommandBuffer cmd, const Request& request);
+	void destroy_payload(Request& request, bool deviceResources);
+	void set_state(StreamHandle handle, StreamState state);
+	void wait_step();
+
+	VkDevice _device = VK_NULL_HANDLE;
+	VmaAllocator _allocator = VK_NULL_HANDLE;
+	VkQueue _transferQueue = VK_NULL_HANDLE;
+	std::vector<uint32_t> _queueFamilies; // both families when they differ, CONCURRENT sharing
+
+	std::thread _loader;
+	mutable std::mutex _mutex;
+	std::condition_variable _wake;      // work queued or stopping
+	std::condition_variable _ringSpace; // a flush retired, the loader may fit its request now
+	bool _stop = false;
+	std::vector<StreamState> _states;
+	StagingRing _ring;
+	std::deque<std::unique_ptr<Request>> _queued; // main -> loader
+	std::vector<std::unique_ptr<Request>> _staged; // loader -> main, data in staging memory, copies not recorded yet
+
+	// main thread only
+	VkCommandPool _commandPool = VK_NULL_HANDLE;
+	std::deque<Flush> _inFlight;
+	std::vector<Flush> _freeFlushes; // command buffer and fence to reuse
+	uint64_t _nextFlushValue = 1;
+};
@@ -0,0 +1,886 @@
+#include <vk_texture.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+	size_t align_up(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// 8 bit sRGB to linear [0, 1], and [0, 1] linear quantized to 4096 steps back to 8 bit sRGB.
+	// 4096 steps keep the round trip exact for every 8 bit value
+	const uint32_t LINEAR_STEPS = 4096;
+
+	struct SrgbTables {
+		float toLinear[256];
+		uint8_t toSrgb[LINEAR_STEPS];
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (uint32_t i = 0; i < LINEAR_STEPS; i++)
+			{
+				float l = i / float(LINEAR_STEPS - 1);
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+				toSrgb[i] = static_cast<uint8_t>(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+			}
+		}
+	};
+
+	const SrgbTables& srgb_tables()
+	{
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	uint8_t unorm8(float value)
+	{
+		return static_cast<uint8_t>(std::clamp(value * 255.f + 0.5f, 0.f, 255.f));
+	}
+
+	void to_linear(const uint8_t* rgba, size_t texels, float* out)
+	{
+		const SrgbTables& tables = srgb_tables();
+		for (size_t i = 0; i < texels * 4; i += 4)
+		{
+			out[i + 0] = tables.toLinear[rgba[i + 0]];
+			out[i + 1] = tables.toLinear[rgba[i + 1]];
+			out[i + 2] = tables.toLinear[rgba[i + 2]];
+			out[i + 3] = rgba[i + 3] / 255.f;
+		}
+	}
+
+	void to_srgb8(const float* linear, size_t texels, uint8_t* out)
+	{
+		const SrgbTables& tables = srgb_tables();
+		for (size_t i = 0; i < texels * 4; i += 4)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				float l = std::clamp(linear[i + c], 0.f, 1.f);
+				out[i + c] = tables.toSrgb[static_cast<uint32_t>(l * (LINEAR_STEPS - 1) + 0.5f)];
+			}
+			out[i + 3] = unorm8(linear[i + 3]);
+		}
+	}
+
+	// 2x2 box filter of linear rgba float texels, one texel is exactly one SSE register
+	void downsample(const float* src, uint32_t srcWidth, uint32_t srcHeight, float* dst, uint32_t dstWidth, uint32_t dstHeight)
+	{
+#ifdef TEXTURE_SSE
+		const __m128 quarter = _mm_set1_ps(0.25f);
+#endif
+		for (uint32_t y = 0; y < dstHeight; y++)
+		{
+			const float* row0 = src + size_t(std::min(2 * y, srcHeight - 1)) * srcWidth * 4;
+			const float* row1 = src + size_t(std::min(2 * y + 1, srcHeight - 1)) * srcWidth * 4;
+			float* out = dst + size_t(y) * dstWidth * 4;
+
+			for (uint32_t x = 0; x < dstWidth; x++)
+			{
+				uint32_t x0 = std::min(2 * x, srcWidth - 1) * 4;
+				uint32_t x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+#ifdef TEXTURE_SSE
+				__m128 top = _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1));
+				__m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1));
+				_mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+#else
+				for (int c = 0; c < 4; c++)
+				{
+					out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+				}
+#endif
+			}
+		}
+	}
+
+	// 4x4 texels at block (bx, by), edge texels repeat into blocks hanging over the border
+	void load_block(const uint8_t* level, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, uint8_t* rgba)
+	{
+		for (uint32_t row = 0; row < 4; row++)
+		{
+			uint32_t y = std::min(by * 4 + row, height - 1);
+			for (uint32_t col = 0; col < 4; col++)
+			{
+				uint32_t x = std::min(bx * 4 + col, width - 1);
+				memcpy(rgba + (row * 4 + col) * 4, level + (size_t(y) * width + x) * 4, 4);
+			}
+		}
+	}
+
+	void store_block(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, uint8_t* level)
+	{
+		for (uint32_t row = 0; row < 4 && by * 4 + row < height; row++)
+		{
+			for (uint32_t col = 0; col < 4 && bx * 4 + col < width; col++)
+			{
+				memcpy(level + (size_t(by * 4 + row) * width + bx * 4 + col) * 4, rgba + (row * 4 + col) * 4, 4);
+			}
+		}
+	}
+
+	// mean and dominant direction of the block's texels over the first `channels` channels, by power iteration
+	// on the covariance matrix. Flat blocks get a zero axis
+	void principal_axis(const uint8_t* rgba, int channels, float mean[4], float axis[4])
+	{
+		float lo[4] = { 255.f, 255.f, 255.f, 255.f };
+		float hi[4] = { 0.f, 0.f, 0.f, 0.f };
+		for (int c = 0; c < 4; c++)
+		{
+			mean[c] = 0.f;
+			axis[c] = 0.f;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < channels; c++)
+			{
+				float v = rgba[i * 4 + c];
+				mean[c] += v;
+				lo[c] = std::min(lo[c], v);
+				hi[c] = std::max(hi[c], v);
+			}
+		}
+		for (int c = 0; c < channels; c++)
+		{
+			mean[c] /= 16.f;
+		}
+
+		float cov[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float d[4];
+			for (int c = 0; c < channels; c++)
+			{
+				d[c] = rgba[i * 4 + c] - mean[c];
+			}
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+				{
+					cov[a][b] += d[a] * d[b];
+				}
+			}
+		}
+
+		// the bounding box diagonal is a good first guess
+		float v[4] = {};
+		for (int c = 0; c < channels; c++)
+		{
+			v[c] = hi[c] - lo[c];
+		}
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0.f;
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+				{
+					next[a] += cov[a][b] * v[b];
+				}
+				length += next[a] * next[a];
+			}
+			if (length < 1e-12f)
+			{
+				break;
+			}
+			float scale = 1.f / std::sqrt(length);
+			for (int c = 0; c < channels; c++)
+			{
+				v[c] = next[c] * scale;
+			}
+		}
+
+		float length = 0.f;
+		for (int c = 0; c < channels; c++)
+		{
+			length += v[c] * v[c];
+		}
+		if (length > 1e-12f)
+		{
+			float scale = 1.f / std::sqrt(length);
+			for (int c = 0; c < channels; c++)
+			{
+				axis[c] = v[c] * scale;
+			}
+		}
+	}
+
+	// endpoints at the extremes of the texels projected onto the principal axis
+	void axis_endpoints(const uint8_t* rgba, int channels, float low[4], float high[4])
+	{
+		float mean[4], axis[4];
+		principal_axis(rgba, channels, mean, axis);
+
+		float tmin = 0.f, tmax = 0.f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.f;
+			for (int c = 0; c < channels; c++)
+			{
+				t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+			}
+			tmin = std::min(tmin, t);
+			tmax = std::max(tmax, t);
+		}
+		for (int c = 0; c < channels; c++)
+		{
+			low[c] = std::clamp(mean[c] + axis[c] * tmin, 0.f, 255.f);
+			high[c] = std::clamp(mean[c] + axis[c] * tmax, 0.f, 255.f);
+		}
+	}
+
+	// ==== BC1 color block ====
+
+	uint16_t pack565(const float color[3])
+	{
+		uint32_t r = static_cast<uint32_t>(std::clamp(color[0] * 31.f / 255.f + 0.5f, 0.f, 31.f));
+		uint32_t g = static_cast<uint32_t>(std::clamp(color[1] * 63.f / 255.f + 0.5f, 0.f, 63.f));
+		uint32_t b = static_cast<uint32_t>(std::clamp(color[2] * 31.f / 255.f + 0.5f, 0.f, 31.f));
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	void unpack565(uint16_t packed, int color[3])
+	{
+		int r = packed >> 11;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// c0 > c1 selects the 4 color palette, equal endpoints would select 3 colors + black
+	void bc1_palette(uint16_t c0, uint16_t c1, bool fourColors, int palette[4][4])
+	{
+		unpack565(c0, palette[0]);
+		unpack565(c1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = 255;
+		palette[3][3] = 255;
+		for (int c = 0; c < 3; c++)
+		{
+			if (fourColors)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		if (!fourColors)
+		{
+			palette[3][3] = 0;
+		}
+	}
+
+	// write a 4 color block for the two endpoints, returns the squared rgb error
+	uint32_t write_bc1_colors(const uint8_t* rgba, uint16_t c0, uint16_t c1, uint8_t* block, uint8_t indices[16])
+	{
+		if (c0 < c1)
+		{
+			std::swap(c0, c1);
+		}
+
+		int palette[4][4];
+		bc1_palette(c0, c1, true, palette);
+
+		uint32_t bits = 0;
+		uint32_t error = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			// equal endpoints only ever use index 0, the 3 color palette's black is never picked
+			int candidates = c0 == c1 ? 1 : 4;
+			uint32_t best = UINT32_MAX;
+			int bestIndex = 0;
+			for (int p = 0; p < candidates; p++)
+			{
+				int dr = rgba[i * 4 + 0] - palette[p][0];
+				int dg = rgba[i * 4 + 1] - palette[p][1];
+				int db = rgba[i * 4 + 2] - palette[p][2];
+				uint32_t distance = static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+				if (distance < best)
+				{
+					best = distance;
+					bestIndex = p;
+				}
+			}
+			indices[i] = static_cast<uint8_t>(bestIndex);
+			bits |= static_cast<uint32_t>(bestIndex) << (2 * i);
+			error += best;
+		}
+
+		block[0] = static_cast<uint8_t>(c0);
+		block[1] = static_cast<uint8_t>(c0 >> 8);
+		block[2] = static_cast<uint8_t>(c1);
+		block[3] = static_cast<uint8_t>(c1 >> 8);
+		memcpy(block + 4, &bits, sizeof(bits));
+		return error;
+	}
+
+	void encode_color_block(const uint8_t* rgba, uint8_t* block)
+	{
+		float low[4], high[4];
+		axis_endpoints(rgba, 3, low, high);
+
+		uint8_t indices[16];
+		uint32_t error = write_bc1_colors(rgba, pack565(high), pack565(low), block, indices);
+		if (error == 0)
+		{
+			return;
+		}
+
+		// one least squares refit of both endpoints to the chosen indices
+		const float weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+		float aa = 0.f, ab = 0.f, bb = 0.f;
+		float ap[3] = {}, bp[3] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float w = weights[indices[i]];
+			aa += w * w;
+			ab += w * (1.f - w);
+			bb += (1.f - w) * (1.f - w);
+			for (int c = 0; c < 3; c++)
+			{
+				ap[c] += w * rgba[i * 4 + c];
+				bp[c] += (1.f - w) * rgba[i * 4 + c];
+			}
+		}
+		float det = aa * bb - ab * ab;
+		if (std::fabs(det) < 1e-6f)
+		{
+			return;
+		}
+
+		float e0[3], e1[3];
+		for (int c = 0; c < 3; c++)
+		{
+			e0[c] = (ap[c] * bb - bp[c] * ab) / det;
+			e1[c] = (bp[c] * aa - ap[c] * ab) / det;
+		}
+
+		uint8_t refined[8];
+		uint8_t refinedIndices[16];
+		if (write_bc1_colors(rgba, pack565(e0), pack565(e1), refined, refinedIndices) < error)
+		{
+			memcpy(block, refined, sizeof(refined));
+		}
+	}
+
+	// ==== BC3 alpha block, the BC4 layout ====
+
+	void alpha_palette(int a0, int a1, int palette[8])
+	{
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1)
+		{
+			for (int k = 2; k < 8; k++)
+			{
+				palette[k] = ((8 - k) * a0 + (k - 1) * a1 + 3) / 7;
+			}
+		}
+		else
+		{
+			for (int k = 2; k < 6; k++)
+			{
+				palette[k] = ((6 - k) * a0 + (k - 1) * a1 + 2) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	void encode_alpha_block(const uint8_t* rgba, uint8_t* block)
+	{
+		int lo = 255, hi = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			lo = std::min(lo, int(rgba[i * 4 + 3]));
+			hi = std::max(hi, int(rgba[i * 4 + 3]));
+		}
+
+		block[0] = static_cast<uint8_t>(hi);
+		block[1] = static_cast<uint8_t>(lo);
+
+		uint64_t bits = 0;
+		if (hi > lo)
+		{
+			int palette[8];
+			alpha_palette(hi, lo, palette);
+			for (int i = 0; i < 16; i++)
+			{
+				int alpha = rgba[i * 4 + 3];
+				int best = 256;
+				uint64_t bestIndex = 0;
+				for (int k = 0; k < 8; k++)
+				{
+					int distance = std::abs(alpha - palette[k]);
+					if (distance < best)
+					{
+						best = distance;
+						bestIndex = static_cast<uint64_t>(k);
+					}
+				}
+				bits |= bestIndex << (3 * i);
+			}
+		}
+		for (int b = 0; b < 6; b++)
+		{
+			block[2 + b] = static_cast<uint8_t>(bits >> (8 * b));
+		}
+	}
+
+	void decode_color_block(const uint8_t* block, bool allowThreeColors, uint8_t* rgba)
+	{
+		uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+		uint16_t c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+		uint32_t bits;
+		memcpy(&bits, block + 4, sizeof(bits));
+
+		int palette[4][4];
+		bc1_palette(c0, c1, c0 > c1 || !allowThreeColors, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			const int* color = palette[(bits >> (2 * i)) & 3];
+			for (int c = 0; c < 4; c++)
+			{
+				rgba[i * 4 + c] = static_cast<uint8_t>(color[c]);
+			}
+		}
+	}
+
+	// ==== BC7 mode 6 ====
+
+	const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	int bc7_interpolate(int e0, int e1, int weight)
+	{
+		return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+	}
+
+	struct BitWriter {
+		uint64_t words[2] = { 0, 0 };
+		uint32_t position = 0;
+
+		void put(uint32_t value, uint32_t bits)
+		{
+			for (uint32_t b = 0; b < bits; b++, position++)
+			{
+				words[position / 64] |= static_cast<uint64_t>((value >> b) & 1) << (position % 64);
+			}
+		}
+	};
+
+	struct BitReader {
+		uint64_t words[2];
+		uint32_t position = 0;
+
+		uint32_t get(uint32_t bits)
+		{
+			uint32_t value = 0;
+			for (uint32_t b = 0; b < bits; b++, position++)
+			{
+				value |= static_cast<uint32_t>((words[position / 64] >> (position % 64)) & 1) << b;
+			}
+			return value;
+		}
+	};
+}
+
+const char* texture_codec_name(TextureCodec codec)
+{
+	switch (codec)
+	{
+	case TextureCodec::BC1:
+		return "bc1";
+	case TextureCodec::BC3:
+		return "bc3";
+	case TextureCodec::BC7:
+		return "bc7";
+	default:
+		return "rgba8";
+	}
+}
+
+VkFormat texture_codec_format(TextureCodec codec)
+{
+	switch (codec)
+	{
+	case TextureCodec::BC1:
+		return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+	case TextureCodec::BC3:
+		return VK_FORMAT_BC3_SRGB_BLOCK;
+	case TextureCodec::BC7:
+		return VK_FORMAT_BC7_SRGB_BLOCK;
+	default:
+		return VK_FORMAT_R8G8B8A8_SRGB;
+	}
+}
+
+size_t texture_level_bytes(TextureCodec codec, uint32_t width, uint32_t height)
+{
+	size_t blocks = size_t((width + 3) / 4) * ((height + 3) / 4);
+	switch (codec)
+	{
+	case TextureCodec::BC1:
+		return blocks * 8;
+	case TextureCodec::BC3:
+	case TextureCodec::BC7:
+		return blocks * 16;
+	default:
+		return size_t(width) * height * 4;
+	}
+}
+
+void texture_copy_regions(const Texture& texture, std::vector<VkBufferImageCopy>& regions)
+{
+	regions.clear();
+	for (uint32_t l = 0; l < texture.levels.size(); l++)
+	{
+		// tightly packed, bufferRowLength 0 works for block formats too
+		VkBufferImageCopy region{};
+		region.bufferOffset = texture.levels[l].offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = l;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { texture.levels[l].width, texture.levels[l].height, 1 };
+		regions.push_back(region);
+	}
+}
+
+void generate_mips(const uint8_t* rgba, uint32_t width, uint32_t height, Texture& out)
+{
+	out = Texture{};
+	out.codec = TextureCodec::RGBA8;
+	out.width = width;
+	out.height = height;
+
+	uint32_t levelCount = 1;
+	while ((std::max(width, height) >> levelCount) > 0)
+	{
+		levelCount++;
+	}
+
+	size_t total = 0;
+	for (uint32_t l = 0; l < levelCount; l++)
+	{
+		TextureLevel level;
+		level.width = std::max(1u, width >> l);
+		level.height = std::max(1u, height >> l);
+		level.offset = align_up(total, TEXTURE_LEVEL_ALIGNMENT);
+		level.size = size_t(level.width) * level.height * 4;
+		total = level.offset + level.size;
+		out.levels.push_back(level);
+	}
+	out.data.resize(total);
+	memcpy(out.data.data(), rgba, out.levels[0].size);
+
+	// every level is filtered from the linear float version of the previous one, never from 8 bit sRGB
+	std::vector<float> current(size_t(width) * height * 4);
+	std::vector<float> next;
+	to_linear(rgba, size_t(width) * height, current.data());
+
+	for (uint32_t l = 1; l < levelCount; l++)
+	{
+		const TextureLevel& previous = out.levels[l - 1];
+		const TextureLevel& level = out.levels[l];
+		next.resize(size_t(level.width) * level.height * 4);
+		downsample(current.data(), previous.width, previous.height, next.data(), level.width, level.height);
+		to_srgb8(next.data(), size_t(level.width) * level.height, out.data.data() + level.offset);
+		current.swap(next);
+	}
+}
+
+void encode_texture(const Texture& source, TextureCodec codec, Texture& out)
+{
+	out = Texture{};
+	out.codec = codec;
+	out.width = source.width;
+	out.height = source.height;
+
+	size_t total = 0;
+	for (const TextureLevel& sourceLevel : source.levels)
+	{
+		TextureLevel level;
+		level.width = sourceLevel.width;
+		level.height = sourceLevel.height;
+		level.offset = align_up(total, TEXTURE_LEVEL_ALIGNMENT);
+		level.size = texture_level_bytes(codec, level.width, level.height);
+		total = level.offset + level.size;
+		out.levels.push_back(level);
+	}
+	out.data.resize(total);
+
+	for (size_t l = 0; l < out.levels.size(); l++)
+	{
+		const TextureLevel& level = out.levels[l];
+		const uint8_t* src = source.data.data() + source.levels[l].offset;
+		uint8_t* dst = out.data.data() + level.offset;
+
+		if (codec == TextureCodec::RGBA8)
+		{
+			memcpy(dst, src, level.size);
+			continue;
+		}
+
+		size_t blockBytes = codec == TextureCodec::BC1 ? 8 : 16;
+		uint32_t blocksX = (level.width + 3) / 4;
+		uint32_t blocksY = (level.height + 3) / 4;
+		uint8_t texels[64];
+		for (uint32_t by = 0; by < blocksY; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				load_block(src, level.width, level.height, bx, by, texels);
+				uint8_t* block = dst + (size_t(by) * blocksX + bx) * blockBytes;
+				switch (codec)
+				{
+				case TextureCodec::BC1:
+					encode_bc1_block(texels, block);
+					break;
+				case TextureCodec::BC3:
+					encode_bc3_block(texels, block);
+					break;
+				default:
+					encode_bc7_block(texels, block);
+					break;
+				}
+			}
+		}
+	}
+}
+
+void encode_bc1_block(const uint8_t* rgba, uint8_t* block)
+{
+	encode_color_block(rgba, block);
+}
+
+void encode_bc3_block(const uint8_t* rgba, uint8_t* block)
+{
+	encode_alpha_block(rgba, block);
+	encode_color_block(rgba, block + 8);
+}
+
+void encode_bc7_block(const uint8_t* rgba, uint8_t* block)
+{
+	float low[4], high[4];
+	axis_endpoints(rgba, 4, low, high);
+
+	// every endpoint is 7 bits plus a p-bit shared by its channels, try all four p-bit pairs
+	uint32_t bestError = UINT32_MAX;
+	int bestQuantized[2][4] = {};
+	int bestPbits[2] = {};
+	uint8_t bestIndices[16] = {};
+
+	for (int pbits = 0; pbits < 4; pbits++)
+	{
+		int p[2] = { pbits & 1, pbits >> 1 };
+		int quantized[2][4];
+		int endpoints[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			quantized[0][c] = std::clamp(static_cast<int>(std::lround((low[c] - p[0]) * 0.5f)), 0, 127);
+			quantized[1][c] = std::clamp(static_cast<int>(std::lround((high[c] - p[1]) * 0.5f)), 0, 127);
+			endpoints[0][c] = (quantized[0][c] << 1) | p[0];
+			endpoints[1][c] = (quantized[1][c] << 1) | p[1];
+		}
+
+		int palette[16][4];
+		for (int w = 0; w < 16; w++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				palette[w][c] = bc7_interpolate(endpoints[0][c], endpoints[1][c], BC7_WEIGHTS4[w]);
+			}
+		}
+
+		// the palette lies on a line, so projecting onto it finds the nearest entry up to rounding; only that
+		// entry and its neighbours are measured
+		float direction[4];
+		float lengthSquared = 0.f;
+		for (int c = 0; c < 4; c++)
+		{
+			direction[c] = float(endpoints[1][c] - endpoints[0][c]);
+			lengthSquared += direction[c] * direction[c];
+		}
+		float projectionScale = lengthSquared > 0.f ? 15.f / lengthSquared : 0.f;
+
+		uint32_t error = 0;
+		uint8_t indices[16];
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.f;
+			for (int c = 0; c < 4; c++)
+			{
+				t += (rgba[i * 4 + c] - endpoints[0][c]) * direction[c];
+			}
+			int guess = std::clamp(static_cast<int>(t * projectionScale + 0.5f), 0, 15);
+
+			uint32_t best = UINT32_MAX;
+			for (int w = std::max(guess - 1, 0); w <= std::min(guess + 1, 15); w++)
+			{
+				uint32_t distance = 0;
+				for (int c = 0; c < 4; c++)
+				{
+					int d = rgba[i * 4 + c] - palette[w][c];
+					distance += static_cast<uint32_t>(d * d);
+				}
+				if (distance < best)
+				{
+					best = distance;
+					indices[i] = static_cast<uint8_t>(w);
+				}
+			}
+			error += best;
+		}
+
+		if (error < bestError)
+		{
+			bestError = error;
+			memcpy(bestQuantized, quantized, sizeof(quantized));
+			bestPbits[0] = p[0];
+			bestPbits[1] = p[1];
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+	}
+
+	// the first index is stored without its top bit, so it has to be in the lower half
+	if (bestIndices[0] & 8)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			std::swap(bestQuantized[0][c], bestQuantized[1][c]);
+		}
+		std::swap(bestPbits[0], bestPbits[1]);
+		for (uint8_t& index : bestIndices)
+		{
+			index = static_cast<uint8_t>(15 - index);
+		}
+	}
+
+	BitWriter writer;
+	writer.put(1u << 6, 7); // mode 6
+	for (int c = 0; c < 4; c++)
+	{
+		writer.put(static_cast<uint32_t>(bestQuantized[0][c]), 7);
+		writer.put(static_cast<uint32_t>(bestQuantized[1][c]), 7);
+	}
+	writer.put(static_cast<uint32_t>(bestPbits[0]), 1);
+	writer.put(static_cast<uint32_t>(bestPbits[1]), 1);
+	writer.put(bestIndices[0], 3);
+	for (int i = 1; i < 16; i++)
+	{
+		writer.put(bestIndices[i], 4);
+	}
+	memcpy(block, writer.words, 16);
+}
+
+void decode_bc1_block(const uint8_t* block, uint8_t* rgba)
+{
+	decode_color_block(block, true, rgba);
+}
+
+void decode_bc3_block(const uint8_t* block, uint8_t* rgba)
+{
+	decode_color_block(block + 8, false, rgba);
+
+	int palette[8];
+	alpha_palette(block[0], block[1], palette);
+	uint64_t bits = 0;
+	for (int b = 0; b < 6; b++)
+	{
+		bits |= static_cast<uint64_t>(block[2 + b]) << (8 * b);
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		rgba[i * 4 + 3] = static_cast<uint8_t>(palette[(bits >> (3 * i)) & 7]);
+	}
+}
+
+void decode_bc7_block(const uint8_t* block, uint8_t* rgba)
+{
+	BitReader reader;
+	memcpy(reader.words, block, 16);
+	if (reader.get(7) != (1u << 6))
+	{
+		memset(rgba, 0, 64);
+		return;
+	}
+
+	int endpoints[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = static_cast<int>(reader.get(7)) << 1;
+		endpoints[1][c] = static_cast<int>(reader.get(7)) << 1;
+	}
+	uint32_t p0 = reader.get(1);
+	uint32_t p1 = reader.get(1);
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] |= static_cast<int>(p0);
+		endpoints[1][c] |= static_cast<int>(p1);
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		uint32_t index = reader.get(i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++)
+		{
+			rgba[i * 4 + c] = static_cast<uint8_t>(bc7_interpolate(endpoints[0][c], endpoints[1][c], BC7_WEIGHTS4[index]));
+		}
+	}
+}
+
+void decode_texture_level(const Texture& texture, uint32_t levelIndex, std::vector<uint8_t>& rgba)
+{
+	const TextureLevel& level = texture.levels[levelIndex];
+	const uint8_t* src = texture.data.data() + level.offset;
+	rgba.resize(size_t(level.width) * level.height * 4);
+
+	if (texture.codec == TextureCodec::RGBA8)
+	{
+		memcpy(rgba.data(), src, rgba.size());
+		return;
+	}
+
+	size_t blockBytes = texture.codec == TextureCodec::BC1 ? 8 : 16;
+	uint32_t blocksX = (level.width + 3) / 4;
+	uint32_t blocksY = (level.height + 3) / 4;
+	uint8_t texels[64];
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			const uint8_t* block = src + (size_t(by) * blocksX + bx) * blockBytes;
+			switch (texture.codec)
+			{
+			case TextureCodec::BC1:
+				decode_bc1_block(block, texels);
+				break;
+			case TextureCodec::BC3:
+				decode_bc3_block(block, texels);
+				break;
+			default:
+				decode_bc7_block(block, texels);
+				break;
+			}
+			store_block(texels, level.width, level.height, bx, by, rgba.data());
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// gpu encodings a texture can be baked to. Block formats store 4x4 texel blocks:
+//   RGBA8  4 bytes per texel, the fallback when the device can't sample BC formats
+//   BC1    8 bytes per block, rgb with 4 colors per block, opaque textures
+//   BC3   16 bytes per block, BC1 color plus a separately interpolated alpha block
+//   BC7   16 bytes per block, rgba at the best quality, encoded as mode 6 (one subset, 7777.1 endpoints)
+enum class TextureCodec : uint32_t {
+	RGBA8,
+	BC1,
+	BC3,
+	BC7,
+};
+
+const char* texture_codec_name(TextureCodec codec);
+
+// sRGB formats, every baked texture is color data
+VkFormat texture_codec_format(TextureCodec codec);
+
+// bytes of one level of the given size, partial blocks at the edges count as whole blocks
+size_t texture_level_bytes(TextureCodec codec, uint32_t width, uint32_t height);
+
+// levels are 16 byte aligned, enough for any block size and buffer to image copy
+const size_t TEXTURE_LEVEL_ALIGNMENT = 16;
+
+struct TextureLevel {
+	uint32_t width;
+	uint32_t height;
+	size_t offset; // into Texture::data
+	size_t size;
+};
+
+// a baked texture: every mip level of one encoding back to back, largest first
+struct Texture {
+	TextureCodec codec = TextureCodec::RGBA8;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<TextureLevel> levels;
+	std::vector<uint8_t> data;
+};
+
+/// @brief Full mip chain of an sRGB rgba8 image down to 1x1, level 0 is a copy of the input.
+/// Color is box filtered in linear space and converted back to sRGB, alpha is filtered as is.
+/// Odd sizes clamp the last row/column into the filter.
+void generate_mips(const uint8_t* rgba, uint32_t width, uint32_t height, Texture& out);
+
+/// @brief vkCmdCopyBufferToImage regions for every level, bufferOffset relative to Texture::data.
+void texture_copy_regions(const Texture& texture, std::vector<VkBufferImageCopy>& regions);
+
+/// @brief Encode every level of an RGBA8 texture, e.g. from generate_mips(), into codec.
+void encode_texture(const Texture& source, TextureCodec codec, Texture& out);
+
+// single 4x4 blocks, rgba is 16 texels in row order. Exposed for the benchmark's quality checks
+void encode_bc1_block(const uint8_t* rgba, uint8_t* block);
+void encode_bc3_block(const uint8_t* rgba, uint8_t* block);
+void encode_bc7_block(const uint8_t* rgba, uint8_t* block);
+void decode_bc1_block(const uint8_t* block, uint8_t* rgba);
+void decode_bc3_block(const uint8_t* block, uint8_t* rgba);
+// mode 6 blocks only, the one encode_bc7_block writes
+void decode_bc7_block(const uint8_t* block, uint8_t* rgba);
+
+/// @brief Decode one level back to rgba8, for measuring the encoding error.
+void decode_texture_level(const Texture& texture, uint32_t level, std::vector<uint8_t>& rgba);
@@ -0,0 +1,131 @@
+#include <vk_texture_cache.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+std::string texture_cache_path(const std::string& sourcePath, TextureCodec codec)
+{
+	return sourcePath + "." + texture_codec_name(codec) + TEXTURE_CACHE_EXTENSION;
+}
+
+bool TextureCache::open(const char* cachePath, const char* sourcePath, TextureCodec codec)
+{
+	_header = nullptr;
+
+	if (!_file.open(cachePath) || _file.size() < sizeof(TextureCacheHeader))
+	{
+		return false;
+	}
+
+	const TextureCacheHeader* header = reinterpret_cast<const TextureCacheHeader*>(_file.data());
+
+	bool valid = header->magic == TEXTURE_CACHE_MAGIC
+		&& header->version == TEXTURE_CACHE_VERSION
+		&& header->codec == static_cast<uint32_t>(codec)
+		&& header->vkFormat == static_cast<uint32_t>(texture_codec_format(codec))
+		&& header->levelCount > 0
+		&& header->levelIndexOffset + header->levelCount * sizeof(TextureCacheLevel) <= _file.size()
+		&& header->regionOffset + header->levelCount * sizeof(VkBufferImageCopy) <= _file.size()
+		&& header->dataOffset + header->dataBytes <= _file.size();
+
+	// caches baked from a different version of the image are stale
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (valid && source_stamp(sourcePath, sourceSize, sourceTime))
+	{
+		valid = header->sourceSize == sourceSize && header->sourceTime == sourceTime;
+	}
+
+	const TextureCacheLevel* levels = reinterpret_cast<const TextureCacheLevel*>(_file.data() + header->levelIndexOffset);
+	const VkBufferImageCopy* regions = reinterpret_cast<const VkBufferImageCopy*>(_file.data() + header->regionOffset);
+	for (uint32_t l = 0; valid && l < header->levelCount; l++)
+	{
+		// the region table goes to the gpu unchecked later, it has to agree with the level index
+		valid = levels[l].byteOffset >= header->dataOffset
+			&& levels[l].byteOffset + levels[l].byteLength <= header->dataOffset + header->dataBytes
+			&& levels[l].byteLength == texture_level_bytes(codec, levels[l].width, levels[l].height)
+			&& regions[l].bufferOffset == levels[l].byteOffset - header->dataOffset
+			&& regions[l].imageSubresource.mipLevel == l
+			&& regions[l].imageExtent.width == levels[l].width
+			&& regions[l].imageExtent.height == levels[l].height;
+	}
+
+	if (!valid)
+	{
+		_file.close();
+		return false;
+	}
+
+	_header = header;
+	_levels = levels;
+	_regions = regions;
+	return true;
+}
+
+bool write_texture_cache(const char* cachePath, const char* sourcePath, const Texture& texture)
+{
+	TextureCacheHeader header{};
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.vkFormat = static_cast<uint32_t>(texture_codec_format(texture.codec));
+	header.codec = static_cast<uint32_t>(texture.codec);
+	header.width = texture.width;
+	header.height = texture.height;
+	header.levelCount = static_cast<uint32_t>(texture.levels.size());
+
+	if (!source_stamp(sourcePath, header.sourceSize, header.sourceTime))
+	{
+		return false;
+	}
+
+	// Texture levels are already aligned relative to the data blob, so the blob only has to start aligned
+	header.levelIndexOffset = sizeof(TextureCacheHeader);
+	header.regionOffset = header.levelIndexOffset + header.levelCount * sizeof(TextureCacheLevel);
+	uint64_t tableEnd = header.regionOffset + header.levelCount * sizeof(VkBufferImageCopy);
+	header.dataOffset = (tableEnd + TEXTURE_LEVEL_ALIGNMENT - 1) / TEXTURE_LEVEL_ALIGNMENT * TEXTURE_LEVEL_ALIGNMENT;
+	header.dataBytes = texture.data.size();
+
+	std::vector<TextureCacheLevel> levels;
+	for (const TextureLevel& level : texture.levels)
+	{
+		levels.push_back({ header.dataOffset + level.offset, level.size, level.width, level.height });
+	}
+
+	std::vector<VkBufferImageCopy> regions;
+	texture_copy_regions(texture, regions);
+
+	std::string tempPath = std::string(cachePath) + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		const char padding[TEXTURE_LEVEL_ALIGNMENT] = {};
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(levels.data()), static_cast<std::streamsize>(levels.size() * sizeof(TextureCacheLevel)));
+		file.write(reinterpret_cast<const char*>(regions.data()), static_cast<std::streamsize>(regions.size() * sizeof(VkBufferImageCopy)));
+		file.write(padding, static_cast<std::streamsize>(header.dataOffset - tableEnd));
+		file.write(reinterpret_cast<const char*>(texture.data.data()), static_cast<std::streamsize>(header.dataBytes));
+
+		if (!file.good())
+		{
+			file.close();
+			std::filesystem::remove(tempPath);
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vk_texture.h>
+#include <vk_mesh_cache.h>
+
+#include <cstdint>
+#include <string>
+
+// Baked texture container, laid out like a KTX2 file without the data format descriptor and
+// supercompression: a header with the VkFormat and base size, a level index, then every level's
+// blocks ready to be copied into an image. The file is memory mapped and the level data goes into
+// staging memory with a single memcpy, the region table is handed to vkCmdCopyBufferToImage as is.
+//
+// layout: [TextureCacheHeader][TextureCacheLevel * levelCount][VkBufferImageCopy * levelCount][level data],
+// level data aligned to 16 bytes
+
+const uint32_t TEXTURE_CACHE_MAGIC = 0x54474b56; // "VKGT"
+const uint32_t TEXTURE_CACHE_VERSION = 2;
+
+// caches live next to their source asset and carry the codec, e.g. assets/wahoo.bmp.bc7.vktex
+const char* const TEXTURE_CACHE_EXTENSION = ".vktex";
+
+struct TextureCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vkFormat;    // VkFormat of every level
+	uint32_t codec;       // TextureCodec
+	uint32_t width;       // level 0
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t reserved;
+	uint64_t sourceSize;  // size and modification time of the source image, used to detect stale caches
+	int64_t sourceTime;
+	uint64_t levelIndexOffset;
+	uint64_t regionOffset;     // copy regions, bufferOffset relative to dataOffset
+	uint64_t dataOffset;
+	uint64_t dataBytes;
+};
+
+struct TextureCacheLevel {
+	uint64_t byteOffset; // from the start of the file
+	uint64_t byteLength;
+	uint32_t width;
+	uint32_t height;
+};
+
+std::string texture_cache_path(const std::string& sourcePath, TextureCodec codec);
+
+class TextureCache {
+public:
+	/// @brief Map a cache file and validate it against the image it was baked from.
+	/// @return false when the cache is missing, corrupt, stale or baked with another codec.
+	bool open(const char* cachePath, const char* sourcePath, TextureCodec codec);
+
+	const TextureCacheHeader& header() const { return *_header; }
+	VkFormat format() const { return static_cast<VkFormat>(_header->vkFormat); }
+	uint32_t level_count() const { return _header->levelCount; }
+	const TextureCacheLevel* levels() const { return _levels; }
+
+	// one region per level, bufferOffset relative to data()
+	const VkBufferImageCopy* regions() const { return _regions; }
+
+	// every level back to back, straight out of the mapping
+	const uint8_t* data() const { return _file.data() + _header->dataOffset; }
+	size_t data_bytes() const { return static_cast<size_t>(_header->dataBytes); }
+
+private:
+	MappedFile _file;
+	const TextureCacheHeader* _header = nullptr;
+	const TextureCacheLevel* _levels = nullptr;
+	const VkBufferImageCopy* _regions = nullptr;
+};
+
+/// @brief Bake a texture to disk. Written to a temporary file first and renamed so readers never see a partial cache.
+bool write_texture_cache(const char* cachePath, const char* sourcePath, const Texture& texture);
@@ -6,6 +6,9 @@
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 
+#include <cstdlib>
+#include <iostream>
+
 
 struct AllocatedBuffer {
     VkBuffer _buffer;
@@ -16,3 +19,15 @@ struct AllocatedImage {
     VkImage _image;
     VmaAllocation _allocation;
 };
+
+// we want to immediately abort when there is an error. In normal engines this would give an error message to the user, or perform a dump of state.
+#define VK_CHECK(x)                                                     \
+	do                                                                  \
+	{                                                                   \
+		VkResult err = x;                                               \
+		if (err != VK_SUCCESS)                                          \
+		{                                                               \
+			std::cout << "Detected Vulkan error: " << err << std::endl; \
+			abort();                                                    \
+		}                                                               \
+	} while (0)